@@ -0,0 +1,135 @@
+/*
+ * PM4 command stream replay tool.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay.h"
+#include "qemu/cutils.h"
+#include "hw/ps4/liverpool/lvp_gc_gfx.h"
+
+#define PS4_PM4_REPLAY_DEFAULT_ITERATIONS  1
+
+/* arguments given by the user */
+typedef struct ReplayArgs {
+    bool verbose;
+    unsigned iterations;
+    const char *filename;
+} ReplayArgs;
+
+static void
+replay_usage(const char *progname)
+{
+    printf("Usage: %s [OPTION]... FILE\n"
+           "Replays a PM4 capture against the Liverpool CP engine.\n"
+           "  -h: show this help\n"
+           "  -v: print every top-level packet\n"
+           "  -n <iterations>: number of passes over the capture\n"
+           "     default %u\n",
+           progname, PS4_PM4_REPLAY_DEFAULT_ITERATIONS);
+}
+
+static void
+replay_help(const char *progname)
+{
+    fprintf(stderr, "Try '%s -h' for more information.\n", progname);
+}
+
+static void
+replay_parse_args(ReplayArgs *args, int argc, char *argv[])
+{
+    unsigned long long v;
+    int c;
+
+    while ((c = getopt(argc, argv, "hvn:")) != -1) {
+        switch (c) {
+        case 'h':
+            replay_usage(argv[0]);
+            exit(0);
+        case 'v':
+            args->verbose = true;
+            break;
+        case 'n':
+            if (parse_uint_full(optarg, &v, 0) < 0 || v == 0) {
+                fprintf(stderr, "cannot parse iterations\n");
+                replay_help(argv[0]);
+                exit(1);
+            }
+            args->iterations = v;
+            break;
+        default:
+            replay_help(argv[0]);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        replay_help(argv[0]);
+        exit(1);
+    }
+    args->filename = argv[optind];
+}
+
+int main(int argc, char *argv[])
+{
+    ReplayArgs args = {
+        .verbose = false,
+        .iterations = PS4_PM4_REPLAY_DEFAULT_ITERATIONS,
+    };
+    ReplayStats stats, total;
+    gart_state_t gart;
+    gfx_state_t *gfx;
+    FILE *file;
+    unsigned i;
+
+    replay_parse_args(&args, argc, argv);
+    replay_verbose = args.verbose;
+
+    file = fopen(args.filename, "rb");
+    if (!file) {
+        fprintf(stderr, "cannot open %s: %s\n",
+                args.filename, strerror(errno));
+        return 1;
+    }
+
+    gfx = replay_gfx_new(&gart);
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < args.iterations; i++) {
+        memset(&stats, 0, sizeof(stats));
+        replay_gfx_reset(gfx);
+        if (replay_pass(file, gfx, &stats) < 0) {
+            return 1;
+        }
+        printf("pass %u: %" PRIu64 " packets, %" PRIu64 " dwords "
+               "in %.3f ms\n", i, stats.packets, stats.dwords,
+               stats.packet_ns / 1e6);
+        total.packets += stats.packets;
+        total.dwords += stats.dwords;
+        total.packet_ns += stats.packet_ns;
+    }
+
+    printf("rings: %" PRIu64 ", maps: %" PRIu64 ", pages: %" PRIu64 "\n",
+           stats.rings, stats.maps, stats.pages);
+    if (total.packet_ns) {
+        printf("throughput: %.0f packets/s, %.2f MB/s\n",
+               total.packets * 1e9 / total.packet_ns,
+               total.dwords * 4 * 1e3 / total.packet_ns);
+    }
+
+    replay_gfx_free(gfx);
+    fclose(file);
+    return 0;
+}
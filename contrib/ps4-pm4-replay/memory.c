@@ -0,0 +1,198 @@
+/*
+ * PM4 command stream replay tool.
+ * Guest memory reconstructed from the capture records.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay.h"
+#include "exec/address-spaces.h"
+#include "hw/ps4/liverpool/lvp_gc_gfx_capture.h"
+
+/*
+ * The replay tool links the CP engine without the rest of the machine, so
+ * the memory API entry points used by the CP are provided here. Guest pages
+ * are looked up by physical address, and GART address spaces resolve through
+ * the MAP records of the capture. Mappings are always bounced, since pages
+ * that are contiguous for the GPU rarely are in the capture.
+ */
+
+#define PAGE_SIZE  PM4_CAPTURE_PAGE_SIZE
+#define PAGE_MASK  (~(uint64_t)(PAGE_SIZE - 1))
+
+/* Pages never seen in the capture get a private physical address */
+#define UNMAPPED_PA(vmid, va) \
+    ((1ULL << 63) | ((uint64_t)(vmid) << 56) | ((va) & PAGE_MASK))
+
+#define MAP_KEY(vmid, va) \
+    (((uint64_t)(vmid) << 60) | ((va) >> 12))
+
+typedef struct replay_mapping_t {
+    AddressSpace *as;
+    hwaddr addr;
+    hwaddr len;
+} replay_mapping_t;
+
+AddressSpace address_space_memory;
+static AddressSpace replay_gart_as[GART_VMID_COUNT];
+
+static GHashTable *replay_maps;
+static GHashTable *replay_pages;
+static GHashTable *replay_mappings;
+
+static uint64_t *replay_key(uint64_t value)
+{
+    uint64_t *key = g_new(uint64_t, 1);
+    *key = value;
+    return key;
+}
+
+void replay_memory_init(gart_state_t *gart)
+{
+    int vmid;
+
+    for (vmid = 0; vmid < GART_VMID_COUNT; vmid++) {
+        gart->as[vmid] = &replay_gart_as[vmid];
+    }
+    replay_maps = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        g_free, g_free);
+    replay_pages = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        g_free, g_free);
+    replay_mappings = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+void replay_memory_reset(void)
+{
+    g_hash_table_remove_all(replay_maps);
+    g_hash_table_remove_all(replay_pages);
+}
+
+void replay_memory_map(int vmid, uint64_t va, uint64_t pa)
+{
+    g_hash_table_replace(replay_maps,
+        replay_key(MAP_KEY(vmid, va)), replay_key(pa & PAGE_MASK));
+}
+
+void replay_memory_page(uint64_t pa, const uint8_t *data)
+{
+    g_hash_table_replace(replay_pages,
+        replay_key(pa & PAGE_MASK), g_memdup(data, PAGE_SIZE));
+}
+
+static uint64_t replay_translate(AddressSpace *as, uint64_t addr)
+{
+    uint64_t key, *pa;
+    int vmid;
+
+    if (as == &address_space_memory) {
+        return addr;
+    }
+    vmid = as - replay_gart_as;
+    assert(vmid >= 0 && vmid < GART_VMID_COUNT);
+    key = MAP_KEY(vmid, addr);
+    pa = g_hash_table_lookup(replay_maps, &key);
+    if (!pa) {
+        return UNMAPPED_PA(vmid, addr) | (addr & ~PAGE_MASK);
+    }
+    return *pa | (addr & ~PAGE_MASK);
+}
+
+static uint8_t *replay_page(uint64_t pa)
+{
+    uint64_t key = pa & PAGE_MASK;
+    uint8_t *page;
+
+    page = g_hash_table_lookup(replay_pages, &key);
+    if (!page) {
+        page = g_malloc0(PAGE_SIZE);
+        g_hash_table_insert(replay_pages, replay_key(key), page);
+    }
+    return page;
+}
+
+static void replay_copy(AddressSpace *as, hwaddr addr,
+    uint8_t *buf, hwaddr len, bool is_write)
+{
+    hwaddr chunk, offset;
+    uint8_t *page;
+
+    while (len) {
+        offset = addr & ~PAGE_MASK;
+        chunk = MIN(len, PAGE_SIZE - offset);
+        page = replay_page(replay_translate(as, addr));
+        if (is_write) {
+            memcpy(page + offset, buf, chunk);
+        } else {
+            memcpy(buf, page + offset, chunk);
+        }
+        addr += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+void replay_memory_read(int vmid, uint64_t va, void *buf, size_t len)
+{
+    replay_copy(&replay_gart_as[vmid], va, buf, len, false);
+}
+
+bool liverpool_gc_gart_translate(gart_state_t *s, int vmid,
+    uint64_t addr, hwaddr *paddr)
+{
+    *paddr = replay_translate(s->as[vmid], addr);
+    return true;
+}
+
+MemTxResult address_space_rw(AddressSpace *as, hwaddr addr,
+                             MemTxAttrs attrs, uint8_t *buf,
+                             int len, bool is_write)
+{
+    replay_copy(as, addr, buf, len, is_write);
+    return MEMTX_OK;
+}
+
+void *address_space_map(AddressSpace *as, hwaddr addr,
+                        hwaddr *plen, bool is_write)
+{
+    replay_mapping_t *mapping;
+    uint8_t *buf;
+
+    buf = g_malloc(*plen);
+    replay_copy(as, addr, buf, *plen, false);
+
+    mapping = g_new(replay_mapping_t, 1);
+    mapping->as = as;
+    mapping->addr = addr;
+    mapping->len = *plen;
+    g_hash_table_insert(replay_mappings, buf, mapping);
+    return buf;
+}
+
+void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
+                         int is_write, hwaddr access_len)
+{
+    replay_mapping_t *mapping;
+
+    mapping = g_hash_table_lookup(replay_mappings, buffer);
+    assert(mapping && mapping->as == as);
+    if (is_write) {
+        replay_copy(as, mapping->addr, buffer,
+            MIN(access_len, mapping->len), true);
+    }
+    g_hash_table_remove(replay_mappings, buffer);
+    g_free(mapping);
+    g_free(buffer);
+}
@@ -0,0 +1,190 @@
+/*
+ * PM4 command stream replay tool.
+ * Capture file parsing and CP engine setup.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay.h"
+#include "qemu/bswap.h"
+#include "qemu/timer.h"
+#include "hw/ps4/liverpool/lvp_gc_gfx.h"
+#include "hw/ps4/liverpool/lvp_gc_gfx_capture.h"
+
+/* No legitimate record is larger than a page or a maximum size packet */
+#define REPLAY_RECORD_MAX_SIZE \
+    MAX(sizeof(pm4_capture_page_t), sizeof(pm4_capture_packet_t) + \
+        PM4_PACKET_MAX_DWORDS * sizeof(uint32_t))
+
+bool replay_verbose;
+
+/* The CP tracing helpers are not linked in, since they print every packet */
+void trace_pm4_packet(const uint32_t *packet)
+{
+    if (replay_verbose) {
+        printf("pm4-packet: %08X\n", packet[0]);
+    }
+}
+
+/* There is no UI to consume the orbital traces */
+bool orbital_trace_enabled(orbital_trace_id_t id)
+{
+    return false;
+}
+
+void orbital_trace_record(orbital_trace_id_t id,
+    const orbital_trace_record_t *rec)
+{
+}
+
+gfx_state_t *replay_gfx_new(gart_state_t *gart)
+{
+    gfx_state_t *gfx;
+
+    memset(gart, 0, sizeof(*gart));
+    replay_memory_init(gart);
+    gfx = g_new0(gfx_state_t, 1);
+    gfx->gart = gart;
+    gfx->mmio = g_new0(uint32_t, 0x10000);
+    liverpool_gc_gfx_init(gfx);
+    /* Captured packets already went past their waits */
+    gfx->cp_skip_waits = true;
+    return gfx;
+}
+
+void replay_gfx_reset(gfx_state_t *gfx)
+{
+    memset(gfx->mmio, 0, 0x10000 * sizeof(uint32_t));
+    gfx->cp_pred_exec = true;
+    replay_memory_reset();
+}
+
+void replay_gfx_free(gfx_state_t *gfx)
+{
+    g_free(gfx->mmio);
+    g_free(gfx);
+}
+
+static int
+replay_malformed(FILE *file, uint32_t type, uint32_t size)
+{
+    fprintf(stderr, "malformed record of type %u and size %u before "
+            "offset %ld\n", type, size, ftell(file));
+    return -1;
+}
+
+int
+replay_pass(FILE *file, gfx_state_t *gfx, ReplayStats *stats)
+{
+    pm4_capture_header_t header;
+    pm4_capture_record_t record;
+    pm4_capture_map_t *map;
+    pm4_capture_page_t *page;
+    pm4_capture_packet_t *packet;
+    uint8_t *payload;
+    uint32_t type, size, count, i;
+    int64_t start;
+    int ret = 0;
+
+    rewind(file);
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        le32_to_cpu(header.magic) != PM4_CAPTURE_MAGIC) {
+        fprintf(stderr, "not a PM4 capture file\n");
+        return -1;
+    }
+    if (le32_to_cpu(header.version) != PM4_CAPTURE_VERSION) {
+        fprintf(stderr, "unsupported capture version %u\n",
+                le32_to_cpu(header.version));
+        return -1;
+    }
+
+    payload = g_malloc(REPLAY_RECORD_MAX_SIZE);
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        type = le32_to_cpu(record.type);
+        size = le32_to_cpu(record.size);
+        if (size > REPLAY_RECORD_MAX_SIZE) {
+            if (type >= PM4_CAPTURE_RECORD_RING &&
+                type <= PM4_CAPTURE_RECORD_PACKET) {
+                ret = replay_malformed(file, type, size);
+                break;
+            }
+            /* newer record types can be safely skipped */
+            if (fseek(file, size, SEEK_CUR) != 0) {
+                break;
+            }
+            continue;
+        }
+        if (fread(payload, 1, size, file) != size) {
+            /* capture is still being written, stop at the last record */
+            break;
+        }
+
+        switch (type) {
+        case PM4_CAPTURE_RECORD_RING:
+            stats->rings++;
+            break;
+        case PM4_CAPTURE_RECORD_MAP:
+            if (size < sizeof(*map)) {
+                ret = replay_malformed(file, type, size);
+                goto out;
+            }
+            map = (pm4_capture_map_t *)payload;
+            replay_memory_map(le32_to_cpu(map->vmid) % GART_VMID_COUNT,
+                le64_to_cpu(map->va), le64_to_cpu(map->pa));
+            stats->maps++;
+            break;
+        case PM4_CAPTURE_RECORD_PAGE:
+            if (size < sizeof(*page)) {
+                ret = replay_malformed(file, type, size);
+                goto out;
+            }
+            page = (pm4_capture_page_t *)payload;
+            replay_memory_page(le64_to_cpu(page->pa), page->data);
+            stats->pages++;
+            break;
+        case PM4_CAPTURE_RECORD_PACKET:
+            packet = (pm4_capture_packet_t *)payload;
+            if (size < sizeof(*packet)) {
+                ret = replay_malformed(file, type, size);
+                goto out;
+            }
+            count = le32_to_cpu(packet->count);
+            if (count > (size - sizeof(*packet)) / sizeof(uint32_t)) {
+                ret = replay_malformed(file, type, size);
+                goto out;
+            }
+            for (i = 0; i < count; i++) {
+                packet->data[i] = le32_to_cpu(packet->data[i]);
+            }
+            start = get_clock();
+            if (!liverpool_gc_gfx_cp_packet(gfx,
+                    (uint32_t *)(packet + 1), count)) {
+                ret = replay_malformed(file, type, size);
+                goto out;
+            }
+            stats->packet_ns += get_clock() - start;
+            stats->packets++;
+            stats->dwords += count;
+            break;
+        default:
+            /* newer record types can be safely skipped */
+            break;
+        }
+    }
+out:
+    g_free(payload);
+    return ret;
+}
@@ -0,0 +1,52 @@
+/*
+ * PM4 command stream replay tool.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PS4_PM4_REPLAY_H
+#define PS4_PM4_REPLAY_H
+
+#include "qemu/osdep.h"
+#include "hw/ps4/liverpool/lvp_gc_gart.h"
+#include "hw/ps4/liverpool/lvp_gc_gfx.h"
+
+/* statistics of a single pass over the capture */
+typedef struct ReplayStats {
+    uint64_t rings;
+    uint64_t maps;
+    uint64_t pages;
+    uint64_t packets;
+    uint64_t dwords;
+    int64_t packet_ns;
+} ReplayStats;
+
+/* replay.c */
+extern bool replay_verbose;
+
+gfx_state_t *replay_gfx_new(gart_state_t *gart);
+void replay_gfx_reset(gfx_state_t *gfx);
+void replay_gfx_free(gfx_state_t *gfx);
+int replay_pass(FILE *file, gfx_state_t *gfx, ReplayStats *stats);
+
+/* memory.c */
+void replay_memory_init(gart_state_t *gart);
+void replay_memory_reset(void);
+void replay_memory_map(int vmid, uint64_t va, uint64_t pa);
+void replay_memory_page(uint64_t pa, const uint8_t *data);
+void replay_memory_read(int vmid, uint64_t va, void *buf, size_t len);
+
+#endif /* PS4_PM4_REPLAY_H */
@@ -0,0 +1,1693 @@
+/*
+ * AMD GCN (Sea Islands) disassembler.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "disas/bfd.h"
+#include "disas/gcn.h"
+
+/* Operand codes shared by the scalar and vector source fields */
+#define GCN_SRC_SGPR_MAX        103
+#define GCN_SRC_FLAT_SCRATCH    104
+#define GCN_SRC_VCC             106
+#define GCN_SRC_TBA             108
+#define GCN_SRC_TMA             110
+#define GCN_SRC_TTMP            112
+#define GCN_SRC_TTMP_MAX        123
+#define GCN_SRC_M0              124
+#define GCN_SRC_EXEC            126
+#define GCN_SRC_ZERO            128
+#define GCN_SRC_INT_POS_MAX     192
+#define GCN_SRC_INT_NEG_MAX     208
+#define GCN_SRC_FLOAT           240
+#define GCN_SRC_FLOAT_MAX       247
+#define GCN_SRC_VCCZ            251
+#define GCN_SRC_EXECZ           252
+#define GCN_SRC_SCC             253
+#define GCN_SRC_LDS_DIRECT      254
+#define GCN_SRC_LITERAL         255
+#define GCN_SRC_VGPR            256
+
+/* opcode tables */
+
+static const char * const gcn_sop2_names[] = {
+    [0x00] = "s_add_u32",
+    [0x01] = "s_sub_u32",
+    [0x02] = "s_add_i32",
+    [0x03] = "s_sub_i32",
+    [0x04] = "s_addc_u32",
+    [0x05] = "s_subb_u32",
+    [0x06] = "s_min_i32",
+    [0x07] = "s_min_u32",
+    [0x08] = "s_max_i32",
+    [0x09] = "s_max_u32",
+    [0x0A] = "s_cselect_b32",
+    [0x0B] = "s_cselect_b64",
+    [0x0E] = "s_and_b32",
+    [0x0F] = "s_and_b64",
+    [0x10] = "s_or_b32",
+    [0x11] = "s_or_b64",
+    [0x12] = "s_xor_b32",
+    [0x13] = "s_xor_b64",
+    [0x14] = "s_andn2_b32",
+    [0x15] = "s_andn2_b64",
+    [0x16] = "s_orn2_b32",
+    [0x17] = "s_orn2_b64",
+    [0x18] = "s_nand_b32",
+    [0x19] = "s_nand_b64",
+    [0x1A] = "s_nor_b32",
+    [0x1B] = "s_nor_b64",
+    [0x1C] = "s_xnor_b32",
+    [0x1D] = "s_xnor_b64",
+    [0x1E] = "s_lshl_b32",
+    [0x1F] = "s_lshl_b64",
+    [0x20] = "s_lshr_b32",
+    [0x21] = "s_lshr_b64",
+    [0x22] = "s_ashr_i32",
+    [0x23] = "s_ashr_i64",
+    [0x24] = "s_bfm_b32",
+    [0x25] = "s_bfm_b64",
+    [0x26] = "s_mul_i32",
+    [0x27] = "s_bfe_u32",
+    [0x28] = "s_bfe_i32",
+    [0x29] = "s_bfe_u64",
+    [0x2A] = "s_bfe_i64",
+    [0x2B] = "s_cbranch_g_fork",
+    [0x2C] = "s_absdiff_i32",
+};
+
+static const char * const gcn_sopk_names[] = {
+    [0x00] = "s_movk_i32",
+    [0x02] = "s_cmovk_i32",
+    [0x03] = "s_cmpk_eq_i32",
+    [0x04] = "s_cmpk_lg_i32",
+    [0x05] = "s_cmpk_gt_i32",
+    [0x06] = "s_cmpk_ge_i32",
+    [0x07] = "s_cmpk_lt_i32",
+    [0x08] = "s_cmpk_le_i32",
+    [0x09] = "s_cmpk_eq_u32",
+    [0x0A] = "s_cmpk_lg_u32",
+    [0x0B] = "s_cmpk_gt_u32",
+    [0x0C] = "s_cmpk_ge_u32",
+    [0x0D] = "s_cmpk_lt_u32",
+    [0x0E] = "s_cmpk_le_u32",
+    [0x0F] = "s_addk_i32",
+    [0x10] = "s_mulk_i32",
+    [0x11] = "s_cbranch_i_fork",
+    [0x12] = "s_getreg_b32",
+    [0x13] = "s_setreg_b32",
+    [0x15] = "s_setreg_imm32_b32",
+};
+
+#define GCN_SOPK_CBRANCH_I_FORK 0x11
+#define GCN_SOPK_GETREG         0x12
+#define GCN_SOPK_SETREG         0x13
+#define GCN_SOPK_SETREG_IMM32   0x15
+
+static const char * const gcn_sop1_names[] = {
+    [0x03] = "s_mov_b32",
+    [0x04] = "s_mov_b64",
+    [0x05] = "s_cmov_b32",
+    [0x06] = "s_cmov_b64",
+    [0x07] = "s_not_b32",
+    [0x08] = "s_not_b64",
+    [0x09] = "s_wqm_b32",
+    [0x0A] = "s_wqm_b64",
+    [0x0B] = "s_brev_b32",
+    [0x0C] = "s_brev_b64",
+    [0x0D] = "s_bcnt0_i32_b32",
+    [0x0E] = "s_bcnt0_i32_b64",
+    [0x0F] = "s_bcnt1_i32_b32",
+    [0x10] = "s_bcnt1_i32_b64",
+    [0x11] = "s_ff0_i32_b32",
+    [0x12] = "s_ff0_i32_b64",
+    [0x13] = "s_ff1_i32_b32",
+    [0x14] = "s_ff1_i32_b64",
+    [0x15] = "s_flbit_i32_b32",
+    [0x16] = "s_flbit_i32_b64",
+    [0x17] = "s_flbit_i32",
+    [0x18] = "s_flbit_i32_i64",
+    [0x19] = "s_sext_i32_i8",
+    [0x1A] = "s_sext_i32_i16",
+    [0x1B] = "s_bitset0_b32",
+    [0x1C] = "s_bitset0_b64",
+    [0x1D] = "s_bitset1_b32",
+    [0x1E] = "s_bitset1_b64",
+    [0x1F] = "s_getpc_b64",
+    [0x20] = "s_setpc_b64",
+    [0x21] = "s_swappc_b64",
+    [0x22] = "s_rfe_b64",
+    [0x24] = "s_and_saveexec_b64",
+    [0x25] = "s_or_saveexec_b64",
+    [0x26] = "s_xor_saveexec_b64",
+    [0x27] = "s_andn2_saveexec_b64",
+    [0x28] = "s_orn2_saveexec_b64",
+    [0x29] = "s_nand_saveexec_b64",
+    [0x2A] = "s_nor_saveexec_b64",
+    [0x2B] = "s_xnor_saveexec_b64",
+    [0x2C] = "s_quadmask_b32",
+    [0x2D] = "s_quadmask_b64",
+    [0x2E] = "s_movrels_b32",
+    [0x2F] = "s_movrels_b64",
+    [0x30] = "s_movreld_b32",
+    [0x31] = "s_movreld_b64",
+    [0x32] = "s_cbranch_join",
+    [0x34] = "s_abs_i32",
+    [0x35] = "s_mov_fed_b32",
+};
+
+#define GCN_SOP1_GETPC          0x1F
+#define GCN_SOP1_SETPC          0x20
+#define GCN_SOP1_RFE            0x22
+#define GCN_SOP1_CBRANCH_JOIN   0x32
+
+static const char * const gcn_sopc_names[] = {
+    [0x00] = "s_cmp_eq_i32",
+    [0x01] = "s_cmp_lg_i32",
+    [0x02] = "s_cmp_gt_i32",
+    [0x03] = "s_cmp_ge_i32",
+    [0x04] = "s_cmp_lt_i32",
+    [0x05] = "s_cmp_le_i32",
+    [0x06] = "s_cmp_eq_u32",
+    [0x07] = "s_cmp_lg_u32",
+    [0x08] = "s_cmp_gt_u32",
+    [0x09] = "s_cmp_ge_u32",
+    [0x0A] = "s_cmp_lt_u32",
+    [0x0B] = "s_cmp_le_u32",
+    [0x0C] = "s_bitcmp0_b32",
+    [0x0D] = "s_bitcmp1_b32",
+    [0x0E] = "s_bitcmp0_b64",
+    [0x0F] = "s_bitcmp1_b64",
+    [0x10] = "s_setvskip",
+};
+
+static const char * const gcn_sopp_names[] = {
+    [0x00] = "s_nop",
+    [0x01] = "s_endpgm",
+    [0x02] = "s_branch",
+    [0x04] = "s_cbranch_scc0",
+    [0x05] = "s_cbranch_scc1",
+    [0x06] = "s_cbranch_vccz",
+    [0x07] = "s_cbranch_vccnz",
+    [0x08] = "s_cbranch_execz",
+    [0x09] = "s_cbranch_execnz",
+    [0x0A] = "s_barrier",
+    [0x0B] = "s_setkill",
+    [0x0C] = "s_waitcnt",
+    [0x0D] = "s_sethalt",
+    [0x0E] = "s_sleep",
+    [0x0F] = "s_setprio",
+    [0x10] = "s_sendmsg",
+    [0x11] = "s_sendmsghalt",
+    [0x12] = "s_trap",
+    [0x13] = "s_icache_inv",
+    [0x14] = "s_incperflevel",
+    [0x15] = "s_decperflevel",
+    [0x16] = "s_ttracedata",
+    [0x17] = "s_cbranch_cdbgsys",
+    [0x18] = "s_cbranch_cdbguser",
+    [0x19] = "s_cbranch_cdbgsys_or_user",
+    [0x1A] = "s_cbranch_cdbgsys_and_user",
+};
+
+#define GCN_SOPP_ENDPGM         0x01
+#define GCN_SOPP_BRANCH         0x02
+#define GCN_SOPP_CBRANCH_FIRST  0x04
+#define GCN_SOPP_CBRANCH_LAST   0x09
+#define GCN_SOPP_BARRIER        0x0A
+#define GCN_SOPP_WAITCNT        0x0C
+#define GCN_SOPP_SENDMSG        0x10
+#define GCN_SOPP_SENDMSGHALT    0x11
+#define GCN_SOPP_ICACHE_INV     0x13
+#define GCN_SOPP_CDBG_FIRST     0x17
+#define GCN_SOPP_CDBG_LAST      0x1A
+
+static const char * const gcn_smrd_names[] = {
+    [0x00] = "s_load_dword",
+    [0x01] = "s_load_dwordx2",
+    [0x02] = "s_load_dwordx4",
+    [0x03] = "s_load_dwordx8",
+    [0x04] = "s_load_dwordx16",
+    [0x08] = "s_buffer_load_dword",
+    [0x09] = "s_buffer_load_dwordx2",
+    [0x0A] = "s_buffer_load_dwordx4",
+    [0x0B] = "s_buffer_load_dwordx8",
+    [0x0C] = "s_buffer_load_dwordx16",
+    [0x1D] = "s_dcache_inv_vol",
+    [0x1E] = "s_memtime",
+    [0x1F] = "s_dcache_inv",
+};
+
+#define GCN_SMRD_BUFFER_LOAD    0x08
+#define GCN_SMRD_MEMTIME        0x1E
+
+static const char * const gcn_vop2_names[] = {
+    [0x00] = "v_cndmask_b32",
+    [0x01] = "v_readlane_b32",
+    [0x02] = "v_writelane_b32",
+    [0x03] = "v_add_f32",
+    [0x04] = "v_sub_f32",
+    [0x05] = "v_subrev_f32",
+    [0x06] = "v_mac_legacy_f32",
+    [0x07] = "v_mul_legacy_f32",
+    [0x08] = "v_mul_f32",
+    [0x09] = "v_mul_i32_i24",
+    [0x0A] = "v_mul_hi_i32_i24",
+    [0x0B] = "v_mul_u32_u24",
+    [0x0C] = "v_mul_hi_u32_u24",
+    [0x0D] = "v_min_legacy_f32",
+    [0x0E] = "v_max_legacy_f32",
+    [0x0F] = "v_min_f32",
+    [0x10] = "v_max_f32",
+    [0x11] = "v_min_i32",
+    [0x12] = "v_max_i32",
+    [0x13] = "v_min_u32",
+    [0x14] = "v_max_u32",
+    [0x15] = "v_lshr_b32",
+    [0x16] = "v_lshrrev_b32",
+    [0x17] = "v_ashr_i32",
+    [0x18] = "v_ashrrev_i32",
+    [0x19] = "v_lshl_b32",
+    [0x1A] = "v_lshlrev_b32",
+    [0x1B] = "v_and_b32",
+    [0x1C] = "v_or_b32",
+    [0x1D] = "v_xor_b32",
+    [0x1E] = "v_bfm_b32",
+    [0x1F] = "v_mac_f32",
+    [0x20] = "v_madmk_f32",
+    [0x21] = "v_madak_f32",
+    [0x22] = "v_bcnt_u32_b32",
+    [0x23] = "v_mbcnt_lo_u32_b32",
+    [0x24] = "v_mbcnt_hi_u32_b32",
+    [0x25] = "v_add_i32",
+    [0x26] = "v_sub_i32",
+    [0x27] = "v_subrev_i32",
+    [0x28] = "v_addc_u32",
+    [0x29] = "v_subb_u32",
+    [0x2A] = "v_subbrev_u32",
+    [0x2B] = "v_ldexp_f32",
+    [0x2C] = "v_cvt_pkaccum_u8_f32",
+    [0x2D] = "v_cvt_pknorm_i16_f32",
+    [0x2E] = "v_cvt_pknorm_u16_f32",
+    [0x2F] = "v_cvt_pkrtz_f16_f32",
+    [0x30] = "v_cvt_pk_u16_u32",
+    [0x31] = "v_cvt_pk_i16_i32",
+};
+
+#define GCN_VOP2_CNDMASK        0x00
+#define GCN_VOP2_MADMK          0x20
+#define GCN_VOP2_MADAK          0x21
+#define GCN_VOP2_CARRY_FIRST    0x25    /* v_add_i32 .. v_subbrev_u32 */
+#define GCN_VOP2_CARRY_IN       0x28    /* v_addc_u32 .. v_subbrev_u32 */
+#define GCN_VOP2_CARRY_LAST     0x2A
+
+static const char * const gcn_vop1_names[] = {
+    [0x00] = "v_nop",
+    [0x01] = "v_mov_b32",
+    [0x02] = "v_readfirstlane_b32",
+    [0x03] = "v_cvt_i32_f64",
+    [0x04] = "v_cvt_f64_i32",
+    [0x05] = "v_cvt_f32_i32",
+    [0x06] = "v_cvt_f32_u32",
+    [0x07] = "v_cvt_u32_f32",
+    [0x08] = "v_cvt_i32_f32",
+    [0x09] = "v_mov_fed_b32",
+    [0x0A] = "v_cvt_f16_f32",
+    [0x0B] = "v_cvt_f32_f16",
+    [0x0C] = "v_cvt_rpi_i32_f32",
+    [0x0D] = "v_cvt_flr_i32_f32",
+    [0x0E] = "v_cvt_off_f32_i4",
+    [0x0F] = "v_cvt_f32_f64",
+    [0x10] = "v_cvt_f64_f32",
+    [0x11] = "v_cvt_f32_ubyte0",
+    [0x12] = "v_cvt_f32_ubyte1",
+    [0x13] = "v_cvt_f32_ubyte2",
+    [0x14] = "v_cvt_f32_ubyte3",
+    [0x15] = "v_cvt_u32_f64",
+    [0x16] = "v_cvt_f64_u32",
+    [0x17] = "v_trunc_f64",
+    [0x18] = "v_ceil_f64",
+    [0x19] = "v_rndne_f64",
+    [0x1A] = "v_floor_f64",
+    [0x20] = "v_fract_f32",
+    [0x21] = "v_trunc_f32",
+    [0x22] = "v_ceil_f32",
+    [0x23] = "v_rndne_f32",
+    [0x24] = "v_floor_f32",
+    [0x25] = "v_exp_f32",
+    [0x26] = "v_log_clamp_f32",
+    [0x27] = "v_log_f32",
+    [0x28] = "v_rcp_clamp_f32",
+    [0x29] = "v_rcp_legacy_f32",
+    [0x2A] = "v_rcp_f32",
+    [0x2B] = "v_rcp_iflag_f32",
+    [0x2C] = "v_rsq_clamp_f32",
+    [0x2D] = "v_rsq_legacy_f32",
+    [0x2E] = "v_rsq_f32",
+    [0x2F] = "v_rcp_f64",
+    [0x30] = "v_rcp_clamp_f64",
+    [0x31] = "v_rsq_f64",
+    [0x32] = "v_rsq_clamp_f64",
+    [0x33] = "v_sqrt_f32",
+    [0x34] = "v_sqrt_f64",
+    [0x35] = "v_sin_f32",
+    [0x36] = "v_cos_f32",
+    [0x37] = "v_not_b32",
+    [0x38] = "v_bfrev_b32",
+    [0x39] = "v_ffbh_u32",
+    [0x3A] = "v_ffbl_b32",
+    [0x3B] = "v_ffbh_i32",
+    [0x3C] = "v_frexp_exp_i32_f64",
+    [0x3D] = "v_frexp_mant_f64",
+    [0x3E] = "v_fract_f64",
+    [0x3F] = "v_frexp_exp_i32_f32",
+    [0x40] = "v_frexp_mant_f32",
+    [0x41] = "v_clrexcp",
+    [0x42] = "v_movreld_b32",
+    [0x43] = "v_movrels_b32",
+    [0x44] = "v_movrelsd_b32",
+    [0x45] = "v_log_legacy_f32",
+    [0x46] = "v_exp_legacy_f32",
+};
+
+#define GCN_VOP1_NOP            0x00
+#define GCN_VOP1_READFIRSTLANE  0x02
+#define GCN_VOP1_CLREXCP        0x41
+
+/* VOP3-only opcodes, starting at 0x140 */
+static const char * const gcn_vop3_names[] = {
+    [0x00] = "v_mad_legacy_f32",
+    [0x01] = "v_mad_f32",
+    [0x02] = "v_mad_i32_i24",
+    [0x03] = "v_mad_u32_u24",
+    [0x04] = "v_cubeid_f32",
+    [0x05] = "v_cubesc_f32",
+    [0x06] = "v_cubetc_f32",
+    [0x07] = "v_cubema_f32",
+    [0x08] = "v_bfe_u32",
+    [0x09] = "v_bfe_i32",
+    [0x0A] = "v_bfi_b32",
+    [0x0B] = "v_fma_f32",
+    [0x0C] = "v_fma_f64",
+    [0x0D] = "v_lerp_u8",
+    [0x0E] = "v_alignbit_b32",
+    [0x0F] = "v_alignbyte_b32",
+    [0x10] = "v_mullit_f32",
+    [0x11] = "v_min3_f32",
+    [0x12] = "v_min3_i32",
+    [0x13] = "v_min3_u32",
+    [0x14] = "v_max3_f32",
+    [0x15] = "v_max3_i32",
+    [0x16] = "v_max3_u32",
+    [0x17] = "v_med3_f32",
+    [0x18] = "v_med3_i32",
+    [0x19] = "v_med3_u32",
+    [0x1A] = "v_sad_u8",
+    [0x1B] = "v_sad_hi_u8",
+    [0x1C] = "v_sad_u16",
+    [0x1D] = "v_sad_u32",
+    [0x1E] = "v_cvt_pk_u8_f32",
+    [0x1F] = "v_div_fixup_f32",
+    [0x20] = "v_div_fixup_f64",
+    [0x21] = "v_lshl_b64",
+    [0x22] = "v_lshr_b64",
+    [0x23] = "v_ashr_i64",
+    [0x24] = "v_add_f64",
+    [0x25] = "v_mul_f64",
+    [0x26] = "v_min_f64",
+    [0x27] = "v_max_f64",
+    [0x28] = "v_ldexp_f64",
+    [0x29] = "v_mul_lo_u32",
+    [0x2A] = "v_mul_hi_u32",
+    [0x2B] = "v_mul_lo_i32",
+    [0x2C] = "v_mul_hi_i32",
+    [0x2D] = "v_div_scale_f32",
+    [0x2E] = "v_div_scale_f64",
+    [0x2F] = "v_div_fmas_f32",
+    [0x30] = "v_div_fmas_f64",
+    [0x31] = "v_msad_u8",
+    [0x32] = "v_qsad_pk_u16_u8",
+    [0x33] = "v_mqsad_pk_u16_u8",
+    [0x34] = "v_trig_preop_f64",
+    [0x35] = "v_mqsad_u32_u8",
+    [0x36] = "v_mad_u64_u32",
+    [0x37] = "v_mad_i64_i32",
+};
+
+#define GCN_VOP3_VOP2_BASE      0x100
+#define GCN_VOP3_ONLY_BASE      0x140
+#define GCN_VOP3_VOP1_BASE      0x180
+#define GCN_VOP3_TWO_SRC_FIRST  0x161   /* v_lshl_b64 .. v_mul_hi_i32 */
+#define GCN_VOP3_TWO_SRC_LAST   0x16C
+#define GCN_VOP3_TRIG_PREOP     0x174
+#define GCN_VOP3_DIV_SCALE_F32  0x16D
+#define GCN_VOP3_DIV_SCALE_F64  0x16E
+
+/* VOPC opcodes are laid out as conditions times operand types */
+static const char * const gcn_vopc_fcond[] = {
+    "f", "lt", "eq", "le", "gt", "lg", "ge", "o",
+    "u", "nge", "nlg", "ngt", "nle", "neq", "nlt", "tru",
+};
+
+static const char * const gcn_vopc_icond[] = {
+    "f", "lt", "eq", "le", "gt", "ne", "ge", "t",
+};
+
+static const char * const gcn_vintrp_names[] = {
+    [0x00] = "v_interp_p1_f32",
+    [0x01] = "v_interp_p2_f32",
+    [0x02] = "v_interp_mov_f32",
+};
+
+#define GCN_VINTRP_MOV          0x02
+
+static const char * const gcn_ds_names[] = {
+    [0x00] = "ds_add_u32",
+    [0x01] = "ds_sub_u32",
+    [0x02] = "ds_rsub_u32",
+    [0x03] = "ds_inc_u32",
+    [0x04] = "ds_dec_u32",
+    [0x05] = "ds_min_i32",
+    [0x06] = "ds_max_i32",
+    [0x07] = "ds_min_u32",
+    [0x08] = "ds_max_u32",
+    [0x09] = "ds_and_b32",
+    [0x0A] = "ds_or_b32",
+    [0x0B] = "ds_xor_b32",
+    [0x0C] = "ds_mskor_b32",
+    [0x0D] = "ds_write_b32",
+    [0x0E] = "ds_write2_b32",
+    [0x0F] = "ds_write2st64_b32",
+    [0x10] = "ds_cmpst_b32",
+    [0x11] = "ds_cmpst_f32",
+    [0x12] = "ds_min_f32",
+    [0x13] = "ds_max_f32",
+    [0x14] = "ds_nop",
+    [0x19] = "ds_gws_init",
+    [0x1A] = "ds_gws_sema_v",
+    [0x1B] = "ds_gws_sema_br",
+    [0x1C] = "ds_gws_sema_p",
+    [0x1D] = "ds_gws_barrier",
+    [0x1E] = "ds_write_b8",
+    [0x1F] = "ds_write_b16",
+    [0x20] = "ds_add_rtn_u32",
+    [0x21] = "ds_sub_rtn_u32",
+    [0x22] = "ds_rsub_rtn_u32",
+    [0x23] = "ds_inc_rtn_u32",
+    [0x24] = "ds_dec_rtn_u32",
+    [0x25] = "ds_min_rtn_i32",
+    [0x26] = "ds_max_rtn_i32",
+    [0x27] = "ds_min_rtn_u32",
+    [0x28] = "ds_max_rtn_u32",
+    [0x29] = "ds_and_rtn_b32",
+    [0x2A] = "ds_or_rtn_b32",
+    [0x2B] = "ds_xor_rtn_b32",
+    [0x2C] = "ds_mskor_rtn_b32",
+    [0x2D] = "ds_wrxchg_rtn_b32",
+    [0x2E] = "ds_wrxchg2_rtn_b32",
+    [0x2F] = "ds_wrxchg2st64_rtn_b32",
+    [0x30] = "ds_cmpst_rtn_b32",
+    [0x31] = "ds_cmpst_rtn_f32",
+    [0x32] = "ds_min_rtn_f32",
+    [0x33] = "ds_max_rtn_f32",
+    [0x34] = "ds_wrap_rtn_b32",
+    [0x35] = "ds_swizzle_b32",
+    [0x36] = "ds_read_b32",
+    [0x37] = "ds_read2_b32",
+    [0x38] = "ds_read2st64_b32",
+    [0x39] = "ds_read_i8",
+    [0x3A] = "ds_read_u8",
+    [0x3B] = "ds_read_i16",
+    [0x3C] = "ds_read_u16",
+    [0x3D] = "ds_consume",
+    [0x3E] = "ds_append",
+    [0x3F] = "ds_ordered_count",
+    [0x4D] = "ds_write_b64",
+    [0x4E] = "ds_write2_b64",
+    [0x4F] = "ds_write2st64_b64",
+    [0x76] = "ds_read_b64",
+    [0x77] = "ds_read2_b64",
+    [0x78] = "ds_read2st64_b64",
+    [0xDE] = "ds_write_b96",
+    [0xDF] = "ds_write_b128",
+    [0xFE] = "ds_read_b96",
+    [0xFF] = "ds_read_b128",
+};
+
+/* Loads and stores shared by MUBUF (buffer_) and FLAT (flat_) */
+static const char * const gcn_mem_names[] = {
+    [0x00] = "load_format_x",
+    [0x01] = "load_format_xy",
+    [0x02] = "load_format_xyz",
+    [0x03] = "load_format_xyzw",
+    [0x04] = "store_format_x",
+    [0x05] = "store_format_xy",
+    [0x06] = "store_format_xyz",
+    [0x07] = "store_format_xyzw",
+    [0x08] = "load_ubyte",
+    [0x09] = "load_sbyte",
+    [0x0A] = "load_ushort",
+    [0x0B] = "load_sshort",
+    [0x0C] = "load_dword",
+    [0x0D] = "load_dwordx2",
+    [0x0E] = "load_dwordx4",
+    [0x0F] = "load_dwordx3",
+    [0x18] = "store_byte",
+    [0x1A] = "store_short",
+    [0x1C] = "store_dword",
+    [0x1D] = "store_dwordx2",
+    [0x1E] = "store_dwordx4",
+    [0x1F] = "store_dwordx3",
+    [0x30] = "atomic_swap",
+    [0x31] = "atomic_cmpswap",
+    [0x32] = "atomic_add",
+    [0x33] = "atomic_sub",
+    [0x35] = "atomic_smin",
+    [0x36] = "atomic_umin",
+    [0x37] = "atomic_smax",
+    [0x38] = "atomic_umax",
+    [0x39] = "atomic_and",
+    [0x3A] = "atomic_or",
+    [0x3B] = "atomic_xor",
+    [0x3C] = "atomic_inc",
+    [0x3D] = "atomic_dec",
+    [0x3E] = "atomic_fcmpswap",
+    [0x3F] = "atomic_fmin",
+    [0x40] = "atomic_fmax",
+    [0x50] = "atomic_swap_x2",
+    [0x51] = "atomic_cmpswap_x2",
+    [0x52] = "atomic_add_x2",
+    [0x53] = "atomic_sub_x2",
+    [0x55] = "atomic_smin_x2",
+    [0x56] = "atomic_umin_x2",
+    [0x57] = "atomic_smax_x2",
+    [0x58] = "atomic_umax_x2",
+    [0x59] = "atomic_and_x2",
+    [0x5A] = "atomic_or_x2",
+    [0x5B] = "atomic_xor_x2",
+    [0x5C] = "atomic_inc_x2",
+    [0x5D] = "atomic_dec_x2",
+    [0x5E] = "atomic_fcmpswap_x2",
+    [0x5F] = "atomic_fmin_x2",
+    [0x60] = "atomic_fmax_x2",
+    [0x70] = "wbinvl1_vol",
+    [0x71] = "wbinvl1",
+};
+
+#define GCN_MEM_STORE_FORMAT    0x04
+#define GCN_MEM_LOAD_FIRST      0x08
+#define GCN_MEM_STORE_FIRST     0x18
+#define GCN_MEM_ATOMIC_FIRST    0x30
+#define GCN_MEM_WBINVL1_VOL     0x70
+
+static const char * const gcn_mtbuf_names[] = {
+    [0x00] = "tbuffer_load_format_x",
+    [0x01] = "tbuffer_load_format_xy",
+    [0x02] = "tbuffer_load_format_xyz",
+    [0x03] = "tbuffer_load_format_xyzw",
+    [0x04] = "tbuffer_store_format_x",
+    [0x05] = "tbuffer_store_format_xy",
+    [0x06] = "tbuffer_store_format_xyz",
+    [0x07] = "tbuffer_store_format_xyzw",
+};
+
+static const char * const gcn_mimg_names[] = {
+    [0x00] = "image_load",
+    [0x01] = "image_load_mip",
+    [0x02] = "image_load_pck",
+    [0x03] = "image_load_pck_sgn",
+    [0x04] = "image_load_mip_pck",
+    [0x05] = "image_load_mip_pck_sgn",
+    [0x08] = "image_store",
+    [0x09] = "image_store_mip",
+    [0x0A] = "image_store_pck",
+    [0x0B] = "image_store_mip_pck",
+    [0x0E] = "image_get_resinfo",
+    [0x0F] = "image_atomic_swap",
+    [0x10] = "image_atomic_cmpswap",
+    [0x11] = "image_atomic_add",
+    [0x12] = "image_atomic_sub",
+    [0x14] = "image_atomic_smin",
+    [0x15] = "image_atomic_umin",
+    [0x16] = "image_atomic_smax",
+    [0x17] = "image_atomic_umax",
+    [0x18] = "image_atomic_and",
+    [0x19] = "image_atomic_or",
+    [0x1A] = "image_atomic_xor",
+    [0x1B] = "image_atomic_inc",
+    [0x1C] = "image_atomic_dec",
+    [0x1D] = "image_atomic_fcmpswap",
+    [0x1E] = "image_atomic_fmin",
+    [0x1F] = "image_atomic_fmax",
+    [0x20] = "image_sample",
+    [0x21] = "image_sample_cl",
+    [0x22] = "image_sample_d",
+    [0x23] = "image_sample_d_cl",
+    [0x24] = "image_sample_l",
+    [0x25] = "image_sample_b",
+    [0x26] = "image_sample_b_cl",
+    [0x27] = "image_sample_lz",
+    [0x28] = "image_sample_c",
+    [0x29] = "image_sample_c_cl",
+    [0x2A] = "image_sample_c_d",
+    [0x2B] = "image_sample_c_d_cl",
+    [0x2C] = "image_sample_c_l",
+    [0x2D] = "image_sample_c_b",
+    [0x2E] = "image_sample_c_b_cl",
+    [0x2F] = "image_sample_c_lz",
+    [0x30] = "image_sample_o",
+    [0x31] = "image_sample_cl_o",
+    [0x32] = "image_sample_d_o",
+    [0x33] = "image_sample_d_cl_o",
+    [0x34] = "image_sample_l_o",
+    [0x35] = "image_sample_b_o",
+    [0x36] = "image_sample_b_cl_o",
+    [0x37] = "image_sample_lz_o",
+    [0x38] = "image_sample_c_o",
+    [0x39] = "image_sample_c_cl_o",
+    [0x3A] = "image_sample_c_d_o",
+    [0x3B] = "image_sample_c_d_cl_o",
+    [0x3C] = "image_sample_c_l_o",
+    [0x3D] = "image_sample_c_b_o",
+    [0x3E] = "image_sample_c_b_cl_o",
+    [0x3F] = "image_sample_c_lz_o",
+    [0x40] = "image_gather4",
+    [0x41] = "image_gather4_cl",
+    [0x42] = "image_gather4_l",
+    [0x43] = "image_gather4_b",
+    [0x44] = "image_gather4_b_cl",
+    [0x45] = "image_gather4_lz",
+    [0x46] = "image_gather4_c",
+    [0x47] = "image_gather4_c_cl",
+    [0x48] = "image_gather4_c_l",
+    [0x49] = "image_gather4_c_b",
+    [0x4A] = "image_gather4_c_b_cl",
+    [0x4B] = "image_gather4_c_lz",
+    [0x60] = "image_get_lod",
+};
+
+#define GCN_MIMG_STORE_FIRST    0x08
+#define GCN_MIMG_STORE_LAST     0x0B
+#define GCN_MIMG_SAMPLER_FIRST  0x20    /* image_sample .. image_get_lod */
+
+static const char *gcn_table_name(const char * const *table, size_t count,
+                                  unsigned opcode)
+{
+    return opcode < count ? table[opcode] : NULL;
+}
+
+#define GCN_NAME(table, opcode) \
+    gcn_table_name(table, ARRAY_SIZE(table), opcode)
+
+/* decoder */
+
+static bool gcn_vop_literal(uint32_t src0)
+{
+    return extract32(src0, 0, 9) == GCN_SRC_LITERAL;
+}
+
+unsigned gcn_decode(GCNInstruction *insn, const uint32_t *words,
+                    unsigned avail)
+{
+    uint32_t w;
+
+    memset(insn, 0, sizeof(*insn));
+    if (avail < 1) {
+        return 0;
+    }
+    w = words[0];
+    insn->word[0] = w;
+    insn->length = 1;
+
+    if (!(w & 0x80000000)) {
+        switch (w >> 25) {
+        case 0x3F:
+            insn->encoding = GCN_ENC_VOP1;
+            insn->opcode = extract32(w, 9, 8);
+            insn->has_literal = gcn_vop_literal(w);
+            break;
+        case 0x3E:
+            insn->encoding = GCN_ENC_VOPC;
+            insn->opcode = extract32(w, 17, 8);
+            insn->has_literal = gcn_vop_literal(w);
+            break;
+        default:
+            insn->encoding = GCN_ENC_VOP2;
+            insn->opcode = extract32(w, 25, 6);
+            insn->has_literal = gcn_vop_literal(w) ||
+                insn->opcode == GCN_VOP2_MADMK ||
+                insn->opcode == GCN_VOP2_MADAK;
+        }
+    } else if ((w >> 30) == 0x2) {
+        switch (w >> 23) {
+        case 0x17D:
+            insn->encoding = GCN_ENC_SOP1;
+            insn->opcode = extract32(w, 8, 8);
+            insn->has_literal = extract32(w, 0, 8) == GCN_SRC_LITERAL;
+            break;
+        case 0x17E:
+            insn->encoding = GCN_ENC_SOPC;
+            insn->opcode = extract32(w, 16, 7);
+            insn->has_literal = extract32(w, 0, 8) == GCN_SRC_LITERAL ||
+                                extract32(w, 8, 8) == GCN_SRC_LITERAL;
+            break;
+        case 0x17F:
+            insn->encoding = GCN_ENC_SOPP;
+            insn->opcode = extract32(w, 16, 7);
+            break;
+        default:
+            if ((w >> 28) == 0xB) {
+                insn->encoding = GCN_ENC_SOPK;
+                insn->opcode = extract32(w, 23, 5);
+                insn->has_literal = insn->opcode == GCN_SOPK_SETREG_IMM32;
+            } else {
+                insn->encoding = GCN_ENC_SOP2;
+                insn->opcode = extract32(w, 23, 7);
+                insn->has_literal = extract32(w, 0, 8) == GCN_SRC_LITERAL ||
+                                    extract32(w, 8, 8) == GCN_SRC_LITERAL;
+            }
+        }
+    } else if ((w >> 27) == 0x18) {
+        insn->encoding = GCN_ENC_SMRD;
+        insn->opcode = extract32(w, 22, 5);
+        insn->has_literal = !extract32(w, 8, 1) &&
+                            extract32(w, 0, 8) == GCN_SRC_LITERAL;
+    } else {
+        switch (w >> 26) {
+        case 0x32:
+            insn->encoding = GCN_ENC_VINTRP;
+            insn->opcode = extract32(w, 16, 2);
+            break;
+        case 0x34:
+            insn->encoding = GCN_ENC_VOP3;
+            insn->opcode = extract32(w, 17, 9);
+            insn->length = 2;
+            break;
+        case 0x36:
+            insn->encoding = GCN_ENC_DS;
+            insn->opcode = extract32(w, 18, 8);
+            insn->length = 2;
+            break;
+        case 0x37:
+            insn->encoding = GCN_ENC_FLAT;
+            insn->opcode = extract32(w, 18, 7);
+            insn->length = 2;
+            break;
+        case 0x38:
+            insn->encoding = GCN_ENC_MUBUF;
+            insn->opcode = extract32(w, 18, 7);
+            insn->length = 2;
+            break;
+        case 0x3A:
+            insn->encoding = GCN_ENC_MTBUF;
+            insn->opcode = extract32(w, 16, 3);
+            insn->length = 2;
+            break;
+        case 0x3C:
+            insn->encoding = GCN_ENC_MIMG;
+            insn->opcode = extract32(w, 18, 7);
+            insn->length = 2;
+            break;
+        case 0x3E:
+            insn->encoding = GCN_ENC_EXP;
+            insn->length = 2;
+            break;
+        default:
+            insn->encoding = GCN_ENC_UNKNOWN;
+        }
+    }
+
+    if (insn->has_literal) {
+        insn->length++;
+    }
+    if (insn->length > avail) {
+        return 0;
+    }
+    if (insn->length > 1) {
+        if (insn->has_literal) {
+            insn->literal = words[insn->length - 1];
+        } else {
+            insn->word[1] = words[1];
+        }
+    }
+    return insn->length;
+}
+
+bool gcn_is_endpgm(const GCNInstruction *insn)
+{
+    return insn->encoding == GCN_ENC_SOPP && insn->opcode == GCN_SOPP_ENDPGM;
+}
+
+/* formatter */
+
+typedef struct GCNPrinter {
+    char *buf;
+    size_t size;
+    size_t pos;
+} GCNPrinter;
+
+static void GCC_FMT_ATTR(2, 3) gcn_printf(GCNPrinter *p, const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    if (p->pos >= p->size) {
+        return;
+    }
+    va_start(ap, fmt);
+    ret = vsnprintf(p->buf + p->pos, p->size - p->pos, fmt, ap);
+    va_end(ap);
+    if (ret > 0) {
+        p->pos = MIN(p->pos + ret, p->size);
+    }
+}
+
+static void gcn_reg_range(GCNPrinter *p, const char *prefix,
+                          unsigned index, unsigned width)
+{
+    if (width > 1) {
+        gcn_printf(p, "%s[%u:%u]", prefix, index, index + width - 1);
+    } else {
+        gcn_printf(p, "%s%u", prefix, index);
+    }
+}
+
+static void gcn_special_reg(GCNPrinter *p, const char *name,
+                            unsigned code, unsigned base, unsigned width)
+{
+    if (width > 1 && code == base) {
+        gcn_printf(p, "%s", name);
+    } else {
+        gcn_printf(p, "%s_%s", name, code == base ? "lo" : "hi");
+    }
+}
+
+static void gcn_src(GCNPrinter *p, const GCNInstruction *insn,
+                    unsigned code, unsigned width)
+{
+    static const char * const floats[] = {
+        "0.5", "-0.5", "1.0", "-1.0", "2.0", "-2.0", "4.0", "-4.0",
+    };
+
+    if (code <= GCN_SRC_SGPR_MAX) {
+        gcn_reg_range(p, "s", code, width);
+    } else if (code < GCN_SRC_VCC) {
+        gcn_special_reg(p, "flat_scratch", code, GCN_SRC_FLAT_SCRATCH, width);
+    } else if (code < GCN_SRC_TBA) {
+        gcn_special_reg(p, "vcc", code, GCN_SRC_VCC, width);
+    } else if (code < GCN_SRC_TMA) {
+        gcn_special_reg(p, "tba", code, GCN_SRC_TBA, width);
+    } else if (code < GCN_SRC_TTMP) {
+        gcn_special_reg(p, "tma", code, GCN_SRC_TMA, width);
+    } else if (code <= GCN_SRC_TTMP_MAX) {
+        gcn_reg_range(p, "ttmp", code - GCN_SRC_TTMP, width);
+    } else if (code == GCN_SRC_M0) {
+        gcn_printf(p, "m0");
+    } else if (code == GCN_SRC_EXEC || code == GCN_SRC_EXEC + 1) {
+        gcn_special_reg(p, "exec", code, GCN_SRC_EXEC, width);
+    } else if (code == GCN_SRC_ZERO) {
+        gcn_printf(p, "0");
+    } else if (code > GCN_SRC_ZERO && code <= GCN_SRC_INT_POS_MAX) {
+        gcn_printf(p, "%u", code - GCN_SRC_ZERO);
+    } else if (code > GCN_SRC_INT_POS_MAX && code <= GCN_SRC_INT_NEG_MAX) {
+        gcn_printf(p, "-%u", code - GCN_SRC_INT_POS_MAX);
+    } else if (code >= GCN_SRC_FLOAT && code <= GCN_SRC_FLOAT_MAX) {
+        gcn_printf(p, "%s", floats[code - GCN_SRC_FLOAT]);
+    } else if (code == GCN_SRC_VCCZ) {
+        gcn_printf(p, "vccz");
+    } else if (code == GCN_SRC_EXECZ) {
+        gcn_printf(p, "execz");
+    } else if (code == GCN_SRC_SCC) {
+        gcn_printf(p, "scc");
+    } else if (code == GCN_SRC_LDS_DIRECT) {
+        gcn_printf(p, "lds_direct");
+    } else if (code == GCN_SRC_LITERAL) {
+        gcn_printf(p, "0x%08x", insn->literal);
+    } else if (code >= GCN_SRC_VGPR) {
+        gcn_reg_range(p, "v", code - GCN_SRC_VGPR, width);
+    } else {
+        gcn_printf(p, "src_%u", code);
+    }
+}
+
+static void gcn_vgpr(GCNPrinter *p, unsigned index, unsigned width)
+{
+    gcn_reg_range(p, "v", index, width);
+}
+
+static void gcn_sgpr(GCNPrinter *p, unsigned index, unsigned width)
+{
+    gcn_reg_range(p, "s", index, width);
+}
+
+/*
+ * Operand widths in dwords, derived from the type suffixes of the
+ * mnemonic: "v_cvt_f64_i32" has a 64-bit result and a 32-bit source.
+ */
+static void gcn_type_widths(const char *name, unsigned *dst, unsigned *src)
+{
+    const char *last, *prev;
+    size_t len = strlen(name);
+
+    *dst = *src = 1;
+    last = strrchr(name, '_');
+    if (!last || len < 2) {
+        return;
+    }
+    *dst = *src = !strcmp(name + len - 2, "64") ? 2 : 1;
+    for (prev = last - 1; prev > name && *prev != '_'; prev--) {
+        continue;
+    }
+    if (last - prev == 4 && strchr("fiub", prev[1]) &&
+        g_ascii_isdigit(prev[2]) && g_ascii_isdigit(prev[3])) {
+        *dst = (prev[2] == '6' && prev[3] == '4') ? 2 : 1;
+    }
+}
+
+/* Data width of buffer, flat and LDS accesses */
+static unsigned gcn_data_width(const char *name)
+{
+    static const struct {
+        const char *suffix;
+        unsigned width;
+    } suffixes[] = {
+        { "_xyzw", 4 }, { "_xyz", 3 }, { "_xy", 2 },
+        { "x4", 4 }, { "x3", 3 }, { "x2", 2 },
+        { "_b128", 4 }, { "_b96", 3 }, { "_b64", 2 },
+    };
+    size_t len = strlen(name);
+    size_t i, n;
+
+    for (i = 0; i < ARRAY_SIZE(suffixes); i++) {
+        n = strlen(suffixes[i].suffix);
+        if (len >= n && !strcmp(name + len - n, suffixes[i].suffix)) {
+            return suffixes[i].width;
+        }
+    }
+    return 1;
+}
+
+static const char *gcn_vopc_name(unsigned opcode, char *buf, size_t size)
+{
+    static const char * const ftypes[] = {
+        "cmp", "cmpx", "cmp", "cmpx", "cmps", "cmpsx", "cmps", "cmpsx",
+    };
+    static const char * const itypes[] = {
+        "i32", "i32", "i64", "i64", "u32", "u32", "u64", "u64",
+    };
+    unsigned group = opcode >> 4;
+
+    if (opcode < 0x80) {
+        snprintf(buf, size, "v_%s_%s_%s", ftypes[group],
+                 gcn_vopc_fcond[opcode & 0xF], (group & 2) ? "f64" : "f32");
+    } else if ((opcode & 0x8) == 0) {
+        snprintf(buf, size, "v_%s_%s_%s", (group & 1) ? "cmpx" : "cmp",
+                 gcn_vopc_icond[opcode & 0x7], itypes[group - 8]);
+    } else if ((opcode & 0x7) == 0 && group < 0xC) {
+        snprintf(buf, size, "v_%s_class_%s", (group & 1) ? "cmpx" : "cmp",
+                 (group & 2) ? "f64" : "f32");
+    } else {
+        return NULL;
+    }
+    return buf;
+}
+
+static const char *gcn_opcode_name(const GCNInstruction *insn,
+                                   char *buf, size_t size)
+{
+    unsigned op = insn->opcode;
+    const char *name = NULL;
+
+    switch (insn->encoding) {
+    case GCN_ENC_SOP2:
+        return GCN_NAME(gcn_sop2_names, op);
+    case GCN_ENC_SOPK:
+        return GCN_NAME(gcn_sopk_names, op);
+    case GCN_ENC_SOP1:
+        return GCN_NAME(gcn_sop1_names, op);
+    case GCN_ENC_SOPC:
+        return GCN_NAME(gcn_sopc_names, op);
+    case GCN_ENC_SOPP:
+        return GCN_NAME(gcn_sopp_names, op);
+    case GCN_ENC_SMRD:
+        return GCN_NAME(gcn_smrd_names, op);
+    case GCN_ENC_VOP2:
+        return GCN_NAME(gcn_vop2_names, op);
+    case GCN_ENC_VOP1:
+        return GCN_NAME(gcn_vop1_names, op);
+    case GCN_ENC_VOPC:
+        return gcn_vopc_name(op, buf, size);
+    case GCN_ENC_VOP3:
+        if (op < GCN_VOP3_VOP2_BASE) {
+            return gcn_vopc_name(op, buf, size);
+        } else if (op < GCN_VOP3_ONLY_BASE) {
+            return GCN_NAME(gcn_vop2_names, op - GCN_VOP3_VOP2_BASE);
+        } else if (op < GCN_VOP3_VOP1_BASE) {
+            return GCN_NAME(gcn_vop3_names, op - GCN_VOP3_ONLY_BASE);
+        }
+        return GCN_NAME(gcn_vop1_names, op - GCN_VOP3_VOP1_BASE);
+    case GCN_ENC_VINTRP:
+        return GCN_NAME(gcn_vintrp_names, op);
+    case GCN_ENC_DS:
+        return GCN_NAME(gcn_ds_names, op);
+    case GCN_ENC_MUBUF:
+    case GCN_ENC_FLAT:
+        name = GCN_NAME(gcn_mem_names, op);
+        if (!name || (insn->encoding == GCN_ENC_FLAT &&
+                      (op < GCN_MEM_LOAD_FIRST ||
+                       op >= GCN_MEM_WBINVL1_VOL))) {
+            return NULL;
+        }
+        snprintf(buf, size, "%s_%s",
+                 insn->encoding == GCN_ENC_FLAT ? "flat" : "buffer", name);
+        return buf;
+    case GCN_ENC_MTBUF:
+        return GCN_NAME(gcn_mtbuf_names, op);
+    case GCN_ENC_MIMG:
+        return GCN_NAME(gcn_mimg_names, op);
+    case GCN_ENC_EXP:
+        return "exp";
+    default:
+        return NULL;
+    }
+}
+
+static const char *gcn_encoding_name(GCNEncoding encoding)
+{
+    static const char * const names[] = {
+        [GCN_ENC_UNKNOWN] = "unknown",
+        [GCN_ENC_SOP2]    = "sop2",
+        [GCN_ENC_SOPK]    = "sopk",
+        [GCN_ENC_SOP1]    = "sop1",
+        [GCN_ENC_SOPC]    = "sopc",
+        [GCN_ENC_SOPP]    = "sopp",
+        [GCN_ENC_SMRD]    = "smrd",
+        [GCN_ENC_VOP2]    = "vop2",
+        [GCN_ENC_VOP1]    = "vop1",
+        [GCN_ENC_VOPC]    = "vopc",
+        [GCN_ENC_VOP3]    = "vop3",
+        [GCN_ENC_VINTRP]  = "vintrp",
+        [GCN_ENC_DS]      = "ds",
+        [GCN_ENC_MUBUF]   = "mubuf",
+        [GCN_ENC_MTBUF]   = "mtbuf",
+        [GCN_ENC_MIMG]    = "mimg",
+        [GCN_ENC_EXP]     = "exp",
+        [GCN_ENC_FLAT]    = "flat",
+    };
+    return names[encoding];
+}
+
+static void gcn_format_hwreg(GCNPrinter *p, uint32_t simm16)
+{
+    gcn_printf(p, "hwreg(%u, %u, %u)", extract32(simm16, 0, 6),
+               extract32(simm16, 6, 5), extract32(simm16, 11, 5) + 1);
+}
+
+static void gcn_format_sop2(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    uint32_t w = insn->word[0];
+    unsigned dst, src;
+
+    gcn_type_widths(name, &dst, &src);
+    gcn_printf(p, " ");
+    gcn_src(p, insn, extract32(w, 16, 7), dst);
+    gcn_printf(p, ", ");
+    gcn_src(p, insn, extract32(w, 0, 8), src);
+    gcn_printf(p, ", ");
+    gcn_src(p, insn, extract32(w, 8, 8), src);
+}
+
+static void gcn_format_sopk(GCNPrinter *p, const GCNInstruction *insn,
+                            uint64_t pc)
+{
+    uint32_t w = insn->word[0];
+    uint32_t simm16 = extract32(w, 0, 16);
+    unsigned sdst = extract32(w, 16, 7);
+
+    gcn_printf(p, " ");
+    switch (insn->opcode) {
+    case GCN_SOPK_CBRANCH_I_FORK:
+        gcn_src(p, insn, sdst, 2);
+        gcn_printf(p, ", 0x%" PRIx64, pc + 4 + (int16_t)simm16 * 4);
+        break;
+    case GCN_SOPK_GETREG:
+        gcn_src(p, insn, sdst, 1);
+        gcn_printf(p, ", ");
+        gcn_format_hwreg(p, simm16);
+        break;
+    case GCN_SOPK_SETREG:
+        gcn_format_hwreg(p, simm16);
+        gcn_printf(p, ", ");
+        gcn_src(p, insn, sdst, 1);
+        break;
+    case GCN_SOPK_SETREG_IMM32:
+        gcn_format_hwreg(p, simm16);
+        gcn_printf(p, ", 0x%08x", insn->literal);
+        break;
+    default:
+        gcn_src(p, insn, sdst, 1);
+        gcn_printf(p, ", 0x%04x", simm16);
+    }
+}
+
+static void gcn_format_sop1(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    uint32_t w = insn->word[0];
+    unsigned dst, src;
+    bool has_dst, has_src;
+
+    gcn_type_widths(name, &dst, &src);
+    has_dst = insn->opcode != GCN_SOP1_SETPC && insn->opcode != GCN_SOP1_RFE;
+    has_src = insn->opcode != GCN_SOP1_GETPC;
+    gcn_printf(p, " ");
+    if (has_dst) {
+        gcn_src(p, insn, extract32(w, 16, 7), dst);
+    }
+    if (has_dst && has_src) {
+        gcn_printf(p, ", ");
+    }
+    if (has_src) {
+        gcn_src(p, insn, extract32(w, 0, 8), src);
+    }
+}
+
+static void gcn_format_sopc(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    uint32_t w = insn->word[0];
+    unsigned dst, src;
+
+    gcn_type_widths(name, &dst, &src);
+    gcn_printf(p, " ");
+    gcn_src(p, insn, extract32(w, 0, 8), src);
+    gcn_printf(p, ", ");
+    gcn_src(p, insn, extract32(w, 8, 8), 1);
+}
+
+static void gcn_format_sopp(GCNPrinter *p, const GCNInstruction *insn,
+                            uint64_t pc)
+{
+    uint32_t simm16 = extract32(insn->word[0], 0, 16);
+    unsigned op = insn->opcode;
+    unsigned vmcnt, expcnt, lgkmcnt;
+
+    if (op == GCN_SOPP_BRANCH ||
+        (op >= GCN_SOPP_CBRANCH_FIRST && op <= GCN_SOPP_CBRANCH_LAST) ||
+        (op >= GCN_SOPP_CDBG_FIRST && op <= GCN_SOPP_CDBG_LAST)) {
+        gcn_printf(p, " 0x%" PRIx64, pc + 4 + (int16_t)simm16 * 4);
+        return;
+    }
+    switch (op) {
+    case GCN_SOPP_ENDPGM:
+    case GCN_SOPP_BARRIER:
+    case GCN_SOPP_ICACHE_INV:
+        break;
+    case GCN_SOPP_WAITCNT:
+        vmcnt = extract32(simm16, 0, 4);
+        expcnt = extract32(simm16, 4, 3);
+        lgkmcnt = extract32(simm16, 8, 5);
+        if (vmcnt != 0xF) {
+            gcn_printf(p, " vmcnt(%u)", vmcnt);
+        }
+        if (expcnt != 0x7) {
+            gcn_printf(p, " expcnt(%u)", expcnt);
+        }
+        if (lgkmcnt != 0x1F) {
+            gcn_printf(p, " lgkmcnt(%u)", lgkmcnt);
+        }
+        break;
+    case GCN_SOPP_SENDMSG:
+    case GCN_SOPP_SENDMSGHALT:
+        gcn_printf(p, " sendmsg(%u, %u, %u)", extract32(simm16, 0, 4),
+                   extract32(simm16, 4, 3), extract32(simm16, 8, 2));
+        break;
+    default:
+        gcn_printf(p, " 0x%04x", simm16);
+    }
+}
+
+static void gcn_format_smrd(GCNPrinter *p, const GCNInstruction *insn)
+{
+    uint32_t w = insn->word[0];
+    unsigned op = insn->opcode;
+    unsigned offset = extract32(w, 0, 8);
+    unsigned sbase = extract32(w, 9, 6) * 2;
+    unsigned sdst = extract32(w, 15, 7);
+
+    if (op == GCN_SMRD_MEMTIME) {
+        gcn_printf(p, " ");
+        gcn_src(p, insn, sdst, 2);
+        return;
+    }
+    if (op > GCN_SMRD_BUFFER_LOAD + 4) {
+        return;
+    }
+    gcn_printf(p, " ");
+    gcn_src(p, insn, sdst, 1 << (op & 0x7));
+    gcn_printf(p, ", ");
+    gcn_sgpr(p, sbase, op >= GCN_SMRD_BUFFER_LOAD ? 4 : 2);
+    if (extract32(w, 8, 1)) {
+        gcn_printf(p, ", 0x%x", offset);
+    } else {
+        gcn_printf(p, ", ");
+        gcn_src(p, insn, offset, 1);
+    }
+}
+
+static void gcn_format_vop2(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    uint32_t w = insn->word[0];
+    unsigned op = insn->opcode;
+    unsigned dst, src;
+
+    gcn_type_widths(name, &dst, &src);
+    gcn_printf(p, " ");
+    gcn_vgpr(p, extract32(w, 17, 8), dst);
+    if (op >= GCN_VOP2_CARRY_FIRST && op <= GCN_VOP2_CARRY_LAST) {
+        gcn_printf(p, ", vcc");
+    }
+    gcn_printf(p, ", ");
+    gcn_src(p, insn, extract32(w, 0, 9), src);
+    if (op == GCN_VOP2_MADMK) {
+        gcn_printf(p, ", 0x%08x", insn->literal);
+    }
+    gcn_printf(p, ", ");
+    gcn_vgpr(p, extract32(w, 9, 8), src);
+    if (op == GCN_VOP2_MADAK) {
+        gcn_printf(p, ", 0x%08x", insn->literal);
+    }
+    if (op == GCN_VOP2_CNDMASK ||
+        (op >= GCN_VOP2_CARRY_IN && op <= GCN_VOP2_CARRY_LAST)) {
+        gcn_printf(p, ", vcc");
+    }
+}
+
+static void gcn_format_vop1(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    uint32_t w = insn->word[0];
+    unsigned dst, src;
+
+    if (insn->opcode == GCN_VOP1_NOP || insn->opcode == GCN_VOP1_CLREXCP) {
+        return;
+    }
+    gcn_type_widths(name, &dst, &src);
+    gcn_printf(p, " ");
+    if (insn->opcode == GCN_VOP1_READFIRSTLANE) {
+        gcn_src(p, insn, extract32(w, 17, 8), 1);
+    } else {
+        gcn_vgpr(p, extract32(w, 17, 8), dst);
+    }
+    gcn_printf(p, ", ");
+    gcn_src(p, insn, extract32(w, 0, 9), src);
+}
+
+static void gcn_format_vopc(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    uint32_t w = insn->word[0];
+    unsigned dst, src;
+
+    gcn_type_widths(name, &dst, &src);
+    gcn_printf(p, " vcc, ");
+    gcn_src(p, insn, extract32(w, 0, 9), src);
+    gcn_printf(p, ", ");
+    gcn_vgpr(p, extract32(w, 9, 8), src);
+}
+
+static void gcn_format_vop3_src(GCNPrinter *p, const GCNInstruction *insn,
+                                unsigned index, unsigned width, bool vop3b)
+{
+    unsigned code = extract32(insn->word[1], index * 9, 9);
+    bool neg = extract32(insn->word[1], 29 + index, 1);
+    bool abs = !vop3b && extract32(insn->word[0], 8 + index, 1);
+
+    gcn_printf(p, ", %s%s", neg ? "-" : "", abs ? "|" : "");
+    gcn_src(p, insn, code, width);
+    if (abs) {
+        gcn_printf(p, "|");
+    }
+}
+
+static void gcn_format_vop3(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    static const char * const omods[] = { "", " mul:2", " mul:4", " div:2" };
+    uint32_t w = insn->word[0];
+    unsigned op = insn->opcode;
+    unsigned dst, src, nsrc, i;
+    bool vop3b;
+
+    gcn_type_widths(name, &dst, &src);
+    vop3b = op == GCN_VOP3_DIV_SCALE_F32 || op == GCN_VOP3_DIV_SCALE_F64 ||
+        (op >= GCN_VOP3_VOP2_BASE + GCN_VOP2_CARRY_FIRST &&
+         op <= GCN_VOP3_VOP2_BASE + GCN_VOP2_CARRY_LAST);
+
+    if (op < GCN_VOP3_VOP2_BASE) {
+        nsrc = 2;
+    } else if (op < GCN_VOP3_ONLY_BASE) {
+        op -= GCN_VOP3_VOP2_BASE;
+        nsrc = (op == GCN_VOP2_CNDMASK || op == GCN_VOP2_MADMK ||
+                op == GCN_VOP2_MADAK ||
+                (op >= GCN_VOP2_CARRY_IN && op <= GCN_VOP2_CARRY_LAST)) ?
+                3 : 2;
+    } else if (op < GCN_VOP3_VOP1_BASE) {
+        nsrc = ((op >= GCN_VOP3_TWO_SRC_FIRST &&
+                 op <= GCN_VOP3_TWO_SRC_LAST) ||
+                op == GCN_VOP3_TRIG_PREOP) ? 2 : 3;
+    } else {
+        nsrc = (op - GCN_VOP3_VOP1_BASE == GCN_VOP1_NOP ||
+                op - GCN_VOP3_VOP1_BASE == GCN_VOP1_CLREXCP) ? 0 : 1;
+    }
+
+    gcn_printf(p, " ");
+    if (insn->opcode < GCN_VOP3_VOP2_BASE) {
+        gcn_src(p, insn, extract32(w, 0, 8), 2);
+    } else {
+        gcn_vgpr(p, extract32(w, 0, 8), dst);
+    }
+    if (vop3b) {
+        gcn_printf(p, ", ");
+        gcn_src(p, insn, extract32(w, 8, 7), 2);
+    }
+    for (i = 0; i < nsrc; i++) {
+        gcn_format_vop3_src(p, insn, i, src, vop3b);
+    }
+    if (!vop3b && extract32(w, 11, 1)) {
+        gcn_printf(p, " clamp");
+    }
+    gcn_printf(p, "%s", omods[extract32(insn->word[1], 27, 2)]);
+}
+
+static void gcn_format_vintrp(GCNPrinter *p, const GCNInstruction *insn)
+{
+    static const char * const params[] = { "p10", "p20", "p0", "p_invalid" };
+    uint32_t w = insn->word[0];
+    unsigned vsrc = extract32(w, 0, 8);
+
+    gcn_printf(p, " v%u, ", extract32(w, 18, 8));
+    if (insn->opcode == GCN_VINTRP_MOV) {
+        gcn_printf(p, "%s", params[vsrc & 3]);
+    } else {
+        gcn_printf(p, "v%u", vsrc);
+    }
+    gcn_printf(p, ", attr%u.%c", extract32(w, 10, 6),
+               "xyzw"[extract32(w, 8, 2)]);
+}
+
+static void gcn_format_ds(GCNPrinter *p, const GCNInstruction *insn,
+                          const char *name)
+{
+    uint32_t w0 = insn->word[0], w1 = insn->word[1];
+    unsigned width = gcn_data_width(name);
+    bool has_dst, has_data0, has_data1, two_offsets;
+
+    has_dst = strstr(name, "read") || strstr(name, "_rtn") ||
+              strstr(name, "swizzle") || strstr(name, "consume") ||
+              strstr(name, "append") || strstr(name, "ordered");
+    has_data0 = !strstr(name, "read") && !strstr(name, "consume") &&
+                !strstr(name, "append") && !strstr(name, "ds_nop");
+    has_data1 = has_data0 &&
+                (strstr(name, "2_") || strstr(name, "2st64") ||
+                 strstr(name, "cmpst") || strstr(name, "mskor"));
+    two_offsets = strstr(name, "2_") || strstr(name, "2st64");
+
+    gcn_printf(p, " ");
+    if (has_dst) {
+        gcn_vgpr(p, extract32(w1, 24, 8),
+                 two_offsets && strstr(name, "read") ? width * 2 : width);
+        gcn_printf(p, ", ");
+    }
+    gcn_vgpr(p, extract32(w1, 0, 8), 1);
+    if (has_data0) {
+        gcn_printf(p, ", ");
+        gcn_vgpr(p, extract32(w1, 8, 8), width);
+    }
+    if (has_data1) {
+        gcn_printf(p, ", ");
+        gcn_vgpr(p, extract32(w1, 16, 8), width);
+    }
+    if (two_offsets) {
+        gcn_printf(p, " offset0:%u offset1:%u",
+                   extract32(w0, 0, 8), extract32(w0, 8, 8));
+    } else if (extract32(w0, 0, 16)) {
+        gcn_printf(p, " offset:%u", extract32(w0, 0, 16));
+    }
+    if (extract32(w0, 17, 1)) {
+        gcn_printf(p, " gds");
+    }
+}
+
+static void gcn_format_buffer(GCNPrinter *p, const GCNInstruction *insn,
+                              const char *name)
+{
+    uint32_t w0 = insn->word[0], w1 = insn->word[1];
+    unsigned width = gcn_data_width(name);
+
+    if (insn->encoding == GCN_ENC_MUBUF &&
+        insn->opcode >= GCN_MEM_WBINVL1_VOL) {
+        return;
+    }
+    if (strstr(name, "cmpswap")) {
+        width *= 2;
+    }
+    gcn_printf(p, " ");
+    gcn_vgpr(p, extract32(w1, 8, 8), width);
+    gcn_printf(p, ", ");
+    gcn_vgpr(p, extract32(w1, 0, 8),
+             (extract32(w0, 12, 1) && extract32(w0, 13, 1)) ||
+             extract32(w0, 15, 1) ? 2 : 1);
+    gcn_printf(p, ", ");
+    gcn_sgpr(p, extract32(w1, 16, 5) * 4, 4);
+    gcn_printf(p, ", ");
+    gcn_src(p, insn, extract32(w1, 24, 8), 1);
+    if (insn->encoding == GCN_ENC_MTBUF) {
+        gcn_printf(p, " format:[%u,%u]",
+                   extract32(w0, 19, 4), extract32(w0, 23, 3));
+    }
+    if (extract32(w0, 0, 12)) {
+        gcn_printf(p, " offset:%u", extract32(w0, 0, 12));
+    }
+    gcn_printf(p, "%s%s%s%s%s%s",
+               extract32(w0, 12, 1) ? " offen" : "",
+               extract32(w0, 13, 1) ? " idxen" : "",
+               extract32(w0, 15, 1) ? " addr64" : "",
+               extract32(w0, 14, 1) ? " glc" : "",
+               extract32(w1, 22, 1) ? " slc" : "",
+               extract32(w1, 23, 1) ? " tfe" : "");
+    if (insn->encoding == GCN_ENC_MUBUF && extract32(w0, 16, 1)) {
+        gcn_printf(p, " lds");
+    }
+}
+
+static void gcn_format_mimg(GCNPrinter *p, const GCNInstruction *insn)
+{
+    uint32_t w0 = insn->word[0], w1 = insn->word[1];
+    unsigned dmask = extract32(w0, 8, 4);
+    unsigned width = MAX(ctpop32(dmask), 1);
+
+    gcn_printf(p, " ");
+    gcn_vgpr(p, extract32(w1, 8, 8), extract32(w1, 23, 1) ? width + 1 : width);
+    gcn_printf(p, ", ");
+    gcn_vgpr(p, extract32(w1, 0, 8), 1);
+    gcn_printf(p, ", ");
+    gcn_sgpr(p, extract32(w1, 16, 5) * 4, extract32(w0, 15, 1) ? 4 : 8);
+    if (insn->opcode >= GCN_MIMG_SAMPLER_FIRST) {
+        gcn_printf(p, ", ");
+        gcn_sgpr(p, extract32(w1, 21, 5) * 4, 4);
+    }
+    gcn_printf(p, " dmask:0x%x%s%s%s%s%s%s%s", dmask,
+               extract32(w0, 12, 1) ? " unorm" : "",
+               extract32(w0, 13, 1) ? " glc" : "",
+               extract32(w0, 25, 1) ? " slc" : "",
+               extract32(w0, 15, 1) ? " r128" : "",
+               extract32(w0, 14, 1) ? " da" : "",
+               extract32(w1, 23, 1) ? " tfe" : "",
+               extract32(w0, 17, 1) ? " lwe" : "");
+}
+
+static void gcn_format_exp(GCNPrinter *p, const GCNInstruction *insn)
+{
+    uint32_t w0 = insn->word[0], w1 = insn->word[1];
+    unsigned target = extract32(w0, 4, 6);
+    unsigned en = extract32(w0, 0, 4);
+    bool compr = extract32(w0, 10, 1);
+    unsigned i, vsrc;
+
+    if (target <= 7) {
+        gcn_printf(p, " mrt%u", target);
+    } else if (target == 8) {
+        gcn_printf(p, " mrtz");
+    } else if (target == 9) {
+        gcn_printf(p, " null");
+    } else if (target >= 12 && target <= 15) {
+        gcn_printf(p, " pos%u", target - 12);
+    } else if (target >= 32) {
+        gcn_printf(p, " param%u", target - 32);
+    } else {
+        gcn_printf(p, " invalid_target_%u", target);
+    }
+    for (i = 0; i < 4; i++) {
+        /* Compressed exports pack two halves per source register */
+        vsrc = compr ? extract32(w1, (i / 2) * 8, 8) : extract32(w1, i * 8, 8);
+        if (en & (1 << i)) {
+            gcn_printf(p, ", v%u", vsrc);
+        } else {
+            gcn_printf(p, ", off");
+        }
+    }
+    gcn_printf(p, "%s%s%s",
+               extract32(w0, 11, 1) ? " done" : "",
+               compr ? " compr" : "",
+               extract32(w0, 12, 1) ? " vm" : "");
+}
+
+static void gcn_format_flat(GCNPrinter *p, const GCNInstruction *insn,
+                            const char *name)
+{
+    uint32_t w0 = insn->word[0], w1 = insn->word[1];
+    unsigned op = insn->opcode;
+    unsigned width = gcn_data_width(name);
+    bool glc = extract32(w0, 16, 1);
+
+    if (strstr(name, "cmpswap")) {
+        width *= 2;
+    }
+    gcn_printf(p, " ");
+    if (op < GCN_MEM_STORE_FIRST || (op >= GCN_MEM_ATOMIC_FIRST && glc)) {
+        gcn_vgpr(p, extract32(w1, 24, 8), gcn_data_width(name));
+        gcn_printf(p, ", ");
+    }
+    gcn_vgpr(p, extract32(w1, 0, 8), 2);
+    if (op >= GCN_MEM_STORE_FIRST) {
+        gcn_printf(p, ", ");
+        gcn_vgpr(p, extract32(w1, 8, 8), width);
+    }
+    gcn_printf(p, "%s%s%s", glc ? " glc" : "",
+               extract32(w0, 17, 1) ? " slc" : "",
+               extract32(w1, 23, 1) ? " tfe" : "");
+}
+
+void gcn_format(const GCNInstruction *insn, uint64_t pc,
+                char *buf, size_t size)
+{
+    GCNPrinter p = { .buf = buf, .size = size, .pos = 0 };
+    char tmp[32];
+    const char *name;
+
+    if (size) {
+        buf[0] = '\0';
+    }
+    name = gcn_opcode_name(insn, tmp, sizeof(tmp));
+    if (!name) {
+        gcn_printf(&p, "%s_op_%u", gcn_encoding_name(insn->encoding),
+                   insn->opcode);
+        return;
+    }
+    gcn_printf(&p, "%s", name);
+
+    switch (insn->encoding) {
+    case GCN_ENC_SOP2:
+        gcn_format_sop2(&p, insn, name);
+        break;
+    case GCN_ENC_SOPK:
+        gcn_format_sopk(&p, insn, pc);
+        break;
+    case GCN_ENC_SOP1:
+        gcn_format_sop1(&p, insn, name);
+        break;
+    case GCN_ENC_SOPC:
+        gcn_format_sopc(&p, insn, name);
+        break;
+    case GCN_ENC_SOPP:
+        gcn_format_sopp(&p, insn, pc);
+        break;
+    case GCN_ENC_SMRD:
+        gcn_format_smrd(&p, insn);
+        break;
+    case GCN_ENC_VOP2:
+        gcn_format_vop2(&p, insn, name);
+        break;
+    case GCN_ENC_VOP1:
+        gcn_format_vop1(&p, insn, name);
+        break;
+    case GCN_ENC_VOPC:
+        gcn_format_vopc(&p, insn, name);
+        break;
+    case GCN_ENC_VOP3:
+        gcn_format_vop3(&p, insn, name);
+        break;
+    case GCN_ENC_VINTRP:
+        gcn_format_vintrp(&p, insn);
+        break;
+    case GCN_ENC_DS:
+        gcn_format_ds(&p, insn, name);
+        break;
+    case GCN_ENC_MUBUF:
+    case GCN_ENC_MTBUF:
+        gcn_format_buffer(&p, insn, name);
+        break;
+    case GCN_ENC_MIMG:
+        gcn_format_mimg(&p, insn);
+        break;
+    case GCN_ENC_EXP:
+        gcn_format_exp(&p, insn);
+        break;
+    case GCN_ENC_FLAT:
+        gcn_format_flat(&p, insn, name);
+        break;
+    default:
+        break;
+    }
+}
+
+/* disassembler interface */
+
+int print_insn_gcn(bfd_vma pc, disassemble_info *info)
+{
+    uint8_t bytes[GCN_INSN_MAX_DWORDS * 4];
+    uint32_t words[GCN_INSN_MAX_DWORDS];
+    GCNInstruction insn;
+    char text[128];
+    unsigned length, avail;
+    int status;
+
+    for (avail = 1; avail <= GCN_INSN_MAX_DWORDS; avail++) {
+        status = info->read_memory_func(pc + (avail - 1) * 4,
+                                        bytes + (avail - 1) * 4, 4, info);
+        if (status) {
+            info->memory_error_func(status, pc + (avail - 1) * 4, info);
+            return -1;
+        }
+        words[avail - 1] = ldl_le_p(bytes + (avail - 1) * 4);
+        length = gcn_decode(&insn, words, avail);
+        if (length) {
+            gcn_format(&insn, pc, text, sizeof(text));
+            info->fprintf_func(info->stream, "%s", text);
+            return length * 4;
+        }
+    }
+    /* gcn_decode never needs more than GCN_INSN_MAX_DWORDS */
+    g_assert_not_reached();
+}
@@ -3843,7 +3843,10 @@ static float16 roundAndPackFloat16(flag zSign, int zExp,
     }
 
     if (zExp < -10) {
-        return packFloat16(zSign, 0, 0);
+        /* Everything was shifted out: only rounding away from zero
+         * leaves the smallest denormal.
+         */
+        return packFloat16(zSign, 0, increment == mask);
     }
     if (zExp < 0) {
         zSig >>= -zExp;
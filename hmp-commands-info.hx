@@ -883,6 +883,24 @@ STEXI
 Show SEV information.
 ETEXI
 
+#if defined(TARGET_PS4)
+    {
+        .name       = "liverpool-shaders",
+        .args_type  = "disassemble:-d",
+        .params     = "[-d]",
+        .help       = "show the shaders bound by the Liverpool GPU "
+                      "(-d: include their disassembly)",
+        .cmd        = hmp_info_liverpool_shaders,
+    },
+#endif
+
+STEXI
+@item info liverpool-shaders [-d]
+@findex info liverpool-shaders
+Show the shader programs bound by the Liverpool command processor, and
+with @code{-d} their GCN disassembly.
+ETEXI
+
 STEXI
 @end table
 ETEXI
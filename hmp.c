@@ -2898,6 +2898,36 @@ void hmp_info_vm_generation_id(Monitor *mon, const QDict *qdict)
     qapi_free_GuidInfo(info);
 }
 
+void hmp_info_liverpool_shaders(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+    bool disassemble = qdict_get_try_bool(qdict, "disassemble", false);
+    LiverpoolShaderInfoList *list, *l;
+    LiverpoolShaderInfo *info;
+
+    list = qmp_query_liverpool_shaders(true, disassemble, &err);
+    if (err) {
+        hmp_handle_error(mon, &err);
+        return;
+    }
+
+    for (l = list; l; l = l->next) {
+        info = l->value;
+        monitor_printf(mon, "%016" PRIx64 ": %s, vmid %" PRIu32
+                       ", addr 0x%010" PRIx64 ", %" PRIu32 " bytes, %"
+                       PRIu32 " instructions, %" PRIu64 " binds%s\n",
+                       info->hash, LiverpoolShaderStage_str(info->stage),
+                       info->vmid, info->address, info->size,
+                       info->instructions, info->binds,
+                       info->truncated ? " (truncated)" : "");
+        if (info->has_disassembly) {
+            monitor_printf(mon, "%s\n", info->disassembly);
+        }
+    }
+
+    qapi_free_LiverpoolShaderInfoList(list);
+}
+
 void hmp_info_memory_size_summary(Monitor *mon, const QDict *qdict)
 {
     Error *err = NULL;
@@ -195,8 +195,6 @@ struct IntelHDAState {
     bool old_msi_addr;
 };
 
-#define TYPE_INTEL_HDA_GENERIC "intel-hda-generic"
-
 #define INTEL_HDA(obj) \
     OBJECT_CHECK(IntelHDAState, (obj), TYPE_INTEL_HDA_GENERIC)
 
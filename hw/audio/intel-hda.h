@@ -3,6 +3,11 @@
 
 #include "hw/qdev.h"
 
+/* --------------------------------------------------------------------- */
+/* hda controller                                                        */
+
+#define TYPE_INTEL_HDA_GENERIC "intel-hda-generic"
+
 /* --------------------------------------------------------------------- */
 /* hda bus                                                               */
 
@@ -834,6 +834,8 @@ struct Rom {
     size_t datasize;
 
     uint8_t *data;
+    /* if set, data points into this mapping instead of being allocated */
+    GMappedFile *mapped_file;
     MemoryRegion *mr;
     AddressSpace *as;
     int isrom;
@@ -1053,9 +1055,12 @@ MemoryRegion *rom_add_blob(const char *name, const void *blob, size_t len,
  * all the rom. We just allocate the first part and the rest is just zeros. This
  * is why romsize and datasize are different. Also, this function seize the
  * memory ownership of "data", so we don't have to allocate and copy the buffer.
+ * When "mapped_file" is given, "data" points into that file mapping instead,
+ * and the rom takes a reference on it.
  */
-int rom_add_elf_program(const char *name, void *data, size_t datasize,
-                        size_t romsize, hwaddr addr, AddressSpace *as)
+int rom_add_elf_program(const char *name, GMappedFile *mapped_file, void *data,
+                        size_t datasize, size_t romsize, hwaddr addr,
+                        AddressSpace *as)
 {
     Rom *rom;
 
@@ -1066,6 +1071,9 @@ int rom_add_elf_program(const char *name, void *data, size_t datasize,
     rom->romsize  = romsize;
     rom->data     = data;
     rom->as       = as;
+    if (mapped_file) {
+        rom->mapped_file = g_mapped_file_ref(mapped_file);
+    }
     rom_insert(rom);
     return 0;
 }
@@ -1080,6 +1088,24 @@ int rom_add_option(const char *file, int32_t bootindex)
     return rom_add_file(file, "genroms", 0, bootindex, true, NULL, NULL);
 }
 
+/* Clear what follows the data of a blob, such as the bss of an ELF segment,
+ * so that it is zero again after a system reset.
+ */
+static void rom_reset_tail(Rom *rom)
+{
+    static const uint8_t zeroes[4096];
+    hwaddr addr = rom->addr + rom->datasize;
+    size_t len = rom->romsize - rom->datasize;
+    size_t l;
+
+    while (len) {
+        l = MIN(len, sizeof(zeroes));
+        cpu_physical_memory_write_rom(rom->as, addr, zeroes, l);
+        addr += l;
+        len -= l;
+    }
+}
+
 static void rom_reset(void *unused)
 {
     Rom *rom;
@@ -1097,10 +1123,18 @@ static void rom_reset(void *unused)
         } else {
             cpu_physical_memory_write_rom(rom->as, rom->addr, rom->data,
                                           rom->datasize);
+            if (rom->romsize > rom->datasize) {
+                rom_reset_tail(rom);
+            }
         }
         if (rom->isrom) {
             /* rom needs to be written only once */
-            g_free(rom->data);
+            if (rom->mapped_file) {
+                g_mapped_file_unref(rom->mapped_file);
+                rom->mapped_file = NULL;
+            } else {
+                g_free(rom->data);
+            }
             rom->data = NULL;
         }
         /*
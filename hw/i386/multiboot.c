@@ -144,148 +144,109 @@ static void mb_add_mod(MultibootState *s,
     s->mb_mods_count++;
 }
 
-int load_multiboot(FWCfgState *fw_cfg,
-                   FILE *f,
-                   const char *kernel_filename,
-                   const char *initrd_filename,
-                   const char *kernel_cmdline,
-                   int kernel_file_size,
-                   uint8_t *header)
+/* Find the multiboot header. It is 12x32bit long, so the latest entry may
+   be 8192 - 48. Returns its offset, or -1 if there is none.  */
+static int mb_find_header(const uint8_t *header, size_t size, uint32_t *flags)
 {
-    int i, is_multiboot = 0;
-    uint32_t flags = 0;
-    uint32_t mh_entry_addr;
-    uint32_t mh_load_addr;
-    uint32_t mb_kernel_size;
-    MultibootState mbs;
-    uint8_t bootinfo[MBI_SIZE];
-    uint8_t *mb_bootinfo_data;
-    uint32_t cmdline_len;
+    uint32_t checksum;
+    size_t i;
 
-    /* Ok, let's see if it is a multiboot image.
-       The header is 12x32bit long, so the latest entry may be 8192 - 48. */
-    for (i = 0; i < (8192 - 48); i += 4) {
+    size = MIN(size, 8192);
+    for (i = 0; i + 48 < size; i += 4) {
         if (ldl_p(header+i) == 0x1BADB002) {
-            uint32_t checksum = ldl_p(header+i+8);
-            flags = ldl_p(header+i+4);
-            checksum += flags;
+            checksum = ldl_p(header+i+8);
+            *flags = ldl_p(header+i+4);
+            checksum += *flags;
             checksum += (uint32_t)0x1BADB002;
             if (!checksum) {
-                is_multiboot = 1;
-                break;
+                return i;
             }
         }
     }
+    return -1;
+}
 
-    if (!is_multiboot)
-        return 0; /* no multiboot */
-
-    mb_debug("qemu: I believe we found a multiboot image!");
-    memset(bootinfo, 0, sizeof(bootinfo));
-    memset(&mbs, 0, sizeof(mbs));
-
-    if (flags & 0x00000004) { /* MULTIBOOT_HEADER_HAS_VBE */
-        error_report("qemu: multiboot knows VBE. we don't.");
+/* Layout of a kernel that sets MULTIBOOT_HEADER_HAS_ADDR */
+static void mb_get_layout(const uint8_t *header, int i,
+                          uint32_t kernel_file_size,
+                          uint32_t *load_addr, uint32_t *entry_addr,
+                          uint32_t *text_offset, uint32_t *load_size,
+                          uint32_t *kernel_size)
+{
+    uint32_t mh_header_addr = ldl_p(header+i+12);
+    uint32_t mh_load_end_addr = ldl_p(header+i+20);
+    uint32_t mh_bss_end_addr = ldl_p(header+i+24);
+    uint32_t mh_load_addr = ldl_p(header+i+16);
+    uint32_t mb_kernel_text_offset, mb_load_size;
+
+    if (mh_header_addr < mh_load_addr) {
+        error_report("invalid load_addr address");
+        exit(1);
+    }
+    if (mh_header_addr - mh_load_addr > i) {
+        error_report("invalid header_addr address");
+        exit(1);
     }
-    if (!(flags & 0x00010000)) { /* MULTIBOOT_HEADER_HAS_ADDR */
-        uint64_t elf_entry;
-        uint64_t elf_low, elf_high;
-        int kernel_size;
-        fclose(f);
 
-        if (((struct elf64_hdr*)header)->e_machine == EM_X86_64) {
-            error_report("Cannot load x86-64 image, give a 32bit one.");
-            exit(1);
-        }
+    mb_kernel_text_offset = i - (mh_header_addr - mh_load_addr);
+    mb_load_size = 0;
 
-        kernel_size = load_elf(kernel_filename, NULL, NULL, &elf_entry,
-                               &elf_low, &elf_high, 0, I386_ELF_MACHINE,
-                               0, 0);
-        if (kernel_size < 0) {
-            error_report("Error while loading elf kernel");
-            exit(1);
-        }
-        mh_load_addr = elf_low;
-        mb_kernel_size = elf_high - elf_low;
-        mh_entry_addr = elf_entry;
-
-        mbs.mb_buf = g_malloc(mb_kernel_size);
-        if (rom_copy(mbs.mb_buf, mh_load_addr, mb_kernel_size) != mb_kernel_size) {
-            error_report("Error while fetching elf kernel from rom");
+    if (mh_load_end_addr) {
+        if (mh_load_end_addr < mh_load_addr) {
+            error_report("invalid load_end_addr address");
             exit(1);
         }
-
-        mb_debug("qemu: loading multiboot-elf kernel "
-                 "(%#x bytes) with entry %#zx",
-                 mb_kernel_size, (size_t)mh_entry_addr);
+        mb_load_size = mh_load_end_addr - mh_load_addr;
     } else {
-        /* Valid if mh_flags sets MULTIBOOT_HEADER_HAS_ADDR. */
-        uint32_t mh_header_addr = ldl_p(header+i+12);
-        uint32_t mh_load_end_addr = ldl_p(header+i+20);
-        uint32_t mh_bss_end_addr = ldl_p(header+i+24);
-
-        mh_load_addr = ldl_p(header+i+16);
-        if (mh_header_addr < mh_load_addr) {
-            error_report("invalid load_addr address");
-            exit(1);
-        }
-        if (mh_header_addr - mh_load_addr > i) {
-            error_report("invalid header_addr address");
+        if (kernel_file_size < mb_kernel_text_offset) {
+            error_report("invalid kernel_file_size");
             exit(1);
         }
-
-        uint32_t mb_kernel_text_offset = i - (mh_header_addr - mh_load_addr);
-        uint32_t mb_load_size = 0;
-        mh_entry_addr = ldl_p(header+i+28);
-
-        if (mh_load_end_addr) {
-            if (mh_load_end_addr < mh_load_addr) {
-                error_report("invalid load_end_addr address");
-                exit(1);
-            }
-            mb_load_size = mh_load_end_addr - mh_load_addr;
-        } else {
-            if (kernel_file_size < mb_kernel_text_offset) {
-                error_report("invalid kernel_file_size");
-                exit(1);
-            }
-            mb_load_size = kernel_file_size - mb_kernel_text_offset;
-        }
-        if (mb_load_size > UINT32_MAX - mh_load_addr) {
-            error_report("kernel does not fit in address space");
+        mb_load_size = kernel_file_size - mb_kernel_text_offset;
+    }
+    if (mb_load_size > UINT32_MAX - mh_load_addr) {
+        error_report("kernel does not fit in address space");
+        exit(1);
+    }
+    if (mh_bss_end_addr) {
+        if (mh_bss_end_addr < (mh_load_addr + mb_load_size)) {
+            error_report("invalid bss_end_addr address");
             exit(1);
         }
-        if (mh_bss_end_addr) {
-            if (mh_bss_end_addr < (mh_load_addr + mb_load_size)) {
-                error_report("invalid bss_end_addr address");
-                exit(1);
-            }
-            mb_kernel_size = mh_bss_end_addr - mh_load_addr;
-        } else {
-            mb_kernel_size = mb_load_size;
-        }
+        *kernel_size = mh_bss_end_addr - mh_load_addr;
+    } else {
+        *kernel_size = mb_load_size;
+    }
 
-        mb_debug("multiboot: header_addr = %#x", mh_header_addr);
-        mb_debug("multiboot: load_addr = %#x", mh_load_addr);
-        mb_debug("multiboot: load_end_addr = %#x", mh_load_end_addr);
-        mb_debug("multiboot: bss_end_addr = %#x", mh_bss_end_addr);
-        mb_debug("qemu: loading multiboot kernel (%#x bytes) at %#x",
-                 mb_load_size, mh_load_addr);
+    mb_debug("multiboot: header_addr = %#x", mh_header_addr);
+    mb_debug("multiboot: load_addr = %#x", mh_load_addr);
+    mb_debug("multiboot: load_end_addr = %#x", mh_load_end_addr);
+    mb_debug("multiboot: bss_end_addr = %#x", mh_bss_end_addr);
+    mb_debug("qemu: loading multiboot kernel (%#x bytes) at %#x",
+             mb_load_size, mh_load_addr);
+
+    *load_addr = mh_load_addr;
+    *entry_addr = ldl_p(header+i+28);
+    *text_offset = mb_kernel_text_offset;
+    *load_size = mb_load_size;
+}
 
-        mbs.mb_buf = g_malloc(mb_kernel_size);
-        fseek(f, mb_kernel_text_offset, SEEK_SET);
-        if (fread(mbs.mb_buf, 1, mb_load_size, f) != mb_load_size) {
-            error_report("fread() failed");
-            exit(1);
-        }
-        memset(mbs.mb_buf + mb_load_size, 0, mb_kernel_size - mb_load_size);
-        fclose(f);
-    }
+/* Append the cmdlines, modules and multiboot info to the mb_kernel_size
+   bytes of mb_buf, and pass the whole buffer to the option rom.  */
+static void mb_setup_bootinfo(FWCfgState *fw_cfg, MultibootState *mbs,
+                              uint32_t mb_kernel_size, uint32_t mh_entry_addr,
+                              const char *kernel_filename,
+                              const char *initrd_filename,
+                              const char *kernel_cmdline)
+{
+    uint8_t bootinfo[MBI_SIZE];
+    uint8_t *mb_bootinfo_data;
+    uint32_t cmdline_len;
 
-    mbs.mb_buf_phys = mh_load_addr;
+    memset(bootinfo, 0, sizeof(bootinfo));
 
-    mbs.mb_buf_size = TARGET_PAGE_ALIGN(mb_kernel_size);
-    mbs.offset_mbinfo = mbs.mb_buf_size;
+    mbs->mb_buf_size = TARGET_PAGE_ALIGN(mb_kernel_size);
+    mbs->offset_mbinfo = mbs->mb_buf_size;
 
     /* Calculate space for cmdlines, bootloader name, and mb_mods */
     cmdline_len = strlen(kernel_filename) + 1;
@@ -293,40 +254,41 @@ int load_multiboot(FWCfgState *fw_cfg,
     if (initrd_filename) {
         const char *r = initrd_filename;
         cmdline_len += strlen(r) + 1;
-        mbs.mb_mods_avail = 1;
+        mbs->mb_mods_avail = 1;
         while (*(r = get_opt_value(NULL, 0, r))) {
-           mbs.mb_mods_avail++;
+           mbs->mb_mods_avail++;
            r++;
         }
     }
 
-    mbs.mb_buf_size += cmdline_len;
-    mbs.mb_buf_size += MB_MOD_SIZE * mbs.mb_mods_avail;
-    mbs.mb_buf_size += strlen(bootloader_name) + 1;
+    mbs->mb_buf_size += cmdline_len;
+    mbs->mb_buf_size += MB_MOD_SIZE * mbs->mb_mods_avail;
+    mbs->mb_buf_size += strlen(bootloader_name) + 1;
 
-    mbs.mb_buf_size = TARGET_PAGE_ALIGN(mbs.mb_buf_size);
+    mbs->mb_buf_size = TARGET_PAGE_ALIGN(mbs->mb_buf_size);
 
     /* enlarge mb_buf to hold cmdlines, bootloader, mb-info structs */
-    mbs.mb_buf            = g_realloc(mbs.mb_buf, mbs.mb_buf_size);
-    mbs.offset_cmdlines   = mbs.offset_mbinfo + mbs.mb_mods_avail * MB_MOD_SIZE;
-    mbs.offset_bootloader = mbs.offset_cmdlines + cmdline_len;
+    mbs->mb_buf            = g_realloc(mbs->mb_buf, mbs->mb_buf_size);
+    mbs->offset_cmdlines   = mbs->offset_mbinfo +
+                             mbs->mb_mods_avail * MB_MOD_SIZE;
+    mbs->offset_bootloader = mbs->offset_cmdlines + cmdline_len;
 
     if (initrd_filename) {
         const char *next_initrd;
         char not_last, tmpbuf[strlen(initrd_filename) + 1];
 
-        mbs.offset_mods = mbs.mb_buf_size;
+        mbs->offset_mods = mbs->mb_buf_size;
 
         do {
             char *next_space;
             int mb_mod_length;
-            uint32_t offs = mbs.mb_buf_size;
+            uint32_t offs = mbs->mb_buf_size;
 
             next_initrd = get_opt_value(tmpbuf, sizeof(tmpbuf), initrd_filename);
             not_last = *next_initrd;
             /* if a space comes after the module filename, treat everything
                after that as parameters */
-            hwaddr c = mb_add_cmdline(&mbs, tmpbuf);
+            hwaddr c = mb_add_cmdline(mbs, tmpbuf);
             if ((next_space = strchr(tmpbuf, ' ')))
                 *next_space = '\0';
             mb_debug("multiboot loading module: %s", tmpbuf);
@@ -336,16 +298,16 @@ int load_multiboot(FWCfgState *fw_cfg,
                 exit(1);
             }
 
-            mbs.mb_buf_size = TARGET_PAGE_ALIGN(mb_mod_length + mbs.mb_buf_size);
-            mbs.mb_buf = g_realloc(mbs.mb_buf, mbs.mb_buf_size);
+            mbs->mb_buf_size = TARGET_PAGE_ALIGN(mb_mod_length + mbs->mb_buf_size);
+            mbs->mb_buf = g_realloc(mbs->mb_buf, mbs->mb_buf_size);
 
-            load_image(tmpbuf, (unsigned char *)mbs.mb_buf + offs);
-            mb_add_mod(&mbs, mbs.mb_buf_phys + offs,
-                       mbs.mb_buf_phys + offs + mb_mod_length, c);
+            load_image(tmpbuf, (unsigned char *)mbs->mb_buf + offs);
+            mb_add_mod(mbs, mbs->mb_buf_phys + offs,
+                       mbs->mb_buf_phys + offs + mb_mod_length, c);
 
             mb_debug("mod_start: %p\nmod_end:   %p\n  cmdline: "TARGET_FMT_plx,
-                     (char *)mbs.mb_buf + offs,
-                     (char *)mbs.mb_buf + offs + mb_mod_length, c);
+                     (char *)mbs->mb_buf + offs,
+                     (char *)mbs->mb_buf + offs + mb_mod_length, c);
             initrd_filename = next_initrd+1;
         } while (not_last);
     }
@@ -354,12 +316,12 @@ int load_multiboot(FWCfgState *fw_cfg,
     char kcmdline[strlen(kernel_filename) + strlen(kernel_cmdline) + 2];
     snprintf(kcmdline, sizeof(kcmdline), "%s %s",
              kernel_filename, kernel_cmdline);
-    stl_p(bootinfo + MBI_CMDLINE, mb_add_cmdline(&mbs, kcmdline));
+    stl_p(bootinfo + MBI_CMDLINE, mb_add_cmdline(mbs, kcmdline));
 
-    stl_p(bootinfo + MBI_BOOTLOADER, mb_add_bootloader(&mbs, bootloader_name));
+    stl_p(bootinfo + MBI_BOOTLOADER, mb_add_bootloader(mbs, bootloader_name));
 
-    stl_p(bootinfo + MBI_MODS_ADDR,  mbs.mb_buf_phys + mbs.offset_mbinfo);
-    stl_p(bootinfo + MBI_MODS_COUNT, mbs.mb_mods_count); /* mods_count */
+    stl_p(bootinfo + MBI_MODS_ADDR,  mbs->mb_buf_phys + mbs->offset_mbinfo);
+    stl_p(bootinfo + MBI_MODS_COUNT, mbs->mb_mods_count); /* mods_count */
 
     /* the kernel is where we want it to be now */
     stl_p(bootinfo + MBI_FLAGS, MULTIBOOT_FLAGS_MEMORY
@@ -372,20 +334,20 @@ int load_multiboot(FWCfgState *fw_cfg,
     stl_p(bootinfo + MBI_MMAP_ADDR,   ADDR_E820_MAP);
 
     mb_debug("multiboot: entry_addr = %#x", mh_entry_addr);
-    mb_debug("           mb_buf_phys   = "TARGET_FMT_plx, mbs.mb_buf_phys);
+    mb_debug("           mb_buf_phys   = "TARGET_FMT_plx, mbs->mb_buf_phys);
     mb_debug("           mod_start     = "TARGET_FMT_plx,
-             mbs.mb_buf_phys + mbs.offset_mods);
-    mb_debug("           mb_mods_count = %d", mbs.mb_mods_count);
+             mbs->mb_buf_phys + mbs->offset_mods);
+    mb_debug("           mb_mods_count = %d", mbs->mb_mods_count);
 
     /* save bootinfo off the stack */
     mb_bootinfo_data = g_memdup(bootinfo, sizeof(bootinfo));
 
     /* Pass variables to option rom */
     fw_cfg_add_i32(fw_cfg, FW_CFG_KERNEL_ENTRY, mh_entry_addr);
-    fw_cfg_add_i32(fw_cfg, FW_CFG_KERNEL_ADDR, mh_load_addr);
-    fw_cfg_add_i32(fw_cfg, FW_CFG_KERNEL_SIZE, mbs.mb_buf_size);
+    fw_cfg_add_i32(fw_cfg, FW_CFG_KERNEL_ADDR, mbs->mb_buf_phys);
+    fw_cfg_add_i32(fw_cfg, FW_CFG_KERNEL_SIZE, mbs->mb_buf_size);
     fw_cfg_add_bytes(fw_cfg, FW_CFG_KERNEL_DATA,
-                     mbs.mb_buf, mbs.mb_buf_size);
+                     mbs->mb_buf, mbs->mb_buf_size);
 
     fw_cfg_add_i32(fw_cfg, FW_CFG_INITRD_ADDR, ADDR_MBI);
     fw_cfg_add_i32(fw_cfg, FW_CFG_INITRD_SIZE, sizeof(bootinfo));
@@ -395,6 +357,226 @@ int load_multiboot(FWCfgState *fw_cfg,
     option_rom[nb_option_roms].name = "multiboot.bin";
     option_rom[nb_option_roms].bootindex = 0;
     nb_option_roms++;
+}
+
+int load_multiboot(FWCfgState *fw_cfg,
+                   FILE *f,
+                   const char *kernel_filename,
+                   const char *initrd_filename,
+                   const char *kernel_cmdline,
+                   int kernel_file_size,
+                   uint8_t *header)
+{
+    int i;
+    uint32_t flags = 0;
+    uint32_t mh_entry_addr;
+    uint32_t mh_load_addr;
+    uint32_t mb_kernel_size;
+    MultibootState mbs;
+
+    /* Ok, let's see if it is a multiboot image. */
+    i = mb_find_header(header, 8192, &flags);
+    if (i < 0)
+        return 0; /* no multiboot */
+
+    mb_debug("qemu: I believe we found a multiboot image!");
+    memset(&mbs, 0, sizeof(mbs));
+
+    if (flags & 0x00000004) { /* MULTIBOOT_HEADER_HAS_VBE */
+        error_report("qemu: multiboot knows VBE. we don't.");
+    }
+    if (!(flags & 0x00010000)) { /* MULTIBOOT_HEADER_HAS_ADDR */
+        uint64_t elf_entry;
+        uint64_t elf_low, elf_high;
+        int kernel_size;
+        fclose(f);
+
+        if (((struct elf64_hdr*)header)->e_machine == EM_X86_64) {
+            error_report("Cannot load x86-64 image, give a 32bit one.");
+            exit(1);
+        }
+
+        kernel_size = load_elf(kernel_filename, NULL, NULL, &elf_entry,
+                               &elf_low, &elf_high, 0, I386_ELF_MACHINE,
+                               0, 0);
+        if (kernel_size < 0) {
+            error_report("Error while loading elf kernel");
+            exit(1);
+        }
+        mh_load_addr = elf_low;
+        mb_kernel_size = elf_high - elf_low;
+        mh_entry_addr = elf_entry;
+
+        mbs.mb_buf = g_malloc(mb_kernel_size);
+        if (rom_copy(mbs.mb_buf, mh_load_addr, mb_kernel_size) != mb_kernel_size) {
+            error_report("Error while fetching elf kernel from rom");
+            exit(1);
+        }
+
+        mb_debug("qemu: loading multiboot-elf kernel "
+                 "(%#x bytes) with entry %#zx",
+                 mb_kernel_size, (size_t)mh_entry_addr);
+    } else {
+        uint32_t mb_kernel_text_offset, mb_load_size;
+
+        mb_get_layout(header, i, kernel_file_size, &mh_load_addr,
+                      &mh_entry_addr, &mb_kernel_text_offset, &mb_load_size,
+                      &mb_kernel_size);
+
+        mbs.mb_buf = g_malloc(mb_kernel_size);
+        fseek(f, mb_kernel_text_offset, SEEK_SET);
+        if (fread(mbs.mb_buf, 1, mb_load_size, f) != mb_load_size) {
+            error_report("fread() failed");
+            exit(1);
+        }
+        memset(mbs.mb_buf + mb_load_size, 0, mb_kernel_size - mb_load_size);
+        fclose(f);
+    }
+
+    mbs.mb_buf_phys = mh_load_addr;
+    mb_setup_bootinfo(fw_cfg, &mbs, mb_kernel_size, mh_entry_addr,
+                      kernel_filename, initrd_filename, kernel_cmdline);
+
+    return 1; /* yes, we are multiboot */
+}
+
+/* Add the loadable segments of a 32-bit ELF kernel as roms that reference
+   the file mapping, and return its extent.  */
+static void mb_map_elf(GMappedFile *kernel, const char *kernel_filename,
+                       uint32_t *entry, uint32_t *low, uint32_t *high)
+{
+    const uint8_t *data = (const uint8_t *)g_mapped_file_get_contents(kernel);
+    size_t size = g_mapped_file_get_length(kernel);
+    uint64_t elf_low = UINT64_MAX, elf_high = 0;
+    uint32_t phoff;
+    uint16_t phnum, phentsize;
+    Elf32_Ehdr ehdr;
+    Elf32_Phdr phdr;
+    char label[128];
+    int i;
+
+    if (size < sizeof(ehdr)) {
+        goto fail;
+    }
+    memcpy(&ehdr, data, sizeof(ehdr));
+    if (lduw_le_p(&ehdr.e_machine) == EM_X86_64) {
+        error_report("Cannot load x86-64 image, give a 32bit one.");
+        exit(1);
+    }
+    if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) ||
+        ehdr.e_ident[EI_CLASS] != ELFCLASS32 ||
+        ehdr.e_ident[EI_DATA] != ELFDATA2LSB ||
+        lduw_le_p(&ehdr.e_machine) != EM_386) {
+        goto fail;
+    }
+
+    phoff = ldl_le_p(&ehdr.e_phoff);
+    phnum = lduw_le_p(&ehdr.e_phnum);
+    phentsize = lduw_le_p(&ehdr.e_phentsize);
+    if (phentsize < sizeof(phdr) || phoff > size ||
+        (uint64_t)phnum * phentsize > size - phoff) {
+        goto fail;
+    }
+
+    for (i = 0; i < phnum; i++) {
+        uint32_t offset, addr, filesz, memsz;
+
+        memcpy(&phdr, data + phoff + i * phentsize, sizeof(phdr));
+        if (ldl_le_p(&phdr.p_type) != PT_LOAD) {
+            continue;
+        }
+        offset = ldl_le_p(&phdr.p_offset);
+        addr = ldl_le_p(&phdr.p_paddr);
+        filesz = ldl_le_p(&phdr.p_filesz);
+        memsz = ldl_le_p(&phdr.p_memsz);
+        if (filesz > memsz || offset > size || filesz > size - offset) {
+            goto fail;
+        }
+        if (memsz == 0) {
+            continue;
+        }
+
+        snprintf(label, sizeof(label), "phdr #%d: %s", i, kernel_filename);
+        rom_add_elf_program(label, kernel, (void *)(data + offset),
+                            filesz, memsz, addr, NULL);
+        elf_low = MIN(elf_low, addr);
+        elf_high = MAX(elf_high, (uint64_t)addr + memsz);
+    }
+    if (elf_high == 0 || elf_high > UINT32_MAX) {
+        goto fail;
+    }
+
+    *entry = ldl_le_p(&ehdr.e_entry);
+    *low = elf_low;
+    *high = elf_high;
+    mb_debug("qemu: mapped multiboot-elf kernel "
+             "(%#x bytes) with entry %#x", *high - *low, *entry);
+    return;
+
+fail:
+    error_report("Error while loading elf kernel");
+    exit(1);
+}
+
+int load_multiboot_mapped(FWCfgState *fw_cfg,
+                          GMappedFile *kernel,
+                          const char *kernel_filename,
+                          const char *initrd_filename,
+                          const char *kernel_cmdline)
+{
+    const uint8_t *data = (const uint8_t *)g_mapped_file_get_contents(kernel);
+    size_t size = g_mapped_file_get_length(kernel);
+    uint32_t flags = 0;
+    uint32_t mh_entry_addr;
+    uint32_t mh_load_addr;
+    uint32_t mb_kernel_end;
+    MultibootState mbs;
+    int i;
+
+    i = mb_find_header(data, size, &flags);
+    if (i < 0) {
+        return 0; /* no multiboot */
+    }
+
+    mb_debug("qemu: I believe we found a multiboot image!");
+    memset(&mbs, 0, sizeof(mbs));
+
+    if (flags & 0x00000004) { /* MULTIBOOT_HEADER_HAS_VBE */
+        error_report("qemu: multiboot knows VBE. we don't.");
+    }
+    if (!(flags & 0x00010000)) { /* MULTIBOOT_HEADER_HAS_ADDR */
+        mb_map_elf(kernel, kernel_filename, &mh_entry_addr, &mh_load_addr,
+                   &mb_kernel_end);
+    } else {
+        uint32_t mb_kernel_text_offset, mb_load_size, mb_kernel_size;
+
+        if (size > UINT32_MAX) {
+            error_report("invalid kernel_file_size");
+            exit(1);
+        }
+        mb_get_layout(data, i, size, &mh_load_addr, &mh_entry_addr,
+                      &mb_kernel_text_offset, &mb_load_size,
+                      &mb_kernel_size);
+        if (mb_kernel_text_offset > size ||
+            mb_load_size > size - mb_kernel_text_offset) {
+            error_report("kernel '%s' is truncated", kernel_filename);
+            exit(1);
+        }
+        if (mb_kernel_size) {
+            rom_add_elf_program(kernel_filename, kernel,
+                                (void *)(data + mb_kernel_text_offset),
+                                mb_load_size, mb_kernel_size,
+                                mh_load_addr, NULL);
+        }
+        mb_kernel_end = mh_load_addr + mb_kernel_size;
+    }
+
+    /* The kernel itself is put in place by the rom loader, so only the
+       info that follows it goes through fw_cfg */
+    mbs.mb_buf_phys = mh_load_addr +
+                      TARGET_PAGE_ALIGN(mb_kernel_end - mh_load_addr);
+    mb_setup_bootinfo(fw_cfg, &mbs, 0, mh_entry_addr,
+                      kernel_filename, initrd_filename, kernel_cmdline);
 
     return 1; /* yes, we are multiboot */
 }
@@ -10,5 +10,10 @@ int load_multiboot(FWCfgState *fw_cfg,
                    const char *kernel_cmdline,
                    int kernel_file_size,
                    uint8_t *header);
+int load_multiboot_mapped(FWCfgState *fw_cfg,
+                          GMappedFile *kernel,
+                          const char *kernel_filename,
+                          const char *initrd_filename,
+                          const char *kernel_cmdline);
 
 #endif
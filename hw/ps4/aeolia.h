@@ -65,9 +65,9 @@ typedef struct aeolia_icc_message_t {
 } QEMU_PACKED aeolia_icc_message_t;
 
 /* aeolia_pcie.c */
-void aeolia_pcie_set_icc_data(PCIDevice* dev, char* icc_data);
+void aeolia_pcie_set_icc_region(PCIDevice* dev, MemoryRegion* mr);
 
 /* aeolia_mem.c */
-char* aeolia_mem_get_icc_data(PCIDevice* dev);
+MemoryRegion* aeolia_mem_get_icc_region(PCIDevice* dev);
 
 #endif /* HW_PS4_AEOLIA_H */
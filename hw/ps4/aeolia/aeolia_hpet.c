@@ -35,6 +35,7 @@
 #include "hw/timer/mc146818rtc.h"
 #include "hw/timer/i8254.h"
 #include "aeolia_hpet.h"
+#include "hw/ps4/ps4_timebase.h"
 
 //#define HPET_DEBUG
 #ifdef HPET_DEBUG
@@ -128,12 +129,12 @@ static uint32_t hpet_time_after64(uint64_t a, uint64_t b)
 
 static uint64_t ticks_to_ns(uint64_t value)
 {
-    return value * HPET_CLK_PERIOD;
+    return ps4_timebase_ticks_to_ns(PS4_CLOCK_HPET, value);
 }
 
 static uint64_t ns_to_ticks(uint64_t value)
 {
-    return value / HPET_CLK_PERIOD;
+    return ps4_timebase_ns_to_ticks(PS4_CLOCK_HPET, value);
 }
 
 static uint64_t hpet_fixup_reg(uint64_t new, uint64_t old, uint64_t mask)
@@ -155,7 +156,7 @@ static int deactivating_bit(uint64_t old, uint64_t new, uint64_t mask)
 
 static uint64_t hpet_get_ticks(AeoliaHPETState *s)
 {
-    return ns_to_ticks(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + s->hpet_offset);
+    return ns_to_ticks(ps4_timebase_ns() + s->hpet_offset);
 }
 
 /*
@@ -250,7 +251,7 @@ static int hpet_post_load(void *opaque, int version_id)
     AeoliaHPETState *s = opaque;
 
     /* Recalculate the offset between the main counter and guest time */
-    s->hpet_offset = ticks_to_ns(s->hpet_counter) - qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->hpet_offset = ticks_to_ns(s->hpet_counter) - ps4_timebase_ns();
 
     /* Push number of timers into capability returned via HPET_ID */
     s->capability &= ~HPET_ID_NUM_TIM_MASK;
@@ -334,22 +335,27 @@ static void hpet_timer(void *opaque)
     uint64_t cur_tick = hpet_get_ticks(t->state);
 
     if (timer_is_periodic(t) && period != 0) {
+        /* Periods missed while the host was busy elsewhere are folded into
+         * this single interrupt, the comparator skips straight past them */
         if (t->config & HPET_TN_32BIT) {
-            while (hpet_time_after(cur_tick, t->cmp)) {
-                t->cmp = (uint32_t)(t->cmp + t->period);
+            if (hpet_time_after(cur_tick, t->cmp)) {
+                uint32_t missed = (uint32_t)cur_tick - (uint32_t)t->cmp;
+                t->cmp = (uint32_t)(t->cmp +
+                    ((uint32_t)period) * (missed / (uint32_t)period + 1));
             }
         } else {
-            while (hpet_time_after64(cur_tick, t->cmp)) {
-                t->cmp += period;
+            if (hpet_time_after64(cur_tick, t->cmp)) {
+                uint64_t missed = cur_tick - t->cmp;
+                t->cmp += period * (missed / period + 1);
             }
         }
         diff = hpet_calculate_diff(t, cur_tick);
         timer_mod(t->qemu_timer,
-                       qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + (int64_t)ticks_to_ns(diff));
+                       ps4_timebase_ns() + (int64_t)ticks_to_ns(diff));
     } else if (t->config & HPET_TN_32BIT && !timer_is_periodic(t)) {
         if (t->wrap_flag) {
             diff = hpet_calculate_diff(t, cur_tick);
-            timer_mod(t->qemu_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+            timer_mod(t->qemu_timer, ps4_timebase_ns() +
                            (int64_t)ticks_to_ns(diff));
             t->wrap_flag = 0;
         }
@@ -378,7 +384,7 @@ static void hpet_set_timer(HPETTimer *t)
         }
     }
     timer_mod(t->qemu_timer,
-                   qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + (int64_t)ticks_to_ns(diff));
+                   ps4_timebase_ns() + (int64_t)ticks_to_ns(diff));
 }
 
 static void hpet_del_timer(HPETTimer *t)
@@ -580,7 +586,7 @@ static void hpet_ram_write(void *opaque, hwaddr addr,
             if (activating_bit(old_val, new_val, HPET_CFG_ENABLE)) {
                 /* Enable main counter and interrupt generation. */
                 s->hpet_offset =
-                    ticks_to_ns(s->hpet_counter) - qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+                    ticks_to_ns(s->hpet_counter) - ps4_timebase_ns();
                 for (i = 0; i < s->num_timers; i++) {
                     if ((&s->timer[i])->cmp != ~0ULL) {
                         hpet_set_timer(&s->timer[i]);
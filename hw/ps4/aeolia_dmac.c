@@ -17,40 +17,429 @@
  * License along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * Each BAR of the Aeolia DMAC exposes an engine of four memory-to-memory
+ * channels. Transfers are either a single contiguous block or a list of
+ * descriptors, and are run by a worker thread that only holds the iothread
+ * lock to translate addresses (through the Liverpool IOMMU) and to update
+ * the registers, so the copies themselves neither stall the vCPUs nor the
+ * main loop. The lock is also released after every round-robin pass over
+ * the channels, so no guest-built descriptor list can hold it for long.
+ * Completion is signaled with MSI.
+ */
+
 #include "aeolia.h"
 #include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qemu/thread.h"
+#include "hw/hw.h"
 #include "hw/pci/pci.h"
 #include "hw/pci/msi.h"
+#include "sysemu/dma.h"
+#include "sysemu/sysemu.h"
 
 #define AEOLIA_DMAC(obj) OBJECT_CHECK(AeoliaDMACState, (obj), TYPE_AEOLIA_DMAC)
 
-typedef struct AeoliaDMACState {
+#define ADMAC_ENGINES           2
+#define ADMAC_CHANNELS          4
+
+/* Channel registers, at 0x40 * channel */
+#define ADMAC_CH_STRIDE         0x40
+#define ADMAC_CH_SRC_LO         0x00
+#define ADMAC_CH_SRC_HI         0x04
+#define ADMAC_CH_DST_LO         0x08
+#define ADMAC_CH_DST_HI         0x0C
+#define ADMAC_CH_LEN            0x10
+#define ADMAC_CH_CTRL           0x14
+#define   CTRL_START            (1 << 0)
+#define   CTRL_IRQ_EN           (1 << 1)
+#define   CTRL_SG               (1 << 2)  /* SRC points to a descriptor list */
+#define   CTRL_ABORT            (1 << 3)
+#define   CTRL_MASK             (CTRL_IRQ_EN | CTRL_SG)
+#define ADMAC_CH_STATUS         0x18
+#define   STATUS_BUSY           (1 << 0)
+#define   STATUS_DONE           (1 << 1)
+#define   STATUS_ERROR          (1 << 2)
+#define ADMAC_CH_XFERRED        0x1C
+
+/* Engine registers */
+#define ADMAC_IRQ_STATUS        0x800  /* one bit per channel, W1C */
+#define ADMAC_IRQ_MASK          0x804
+
+/* Descriptor flags */
+#define DESC_END                (1 << 0)
+#define DESC_LINK               (1 << 1)  /* continue the list at SRC */
+
+/* Largest block copied per iothread lock release */
+#define ADMAC_CHUNK_SIZE        0x100000
+/* Copies between non-RAM regions go through this buffer */
+#define ADMAC_BOUNCE_SIZE       0x1000
+/* Descriptors without data fetched in a row before the list is rejected */
+#define ADMAC_FETCH_MAX         16
+
+typedef struct admac_desc_t {
+    uint64_t src;
+    uint64_t dst;
+    uint32_t len;
+    uint32_t flags;
+} QEMU_PACKED admac_desc_t;
+
+typedef struct admac_channel_t {
+    /* registers */
+    uint64_t src;
+    uint64_t dst;
+    uint32_t len;
+    uint32_t ctrl;
+    uint32_t status;
+    uint32_t xferred;
+
+    /* transfer */
+    uint64_t cur_src;
+    uint64_t cur_dst;
+    uint32_t cur_len;
+    uint64_t desc;
+    bool last;
+    uint32_t seq;   /* bumped when the transfer is cancelled */
+    uint32_t links;         /* LINK descriptors followed so far */
+    uint64_t link_mark;     /* LINK target checked for cycles */
+} admac_channel_t;
+
+typedef struct AeoliaDMACState AeoliaDMACState;
+
+typedef struct admac_engine_t {
+    AeoliaDMACState *s;
+    admac_channel_t ch[ADMAC_CHANNELS];
+    uint32_t irq_status;
+    uint32_t irq_mask;
+} admac_engine_t;
+
+struct AeoliaDMACState {
     /*< private >*/
     PCIDevice parent_obj;
     /*< public >*/
-    MemoryRegion iomem[2];
-} AeoliaDMACState;
+    MemoryRegion iomem[ADMAC_ENGINES];
+    admac_engine_t engine[ADMAC_ENGINES];
+
+    /* worker */
+    QemuThread thread;
+    QemuSemaphore sem;
+    VMChangeStateEntry *vmstate;
+    QemuEvent copy_done;    /* reset while copying without the lock */
+    bool stopping;
+    uint8_t bounce[ADMAC_BOUNCE_SIZE];
+};
+
+/* interrupts */
+static void admac_raise(admac_engine_t *e, uint32_t bits)
+{
+    PCIDevice *dev = PCI_DEVICE(e->s);
+
+    e->irq_status |= bits;
+    if ((bits & ~e->irq_mask) && msi_enabled(dev)) {
+        msi_notify(dev, 0);
+    }
+}
+
+/* transfers (called with the iothread lock held) */
+static void admac_complete(admac_engine_t *e, int n, bool error)
+{
+    admac_channel_t *ch = &e->ch[n];
+
+    ch->status &= ~STATUS_BUSY;
+    ch->status |= error ? STATUS_ERROR : STATUS_DONE;
+    if (ch->ctrl & CTRL_IRQ_EN) {
+        admac_raise(e, 1 << n);
+    }
+}
 
+static void admac_start(admac_engine_t *e, int n)
+{
+    admac_channel_t *ch = &e->ch[n];
+
+    ch->status = STATUS_BUSY;
+    ch->xferred = 0;
+    if (ch->ctrl & CTRL_SG) {
+        ch->desc = ch->src;
+        ch->cur_len = 0;
+        ch->last = false;
+        ch->links = 0;
+        ch->link_mark = 0;
+    } else {
+        ch->cur_src = ch->src;
+        ch->cur_dst = ch->dst;
+        ch->cur_len = ch->len;
+        ch->last = true;
+    }
+    qemu_sem_post(&e->s->sem);
+}
+
+static void admac_cancel(admac_channel_t *ch)
+{
+    ch->seq++;
+    ch->cur_len = 0;
+    if (ch->status & STATUS_BUSY) {
+        ch->status = STATUS_ERROR;
+    }
+}
+
+/* Fetches the next descriptor. Returns false on error, including a LINK
+ * back to a descriptor already visited: every cycle in a list goes through
+ * a LINK, so Brent's cycle detection on the sequence of LINK targets
+ * catches it within a couple of turns around the cycle. */
+static bool admac_fetch(AddressSpace *as, admac_channel_t *ch)
+{
+    admac_desc_t desc;
+    uint64_t target;
+
+    if (dma_memory_read(as, ch->desc, &desc, sizeof(desc))) {
+        return false;
+    }
+    if (le32_to_cpu(desc.flags) & DESC_LINK) {
+        target = le64_to_cpu(desc.src);
+        if (ch->links && target == ch->link_mark) {
+            return false;
+        }
+        ch->links++;
+        if (is_power_of_2(ch->links)) {
+            ch->link_mark = target;
+        }
+        ch->desc = target;
+        return true;
+    }
+    ch->desc += sizeof(desc);
+    ch->cur_src = le64_to_cpu(desc.src);
+    ch->cur_dst = le64_to_cpu(desc.dst);
+    ch->cur_len = le32_to_cpu(desc.len);
+    ch->last = le32_to_cpu(desc.flags) & DESC_END;
+    return true;
+}
+
+/* Copies the next chunk of a transfer, releasing the iothread lock while
+ * copying between mapped RAM. Returns false on error. */
+static bool admac_copy(AeoliaDMACState *s, admac_channel_t *ch)
+{
+    AddressSpace *as = pci_get_address_space(PCI_DEVICE(s));
+    dma_addr_t len = MIN(ch->cur_len, ADMAC_CHUNK_SIZE);
+    dma_addr_t src_len = len, dst_len = len;
+    uint32_t seq = ch->seq;
+    void *src, *dst;
+
+    src = dma_memory_map(as, ch->cur_src, &src_len, DMA_DIRECTION_TO_DEVICE);
+    dst = NULL;
+    if (src) {
+        dst_len = MIN(src_len, dst_len);
+        dst = dma_memory_map(as, ch->cur_dst, &dst_len,
+            DMA_DIRECTION_FROM_DEVICE);
+    }
+    if (!dst) {
+        if (src) {
+            dma_memory_unmap(as, src, src_len, DMA_DIRECTION_TO_DEVICE, 0);
+        }
+        len = MIN(len, ADMAC_BOUNCE_SIZE);
+        if (dma_memory_read(as, ch->cur_src, s->bounce, len) ||
+            dma_memory_write(as, ch->cur_dst, s->bounce, len)) {
+            return false;
+        }
+    } else {
+        len = dst_len;
+        qemu_event_reset(&s->copy_done);
+        qemu_mutex_unlock_iothread();
+        memmove(dst, src, len);
+        qemu_event_set(&s->copy_done);
+        qemu_mutex_lock_iothread();
+        dma_memory_unmap(as, dst, dst_len, DMA_DIRECTION_FROM_DEVICE, len);
+        dma_memory_unmap(as, src, src_len, DMA_DIRECTION_TO_DEVICE, len);
+        if (seq != ch->seq) {
+            return true;
+        }
+    }
+    ch->cur_src += len;
+    ch->cur_dst += len;
+    ch->cur_len -= len;
+    ch->xferred += len;
+    return true;
+}
+
+/* Advances the transfer of a busy channel. Descriptors are fetched until
+ * one carries data, at most ADMAC_FETCH_MAX of them: longer runs of LINK
+ * or empty descriptors fail the channel. */
+static void admac_step(admac_engine_t *e, int n)
+{
+    AddressSpace *as = pci_get_address_space(PCI_DEVICE(e->s));
+    admac_channel_t *ch = &e->ch[n];
+    int i;
+
+    for (i = 0; !ch->cur_len; i++) {
+        if (ch->last) {
+            admac_complete(e, n, false);
+            return;
+        }
+        if (i == ADMAC_FETCH_MAX || !admac_fetch(as, ch)) {
+            admac_complete(e, n, true);
+            return;
+        }
+    }
+    if (!admac_copy(e->s, ch)) {
+        admac_complete(e, n, true);
+    }
+}
+
+static void *aeolia_dmac_thread(void *arg)
+{
+    AeoliaDMACState *s = arg;
+    admac_engine_t *e;
+    bool busy;
+    int i, n;
+
+    rcu_register_thread();
+    qemu_mutex_lock_iothread();
+    while (!s->stopping) {
+        // Channels are served a chunk at a time, in round-robin
+        busy = false;
+        for (i = 0; i < ADMAC_ENGINES && runstate_is_running(); i++) {
+            e = &s->engine[i];
+            for (n = 0; n < ADMAC_CHANNELS; n++) {
+                if (e->ch[n].status & STATUS_BUSY) {
+                    admac_step(e, n);
+                    busy = true;
+                }
+            }
+        }
+        qemu_mutex_unlock_iothread();
+        if (!busy) {
+            qemu_sem_wait(&s->sem);
+        }
+        qemu_mutex_lock_iothread();
+    }
+    qemu_mutex_unlock_iothread();
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void aeolia_dmac_vm_state_change(void *opaque, int running,
+    RunState state)
+{
+    AeoliaDMACState *s = opaque;
+
+    if (running) {
+        qemu_sem_post(&s->sem);
+    } else {
+        /* No copy starts once the VM is stopped, but one may still be
+         * running without the lock: guest memory must be settled before
+         * the VM is treated as stopped. */
+        qemu_event_wait(&s->copy_done);
+    }
+}
+
+/* registers */
 static uint64_t aeolia_dmac_read(
     void *opaque, hwaddr addr, unsigned size)
 {
-    return 0;
+    admac_engine_t *e = opaque;
+    admac_channel_t *ch;
+
+    switch (addr) {
+    case ADMAC_IRQ_STATUS:
+        return e->irq_status;
+    case ADMAC_IRQ_MASK:
+        return e->irq_mask;
+    }
+    if (addr >= ADMAC_CH_STRIDE * ADMAC_CHANNELS) {
+        return 0;
+    }
+    ch = &e->ch[addr / ADMAC_CH_STRIDE];
+    switch (addr % ADMAC_CH_STRIDE) {
+    case ADMAC_CH_SRC_LO:
+        return (uint32_t)ch->src;
+    case ADMAC_CH_SRC_HI:
+        return ch->src >> 32;
+    case ADMAC_CH_DST_LO:
+        return (uint32_t)ch->dst;
+    case ADMAC_CH_DST_HI:
+        return ch->dst >> 32;
+    case ADMAC_CH_LEN:
+        return ch->len;
+    case ADMAC_CH_CTRL:
+        return ch->ctrl;
+    case ADMAC_CH_STATUS:
+        return ch->status;
+    case ADMAC_CH_XFERRED:
+        return ch->xferred;
+    default:
+        return 0;
+    }
 }
 
 static void aeolia_dmac_write(
     void *opaque, hwaddr addr, uint64_t value, unsigned size)
 {
+    admac_engine_t *e = opaque;
+    admac_channel_t *ch;
+    int n;
+
+    switch (addr) {
+    case ADMAC_IRQ_STATUS:
+        e->irq_status &= ~value;
+        return;
+    case ADMAC_IRQ_MASK:
+        e->irq_mask = value & ((1 << ADMAC_CHANNELS) - 1);
+        /* Unmasking pending channels signals them */
+        if (e->irq_status & ~e->irq_mask) {
+            admac_raise(e, e->irq_status);
+        }
+        return;
+    }
+    if (addr >= ADMAC_CH_STRIDE * ADMAC_CHANNELS) {
+        return;
+    }
+    n = addr / ADMAC_CH_STRIDE;
+    ch = &e->ch[n];
+    switch (addr % ADMAC_CH_STRIDE) {
+    case ADMAC_CH_SRC_LO:
+        ch->src = deposit64(ch->src, 0, 32, value);
+        break;
+    case ADMAC_CH_SRC_HI:
+        ch->src = deposit64(ch->src, 32, 32, value);
+        break;
+    case ADMAC_CH_DST_LO:
+        ch->dst = deposit64(ch->dst, 0, 32, value);
+        break;
+    case ADMAC_CH_DST_HI:
+        ch->dst = deposit64(ch->dst, 32, 32, value);
+        break;
+    case ADMAC_CH_LEN:
+        ch->len = value;
+        break;
+    case ADMAC_CH_CTRL:
+        if (value & CTRL_ABORT) {
+            admac_cancel(ch);
+            break;
+        }
+        ch->ctrl = value & CTRL_MASK;
+        if ((value & CTRL_START) && !(ch->status & STATUS_BUSY)) {
+            admac_start(e, n);
+        }
+        break;
+    case ADMAC_CH_STATUS:
+        ch->status &= ~(value & (STATUS_DONE | STATUS_ERROR));
+        break;
+    }
 }
 
 static const MemoryRegionOps aeolia_dmac_ops = {
     .read = aeolia_dmac_read,
     .write = aeolia_dmac_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
 };
 
 static void aeolia_dmac_realize(PCIDevice *dev, Error **errp)
 {
     AeoliaDMACState *s = AEOLIA_DMAC(dev);
+    int i;
 
     // PCI Configuration Space
     dev->config[PCI_CLASS_PROG] = 0x05;
@@ -60,17 +449,117 @@ static void aeolia_dmac_realize(PCIDevice *dev, Error **errp)
     }
 
     // Memory
+    for (i = 0; i < ADMAC_ENGINES; i++) {
+        s->engine[i].s = s;
+    }
     memory_region_init_io(&s->iomem[0], OBJECT(dev),
-        &aeolia_dmac_ops, s, "aeolia-dmac-0", 0x1000);
+        &aeolia_dmac_ops, &s->engine[0], "aeolia-dmac-0", 0x1000);
     memory_region_init_io(&s->iomem[1], OBJECT(dev),
-        &aeolia_dmac_ops, s, "aeolia-dmac-1", 0x1000);
+        &aeolia_dmac_ops, &s->engine[1], "aeolia-dmac-1", 0x1000);
 
     pci_register_bar(dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[0]);
     pci_register_bar(dev, 2, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[1]);
+
+    // Worker
+    qemu_sem_init(&s->sem, 0);
+    qemu_event_init(&s->copy_done, true);
+    s->vmstate = qemu_add_vm_change_state_handler(
+        aeolia_dmac_vm_state_change, s);
+    qemu_thread_create(&s->thread, "aeolia-dmac",
+        aeolia_dmac_thread, s, QEMU_THREAD_JOINABLE);
 }
 
+static void aeolia_dmac_exit(PCIDevice *dev)
+{
+    AeoliaDMACState *s = AEOLIA_DMAC(dev);
+
+    s->stopping = true;
+    qemu_sem_post(&s->sem);
+    qemu_mutex_unlock_iothread();
+    qemu_thread_join(&s->thread);
+    qemu_mutex_lock_iothread();
+    qemu_del_vm_change_state_handler(s->vmstate);
+    qemu_event_destroy(&s->copy_done);
+    qemu_sem_destroy(&s->sem);
+    msi_uninit(dev);
+}
+
+static void aeolia_dmac_reset(DeviceState *dev)
+{
+    AeoliaDMACState *s = AEOLIA_DMAC(dev);
+    admac_engine_t *e;
+    uint32_t seq;
+    int i, n;
+
+    for (i = 0; i < ADMAC_ENGINES; i++) {
+        e = &s->engine[i];
+        for (n = 0; n < ADMAC_CHANNELS; n++) {
+            seq = e->ch[n].seq + 1;
+            memset(&e->ch[n], 0, sizeof(e->ch[n]));
+            e->ch[n].seq = seq;
+        }
+        e->irq_status = 0;
+        e->irq_mask = 0;
+    }
+}
+
+static int aeolia_dmac_post_load(void *opaque, int version_id)
+{
+    AeoliaDMACState *s = opaque;
+
+    qemu_sem_post(&s->sem);
+    return 0;
+}
+
+static const VMStateDescription vmstate_admac_channel = {
+    .name = "aeolia-dmac/channel",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT64(src, admac_channel_t),
+        VMSTATE_UINT64(dst, admac_channel_t),
+        VMSTATE_UINT32(len, admac_channel_t),
+        VMSTATE_UINT32(ctrl, admac_channel_t),
+        VMSTATE_UINT32(status, admac_channel_t),
+        VMSTATE_UINT32(xferred, admac_channel_t),
+        VMSTATE_UINT64(cur_src, admac_channel_t),
+        VMSTATE_UINT64(cur_dst, admac_channel_t),
+        VMSTATE_UINT32(cur_len, admac_channel_t),
+        VMSTATE_UINT64(desc, admac_channel_t),
+        VMSTATE_BOOL(last, admac_channel_t),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_admac_engine = {
+    .name = "aeolia-dmac/engine",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(ch, admac_engine_t, ADMAC_CHANNELS, 1,
+            vmstate_admac_channel, admac_channel_t),
+        VMSTATE_UINT32(irq_status, admac_engine_t),
+        VMSTATE_UINT32(irq_mask, admac_engine_t),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_aeolia_dmac = {
+    .name = "aeolia-dmac",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = aeolia_dmac_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_PCI_DEVICE(parent_obj, AeoliaDMACState),
+        VMSTATE_STRUCT_ARRAY(engine, AeoliaDMACState, ADMAC_ENGINES, 1,
+            vmstate_admac_engine, admac_engine_t),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static void aeolia_dmac_class_init(ObjectClass *klass, void *data)
 {
+    DeviceClass *dc = DEVICE_CLASS(klass);
     PCIDeviceClass *pc = PCI_DEVICE_CLASS(klass);
 
     pc->vendor_id = 0x104D;
@@ -78,6 +567,9 @@ static void aeolia_dmac_class_init(ObjectClass *klass, void *data)
     pc->revision = 0;
     pc->class_id = PCI_CLASS_SYSTEM_OTHER;
     pc->realize = aeolia_dmac_realize;
+    pc->exit = aeolia_dmac_exit;
+    dc->reset = aeolia_dmac_reset;
+    dc->vmsd = &vmstate_aeolia_dmac;
 }
 
 static const TypeInfo aeolia_dmac_info = {
@@ -17,60 +17,1057 @@
  * License along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * The GbE function is a Marvell Yukon-2 (Yukon Prime) core: descriptors are
+ * 8-byte list elements fetched by per-queue prefetch units, and completions
+ * are reported through a shared status ring. A single MAC port is modeled.
+ */
+
 #include "aeolia.h"
 #include "qemu/osdep.h"
+#include "hw/hw.h"
 #include "hw/pci/pci.h"
 #include "hw/pci/msi.h"
+#include "hw/net/mii.h"
+#include "net/net.h"
+#include "net/eth.h"
+#include "net/checksum.h"
+#include "net/tap.h"
+#include "qemu/timer.h"
+#include "qemu/log.h"
+#include "hw/net/net_tx_pkt.h"
+#include "hw/net/net_rx_pkt.h"
 
 #define AEOLIA_GBE(obj) OBJECT_CHECK(AeoliaGBEState, (obj), TYPE_AEOLIA_GBE)
 
-#define AGBE_DEVICE_ID   0x11B
-#define AGBE_DEVICE_REV  0x11A
-#define AGBE_UNK2880     0x2880
+#define AGBE_MMIO_SIZE   0x4000
+
+/* Control */
+#define AGBE_CTST        0x0004
+#define AGBE_ISRC        0x0008
+#define AGBE_IMSK        0x000C
+#define AGBE_HWE_ISRC    0x0010
+#define AGBE_HWE_IMSK    0x0014
+#define AGBE_SP_ISRC2    0x001C  /* masked sources, disables interrupts */
+#define AGBE_SP_ISRC3    0x0020
+#define AGBE_SP_EISR     0x0024  /* masked sources */
+#define AGBE_SP_LISR     0x0028  /* last value read from AGBE_SP_ISRC2 */
+#define AGBE_SP_ICR      0x002C  /* reenables interrupts */
+#define AGBE_MAC_1       0x0100
+#define AGBE_MAC_2       0x0108
+#define AGBE_PMD_TYP     0x0119
+#define AGBE_DEVICE_REV  0x011A
+#define AGBE_DEVICE_ID   0x011B
+#define AGBE_IRQM_INI    0x0140
+#define AGBE_IRQM_VAL    0x0144
+#define AGBE_IRQM_CTRL   0x0148
+#define AGBE_IRQM_MSK    0x014C
+
+/* Queues */
+#define AGBE_Q_R1        0x0000
+#define AGBE_Q_XA1       0x0280
+#define AGBE_Q_CSR(q)    (0x0400 + (q) + 0x34)
+#define AGBE_PREF(q)     (0x0450 + (q))
+#define AGBE_PREF_SIZE   0x18
+#define AGBE_PREF_CTRL      0x00
+#define AGBE_PREF_LAST_IDX  0x04
+#define AGBE_PREF_ADDR_LO   0x08
+#define AGBE_PREF_ADDR_HI   0x0C
+#define AGBE_PREF_GET_IDX   0x10
+#define AGBE_PREF_PUT_IDX   0x14
+
+/* Status BMU */
+#define AGBE_STAT_CTRL            0x0E80
+#define AGBE_STAT_LAST_IDX        0x0E84
+#define AGBE_STAT_LIST_ADDR_LO    0x0E88
+#define AGBE_STAT_LIST_ADDR_HI    0x0E8C
+#define AGBE_STAT_TXA1_RIDX       0x0E90
+#define AGBE_STAT_PUT_IDX         0x0E9C
+#define AGBE_STAT_LEV_TIMER_INI   0x0EB0
+#define AGBE_STAT_LEV_TIMER_CTRL  0x0EB8
+
+/* GMAC */
+#define AGBE_GMAC_CTRL     0x0F00
+#define AGBE_GMAC_IRQ_SRC  0x0F08
+#define AGBE_GM(reg)       (0x2800 + (reg))
+#define AGBE_GM_GP_STAT    AGBE_GM(0x00)
+#define AGBE_GM_GP_CTRL    AGBE_GM(0x04)
+#define AGBE_GM_RX_CTRL    AGBE_GM(0x0C)
+#define AGBE_GM_SRC_ADDR1  AGBE_GM(0x1C)
+#define AGBE_GM_SRC_ADDR2  AGBE_GM(0x28)
+#define AGBE_GM_MC_ADDR    AGBE_GM(0x34)
+#define AGBE_GM_SMI_CTRL   AGBE_GM(0x80)
+#define AGBE_GM_SMI_DATA   AGBE_GM(0x84)
+
+/* flags */
+#define CS_RST_SET  (1<<0)
+#define CS_RST_CLR  (1<<1)
+
+#define IS_STAT_BMU  (1<<30)
+#define IS_IRQ_PHY1  (1<<4)
+#define IS_IRQ_MAC1  (1<<3)
+
+#define TIM_CLR_IRQ  (1<<0)
+#define TIM_STOP     (1<<1)
+#define TIM_START    (1<<2)
+
+#define BMU_DIS_RX_CHKSUM  (1<<12)
+#define BMU_ENA_RX_CHKSUM  (1<<13)
+
+#define PREF_RST_SET  (1<<0)
+#define PREF_RST_CLR  (1<<1)
+#define PREF_OP_OFF   (1<<2)
+#define PREF_OP_ON    (1<<3)
+
+#define SC_STAT_RST_SET  (1<<0)
+#define SC_STAT_RST_CLR  (1<<1)
+#define SC_STAT_OP_OFF   (1<<2)
+#define SC_STAT_OP_ON    (1<<3)
+#define SC_STAT_CLR_IRQ  (1<<4)
+
+#define GPSR_LINK_UP   (1<<12)
+#define GPSR_DUPLEX    (1<<14)
+#define GPCR_RX_ENA    (1<<11)
+#define GPCR_TX_ENA    (1<<12)
+#define RXCR_MCF_ENA   (1<<14)
+#define RXCR_UCF_ENA   (1<<15)
+
+#define SMI_BUSY       (1<<3)
+#define SMI_RD_VAL     (1<<4)
+#define SMI_OP_RD      (1<<5)
+#define SMI_REG(v)     (((v) >> 6) & 0x1F)
+#define SMI_PHY(v)     (((v) >> 11) & 0x1F)
+
+/* list elements */
+#define HW_OWNER     0x80
+#define OP_TCPSTART  0x02
+#define OP_ADDR64    0x21
+#define OP_VLAN      0x22
+#define OP_LRGLEN    0x24
+#define OP_MSS       0x28
+#define OP_BUFFER    0x40
+#define OP_PACKET    0x41
+#define OP_LARGESEND 0x43
+#define OP_RXSTAT    0x60
+#define OP_TXINDEXLE 0x68
+
+#define LE_CALSUM    (1<<0)
+#define LE_INS_VLAN  (1<<4)
+#define LE_EOP       (1<<7)
+
+/* receive status */
+#define RXS_RX_OK    (1<<8)
+#define RXS_LONG_ERR (1<<4)
+#define RXS_FIFO_OV  (1<<0)
+#define RXS_BC       (1<<9)
+#define RXS_MC       (1<<10)
+#define RXS_VLAN     (1<<13)
+
+#define CSS_ISIPV4       (1<<1)
+#define CSS_IPV4CSUMOK   (1<<2)
+#define CSS_ISIPV6       (1<<3)
+#define CSS_ISTCP        (1<<5)
+#define CSS_ISUDP        (1<<6)
+#define CSS_TCPUDPCSOK   (1<<7)
+
+/* Marvell PHY */
+#define AGBE_PHY_ADDR        0
+#define PHY_MARV_PHY_STAT    17
+#define PHY_MARV_INT_MASK    18
+#define PHY_MARV_INT_STAT    19
+#define PHY_M_PS_LINK_UP     (1<<10)
+#define PHY_M_PS_SPDUP_RES   (1<<11)
+#define PHY_M_PS_FULL_DUP    (1<<13)
+#define PHY_M_PS_SPEED_1000  (2<<14)
+#define PHY_M_IS_LST_CHANGE  (1<<10)
+#define PHY_M_IS_AN_COMPL    (1<<11)
+
+/* Core clock used by the moderation timers */
+#define AGBE_CLK_MHZ     125
+#define AGBE_TICKS_NS(t) ((int64_t)(t) * 1000 / AGBE_CLK_MHZ)
+
+#define AGBE_MIN_FRAME      60
+#define AGBE_MAX_FRAME      9022
+#define AGBE_MAX_TX_FRAGS   64
+
+typedef struct agbe_le_t {
+    uint32_t addr;
+    uint16_t length;
+    uint8_t ctrl;
+    uint8_t opcode;
+} QEMU_PACKED agbe_le_t;
+
+/* Prefetch unit of a descriptor queue, or the status unit */
+typedef struct agbe_ring_t {
+    uint32_t ctrl;
+    uint64_t base;
+    uint16_t last;
+    uint16_t get;
+    uint16_t put;
+    uint32_t addr_hi;   /* from the latest OP_ADDR64 */
+} agbe_ring_t;
+
+/* State set by control elements, applying to the following packets */
+typedef struct agbe_tx_ctx_t {
+    uint32_t addr_hi;
+    uint32_t mss;
+    uint16_t vlan;
+} agbe_tx_ctx_t;
 
 typedef struct AeoliaGBEState {
     /*< private >*/
     PCIDevice parent_obj;
     /*< public >*/
     MemoryRegion iomem;
+    NICState *nic;
+    NICConf conf;
+    bool has_vnet;
+
+    uint8_t regs[AGBE_MMIO_SIZE];
+    uint16_t phy[32];
+
+    /* interrupts */
+    uint32_t isrc;
+    uint32_t imsk;
+    uint32_t lisr;
+    bool isr_masked;
+    bool irq_level;
+    bool irqm_ready;
+    QEMUTimer *irqm_timer;
+    QEMUTimer *stat_timer;
+
+    /* queues */
+    agbe_ring_t rxq;
+    agbe_ring_t txq;
+    agbe_ring_t stat;
+    agbe_tx_ctx_t tx;
+    bool rx_csum;
+    struct NetTxPkt *tx_pkt;
+    struct NetRxPkt *rx_pkt;
 } AeoliaGBEState;
 
+static uint32_t agbe_reg_read(AeoliaGBEState *s, hwaddr addr, unsigned size)
+{
+    switch (size) {
+    case 1:
+        return ldub_p(&s->regs[addr]);
+    case 2:
+        return lduw_le_p(&s->regs[addr]);
+    default:
+        return ldl_le_p(&s->regs[addr]);
+    }
+}
+
+static void agbe_reg_write(AeoliaGBEState *s, hwaddr addr, uint32_t value,
+    unsigned size)
+{
+    switch (size) {
+    case 1:
+        stb_p(&s->regs[addr], value);
+        break;
+    case 2:
+        stw_le_p(&s->regs[addr], value);
+        break;
+    default:
+        stl_le_p(&s->regs[addr], value);
+        break;
+    }
+}
+
+static bool agbe_timer_started(AeoliaGBEState *s, hwaddr ctrl, hwaddr ini)
+{
+    return (s->regs[ctrl] & TIM_START) && ldl_le_p(&s->regs[ini]);
+}
+
+/* interrupts */
+static void agbe_update_irq(AeoliaGBEState *s)
+{
+    PCIDevice *dev = PCI_DEVICE(s);
+    uint32_t pending, moderated = 0;
+    bool level = false;
+
+    if (s->phy[PHY_MARV_INT_STAT] & s->phy[PHY_MARV_INT_MASK]) {
+        s->isrc |= IS_IRQ_PHY1;
+    } else {
+        s->isrc &= ~IS_IRQ_PHY1;
+    }
+
+    /* Moderated sources only interrupt once per AGBE_IRQM_INI period */
+    pending = s->isrc & s->imsk;
+    if (agbe_timer_started(s, AGBE_IRQM_CTRL, AGBE_IRQM_INI)) {
+        moderated = ldl_le_p(&s->regs[AGBE_IRQM_MSK]);
+    }
+    if (!s->isr_masked && pending) {
+        if ((pending & ~moderated) || s->irqm_ready) {
+            level = true;
+        } else if (!timer_pending(s->irqm_timer)) {
+            timer_mod(s->irqm_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                AGBE_TICKS_NS(ldl_le_p(&s->regs[AGBE_IRQM_INI])));
+        }
+    }
+
+    if (level == s->irq_level) {
+        return;
+    }
+    s->irq_level = level;
+    if (level) {
+        s->irqm_ready = false;
+    }
+    if (msi_enabled(dev)) {
+        if (level) {
+            msi_notify(dev, 0);
+        }
+    } else {
+        pci_set_irq(dev, level);
+    }
+}
+
+static void agbe_irqm_expired(void *opaque)
+{
+    AeoliaGBEState *s = opaque;
+
+    s->irqm_ready = true;
+    agbe_update_irq(s);
+}
+
+/* status */
+static void agbe_stat_expired(void *opaque)
+{
+    AeoliaGBEState *s = opaque;
+
+    s->isrc |= IS_STAT_BMU;
+    agbe_update_irq(s);
+}
+
+static void agbe_stat_post(AeoliaGBEState *s, uint8_t opcode,
+    uint32_t status, uint16_t length, uint8_t css)
+{
+    agbe_le_t le;
+
+    if (!(s->stat.ctrl & SC_STAT_OP_ON)) {
+        return;
+    }
+    le.addr = cpu_to_le32(status);
+    le.length = cpu_to_le16(length);
+    le.ctrl = css;
+    le.opcode = opcode | HW_OWNER;
+    pci_dma_write(PCI_DEVICE(s), s->stat.base + s->stat.put * sizeof(le),
+        &le, sizeof(le));
+    s->stat.put = (s->stat.put == s->stat.last) ? 0 : s->stat.put + 1;
+
+    /* Completions are batched until the level timer expires */
+    if (agbe_timer_started(s, AGBE_STAT_LEV_TIMER_CTRL,
+                           AGBE_STAT_LEV_TIMER_INI)) {
+        if (!(s->isrc & IS_STAT_BMU) && !timer_pending(s->stat_timer)) {
+            timer_mod(s->stat_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                AGBE_TICKS_NS(ldl_le_p(&s->regs[AGBE_STAT_LEV_TIMER_INI])));
+        }
+        return;
+    }
+    s->isrc |= IS_STAT_BMU;
+    agbe_update_irq(s);
+}
+
+/* queues */
+static void agbe_ring_read(AeoliaGBEState *s, agbe_ring_t *ring,
+    uint16_t index, agbe_le_t *le)
+{
+    pci_dma_read(PCI_DEVICE(s), ring->base + index * sizeof(*le),
+        le, sizeof(*le));
+    le->addr = le32_to_cpu(le->addr);
+    le->length = le16_to_cpu(le->length);
+}
+
+static uint16_t agbe_ring_next(agbe_ring_t *ring, uint16_t index)
+{
+    return (index >= ring->last) ? 0 : index + 1;
+}
+
+/* Keeps the indices within the ring after the guest moves its end.
+ * agbe_ring_next() never produces an index past the last one, so an
+ * out-of-range put would never be reached. */
+static void agbe_ring_clamp(agbe_ring_t *ring)
+{
+    ring->get = MIN(ring->get, ring->last);
+    ring->put = MIN(ring->put, ring->last);
+}
+
+static bool agbe_ring_active(agbe_ring_t *ring)
+{
+    return (ring->ctrl & PREF_OP_ON) && ring->get != ring->put;
+}
+
+/* tx */
+static void agbe_tx_send(AeoliaGBEState *s, uint8_t opcode, uint8_t ctrl)
+{
+    NetClientState *nc = qemu_get_queue(s->nic);
+    bool tso = (opcode == OP_LARGESEND);
+
+    if (!net_tx_pkt_parse(s->tx_pkt)) {
+        return;
+    }
+    if (ctrl & LE_INS_VLAN) {
+        net_tx_pkt_setup_vlan_header(s->tx_pkt, s->tx.vlan);
+    }
+    if (tso) {
+        net_tx_pkt_update_ip_checksums(s->tx_pkt);
+    }
+    /* Segmentation and checksums are left to the backend when it accepts
+     * virtio-net headers (e.g. tap with vnet_hdr=on), and are done in
+     * software otherwise */
+    net_tx_pkt_build_vheader(s->tx_pkt, tso, tso || (ctrl & LE_CALSUM),
+        s->tx.mss);
+    net_tx_pkt_send(s->tx_pkt, nc);
+}
+
+static void agbe_tx_process(AeoliaGBEState *s)
+{
+    agbe_ring_t *q = &s->txq;
+    agbe_tx_ctx_t ctx = s->tx;
+    uint16_t start = q->get;
+    uint8_t op, first_op = 0, first_ctrl = 0;
+    bool in_packet = false, drop = false, sent = false;
+    unsigned int n;
+    agbe_le_t le;
+
+    if (!(s->regs[AGBE_GM_GP_CTRL + 1] & (GPCR_TX_ENA >> 8))) {
+        return;
+    }
+    for (n = 0; n <= q->last && agbe_ring_active(q); n++) {
+        agbe_ring_read(s, q, q->get, &le);
+        q->get = agbe_ring_next(q, q->get);
+        op = le.opcode & ~HW_OWNER;
+
+        if ((op & 0xF0) == 0x20) {
+            /* Control opcodes combine with OP_VLAN. The tag is stored
+             * big-endian in the length field, which agbe_ring_read has
+             * already converted as little-endian, so swap it back to get
+             * the host-order TCI that net_tx_pkt expects. */
+            if (op & (OP_VLAN & 0x0F)) {
+                s->tx.vlan = bswap16(le.length);
+            }
+            switch (op & ~(OP_VLAN & 0x0F)) {
+            case OP_ADDR64:
+                s->tx.addr_hi = le.addr;
+                break;
+            case OP_LRGLEN:
+            case OP_MSS:
+                s->tx.mss = le.addr;
+                break;
+            }
+            continue;
+        }
+        if (op != OP_PACKET && op != OP_LARGESEND && op != OP_BUFFER) {
+            /* Checksum offsets are taken from the parsed headers */
+            continue;
+        }
+        if (op != OP_BUFFER) {
+            net_tx_pkt_reset(s->tx_pkt);
+            first_op = op;
+            first_ctrl = le.ctrl;
+            in_packet = true;
+            drop = false;
+        }
+        if (in_packet && !drop && le.length) {
+            drop = !net_tx_pkt_add_raw_fragment(s->tx_pkt,
+                ((uint64_t)s->tx.addr_hi << 32) | le.addr, le.length);
+        }
+        if (le.ctrl & LE_EOP) {
+            if (in_packet && !drop) {
+                agbe_tx_send(s, first_op, first_ctrl);
+            }
+            net_tx_pkt_reset(s->tx_pkt);
+            in_packet = false;
+            start = q->get;
+            ctx = s->tx;
+            sent = true;
+        }
+    }
+
+    /* Incomplete packets are fetched again once the rest is posted */
+    if (in_packet) {
+        net_tx_pkt_reset(s->tx_pkt);
+        q->get = start;
+        s->tx = ctx;
+    }
+    if (sent) {
+        stw_le_p(&s->regs[AGBE_STAT_TXA1_RIDX], q->get);
+        agbe_stat_post(s, OP_TXINDEXLE, q->get & 0xFFF, 0, 0);
+    }
+}
+
+/* rx */
+static bool agbe_rx_enabled(AeoliaGBEState *s)
+{
+    return (s->regs[AGBE_GM_GP_CTRL + 1] & (GPCR_RX_ENA >> 8)) &&
+        (s->stat.ctrl & SC_STAT_OP_ON) && agbe_ring_active(&s->rxq);
+}
+
+static int agbe_can_receive(NetClientState *nc)
+{
+    AeoliaGBEState *s = qemu_get_nic_opaque(nc);
+
+    return agbe_rx_enabled(s);
+}
+
+static bool agbe_rx_filter(AeoliaGBEState *s, const uint8_t *buf)
+{
+    uint16_t rx_ctrl = lduw_le_p(&s->regs[AGBE_GM_RX_CTRL]);
+    uint8_t addr[ETH_ALEN];
+    uint32_t bit;
+    int i, j;
+
+    if (is_broadcast_ether_addr(buf)) {
+        return true;
+    }
+    if (is_multicast_ether_addr(buf)) {
+        if (!(rx_ctrl & RXCR_MCF_ENA)) {
+            return true;
+        }
+        bit = net_crc32(buf, ETH_ALEN) & 63;
+        return s->regs[AGBE_GM_MC_ADDR + (bit / 16) * 4 + (bit % 16) / 8] &
+            (1 << (bit % 8));
+    }
+    if (!(rx_ctrl & RXCR_UCF_ENA)) {
+        return true;
+    }
+    for (i = 0; i < 2; i++) {
+        hwaddr base = i ? AGBE_GM_SRC_ADDR2 : AGBE_GM_SRC_ADDR1;
+        for (j = 0; j < 3; j++) {
+            stw_le_p(&addr[j * 2], lduw_le_p(&s->regs[base + j * 4]));
+        }
+        if (!memcmp(buf, addr, ETH_ALEN)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint8_t agbe_rx_csum(AeoliaGBEState *s, const uint8_t *buf, size_t size)
+{
+    bool isip4, isip6, isudp, istcp, valid;
+    uint8_t css = 0;
+
+    net_rx_pkt_attach_data(s->rx_pkt, buf, size, false);
+    net_rx_pkt_get_protocols(s->rx_pkt, &isip4, &isip6, &isudp, &istcp);
+    if (isip4) {
+        css |= CSS_ISIPV4;
+        if (net_rx_pkt_validate_l3_csum(s->rx_pkt, &valid) && valid) {
+            css |= CSS_IPV4CSUMOK;
+        }
+    }
+    if (isip6) {
+        css |= CSS_ISIPV6;
+    }
+    if (istcp || isudp) {
+        css |= istcp ? CSS_ISTCP : CSS_ISUDP;
+        if (net_rx_pkt_validate_l4_csum(s->rx_pkt, &valid) && valid) {
+            css |= CSS_TCPUDPCSOK;
+        }
+    }
+    return css;
+}
+
+/* Copies the frame into the buffers of the next OP_PACKET element and the
+ * OP_BUFFER elements following it. Returns the number of bytes stored. */
+static size_t agbe_rx_copy(AeoliaGBEState *s, const uint8_t *buf, size_t size)
+{
+    agbe_ring_t *q = &s->rxq;
+    bool started = false;
+    size_t done = 0, chunk;
+    unsigned int n;
+    agbe_le_t le;
+    uint8_t op;
+
+    for (n = 0; n <= q->last && q->get != q->put; n++) {
+        agbe_ring_read(s, q, q->get, &le);
+        op = le.opcode & ~HW_OWNER;
+        if (op == OP_PACKET) {
+            if (started) {
+                break;
+            }
+            started = true;
+        }
+        q->get = agbe_ring_next(q, q->get);
+
+        switch (op) {
+        case OP_ADDR64:
+            q->addr_hi = le.addr;
+            break;
+        case OP_PACKET:
+        case OP_BUFFER:
+            if (!started) {
+                break;
+            }
+            chunk = MIN(le.length, size - done);
+            pci_dma_write(PCI_DEVICE(s),
+                ((uint64_t)q->addr_hi << 32) | le.addr, buf + done, chunk);
+            done += chunk;
+            break;
+        }
+    }
+    return done;
+}
+
+static ssize_t agbe_receive(NetClientState *nc, const uint8_t *buf,
+    size_t size)
+{
+    AeoliaGBEState *s = qemu_get_nic_opaque(nc);
+    size_t orig_size = size;
+    uint8_t min_buf[AGBE_MIN_FRAME];
+    uint32_t status;
+    uint8_t css = 0;
+
+    if (!agbe_rx_enabled(s)) {
+        return 0;
+    }
+    if (s->has_vnet) {
+        if (size < sizeof(struct virtio_net_hdr)) {
+            return orig_size;
+        }
+        buf += sizeof(struct virtio_net_hdr);
+        size -= sizeof(struct virtio_net_hdr);
+    }
+    if (size < ETH_HLEN || !agbe_rx_filter(s, buf)) {
+        return orig_size;
+    }
+    if (size < AGBE_MIN_FRAME) {
+        memcpy(min_buf, buf, size);
+        memset(&min_buf[size], 0, AGBE_MIN_FRAME - size);
+        buf = min_buf;
+        size = AGBE_MIN_FRAME;
+    }
+
+    status = RXS_RX_OK;
+    if (is_broadcast_ether_addr(buf)) {
+        status |= RXS_BC;
+    } else if (is_multicast_ether_addr(buf)) {
+        status |= RXS_MC;
+    }
+    if (lduw_be_p(&PKT_GET_ETH_HDR(buf)->h_proto) == ETH_P_VLAN) {
+        status |= RXS_VLAN;
+    }
+    if (size > AGBE_MAX_FRAME) {
+        status = RXS_LONG_ERR;
+        size = AGBE_MAX_FRAME;
+    }
+    if (s->rx_csum && (status & RXS_RX_OK)) {
+        css = agbe_rx_csum(s, buf, size);
+    }
+    if (agbe_rx_copy(s, buf, size) < size) {
+        status = RXS_FIFO_OV;
+    }
+    agbe_stat_post(s, OP_RXSTAT, status | (size << 16), size, css);
+    return orig_size;
+}
+
+/* phy */
+static void agbe_phy_link(AeoliaGBEState *s)
+{
+    NetClientState *nc = qemu_get_queue(s->nic);
+    uint16_t *phy = s->phy;
+
+    if (nc->link_down) {
+        phy[MII_BMSR] &= ~(MII_BMSR_LINK_ST | MII_BMSR_AN_COMP);
+        phy[MII_ANLPAR] = 0;
+        phy[MII_STAT1000] = 0;
+        phy[PHY_MARV_PHY_STAT] = 0;
+    } else {
+        phy[MII_BMSR] |= MII_BMSR_LINK_ST | MII_BMSR_AN_COMP;
+        phy[MII_ANLPAR] = MII_ANLPAR_ACK | MII_ANLPAR_PAUSE | MII_ANLPAR_TXFD |
+            MII_ANLPAR_TX | MII_ANLPAR_10FD | MII_ANLPAR_10 | MII_ANLPAR_CSMACD;
+        phy[MII_STAT1000] = MII_STAT1000_FULL | MII_STAT1000_HALF;
+        phy[PHY_MARV_PHY_STAT] = PHY_M_PS_SPEED_1000 | PHY_M_PS_FULL_DUP |
+            PHY_M_PS_SPDUP_RES | PHY_M_PS_LINK_UP;
+        phy[PHY_MARV_INT_STAT] |= PHY_M_IS_AN_COMPL;
+    }
+    phy[PHY_MARV_INT_STAT] |= PHY_M_IS_LST_CHANGE;
+}
+
+static void agbe_phy_reset(AeoliaGBEState *s)
+{
+    uint16_t *phy = s->phy;
+
+    memset(phy, 0, sizeof(s->phy));
+    phy[MII_BMCR] = MII_BMCR_AUTOEN | MII_BMCR_FD | MII_BMCR_SPEED1000;
+    phy[MII_BMSR] = MII_BMSR_100TX_FD | MII_BMSR_100TX_HD | MII_BMSR_10T_FD |
+        MII_BMSR_10T_HD | MII_BMSR_EXTSTAT | MII_BMSR_MFPS |
+        MII_BMSR_AUTONEG | MII_BMSR_EXTCAP;
+    phy[MII_PHYID1] = 0x0141;
+    phy[MII_PHYID2] = 0x0CC2;
+    phy[MII_ANAR] = MII_ANAR_PAUSE | MII_ANAR_TXFD | MII_ANAR_TX |
+        MII_ANAR_10FD | MII_ANAR_10 | MII_ANAR_CSMACD;
+    phy[MII_CTRL1000] = MII_CTRL1000_FULL | MII_CTRL1000_HALF;
+    phy[MII_EXTSTAT] = 0x3000;
+    agbe_phy_link(s);
+    phy[PHY_MARV_INT_STAT] = 0;
+}
+
+static void agbe_phy_write(AeoliaGBEState *s, int reg, uint16_t value)
+{
+    switch (reg) {
+    case MII_BMCR:
+        if (value & MII_BMCR_RESET) {
+            agbe_phy_reset(s);
+            break;
+        }
+        s->phy[MII_BMCR] = value & ~MII_BMCR_ANRESTART;
+        if (value & MII_BMCR_ANRESTART) {
+            agbe_phy_link(s);
+        }
+        break;
+    case MII_ANAR:
+    case MII_CTRL1000:
+    case PHY_MARV_INT_MASK:
+        s->phy[reg] = value;
+        break;
+    default:
+        /* Vendor control registers are accepted but have no effect */
+        if (reg >= 16) {
+            s->phy[reg] = value;
+        }
+        break;
+    }
+}
+
+static uint16_t agbe_phy_read(AeoliaGBEState *s, int reg)
+{
+    uint16_t value = s->phy[reg];
+
+    if (reg == PHY_MARV_INT_STAT) {
+        s->phy[reg] = 0;
+    }
+    return value;
+}
+
+static void agbe_smi_write(AeoliaGBEState *s, uint16_t value)
+{
+    hwaddr data = AGBE_GM_SMI_DATA;
+
+    if (SMI_PHY(value) != AGBE_PHY_ADDR) {
+        if (value & SMI_OP_RD) {
+            stw_le_p(&s->regs[data], 0xFFFF);
+            value |= SMI_RD_VAL;
+        }
+    } else if (value & SMI_OP_RD) {
+        stw_le_p(&s->regs[data], agbe_phy_read(s, SMI_REG(value)));
+        value |= SMI_RD_VAL;
+    } else {
+        agbe_phy_write(s, SMI_REG(value), lduw_le_p(&s->regs[data]));
+    }
+    stw_le_p(&s->regs[AGBE_GM_SMI_CTRL], value & ~SMI_BUSY);
+}
+
+static void agbe_set_link_status(NetClientState *nc)
+{
+    AeoliaGBEState *s = qemu_get_nic_opaque(nc);
+
+    agbe_phy_link(s);
+    agbe_update_irq(s);
+}
+
+/* reset */
+static void agbe_reset(AeoliaGBEState *s)
+{
+    const uint8_t *mac = s->conf.macaddr.a;
+    int i;
+
+    timer_del(s->irqm_timer);
+    timer_del(s->stat_timer);
+    memset(s->regs, 0, sizeof(s->regs));
+    memset(&s->rxq, 0, sizeof(s->rxq));
+    memset(&s->txq, 0, sizeof(s->txq));
+    memset(&s->stat, 0, sizeof(s->stat));
+    memset(&s->tx, 0, sizeof(s->tx));
+    s->isrc = 0;
+    s->imsk = 0;
+    s->lisr = 0;
+    s->isr_masked = false;
+    s->irqm_ready = false;
+    s->rx_csum = false;
+    net_tx_pkt_reset(s->tx_pkt);
+
+    /* identification */
+    s->regs[AGBE_DEVICE_ID] = 0xBD;
+    s->regs[AGBE_DEVICE_REV] = 0x00;
+    s->regs[AGBE_PMD_TYP] = 'T';
+    for (i = 0; i < 3; i++) {
+        stw_le_p(&s->regs[AGBE_GM_SRC_ADDR1 + i * 4], lduw_le_p(&mac[i * 2]));
+        stw_le_p(&s->regs[AGBE_GM_SRC_ADDR2 + i * 4], lduw_le_p(&mac[i * 2]));
+    }
+    memcpy(&s->regs[AGBE_MAC_1], mac, ETH_ALEN);
+    memcpy(&s->regs[AGBE_MAC_2], mac, ETH_ALEN);
+    agbe_phy_reset(s);
+    agbe_update_irq(s);
+}
+
+/* mmio */
+static agbe_ring_t *agbe_pref_ring(AeoliaGBEState *s, hwaddr addr,
+    hwaddr *reg)
+{
+    if (addr >= AGBE_PREF(AGBE_Q_R1) &&
+        addr < AGBE_PREF(AGBE_Q_R1) + AGBE_PREF_SIZE) {
+        *reg = addr - AGBE_PREF(AGBE_Q_R1);
+        return &s->rxq;
+    }
+    if (addr >= AGBE_PREF(AGBE_Q_XA1) &&
+        addr < AGBE_PREF(AGBE_Q_XA1) + AGBE_PREF_SIZE) {
+        *reg = addr - AGBE_PREF(AGBE_Q_XA1);
+        return &s->txq;
+    }
+    return NULL;
+}
+
+static uint32_t agbe_pref_read(agbe_ring_t *ring, hwaddr reg)
+{
+    switch (reg) {
+    case AGBE_PREF_CTRL:
+        return ring->ctrl;
+    case AGBE_PREF_LAST_IDX:
+        return ring->last;
+    case AGBE_PREF_ADDR_LO:
+        return (uint32_t)ring->base;
+    case AGBE_PREF_ADDR_HI:
+        return ring->base >> 32;
+    case AGBE_PREF_GET_IDX:
+        return ring->get;
+    case AGBE_PREF_PUT_IDX:
+        return ring->put;
+    default:
+        return 0;
+    }
+}
+
+static void agbe_pref_write(AeoliaGBEState *s, agbe_ring_t *ring, hwaddr reg,
+    uint32_t value)
+{
+    switch (reg) {
+    case AGBE_PREF_CTRL:
+        if (value & PREF_RST_SET) {
+            ring->get = ring->put = 0;
+            ring->addr_hi = 0;
+            ring->ctrl &= ~PREF_OP_ON;
+        }
+        if (value & PREF_OP_OFF) {
+            ring->ctrl &= ~PREF_OP_ON;
+        }
+        if (value & PREF_OP_ON) {
+            ring->ctrl |= PREF_OP_ON;
+        }
+        break;
+    case AGBE_PREF_LAST_IDX:
+        ring->last = value;
+        agbe_ring_clamp(ring);
+        break;
+    case AGBE_PREF_ADDR_LO:
+        ring->base = deposit64(ring->base, 0, 32, value);
+        break;
+    case AGBE_PREF_ADDR_HI:
+        ring->base = deposit64(ring->base, 32, 32, value);
+        break;
+    case AGBE_PREF_PUT_IDX:
+        if (value > ring->last) {
+            qemu_log_mask(LOG_GUEST_ERROR, "aeolia-gbe: put index %u is "
+                "past the last index %u\n", value, ring->last);
+            return;
+        }
+        ring->put = value;
+        break;
+    }
+    if (ring == &s->txq) {
+        agbe_tx_process(s);
+    } else if (agbe_rx_enabled(s)) {
+        qemu_flush_queued_packets(qemu_get_queue(s->nic));
+    }
+}
+
 static uint64_t aeolia_gbe_read(
     void *opaque, hwaddr addr, unsigned size)
 {
-    printf("aeolia_gbe_read { addr: %llX, size: %X }\n", addr, size);
+    AeoliaGBEState *s = opaque;
+    agbe_ring_t *ring;
+    hwaddr reg;
+    uint32_t value;
+
+    ring = agbe_pref_ring(s, addr, &reg);
+    if (ring) {
+        return agbe_pref_read(ring, reg);
+    }
     switch (addr) {
-    case AGBE_DEVICE_ID:
-        assert(size == 1);
-        return 0xBD;
-    case AGBE_DEVICE_REV:
-        assert(size == 1);
-        return 0x00; // TODO
-    case AGBE_UNK2880:
-        assert(size == 2);
-        return 0x10; // TODO
+    case AGBE_ISRC:
+        return s->isrc;
+    case AGBE_IMSK:
+        return s->imsk;
+    case AGBE_SP_ISRC2:
+        /* Interrupt handlers start here, masking until AGBE_SP_ICR */
+        value = s->isrc & s->imsk;
+        s->lisr = value;
+        s->isr_masked = true;
+        agbe_update_irq(s);
+        return value;
+    case AGBE_SP_ISRC3:
+    case AGBE_SP_EISR:
+        return s->isrc & s->imsk;
+    case AGBE_SP_LISR:
+        return s->lisr;
+    case AGBE_STAT_CTRL:
+        return s->stat.ctrl;
+    case AGBE_STAT_LAST_IDX:
+        return s->stat.last;
+    case AGBE_STAT_LIST_ADDR_LO:
+        return (uint32_t)s->stat.base;
+    case AGBE_STAT_LIST_ADDR_HI:
+        return s->stat.base >> 32;
+    case AGBE_STAT_PUT_IDX:
+        return s->stat.put;
+    case AGBE_GM_GP_STAT:
+        value = lduw_le_p(&s->regs[addr]) & ~(GPSR_LINK_UP | GPSR_DUPLEX);
+        if (!qemu_get_queue(s->nic)->link_down) {
+            value |= GPSR_LINK_UP | GPSR_DUPLEX;
+        }
+        return value;
+    default:
+        if (addr + size > AGBE_MMIO_SIZE) {
+            return 0;
+        }
+        return agbe_reg_read(s, addr, size);
     }
-    return 0;
 }
 
 static void aeolia_gbe_write(
     void *opaque, hwaddr addr, uint64_t value, unsigned size)
 {
-    printf("aeolia_gbe_write { addr: %llX, size: %X, value: %llX }\n", addr, size, value);
+    AeoliaGBEState *s = opaque;
+    agbe_ring_t *ring;
+    hwaddr reg;
+
+    ring = agbe_pref_ring(s, addr, &reg);
+    if (ring) {
+        agbe_pref_write(s, ring, reg, value);
+        return;
+    }
+    switch (addr) {
+    case AGBE_CTST:
+        if (value & CS_RST_SET) {
+            agbe_reset(s);
+        }
+        break;
+    case AGBE_ISRC:
+    case AGBE_SP_ISRC2:
+    case AGBE_SP_ISRC3:
+    case AGBE_SP_EISR:
+    case AGBE_SP_LISR:
+    case AGBE_DEVICE_ID:
+    case AGBE_DEVICE_REV:
+        break;
+    case AGBE_IMSK:
+        s->imsk = value;
+        agbe_update_irq(s);
+        break;
+    case AGBE_SP_ICR:
+        s->isr_masked = false;
+        agbe_update_irq(s);
+        break;
+    case AGBE_IRQM_CTRL:
+        if (value & TIM_STOP) {
+            timer_del(s->irqm_timer);
+            s->regs[addr] &= ~TIM_START;
+        }
+        if (value & TIM_START) {
+            s->regs[addr] |= TIM_START;
+        }
+        s->irqm_ready = false;
+        agbe_update_irq(s);
+        break;
+    case AGBE_STAT_LEV_TIMER_CTRL:
+        if (value & TIM_STOP) {
+            timer_del(s->stat_timer);
+            s->regs[addr] &= ~TIM_START;
+        }
+        if (value & TIM_START) {
+            s->regs[addr] |= TIM_START;
+        }
+        break;
+    case AGBE_Q_CSR(AGBE_Q_R1):
+        if (value & BMU_ENA_RX_CHKSUM) {
+            s->rx_csum = true;
+        }
+        if (value & BMU_DIS_RX_CHKSUM) {
+            s->rx_csum = false;
+        }
+        break;
+    case AGBE_STAT_CTRL:
+        if (value & SC_STAT_RST_SET) {
+            s->stat.put = 0;
+            s->stat.ctrl &= ~SC_STAT_OP_ON;
+            timer_del(s->stat_timer);
+        }
+        if (value & SC_STAT_OP_OFF) {
+            s->stat.ctrl &= ~SC_STAT_OP_ON;
+        }
+        if (value & SC_STAT_OP_ON) {
+            s->stat.ctrl |= SC_STAT_OP_ON;
+        }
+        if (value & SC_STAT_CLR_IRQ) {
+            s->isrc &= ~IS_STAT_BMU;
+            agbe_update_irq(s);
+        }
+        break;
+    case AGBE_STAT_LAST_IDX:
+        s->stat.last = value;
+        agbe_ring_clamp(&s->stat);
+        break;
+    case AGBE_STAT_LIST_ADDR_LO:
+        s->stat.base = deposit64(s->stat.base, 0, 32, value);
+        break;
+    case AGBE_STAT_LIST_ADDR_HI:
+        s->stat.base = deposit64(s->stat.base, 32, 32, value);
+        break;
+    case AGBE_GM_GP_CTRL:
+        agbe_reg_write(s, addr, value, size);
+        agbe_tx_process(s);
+        if (agbe_rx_enabled(s)) {
+            qemu_flush_queued_packets(qemu_get_queue(s->nic));
+        }
+        break;
+    case AGBE_GM_SMI_CTRL:
+        agbe_smi_write(s, value);
+        agbe_update_irq(s);
+        break;
+    default:
+        if (addr + size <= AGBE_MMIO_SIZE) {
+            agbe_reg_write(s, addr, value, size);
+        }
+        break;
+    }
 }
 
 static const MemoryRegionOps aeolia_gbe_ops = {
     .read = aeolia_gbe_read,
     .write = aeolia_gbe_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
+    .impl = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+    },
+};
+
+static NetClientInfo aeolia_gbe_net_info = {
+    .type = NET_CLIENT_DRIVER_NIC,
+    .size = sizeof(NICState),
+    .can_receive = agbe_can_receive,
+    .receive = agbe_receive,
+    .link_status_changed = agbe_set_link_status,
 };
 
 static void aeolia_gbe_realize(PCIDevice *dev, Error **errp)
 {
     AeoliaGBEState *s = AEOLIA_GBE(dev);
+    NetClientState *nc;
 
     // PCI Configuration Space
     dev->config[PCI_CLASS_PROG] = 0x01;
+    dev->config[PCI_INTERRUPT_PIN] = 1;
     msi_init(dev, 0x50, 1, true, false, NULL);
     if (pci_is_express(dev)) {
         pcie_endpoint_cap_init(dev, 0x70);
@@ -78,12 +1075,103 @@ static void aeolia_gbe_realize(PCIDevice *dev, Error **errp)
 
     // Memory
     memory_region_init_io(&s->iomem, OBJECT(dev),
-        &aeolia_gbe_ops, s, "aeolia-gbe-mem", 0x4000);
+        &aeolia_gbe_ops, s, "aeolia-gbe-mem", AGBE_MMIO_SIZE);
     pci_register_bar(dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem);
+
+    // Network
+    qemu_macaddr_default_if_unset(&s->conf.macaddr);
+    s->nic = qemu_new_nic(&aeolia_gbe_net_info, &s->conf,
+        object_get_typename(OBJECT(dev)), DEVICE(dev)->id, s);
+    nc = qemu_get_queue(s->nic);
+    qemu_format_nic_info_str(nc, s->conf.macaddr.a);
+
+    /* Offloads are forwarded to backends that take virtio-net headers */
+    s->has_vnet = nc->peer && qemu_has_vnet_hdr(nc->peer);
+    if (s->has_vnet) {
+        qemu_set_vnet_hdr_len(nc->peer, sizeof(struct virtio_net_hdr));
+        qemu_using_vnet_hdr(nc->peer, true);
+    }
+    net_tx_pkt_init(&s->tx_pkt, dev, AGBE_MAX_TX_FRAGS, s->has_vnet);
+    net_rx_pkt_init(&s->rx_pkt, false);
+
+    s->irqm_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, agbe_irqm_expired, s);
+    s->stat_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, agbe_stat_expired, s);
 }
 
+static void aeolia_gbe_exit(PCIDevice *dev)
+{
+    AeoliaGBEState *s = AEOLIA_GBE(dev);
+
+    timer_free(s->irqm_timer);
+    timer_free(s->stat_timer);
+    net_tx_pkt_uninit(s->tx_pkt);
+    net_rx_pkt_uninit(s->rx_pkt);
+    qemu_del_nic(s->nic);
+    msi_uninit(dev);
+}
+
+static void aeolia_gbe_qdev_reset(DeviceState *dev)
+{
+    agbe_reset(AEOLIA_GBE(dev));
+}
+
+static int agbe_ring_post_load(void *opaque, int version_id)
+{
+    agbe_ring_clamp(opaque);
+    return 0;
+}
+
+static const VMStateDescription vmstate_agbe_ring = {
+    .name = "aeolia-gbe/ring",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = agbe_ring_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(ctrl, agbe_ring_t),
+        VMSTATE_UINT64(base, agbe_ring_t),
+        VMSTATE_UINT16(last, agbe_ring_t),
+        VMSTATE_UINT16(get, agbe_ring_t),
+        VMSTATE_UINT16(put, agbe_ring_t),
+        VMSTATE_UINT32(addr_hi, agbe_ring_t),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_aeolia_gbe = {
+    .name = "aeolia-gbe",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_PCI_DEVICE(parent_obj, AeoliaGBEState),
+        VMSTATE_UINT8_ARRAY(regs, AeoliaGBEState, AGBE_MMIO_SIZE),
+        VMSTATE_UINT16_ARRAY(phy, AeoliaGBEState, 32),
+        VMSTATE_UINT32(isrc, AeoliaGBEState),
+        VMSTATE_UINT32(imsk, AeoliaGBEState),
+        VMSTATE_UINT32(lisr, AeoliaGBEState),
+        VMSTATE_BOOL(isr_masked, AeoliaGBEState),
+        VMSTATE_BOOL(irq_level, AeoliaGBEState),
+        VMSTATE_BOOL(irqm_ready, AeoliaGBEState),
+        VMSTATE_TIMER_PTR(irqm_timer, AeoliaGBEState),
+        VMSTATE_TIMER_PTR(stat_timer, AeoliaGBEState),
+        VMSTATE_STRUCT(rxq, AeoliaGBEState, 1, vmstate_agbe_ring, agbe_ring_t),
+        VMSTATE_STRUCT(txq, AeoliaGBEState, 1, vmstate_agbe_ring, agbe_ring_t),
+        VMSTATE_STRUCT(stat, AeoliaGBEState, 1, vmstate_agbe_ring, agbe_ring_t),
+        VMSTATE_UINT32(tx.addr_hi, AeoliaGBEState),
+        VMSTATE_UINT32(tx.mss, AeoliaGBEState),
+        VMSTATE_UINT16(tx.vlan, AeoliaGBEState),
+        VMSTATE_BOOL(rx_csum, AeoliaGBEState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property aeolia_gbe_properties[] = {
+    DEFINE_NIC_PROPERTIES(AeoliaGBEState, conf),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void aeolia_gbe_class_init(ObjectClass *klass, void *data)
 {
+    DeviceClass *dc = DEVICE_CLASS(klass);
     PCIDeviceClass *pc = PCI_DEVICE_CLASS(klass);
 
     pc->vendor_id = 0x104D;
@@ -91,6 +1179,11 @@ static void aeolia_gbe_class_init(ObjectClass *klass, void *data)
     pc->revision = 0;
     pc->class_id = PCI_CLASS_SYSTEM_OTHER;
     pc->realize = aeolia_gbe_realize;
+    pc->exit = aeolia_gbe_exit;
+    dc->reset = aeolia_gbe_qdev_reset;
+    dc->vmsd = &vmstate_aeolia_gbe;
+    dc->props = aeolia_gbe_properties;
+    set_bit(DEVICE_CATEGORY_NETWORK, dc->categories);
 }
 
 static const TypeInfo aeolia_gbe_info = {
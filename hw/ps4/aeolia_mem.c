@@ -22,6 +22,7 @@
 
 #include "aeolia.h"
 #include "qemu/osdep.h"
+#include "qapi/error.h"
 #include "hw/pci/pci.h"
 
 // Helpers
@@ -33,14 +34,13 @@ typedef struct AeoliaMemState {
     PCIDevice parent_obj;
     /*< public >*/
     MemoryRegion iomem[4];
-    char data[0x40000];
 } AeoliaMemState;
 
 /* helpers */
-char* aeolia_mem_get_icc_data(PCIDevice* dev)
+MemoryRegion* aeolia_mem_get_icc_region(PCIDevice* dev)
 {
     AeoliaMemState *s = AEOLIA_MEM(dev);
-    return s->data;
+    return &s->iomem[3];
 }
 
 /* bar ? */
@@ -63,59 +63,11 @@ static const MemoryRegionOps aeolia_mem_ops = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
-/* bar 5 */
-static uint64_t aeolia_mem_3_read
-    (void *opaque, hwaddr addr, unsigned size)
-{
-    AeoliaMemState *s = AEOLIA_MEM(opaque);
-    uint64_t value;
-
-    switch (size) {
-    case 1:
-        value = *(uint8_t*)(&s->data[addr]);
-        break;
-    case 2:
-        value = *(uint16_t*)(&s->data[addr]);
-        break;
-    case 4:
-        value = *(uint32_t*)(&s->data[addr]);
-        break;
-    default:
-        printf("aeolia_mem_3_read: Unexpected size %d\n", size);
-    }
-    return value;
-}
-
-static void aeolia_mem_3_write
-    (void *opaque, hwaddr addr, uint64_t value, unsigned size)
-{
-    AeoliaMemState *s = AEOLIA_MEM(opaque);
-
-    switch (size) {
-    case 1:
-        stb_p(&s->data[addr], value);
-        break;
-    case 2:
-        stw_le_p(&s->data[addr], value);
-        break;
-    case 4:
-        stl_le_p(&s->data[addr], value);
-        break;
-    default:
-        printf("aeolia_mem_3_write: Unexpected size %d\n", size);
-    }
-}
-
-static const MemoryRegionOps aeolia_mem_3_ops = {
-    .read = aeolia_mem_3_read,
-    .write = aeolia_mem_3_write,
-    .endianness = DEVICE_LITTLE_ENDIAN,
-};
-
 static void aeolia_mem_realize(PCIDevice *dev, Error **errp)
 {
     AeoliaMemState *s = AEOLIA_MEM(dev);
-    
+    Error *err = NULL;
+
     // PCI Configuration Space
     dev->config[PCI_CLASS_PROG] = 0x06;
     dev->config[PCI_INTERRUPT_LINE] = 0xFF;
@@ -129,9 +81,15 @@ static void aeolia_mem_realize(PCIDevice *dev, Error **errp)
         &aeolia_mem_ops, s, "aeolia-mem-1", 0x10000000 /* 0x40000000 */);
     memory_region_init_io(&s->iomem[2], OBJECT(dev),
         &aeolia_mem_ops, s, "aeolia-mem-2", 0x100000);
-    memory_region_init_io(&s->iomem[3], OBJECT(dev),
-        &aeolia_mem_3_ops, s, "aeolia-mem-3", 0x40000);
-    
+    /* ICC shared memory: guest accesses go straight to host memory, the
+     * device side only looks at it when a doorbell is rung */
+    memory_region_init_ram(&s->iomem[3], OBJECT(dev),
+        "aeolia-mem-3", 0x40000, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
     pci_register_bar(dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[0]);
     pci_register_bar(dev, 2, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[1]);
     pci_register_bar(dev, 4, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[2]);
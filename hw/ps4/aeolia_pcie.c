@@ -22,14 +22,24 @@
 
 #include "aeolia.h"
 #include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bitmap.h"
+#include "qemu/event_notifier.h"
+#include "qemu/error-report.h"
+#include "qemu/queue.h"
 #include "qemu/timer.h"
 #include "hw/pci/msi.h"
 #include "hw/pci/pci.h"
 #include "hw/sysbus.h"
 #include "hw/i386/pc.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/kvm.h"
+#include "sysemu/sysemu.h"
+#include "ui/orbital-trace.h"
 
 #include "aeolia/aeolia_hpet.h"
 #include "aeolia/aeolia_sflash.h"
+#include "ps4_timebase.h"
 
 // MMIO
 #define APCIE_RTC_STATUS              0x100
@@ -92,6 +102,26 @@
 #define ICC_CMD_QUERY_UNK70                                   0x70 // sceControlEmcHdmiService
 #define ICC_CMD_QUERY_SNVRAM_READ                             0x8D
 
+#define ICC_RESULT_OK                                       0x0000
+#define ICC_RESULT_INVALID                                  0x0001
+#define ICC_RESULT_IO_ERROR                                 0x0002
+
+/* Each mailbox slot holds a single message */
+#define ICC_MSG_SIZE                                         0x7F0
+#define ICC_MSG_DATA_MAX  (ICC_MSG_SIZE - sizeof(aeolia_icc_message_t))
+
+// NVRAM
+/* The backing image holds the NVRAM followed by the SNVRAM */
+#define APCIE_NVRAM_BASE                                       0x0
+#define APCIE_NVRAM_SIZE                                    0x4000
+#define APCIE_SNVRAM_BASE                                   0x4000
+#define APCIE_SNVRAM_SIZE                                   0x4000
+#define APCIE_NVRAM_STORE_SIZE                              0x8000
+#define APCIE_NVRAM_SECTOR                                   0x200
+#define APCIE_NVRAM_SECTORS \
+    (APCIE_NVRAM_STORE_SIZE / APCIE_NVRAM_SECTOR)
+#define APCIE_NVRAM_WRITEBACK_MS                              1000
+
 // Peripherals
 #define AEOLIA_SFLASH_BASE  0xC2000
 #define AEOLIA_SFLASH_SIZE  0x2000
@@ -120,6 +150,11 @@ do { \
     } \
 } while (0)
 
+typedef struct AeoliaICCFrame {
+    uint8_t data[ICC_MSG_SIZE];
+    QSIMPLEQ_ENTRY(AeoliaICCFrame) next;
+} AeoliaICCFrame;
+
 typedef struct AeoliaPCIEState {
     /*< private >*/
     PCIDevice parent_obj;
@@ -140,7 +175,18 @@ typedef struct AeoliaPCIEState {
 
     uint32_t icc_doorbell;
     uint32_t icc_status;
+    EventNotifier icc_event;
+    bool icc_event_active;
+    bool ioeventfd;
     char* icc_data;
+    MemoryRegion* icc_mr;
+    QSIMPLEQ_HEAD(, AeoliaICCFrame) icc_frames;
+
+    BlockBackend *nvram_blk;
+    uint8_t nvram[APCIE_NVRAM_STORE_SIZE];
+    DECLARE_BITMAP(nvram_dirty, APCIE_NVRAM_SECTORS);
+    QEMUTimer *nvram_timer;
+    VMChangeStateEntry *vmstate;
 
     uint32_t msi_data_fn4;
     uint32_t msi_data_fn5;
@@ -156,10 +202,11 @@ typedef struct AeoliaPCIEState {
 } AeoliaPCIEState;
 
 /* helpers */
-void aeolia_pcie_set_icc_data(PCIDevice* dev, char* icc_data)
+void aeolia_pcie_set_icc_region(PCIDevice* dev, MemoryRegion* mr)
 {
     AeoliaPCIEState *s = AEOLIA_PCIE(dev);
-    s->icc_data = icc_data;
+    s->icc_mr = mr;
+    s->icc_data = memory_region_get_ram_ptr(mr);
 }
 
 /* Aeolia PCIe Unk0 */
@@ -265,6 +312,103 @@ static void sflash_doorbell(AeoliaPCIEState *s, uint32_t value)
         s->msi_addr_fn4, s->msi_data_fn4 | s->msi_vector_sflash);
 }
 
+/* nvram */
+static void nvram_writeback(AeoliaPCIEState *s)
+{
+    long first, last;
+    int ret;
+
+    timer_del(s->nvram_timer);
+    if (!s->nvram_blk) {
+        bitmap_zero(s->nvram_dirty, APCIE_NVRAM_SECTORS);
+        return;
+    }
+    first = find_first_bit(s->nvram_dirty, APCIE_NVRAM_SECTORS);
+    if (first >= APCIE_NVRAM_SECTORS) {
+        return;
+    }
+    while (first < APCIE_NVRAM_SECTORS) {
+        last = find_next_zero_bit(s->nvram_dirty, APCIE_NVRAM_SECTORS, first);
+        ret = blk_pwrite(s->nvram_blk, first * APCIE_NVRAM_SECTOR,
+            &s->nvram[first * APCIE_NVRAM_SECTOR],
+            (last - first) * APCIE_NVRAM_SECTOR, 0);
+        if (ret < 0) {
+            error_report("aeolia-pcie: NVRAM write-back failed: %s",
+                strerror(-ret));
+            return;
+        }
+        bitmap_clear(s->nvram_dirty, first, last - first);
+        first = find_next_bit(s->nvram_dirty, APCIE_NVRAM_SECTORS, last);
+    }
+    blk_flush(s->nvram_blk);
+}
+
+static void nvram_writeback_timer(void *opaque)
+{
+    nvram_writeback(opaque);
+}
+
+/* Flush on stop, which covers both savevm and shutdown */
+static void nvram_vm_state_change(void *opaque, int running, RunState state)
+{
+    if (!running) {
+        nvram_writeback(opaque);
+    }
+}
+
+static void nvram_store(AeoliaPCIEState *s,
+    uint32_t offset, const void *data, uint32_t size)
+{
+    long first = offset / APCIE_NVRAM_SECTOR;
+    long last = DIV_ROUND_UP(offset + size, APCIE_NVRAM_SECTOR);
+
+    memcpy(&s->nvram[offset], data, size);
+    bitmap_set(s->nvram_dirty, first, last - first);
+    if (s->nvram_blk && !timer_pending(s->nvram_timer)) {
+        timer_mod(s->nvram_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+            APCIE_NVRAM_WRITEBACK_MS);
+    }
+}
+
+static void nvram_load(AeoliaPCIEState *s, Error **errp)
+{
+    int64_t len;
+    int ret;
+
+    /* Erased flash until the guest stores something */
+    memset(s->nvram, 0xFF, sizeof(s->nvram));
+    if (!s->nvram_blk) {
+        return;
+    }
+    len = blk_getlength(s->nvram_blk);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "could not get length of NVRAM image");
+        return;
+    }
+    if (len < APCIE_NVRAM_STORE_SIZE) {
+        error_setg(errp, "NVRAM image must be at least %d bytes",
+            APCIE_NVRAM_STORE_SIZE);
+        return;
+    }
+    ret = blk_set_perm(s->nvram_blk, BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE,
+        BLK_PERM_ALL, errp);
+    if (ret < 0) {
+        return;
+    }
+    ret = blk_pread(s->nvram_blk, 0, s->nvram, APCIE_NVRAM_STORE_SIZE);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "could not read NVRAM image");
+    }
+}
+
+/* icc */
+/* The mailbox is guest RAM, so device-side updates must be visible to
+ * migration and display dirty tracking */
+static void icc_set_dirty(AeoliaPCIEState *s)
+{
+    memory_region_set_dirty(s->icc_mr, AMEM_ICC_BASE, AMEM_ICC_SIZE);
+}
+
 static void icc_send_irq(AeoliaPCIEState *s)
 {
     s->icc_status |= APCIE_ICC_IRQ_PENDING;
@@ -288,6 +432,60 @@ static void icc_calculate_csum(aeolia_icc_message_t* msg)
     msg->checksum = checksum;
 }
 
+/* Replies are queued as frames and moved into the reply slot one at a time,
+ * each time the guest acknowledges the previous one. Frames delivered while
+ * the guest has not acknowledged the interrupt yet share it. */
+static aeolia_icc_message_t* icc_frame_new(
+    AeoliaPCIEState *s, const aeolia_icc_message_t *query)
+{
+    AeoliaICCFrame *frame = g_new0(AeoliaICCFrame, 1);
+    aeolia_icc_message_t *reply = (void*)frame->data;
+
+    reply->magic = 0x42;
+    reply->major = query->major;
+    reply->minor = query->minor | APCIE_ICC_REPLY;
+    reply->reserved = 0;
+    reply->cookie = query->cookie;
+    reply->length = sizeof(aeolia_icc_message_t);
+    reply->result = ICC_RESULT_OK;
+    QSIMPLEQ_INSERT_TAIL(&s->icc_frames, frame, next);
+    return reply;
+}
+
+static void icc_frames_clear(AeoliaPCIEState *s)
+{
+    AeoliaICCFrame *frame;
+
+    while ((frame = QSIMPLEQ_FIRST(&s->icc_frames))) {
+        QSIMPLEQ_REMOVE_HEAD(&s->icc_frames, next);
+        g_free(frame);
+    }
+}
+
+static void icc_deliver(AeoliaPCIEState *s)
+{
+    AeoliaICCFrame *frame;
+    aeolia_icc_message_t *reply;
+
+    frame = QSIMPLEQ_FIRST(&s->icc_frames);
+    if (!frame || (s->icc_status & APCIE_ICC_MSG_PENDING)) {
+        return;
+    }
+    QSIMPLEQ_REMOVE_HEAD(&s->icc_frames, next);
+    reply = (aeolia_icc_message_t*)&s->icc_data[AMEM_ICC_REPLY];
+    memcpy(reply, frame->data, ICC_MSG_SIZE);
+    g_free(frame);
+    icc_calculate_csum(reply);
+
+    s->icc_data[AMEM_ICC_REPLY_W] = 1;
+    s->icc_data[AMEM_ICC_REPLY_R] = 0;
+    icc_set_dirty(s);
+    s->icc_status |= APCIE_ICC_MSG_PENDING;
+    if (!(s->icc_status & APCIE_ICC_IRQ_PENDING)) {
+        icc_send_irq(s);
+    }
+}
+
 static void icc_query_board_id(
     AeoliaPCIEState *s, aeolia_icc_message_t* reply)
 {
@@ -328,25 +526,152 @@ static void icc_query_buttons_state(
     printf("qemu: ICC: icc_query_buttons_state\n");
 }
 
+typedef struct icc_query_nvram_t {
+    uint16_t offset;
+    uint16_t size;
+    uint8_t data[0];
+} QEMU_PACKED icc_query_nvram_t;
+
+#define ICC_NVRAM_DATA_MAX  (ICC_MSG_DATA_MAX - sizeof(icc_query_nvram_t))
+
+static bool icc_nvram_check(const aeolia_icc_message_t *query,
+    aeolia_icc_message_t *reply, uint32_t limit)
+{
+    const icc_query_nvram_t *req = (const void*)&query->data;
+
+    if (query->length < sizeof(aeolia_icc_message_t) + sizeof(*req) ||
+        req->offset + req->size > limit) {
+        printf("qemu: ICC: Invalid NVRAM access (offset: %#x, size: %#x)\n",
+            req->offset, req->size);
+        reply->result = ICC_RESULT_INVALID;
+        return false;
+    }
+    return true;
+}
+
+static void icc_query_nvram_write(AeoliaPCIEState *s,
+    const aeolia_icc_message_t *query, aeolia_icc_message_t *reply)
+{
+    const icc_query_nvram_t *req = (const void*)&query->data;
+
+    if (!icc_nvram_check(query, reply, APCIE_NVRAM_SIZE)) {
+        return;
+    }
+    if (req->size > ICC_NVRAM_DATA_MAX || query->length <
+        sizeof(aeolia_icc_message_t) + sizeof(*req) + req->size) {
+        reply->result = ICC_RESULT_INVALID;
+        return;
+    }
+    nvram_store(s, APCIE_NVRAM_BASE + req->offset, req->data, req->size);
+}
+
+/* Reads larger than a message are split over as many reply frames */
+static void icc_query_nvram_read(AeoliaPCIEState *s,
+    const aeolia_icc_message_t *query, aeolia_icc_message_t *reply,
+    uint32_t base, uint32_t limit)
+{
+    const icc_query_nvram_t *req = (const void*)&query->data;
+    icc_query_nvram_t *rsp;
+    uint32_t offset, size, chunk;
+
+    if (!icc_nvram_check(query, reply, limit)) {
+        return;
+    }
+    offset = req->offset;
+    size = req->size;
+    do {
+        chunk = MIN(size, ICC_NVRAM_DATA_MAX);
+        rsp = (void*)&reply->data;
+        rsp->offset = offset;
+        rsp->size = chunk;
+        memcpy(rsp->data, &s->nvram[base + offset], chunk);
+        reply->length = sizeof(aeolia_icc_message_t) + sizeof(*rsp) + chunk;
+        offset += chunk;
+        size -= chunk;
+        if (size) {
+            reply = icc_frame_new(s, query);
+        }
+    } while (size);
+}
+
+/* orbital trace decoders */
+static const char* icc_trace_opname(uint32_t opcode)
+{
+    switch (opcode >> 16) {
+    case ICC_CMD_QUERY_SERVICE:
+        return "SERVICE";
+    case ICC_CMD_QUERY_BOARD:
+        return "BOARD";
+    case ICC_CMD_QUERY_NVRAM:
+        return "NVRAM";
+    case ICC_CMD_QUERY_UNK04:
+        return "UNK04";
+    case ICC_CMD_QUERY_BUTTONS:
+        return "BUTTONS";
+    case ICC_CMD_QUERY_BUZZER:
+        return "BUZZER";
+    case ICC_CMD_QUERY_SAVE_CONTEXT:
+        return "SAVE_CONTEXT";
+    case ICC_CMD_QUERY_LOAD_CONTEXT:
+        return "LOAD_CONTEXT";
+    case ICC_CMD_QUERY_UNK0D:
+        return "UNK0D";
+    case ICC_CMD_QUERY_UNK70:
+        return "UNK70";
+    case ICC_CMD_QUERY_SNVRAM_READ:
+        return "SNVRAM_READ";
+    default:
+        return "UNKNOWN!";
+    }
+}
+
+static void icc_trace_format(const orbital_trace_record_t *rec,
+    char *buf, size_t size)
+{
+    snprintf(buf, size, "%s 0x%04X, cookie: 0x%04X, length: %u, result: %u",
+        icc_trace_opname(rec->opcode), rec->opcode & 0xFFFF,
+        rec->data[0], rec->data[1], rec->data[2]);
+}
+
+static void icc_trace_query(const aeolia_icc_message_t *query,
+    const aeolia_icc_message_t *reply, int64_t start)
+{
+    orbital_trace_record_t rec;
+
+    rec.timestamp = start;
+    rec.duration = MIN(get_clock() - start, UINT32_MAX);
+    rec.opcode = (query->major << 16) | query->minor;
+    rec.data[0] = query->cookie;
+    rec.data[1] = query->length;
+    rec.data[2] = reply->result;
+    rec.data[3] = 0;
+    orbital_trace_record(ORBITAL_TRACE_ICC, &rec);
+}
+
 static void icc_query(AeoliaPCIEState *s)
 {
     aeolia_icc_message_t *query, *reply;
-    query = (aeolia_icc_message_t*)&s->icc_data[AMEM_ICC_QUERY];
-    reply = (aeolia_icc_message_t*)&s->icc_data[AMEM_ICC_REPLY];
+    uint8_t query_data[ICC_MSG_SIZE];
+    int64_t start = 0;
+    bool traced;
+
+    traced = orbital_trace_enabled(ORBITAL_TRACE_ICC);
+    if (traced) {
+        start = get_clock();
+    }
+    /* The mailbox is guest RAM that vCPUs can rewrite at any time: the
+     * query is fetched once, and only that copy is validated and used */
+    memcpy(query_data, &s->icc_data[AMEM_ICC_QUERY], sizeof(query_data));
+    query = (aeolia_icc_message_t*)query_data;
 
     printf("qemu: ICC: New command\n");
     if (query->magic != 0x42) {
         printf("qemu: ICC: Unexpected command: %x\n", query->magic);
     }
 
-    memset(reply, 0, 0x7F0);
-    reply->magic = 0x42;
-    reply->major = query->major;
-    reply->minor = query->minor | APCIE_ICC_REPLY;
-    reply->reserved = 0;
-    reply->cookie = query->cookie;
-    reply->length = sizeof(aeolia_icc_message_t);
-    reply->result = 0;
+    /* A new query means the guest is done with any previous reply */
+    icc_frames_clear(s);
+    reply = icc_frame_new(s, query);
 
     switch (query->major) {
     case ICC_CMD_QUERY_SERVICE:
@@ -393,31 +718,37 @@ static void icc_query(AeoliaPCIEState *s)
             printf("qemu: ICC: Unknown unk_0D query 0x%04X!\n", query->minor);
         }
         break;
-#if 0
     case ICC_CMD_QUERY_NVRAM:
         switch (query->minor) {
         case ICC_CMD_QUERY_NVRAM_OP_WRITE:
-            icc_query_nvram_write(s, reply);
+            icc_query_nvram_write(s, query, reply);
             break;
         case ICC_CMD_QUERY_NVRAM_OP_READ:
-            icc_query_nvram_read(s, reply);
+            icc_query_nvram_read(s, query, reply,
+                APCIE_NVRAM_BASE, APCIE_NVRAM_SIZE);
             break;
         default:
             printf("qemu: ICC: Unknown NVRAM query 0x%04X!\n", query->minor);
         }
         break;
-#endif
+    case ICC_CMD_QUERY_SNVRAM_READ:
+        icc_query_nvram_read(s, query, reply,
+            APCIE_SNVRAM_BASE, APCIE_SNVRAM_SIZE);
+        break;
     default:
         printf("qemu: ICC: Unknown query %#x!\n", query->major);
     }
-    icc_calculate_csum(reply);
-    s->icc_status |= APCIE_ICC_MSG_PENDING;
+    if (traced) {
+        icc_trace_query(query, reply, start);
+    }
     s->icc_doorbell &= ~APCIE_ICC_MSG_PENDING;
     s->icc_data[AMEM_ICC_QUERY_W] = 0;
     s->icc_data[AMEM_ICC_QUERY_R] = 1;
-    s->icc_data[AMEM_ICC_REPLY_W] = 1;
-    s->icc_data[AMEM_ICC_REPLY_R] = 0;
-    icc_send_irq(s);
+    icc_set_dirty(s);
+
+    /* The first frame always gets its own interrupt */
+    s->icc_status &= ~(APCIE_ICC_MSG_PENDING | APCIE_ICC_IRQ_PENDING);
+    icc_deliver(s);
 }
 
 static void icc_doorbell(AeoliaPCIEState *s, uint32_t value)
@@ -431,6 +762,45 @@ static void icc_doorbell(AeoliaPCIEState *s, uint32_t value)
     }
 }
 
+/* Queries rung through the ioeventfd are handled from the main loop, but
+ * other ICC register accesses still take the MMIO path. Those accesses
+ * first handle a query that was rung and not picked up yet, so the guest
+ * sees its doorbell writes take effect in program order. */
+static void icc_doorbell_flush(AeoliaPCIEState *s)
+{
+    if (s->icc_event_active && event_notifier_test_and_clear(&s->icc_event)) {
+        icc_doorbell(s, APCIE_ICC_MSG_PENDING);
+    }
+}
+
+static void icc_doorbell_notify(EventNotifier *e)
+{
+    AeoliaPCIEState *s = container_of(e, AeoliaPCIEState, icc_event);
+
+    icc_doorbell_flush(s);
+}
+
+/* The guest posts a query by writing MSG_PENDING alone to the doorbell, so
+ * that exact write can be turned into an eventfd signal by KVM. Any other
+ * value, such as interrupt acks, still takes the MMIO path. */
+static void icc_set_ioeventfd(AeoliaPCIEState *s, bool assign)
+{
+    if (assign) {
+        event_notifier_init(&s->icc_event, false);
+        event_notifier_set_handler(&s->icc_event, icc_doorbell_notify);
+        memory_region_add_eventfd(&s->iomem[2], APCIE_ICC_REG_DOORBELL, 4,
+            true, APCIE_ICC_MSG_PENDING, &s->icc_event);
+        s->icc_event_active = true;
+    } else {
+        memory_region_del_eventfd(&s->iomem[2], APCIE_ICC_REG_DOORBELL, 4,
+            true, APCIE_ICC_MSG_PENDING, &s->icc_event);
+        icc_doorbell_flush(s);
+        s->icc_event_active = false;
+        event_notifier_set_handler(&s->icc_event, NULL);
+        event_notifier_cleanup(&s->icc_event);
+    }
+}
+
 static void icc_irq_mask(AeoliaPCIEState *s, uint32_t type)
 {
     if (type != 3) {
@@ -438,6 +808,7 @@ static void icc_irq_mask(AeoliaPCIEState *s, uint32_t type)
         return;
     }
     stl_le_p(&s->icc_data[AMEM_ICC_QUERY_R], 1);
+    icc_set_dirty(s);
 }
 
 static uint64_t aeolia_pcie_peripherals_read(
@@ -458,8 +829,7 @@ static uint64_t aeolia_pcie_peripherals_read(
     case WDT_TIMER0:
     case WDT_TIMER1:
         // EMC timer ticking at 32.768kHz
-        value = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
-        value /= 30518LL; // 10^9 Hz / 32768 Hz
+        value = ps4_timebase_ticks(PS4_CLOCK_EMC);
         break;
     // SFlash
     case SFLASH_VENDOR:
@@ -473,9 +843,11 @@ static uint64_t aeolia_pcie_peripherals_read(
         break;
     // ICC
     case APCIE_ICC_REG_DOORBELL:
+        icc_doorbell_flush(s);
         value = s->icc_doorbell;
         break;
     case APCIE_ICC_REG_STATUS:
+        icc_doorbell_flush(s);
         value = s->icc_status;
         break;
     default:
@@ -526,12 +898,16 @@ static void aeolia_pcie_peripherals_write(
         break;
     // ICC
     case APCIE_ICC_REG_DOORBELL:
+        icc_doorbell_flush(s);
         icc_doorbell(s, value);
         break;
     case APCIE_ICC_REG_STATUS:
+        icc_doorbell_flush(s);
         s->icc_status &= ~value;
+        icc_deliver(s);
         break;
     case APCIE_ICC_REG_IRQ_MASK:
+        icc_doorbell_flush(s);
         icc_irq_mask(s, value);
         break;
     // PCIE
@@ -564,6 +940,8 @@ static const MemoryRegionOps aeolia_pcie_peripherals_ops = {
 static void aeolia_pcie_realize(PCIDevice *dev, Error **errp)
 {
     AeoliaPCIEState *s = AEOLIA_PCIE(dev);
+    Error *err = NULL;
+
     s->iommu_as = pci_device_iommu_address_space(dev);
 
     // PCI Configuration Space
@@ -594,10 +972,52 @@ static void aeolia_pcie_realize(PCIDevice *dev, Error **errp)
     /* sflash */
     s->sflash = fopen("sflash.bin", "r+");
     assert(s->sflash);
+
+    /* icc */
+    QSIMPLEQ_INIT(&s->icc_frames);
+    nvram_load(s, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    s->nvram_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+        nvram_writeback_timer, s);
+    s->vmstate = qemu_add_vm_change_state_handler(nvram_vm_state_change, s);
+    if (s->ioeventfd && kvm_eventfds_enabled()) {
+        icc_set_ioeventfd(s, true);
+    }
+
+    orbital_trace_register(ORBITAL_TRACE_ICC,
+        icc_trace_opname, icc_trace_format);
 }
 
+static void aeolia_pcie_exit(PCIDevice *dev)
+{
+    AeoliaPCIEState *s = AEOLIA_PCIE(dev);
+
+    if (s->ioeventfd && kvm_eventfds_enabled()) {
+        icc_set_ioeventfd(s, false);
+    }
+    if (s->vmstate) {
+        qemu_del_vm_change_state_handler(s->vmstate);
+    }
+    if (s->nvram_timer) {
+        nvram_writeback(s);
+        timer_free(s->nvram_timer);
+    }
+    icc_frames_clear(s);
+    msi_uninit(dev);
+}
+
+static Property aeolia_pcie_properties[] = {
+    DEFINE_PROP_DRIVE("nvram", AeoliaPCIEState, nvram_blk),
+    DEFINE_PROP_BOOL("ioeventfd", AeoliaPCIEState, ioeventfd, true),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void aeolia_pcie_class_init(ObjectClass *klass, void *data)
 {
+    DeviceClass *dc = DEVICE_CLASS(klass);
     PCIDeviceClass *pc = PCI_DEVICE_CLASS(klass);
 
     pc->vendor_id = 0x104D;
@@ -605,6 +1025,8 @@ static void aeolia_pcie_class_init(ObjectClass *klass, void *data)
     pc->revision = 0;
     pc->class_id = PCI_CLASS_SYSTEM_OTHER;
     pc->realize = aeolia_pcie_realize;
+    pc->exit = aeolia_pcie_exit;
+    dc->props = aeolia_pcie_properties;
 }
 
 static const TypeInfo aeolia_pcie_info = {
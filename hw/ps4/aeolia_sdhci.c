@@ -17,40 +17,65 @@
  * License along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * The Aeolia SD/MMC function is a standard SD Host Controller, so it is
+ * backed by the generic sdhci core. Its DMA goes through the bus master
+ * address space of this function (hence through the Liverpool IOMMU), and
+ * its interrupt line is turned into MSI messages.
+ */
+
 #include "aeolia.h"
 #include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
 #include "hw/pci/pci.h"
 #include "hw/pci/msi.h"
+#include "hw/sd/sdhci.h"
 
 #define AEOLIA_SDHCI(obj) OBJECT_CHECK(AeoliaSDHCIState, (obj), TYPE_AEOLIA_SDHCI)
 
+/* ADMA2 descriptors walked per transfer, so that a whole chain is done
+ * in a single pass rather than a few descriptors per timer tick */
+#define ASDHCI_ADMA_DESCS  1024
+
 typedef struct AeoliaSDHCIState {
     /*< private >*/
-    PCIDevice parent_obj;
+    SDHCIState parent_obj;
     /*< public >*/
-    MemoryRegion iomem;
+    bool level;
 } AeoliaSDHCIState;
 
-static uint64_t aeolia_sdhci_read(
-    void *opaque, hwaddr addr, unsigned size)
+/* interrupts */
+static void aeolia_sdhci_set_irq(void *opaque, int n, int level)
 {
-    return 0;
-}
+    AeoliaSDHCIState *s = opaque;
+    PCIDevice *dev = PCI_DEVICE(s);
+    bool raised = level && !s->level;
 
-static void aeolia_sdhci_write(
-    void *opaque, hwaddr addr, uint64_t value, unsigned size)
-{
+    s->level = level;
+    if (!msi_enabled(dev)) {
+        pci_set_irq(dev, level);
+    } else if (raised) {
+        msi_notify(dev, 0);
+    }
 }
 
-static const MemoryRegionOps aeolia_sdhci_ops = {
-    .read = aeolia_sdhci_read,
-    .write = aeolia_sdhci_write,
-    .endianness = DEVICE_LITTLE_ENDIAN,
-};
-
 static void aeolia_sdhci_realize(PCIDevice *dev, Error **errp)
 {
     AeoliaSDHCIState *s = AEOLIA_SDHCI(dev);
+    SDHCIState *sd = &s->parent_obj;
+    PCIDeviceClass *pc;
+    Error *err = NULL;
+
+    pc = PCI_DEVICE_CLASS(object_class_by_name(TYPE_PCI_SDHCI));
+    pc->realize(dev, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    qemu_free_irq(sd->irq);
+    sd->irq = qemu_allocate_irq(aeolia_sdhci_set_irq, s, 0);
+    sd->adma_descs_per_delay = ASDHCI_ADMA_DESCS;
 
     // PCI Configuration Space
     dev->config[PCI_CLASS_PROG] = 0x03;
@@ -58,15 +83,39 @@ static void aeolia_sdhci_realize(PCIDevice *dev, Error **errp)
     if (pci_is_express(dev)) {
         pcie_endpoint_cap_init(dev, 0x70);
     }
+}
 
-    // Memory
-    memory_region_init_io(&s->iomem, OBJECT(dev),
-        &aeolia_sdhci_ops, s, "aeolia-sdhci-mem", 0x1000);
-    pci_register_bar(dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem);
+static void aeolia_sdhci_exit(PCIDevice *dev)
+{
+    AeoliaSDHCIState *s = AEOLIA_SDHCI(dev);
+    PCIDeviceClass *pc;
+
+    pc = PCI_DEVICE_CLASS(object_class_by_name(TYPE_PCI_SDHCI));
+    msi_uninit(dev);
+    qemu_free_irq(s->parent_obj.irq);
+    s->parent_obj.irq = NULL;
+    pc->exit(dev);
+}
+
+static void aeolia_sdhci_reset(DeviceState *dev)
+{
+    AeoliaSDHCIState *s = AEOLIA_SDHCI(dev);
+    DeviceClass *dc;
+
+    dc = DEVICE_CLASS(object_class_by_name(TYPE_PCI_SDHCI));
+    dc->reset(dev);
+    s->level = false;
+}
+
+static void aeolia_sdhci_init(Object *obj)
+{
+    /* Both a conventional and an express function, see realize */
+    PCI_DEVICE(obj)->cap_present |= QEMU_PCI_CAP_EXPRESS;
 }
 
 static void aeolia_sdhci_class_init(ObjectClass *klass, void *data)
 {
+    DeviceClass *dc = DEVICE_CLASS(klass);
     PCIDeviceClass *pc = PCI_DEVICE_CLASS(klass);
 
     pc->vendor_id = 0x104D;
@@ -74,12 +123,15 @@ static void aeolia_sdhci_class_init(ObjectClass *klass, void *data)
     pc->revision = 0;
     pc->class_id = PCI_CLASS_SYSTEM_OTHER;
     pc->realize = aeolia_sdhci_realize;
+    pc->exit = aeolia_sdhci_exit;
+    dc->reset = aeolia_sdhci_reset;
 }
 
 static const TypeInfo aeolia_sdhci_info = {
     .name          = TYPE_AEOLIA_SDHCI,
-    .parent        = TYPE_PCI_DEVICE,
+    .parent        = TYPE_PCI_SDHCI,
     .instance_size = sizeof(AeoliaSDHCIState),
+    .instance_init = aeolia_sdhci_init,
     .class_init    = aeolia_sdhci_class_init,
     .interfaces    = (InterfaceInfo[]) {
         { INTERFACE_PCIE_DEVICE },
@@ -26,6 +26,8 @@
 #include "hw/sysbus.h"
 #include "chardev/char-fe.h"
 #include "qemu/error-report.h"
+#include "qemu/fifo8.h"
+#include "qemu/timer.h"
 
 #include "ui/orbital.h"
 
@@ -33,6 +35,7 @@
 #define REG_RXTX  0
 #define REG_IER   1
 #define REG_IIR   2
+#define REG_FCR   2  /* write-only, shares the IIR offset */
 #define REG_LCR   3
 #define REG_MCR   4
 #define REG_LSR   5
@@ -48,6 +51,13 @@
 #define IIR_STAT  (1<<0)
 #define IIR_ID0   (1<<1)
 #define IIR_ID1   (1<<2)
+#define IIR_ID2   (1<<3)
+#define IIR_FE    (3<<6)
+
+#define FCR_FE    (1<<0)
+#define FCR_RFR   (1<<1)
+#define FCR_XFR   (1<<2)
+#define FCR_ITL   (3<<6)
 
 #define LCR_WLS0  (1<<0)
 #define LCR_WLS1  (1<<1)
@@ -77,6 +87,19 @@
 #define MSR_RI    (1<<6)
 #define MSR_DCD   (1<<7)
 
+/* 16550 receive FIFO */
+#define UART_RX_FIFO_SIZE  16
+
+/* Transmitted bytes are batched, with or without FIFO mode, and sent to the
+ * backend once the buffer fills up or has been pending for UART_TX_DRAIN_NS.
+ * The transmitter is only reported busy (THRE clear) while the backend is
+ * not accepting data. */
+#define UART_TX_BUF_SIZE   256
+#define UART_TX_DRAIN_NS   (1 * SCALE_MS)
+
+/* Receive timeout, 4 character times at 115200 baud (8N1) */
+#define UART_RX_TIMEOUT_NS (4 * 10 * NANOSECONDS_PER_SECOND / 115200)
+
 #define AEOLIA_UART(obj) OBJECT_CHECK(AeoliaUartState, (obj), TYPE_AEOLIA_UART)
 
 struct AeoliaUartState {
@@ -84,8 +107,22 @@ struct AeoliaUartState {
 
     MemoryRegion iomem;
     qemu_irq irq;
+    CharBackend chr;
 
     uint32_t regs[REGS_MAX];
+    uint32_t fcr;
+
+    /* rx */
+    Fifo8 rx_fifo;
+    uint32_t rx_itl;
+    bool rx_timeout;
+    QEMUTimer *rx_timeout_timer;
+
+    /* tx */
+    uint8_t tx_buf[UART_TX_BUF_SIZE];
+    uint32_t tx_len;
+    guint tx_watch;
+    QEMUTimer *tx_drain_timer;
 };
 typedef struct AeoliaUartState AeoliaUartState;
 
@@ -97,7 +134,12 @@ static void uart_update_irq(AeoliaUartState *s)
             && (s->regs[REG_IER] & IER_RLSI)) {
         irq = 1;
         s->regs[REG_IIR] = IIR_ID1 | IIR_ID0;
-    } else if ((s->regs[REG_LSR] & LSR_DR) && (s->regs[REG_IER] & IER_RBRI)) {
+    } else if (s->rx_timeout && (s->regs[REG_IER] & IER_RBRI)) {
+        irq = 1;
+        s->regs[REG_IIR] = IIR_ID2 | IIR_ID1;
+    } else if ((s->regs[REG_LSR] & LSR_DR) && (s->regs[REG_IER] & IER_RBRI) &&
+               (!(s->fcr & FCR_FE) ||
+                fifo8_num_used(&s->rx_fifo) >= s->rx_itl)) {
         irq = 1;
         s->regs[REG_IIR] = IIR_ID1;
     } else if ((s->regs[REG_LSR] & LSR_THRE) && (s->regs[REG_IER] & IER_THRI)) {
@@ -110,10 +152,181 @@ static void uart_update_irq(AeoliaUartState *s)
         irq = 0;
         s->regs[REG_IIR] = IIR_STAT;
     }
+    if (s->fcr & FCR_FE) {
+        s->regs[REG_IIR] |= IIR_FE;
+    }
 
     qemu_set_irq(s->irq, irq);
 }
 
+/* tx */
+static gboolean uart_tx_watch(GIOChannel *chan, GIOCondition cond,
+                              void *opaque);
+
+static void uart_tx_flush(AeoliaUartState *s)
+{
+    int ret;
+
+    timer_del(s->tx_drain_timer);
+    if (s->tx_watch || !s->tx_len) {
+        return;
+    }
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        s->tx_len = 0;
+    } else {
+        ret = qemu_chr_fe_write(&s->chr, s->tx_buf, s->tx_len);
+        if (ret > 0) {
+            s->tx_len -= ret;
+            memmove(s->tx_buf, s->tx_buf + ret, s->tx_len);
+        }
+        if (s->tx_len) {
+            s->tx_watch = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                                uart_tx_watch, s);
+            if (!s->tx_watch) {
+                /* Backend cannot report when it is writable, drop the data */
+                s->tx_len = 0;
+            }
+        }
+    }
+
+    s->regs[REG_LSR] &= ~(LSR_THRE | LSR_TEMT);
+    if (s->tx_len < UART_TX_BUF_SIZE) {
+        s->regs[REG_LSR] |= LSR_THRE;
+    }
+    if (!s->tx_len) {
+        s->regs[REG_LSR] |= LSR_TEMT;
+    }
+}
+
+static gboolean uart_tx_watch(GIOChannel *chan, GIOCondition cond,
+                              void *opaque)
+{
+    AeoliaUartState *s = opaque;
+
+    s->tx_watch = 0;
+    uart_tx_flush(s);
+    uart_update_irq(s);
+    return FALSE;
+}
+
+static void uart_tx_drain(void *opaque)
+{
+    AeoliaUartState *s = opaque;
+
+    uart_tx_flush(s);
+    uart_update_irq(s);
+}
+
+static void uart_tx(AeoliaUartState *s, uint8_t ch)
+{
+    if (orbital_display_active()) {
+        orbital_log_uart(0, ch);
+    }
+    if (s->tx_len == UART_TX_BUF_SIZE) {
+        /* Guest ignored THRE, the character is lost */
+        return;
+    }
+    s->tx_buf[s->tx_len++] = ch;
+    s->regs[REG_LSR] &= ~LSR_TEMT;
+    if (s->tx_len == UART_TX_BUF_SIZE) {
+        uart_tx_flush(s);
+    } else if (s->tx_len == 1 && !s->tx_watch) {
+        timer_mod(s->tx_drain_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + UART_TX_DRAIN_NS);
+    }
+}
+
+/* rx */
+static uint8_t uart_rx_pop(AeoliaUartState *s)
+{
+    uint8_t ch = 0;
+
+    if (!fifo8_is_empty(&s->rx_fifo)) {
+        ch = fifo8_pop(&s->rx_fifo);
+    }
+    s->rx_timeout = false;
+    if (fifo8_is_empty(&s->rx_fifo)) {
+        s->regs[REG_LSR] &= ~LSR_DR;
+        timer_del(s->rx_timeout_timer);
+    } else {
+        timer_mod(s->rx_timeout_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + UART_RX_TIMEOUT_NS);
+    }
+    qemu_chr_fe_accept_input(&s->chr);
+    return ch;
+}
+
+static int uart_can_rx(void *opaque)
+{
+    AeoliaUartState *s = opaque;
+
+    if (!(s->fcr & FCR_FE)) {
+        return fifo8_is_empty(&s->rx_fifo) ? 1 : 0;
+    }
+    return fifo8_num_free(&s->rx_fifo);
+}
+
+static void uart_rx(void *opaque, const uint8_t *buf, int size)
+{
+    AeoliaUartState *s = opaque;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if (fifo8_is_full(&s->rx_fifo)) {
+            s->regs[REG_LSR] |= LSR_OE;
+            break;
+        }
+        fifo8_push(&s->rx_fifo, buf[i]);
+    }
+    s->regs[REG_LSR] |= LSR_DR;
+    timer_mod(s->rx_timeout_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + UART_RX_TIMEOUT_NS);
+    uart_update_irq(s);
+}
+
+static void uart_rx_timeout(void *opaque)
+{
+    AeoliaUartState *s = opaque;
+
+    if (!fifo8_is_empty(&s->rx_fifo)) {
+        s->rx_timeout = true;
+        uart_update_irq(s);
+    }
+}
+
+static void uart_event(void *opaque, int event)
+{
+    AeoliaUartState *s = opaque;
+
+    if (event == CHR_EVENT_BREAK) {
+        s->regs[REG_LSR] |= LSR_BI | LSR_DR;
+        uart_update_irq(s);
+    }
+}
+
+static void uart_set_fcr(AeoliaUartState *s, uint32_t value)
+{
+    static const uint32_t itl[] = { 1, 4, 8, 14 };
+
+    /* Toggling the FIFOs clears them */
+    if ((value ^ s->fcr) & FCR_FE) {
+        value |= FCR_RFR | FCR_XFR;
+    }
+    if (value & FCR_RFR) {
+        fifo8_reset(&s->rx_fifo);
+        timer_del(s->rx_timeout_timer);
+        s->rx_timeout = false;
+        s->regs[REG_LSR] &= ~(LSR_DR | LSR_OE);
+        qemu_chr_fe_accept_input(&s->chr);
+    }
+    if (value & FCR_XFR) {
+        /* Everything written so far has already left the shift register */
+        uart_tx_flush(s);
+    }
+    s->fcr = value & (FCR_FE | FCR_ITL);
+    s->rx_itl = itl[(value & FCR_ITL) >> 6];
+}
+
 static uint64_t uart_read(void *opaque, hwaddr addr,
                           unsigned size)
 {
@@ -123,15 +336,21 @@ static uint64_t uart_read(void *opaque, hwaddr addr,
     addr >>= 2;
     switch (addr) {
     case REG_RXTX:
-        r = 0; // TODO: getc(stdin);
-        s->regs[REG_LSR] &= ~LSR_DR;
+        r = uart_rx_pop(s);
         uart_update_irq(s);
         break;
     case REG_IIR:
-    case REG_LSR:
     case REG_MSR:
         r = s->regs[addr];
         break;
+    case REG_LSR:
+        r = s->regs[addr];
+        /* Error bits are cleared on read */
+        if (r & (LSR_OE | LSR_BI)) {
+            s->regs[REG_LSR] &= ~(LSR_OE | LSR_BI);
+            uart_update_irq(s);
+        }
+        break;
     case REG_IER:
     case REG_MCR:
         warn_report("aeolia_uart: read access to unimplemented register 0x"
@@ -159,18 +378,15 @@ static void uart_write(void *opaque, hwaddr addr,
     addr >>= 2;
     switch (addr) {
     case REG_RXTX:
-        putc(ch, stdout);
-        if (orbital_display_active())
-            orbital_log_uart(0, ch);
+        uart_tx(s, ch);
         break;
     case REG_IER:
     case REG_LCR:
     case REG_MCR:
         s->regs[addr] = value;
         break;
-    case REG_IIR:
-        warn_report("aeolia_uart: write access to unimplemented register 0x"
-                TARGET_FMT_plx, addr << 2);
+    case REG_FCR:
+        uart_set_fcr(s, value);
         break;
     case REG_LSR:
     case REG_MSR:
@@ -200,12 +416,19 @@ static void uart_reset(DeviceState *d)
     AeoliaUartState *s = AEOLIA_UART(d);
     int i;
 
+    uart_tx_flush(s);
     for (i = 0; i < REGS_MAX; i++) {
         s->regs[i] = 0;
     }
+    s->fcr = 0;
+    s->rx_itl = 1;
+    s->rx_timeout = false;
+    fifo8_reset(&s->rx_fifo);
+    timer_del(s->rx_timeout_timer);
 
     /* defaults */
     s->regs[REG_LSR] = LSR_THRE | LSR_TEMT;
+    s->regs[REG_IIR] = IIR_STAT;
 }
 
 static void aeolia_uart_init(Object *obj)
@@ -220,17 +443,48 @@ static void aeolia_uart_init(Object *obj)
     sysbus_init_mmio(dev, &s->iomem);
 }
 
+static void aeolia_uart_realize(DeviceState *dev, Error **errp)
+{
+    AeoliaUartState *s = AEOLIA_UART(dev);
+
+    fifo8_create(&s->rx_fifo, UART_RX_FIFO_SIZE);
+    s->rx_timeout_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                       uart_rx_timeout, s);
+    s->tx_drain_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, uart_tx_drain, s);
+    qemu_chr_fe_set_handlers(&s->chr, uart_can_rx, uart_rx,
+                             uart_event, NULL, s, NULL, true);
+}
+
+static int aeolia_uart_post_load(void *opaque, int version_id)
+{
+    AeoliaUartState *s = opaque;
+
+    if (s->tx_len) {
+        timer_mod(s->tx_drain_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + UART_TX_DRAIN_NS);
+    }
+    return 0;
+}
+
 static const VMStateDescription vmstate_aeolia_uart = {
     .name = "aeolia-uart",
-    .version_id = 1,
+    .version_id = 2,
     .minimum_version_id = 1,
+    .post_load = aeolia_uart_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, AeoliaUartState, REGS_MAX),
+        VMSTATE_UINT32_V(fcr, AeoliaUartState, 2),
+        VMSTATE_UINT32_V(rx_itl, AeoliaUartState, 2),
+        VMSTATE_BOOL_V(rx_timeout, AeoliaUartState, 2),
+        VMSTATE_STRUCT(rx_fifo, AeoliaUartState, 2, vmstate_fifo8, Fifo8),
+        VMSTATE_UINT32_V(tx_len, AeoliaUartState, 2),
+        VMSTATE_UINT8_ARRAY_V(tx_buf, AeoliaUartState, UART_TX_BUF_SIZE, 2),
         VMSTATE_END_OF_LIST()
     }
 };
 
 static Property aeolia_uart_properties[] = {
+    DEFINE_PROP_CHR("chardev", AeoliaUartState, chr),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -238,6 +492,7 @@ static void aeolia_uart_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
+    dc->realize = aeolia_uart_realize;
     dc->reset = uart_reset;
     dc->vmsd = &vmstate_aeolia_uart;
     dc->props = aeolia_uart_properties;
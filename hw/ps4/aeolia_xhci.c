@@ -17,66 +17,239 @@
  * License along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * The Aeolia xHCI function hosts three independent xHCI controllers, each
+ * one behind its own BAR and MSI vector. They are instances of the generic
+ * hcd-xhci model, plugged into a private bus that is invisible to the guest:
+ * their registers are mapped through the BARs of this function, their DMA
+ * goes through its bus master address space (hence through the Liverpool
+ * IOMMU), and their interrupt lines are turned into MSI messages.
+ */
+
 #include "aeolia.h"
 #include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/range.h"
+#include "qemu/timer.h"
+#include "hw/hw.h"
 #include "hw/pci/pci.h"
+#include "hw/pci/pci_bus.h"
 #include "hw/pci/msi.h"
+#include "hw/usb.h"
+#include "hw/usb/hcd-xhci.h"
 
 // Helpers
 #define AEOLIA_XHCI(obj) \
     OBJECT_CHECK(AeoliaXHCIState, (obj), TYPE_AEOLIA_XHCI)
 
+#define TYPE_AEOLIA_XHCI_HC "aeolia-xhci-hc"
+
+#define AXHCI_HC_COUNT  3
+#define AXHCI_BAR_SIZE  0x200000
+
+/* Interrupt moderation interval, in units of 250 ns */
+#define AXHCI_IMODI(imod)  ((int64_t)((imod) & 0xFFFF) * 250)
+
 typedef struct AeoliaXHCIState {
     /*< private >*/
     PCIDevice parent_obj;
     /*< public >*/
-    MemoryRegion iomem[3];
+    MemoryRegion iomem[AXHCI_HC_COUNT];
+    MemoryRegion iomem_hc[AXHCI_HC_COUNT];
+    MemoryRegion bus_mem;
+    MemoryRegion bus_io;
+    PCIBus bus;
+    XHCIState *hc[AXHCI_HC_COUNT];
+
+    /* interrupts */
+    bool level[AXHCI_HC_COUNT];
+    int64_t imod_deadline[AXHCI_HC_COUNT];
+    uint32_t imod_deferred;
+    QEMUTimer *imod_timer[AXHCI_HC_COUNT];
 } AeoliaXHCIState;
 
-static uint64_t aeolia_xhci_read
-    (void *opaque, hwaddr addr, unsigned size)
+/* interrupts */
+static void aeolia_xhci_notify(AeoliaXHCIState *s, int n)
 {
-    printf("aeolia_xhci_read:  { addr: %lX, size: %X }\n", addr, size);
-    return 0;
+    PCIDevice *dev = PCI_DEVICE(s);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (!msi_enabled(dev)) {
+        return;
+    }
+    s->imod_deadline[n] = now + AXHCI_IMODI(s->hc[n]->intr[0].imod);
+    msi_notify(dev, n % msi_nr_vectors_allocated(dev));
 }
 
-static void aeolia_xhci_write
-    (void *opaque, hwaddr addr, uint64_t value, unsigned size)
+static void aeolia_xhci_imod_expired(void *opaque)
 {
-    printf("aeolia_xhci_write: { addr: %lX, size: %X, value: %lX }\n", addr, size, value);
+    AeoliaXHCIState *s = opaque;
+    int n;
+
+    for (n = 0; n < AXHCI_HC_COUNT; n++) {
+        if (!(s->imod_deferred & (1 << n)) ||
+            timer_pending(s->imod_timer[n])) {
+            continue;
+        }
+        /* Events queued during the interval share a single message */
+        s->imod_deferred &= ~(1 << n);
+        if (s->level[n]) {
+            aeolia_xhci_notify(s, n);
+        }
+    }
 }
 
-static const MemoryRegionOps aeolia_xhci_ops = {
-    .read = aeolia_xhci_read,
-    .write = aeolia_xhci_write,
-    .endianness = DEVICE_LITTLE_ENDIAN,
-};
+static void aeolia_xhci_set_irq(void *opaque, int n, int level)
+{
+    AeoliaXHCIState *s = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (s->level[n] == !!level) {
+        return;
+    }
+    s->level[n] = level;
+    if (!level || (s->imod_deferred & (1 << n))) {
+        return;
+    }
+    if (now >= s->imod_deadline[n]) {
+        aeolia_xhci_notify(s, n);
+    } else {
+        s->imod_deferred |= 1 << n;
+        timer_mod(s->imod_timer[n], s->imod_deadline[n]);
+    }
+}
+
+static int aeolia_xhci_map_irq(PCIDevice *dev, int pin)
+{
+    return PCI_SLOT(dev->devfn);
+}
+
+static AddressSpace *aeolia_xhci_dma_as(PCIBus *bus, void *opaque, int devfn)
+{
+    return pci_get_address_space(PCI_DEVICE(opaque));
+}
+
+/* Controllers only master DMA when the function does */
+static void aeolia_xhci_write_config(PCIDevice *dev,
+    uint32_t addr, uint32_t value, int len)
+{
+    AeoliaXHCIState *s = AEOLIA_XHCI(dev);
+    uint16_t cmd;
+    int n;
+
+    pci_default_write_config(dev, addr, value, len);
+    if (!ranges_overlap(addr, len, PCI_COMMAND, 2)) {
+        return;
+    }
+    cmd = pci_get_word(dev->config + PCI_COMMAND) & PCI_COMMAND_MASTER;
+    for (n = 0; n < AXHCI_HC_COUNT; n++) {
+        pci_default_write_config(PCI_DEVICE(s->hc[n]), PCI_COMMAND, cmd, 2);
+    }
+}
 
 static void aeolia_xhci_realize(PCIDevice *dev, Error **errp)
 {
     AeoliaXHCIState *s = AEOLIA_XHCI(dev);
+    PCIBus *bus = &s->bus;
+    PCIDevice *hc;
+    Error *err = NULL;
+    char name[32];
+    int n;
 
     // PCI Configuration Space
     dev->config[PCI_CLASS_PROG] = 0x07;
     dev->config[PCI_INTERRUPT_LINE] = 0xFF;
     dev->config[PCI_INTERRUPT_PIN] = 0x00;
-    pci_add_capability(dev, PCI_CAP_ID_MSI, 0, PCI_CAP_SIZEOF, errp);
-
-    memory_region_init_io(&s->iomem[0], OBJECT(dev),
-        &aeolia_xhci_ops, s, "aeolia-xhci-0", 0x200000);
-    memory_region_init_io(&s->iomem[1], OBJECT(dev),
-        &aeolia_xhci_ops, s, "aeolia-xhci-1", 0x200000);
-    memory_region_init_io(&s->iomem[2], OBJECT(dev),
-        &aeolia_xhci_ops, s, "aeolia-xhci-2", 0x200000);
-
-    pci_register_bar(dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[0]);
-    pci_register_bar(dev, 2, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[1]);
-    pci_register_bar(dev, 4, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[2]);
-    msi_init(dev, 0x50, 1, true, false, errp);
+    msi_init(dev, 0x50, 4, true, false, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    if (pci_is_express(dev)) {
+        pcie_endpoint_cap_init(dev, 0x70);
+    }
+
+    // Controllers
+    memory_region_init(&s->bus_mem, OBJECT(dev), "aeolia-xhci-bus-mem",
+        UINT64_MAX);
+    memory_region_init(&s->bus_io, OBJECT(dev), "aeolia-xhci-bus-io", 0x10000);
+    qbus_create_inplace(bus, sizeof(s->bus), TYPE_PCI_BUS, DEVICE(dev), NULL);
+    bus->parent_dev = dev;
+    bus->address_space_mem = &s->bus_mem;
+    bus->address_space_io = &s->bus_io;
+    QLIST_INIT(&bus->child);
+    pci_bus_irqs(bus, aeolia_xhci_set_irq, aeolia_xhci_map_irq, s,
+        AXHCI_HC_COUNT);
+    pci_setup_iommu(bus, aeolia_xhci_dma_as, s);
+
+    for (n = 0; n < AXHCI_HC_COUNT; n++) {
+        hc = pci_create(bus, PCI_DEVFN(n, 0), TYPE_AEOLIA_XHCI_HC);
+        object_property_set_bool(OBJECT(hc), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+        s->hc[n] = XHCI(hc);
+        s->imod_timer[n] = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+            aeolia_xhci_imod_expired, s);
+
+        // Memory
+        snprintf(name, sizeof(name), "aeolia-xhci-%d", n);
+        memory_region_init(&s->iomem[n], OBJECT(dev), name, AXHCI_BAR_SIZE);
+        memory_region_init_alias(&s->iomem_hc[n], OBJECT(dev), name,
+            &s->hc[n]->mem, 0, memory_region_size(&s->hc[n]->mem));
+        memory_region_add_subregion(&s->iomem[n], 0, &s->iomem_hc[n]);
+        pci_register_bar(dev, n * 2, PCI_BASE_ADDRESS_SPACE_MEMORY,
+            &s->iomem[n]);
+    }
 }
 
+static void aeolia_xhci_exit(PCIDevice *dev)
+{
+    AeoliaXHCIState *s = AEOLIA_XHCI(dev);
+    int n;
+
+    for (n = 0; n < AXHCI_HC_COUNT; n++) {
+        if (s->imod_timer[n]) {
+            timer_free(s->imod_timer[n]);
+        }
+        if (s->hc[n]) {
+            memory_region_del_subregion(&s->iomem[n], &s->iomem_hc[n]);
+            object_unparent(OBJECT(s->hc[n]));
+        }
+    }
+    msi_uninit(dev);
+}
+
+static void aeolia_xhci_reset(DeviceState *dev)
+{
+    AeoliaXHCIState *s = AEOLIA_XHCI(dev);
+    int n;
+
+    for (n = 0; n < AXHCI_HC_COUNT; n++) {
+        timer_del(s->imod_timer[n]);
+        s->imod_deadline[n] = 0;
+    }
+    s->imod_deferred = 0;
+}
+
+static const VMStateDescription vmstate_aeolia_xhci = {
+    .name = "aeolia-xhci",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_PCI_DEVICE(parent_obj, AeoliaXHCIState),
+        VMSTATE_BOOL_ARRAY(level, AeoliaXHCIState, AXHCI_HC_COUNT),
+        VMSTATE_INT64_ARRAY(imod_deadline, AeoliaXHCIState, AXHCI_HC_COUNT),
+        VMSTATE_UINT32(imod_deferred, AeoliaXHCIState),
+        VMSTATE_TIMER_PTR_ARRAY(imod_timer, AeoliaXHCIState, AXHCI_HC_COUNT),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static void aeolia_xhci_class_init(ObjectClass *oc, void *data)
 {
+    DeviceClass *dc = DEVICE_CLASS(oc);
     PCIDeviceClass *pc = PCI_DEVICE_CLASS(oc);
 
     pc->vendor_id = 0x104D;
@@ -84,6 +257,11 @@ static void aeolia_xhci_class_init(ObjectClass *oc, void *data)
     pc->revision = 0;
     pc->class_id = PCI_CLASS_SYSTEM_OTHER;
     pc->realize = aeolia_xhci_realize;
+    pc->exit = aeolia_xhci_exit;
+    pc->config_write = aeolia_xhci_write_config;
+    dc->reset = aeolia_xhci_reset;
+    dc->vmsd = &vmstate_aeolia_xhci;
+    set_bit(DEVICE_CATEGORY_USB, dc->categories);
 }
 
 static const TypeInfo aeolia_xhci_info = {
@@ -97,9 +275,40 @@ static const TypeInfo aeolia_xhci_info = {
     },
 };
 
+/* controllers */
+static void aeolia_xhci_hc_init(Object *obj)
+{
+    XHCIState *xhci = XHCI(obj);
+
+    /* Interrupts are signaled by the parent function */
+    xhci->msi      = ON_OFF_AUTO_OFF;
+    xhci->msix     = ON_OFF_AUTO_OFF;
+    xhci->numintrs = 1;
+    xhci->numslots = MAXSLOTS;
+}
+
+static void aeolia_xhci_hc_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+    PCIDeviceClass *pc = PCI_DEVICE_CLASS(oc);
+
+    pc->vendor_id = 0x104D;
+    pc->device_id = 0x90A4;
+    pc->revision = 0;
+    dc->user_creatable = false;
+}
+
+static const TypeInfo aeolia_xhci_hc_info = {
+    .name          = TYPE_AEOLIA_XHCI_HC,
+    .parent        = TYPE_XHCI,
+    .instance_init = aeolia_xhci_hc_init,
+    .class_init    = aeolia_xhci_hc_class_init,
+};
+
 static void aeolia_register_types(void)
 {
     type_register_static(&aeolia_xhci_info);
+    type_register_static(&aeolia_xhci_hc_info);
 }
 
 type_init(aeolia_register_types)
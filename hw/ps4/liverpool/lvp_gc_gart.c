@@ -18,25 +18,43 @@
  */
 
 #include "lvp_gc_gart.h"
+#include "lvp_gc_perf.h"
 
+#include "qemu/atomic.h"
 #include "qemu/module.h"
 #include "exec/memory.h"
 #include "exec/address-spaces.h"
+#include "ui/orbital-memory.h"
 
 #define TYPE_LIVERPOOL_GART_MEMORY_REGION "liverpool-gart"
 
-#define UNUSED_ARGUMENT(x) (void)(x)
-
 #define DEBUG_GART 0
 
+#define GART_PTE_VALID (1ULL << 0)
+
+/* Each PDE maps 2048 pages of 4 KB */
+#define GART_PDE_SPAN  (1ULL << 23)
+#define GART_PTE_COUNT 2048
+
+/* Logical page numbers are 28-bit wide */
+#define GART_VA_MASK   ((1ULL << 40) - 1)
+
 typedef struct GARTMemoryRegion {
     /*< private >*/
     IOMMUMemoryRegion iommu_mr;
     /*< public >*/
     uint64_t pde_base;
+    uint64_t start;     /* first mapped logical page */
+    uint64_t end;       /* last mapped logical page */
+    IOMMUNotifierFlag notify_flags;
 } gart_as_t;
 
-void liverpool_gc_gart_set_pde(gart_state_t *s, int vmid, uint64_t pde_base)
+typedef void (*gart_map_fn)(GARTMemoryRegion *gart,
+    IOMMUTLBEntry *entry, void *opaque);
+
+static void gart_notify(GARTMemoryRegion *gart);
+
+static GARTMemoryRegion *gart_get(gart_state_t *s, int vmid)
 {
     GARTMemoryRegion *mr;
     AddressSpace *as;
@@ -58,17 +76,125 @@ void liverpool_gc_gart_set_pde(gart_state_t *s, int vmid, uint64_t pde_base)
             vmid_gart_name);
     } else {
         mr = s->mr[vmid];
-        as = s->as[vmid];
     }
-    mr->pde_base = pde_base;
+    return mr;
+}
+
+void liverpool_gc_gart_set_pde(gart_state_t *s, int vmid, uint64_t pde_base)
+{
+    GARTMemoryRegion *mr = gart_get(s, vmid);
+
+    if (mr->pde_base != pde_base) {
+        mr->pde_base = pde_base;
+        gart_notify(mr);
+    }
+}
+
+void liverpool_gc_gart_set_range(gart_state_t *s, int vmid,
+    uint64_t start, uint64_t end)
+{
+    GARTMemoryRegion *mr = gart_get(s, vmid);
+
+    if (mr->start != start || mr->end != end) {
+        mr->start = start;
+        mr->end = end;
+        gart_notify(mr);
+    }
+}
+
+void liverpool_gc_gart_invalidate(gart_state_t *s, uint32_t vmid_mask)
+{
+    int vmid;
+
+    for (vmid = 0; vmid < GART_VMID_COUNT; vmid++) {
+        if ((vmid_mask & (1 << vmid)) && s->mr[vmid]) {
+            gart_notify(s->mr[vmid]);
+        }
+    }
+}
+
+/* Reads the PTE mapping @addr. Debuggers run without the BQL and must not
+ * dispatch MMIO, so with @inspect only tables in RAM are read. */
+static bool gart_read_pte(uint64_t pde_base, hwaddr addr, bool inspect,
+    uint64_t *pte)
+{
+    uint64_t pde_index, pde;
+    uint64_t pte_base, pte_index;
+
+    pde_index = (addr >> 23) & 0xFFFFF; /* TODO: What's the mask? */
+    pte_index = (addr >> 12) & 0x7FF;
+    if (!inspect) {
+        pde = ldq_le_phys(&address_space_memory, pde_base + pde_index * 8);
+        pte_base = (pde & ~0xFF);
+        *pte = ldq_le_phys(&address_space_memory, pte_base + pte_index * 8);
+        return true;
+    }
+    if (!orbital_memory_read_ram(&address_space_memory,
+        pde_base + pde_index * 8, &pde, sizeof(pde))) {
+        return false;
+    }
+    pte_base = (le64_to_cpu(pde) & ~0xFF);
+    if (!orbital_memory_read_ram(&address_space_memory,
+        pte_base + pte_index * 8, pte, sizeof(*pte))) {
+        return false;
+    }
+    *pte = le64_to_cpu(*pte);
+    return true;
+}
+
+static uint64_t gart_walk(uint64_t pde_base, hwaddr addr)
+{
+    uint64_t pte;
+
+    gart_read_pte(pde_base, addr, false, &pte);
+    liverpool_gc_perf_inc(LVP_PERF_GART_WALKS);
+    if (!(pte & GART_PTE_VALID)) {
+        liverpool_gc_perf_inc(LVP_PERF_GART_MISSES);
+    }
+    return pte;
+}
+
+bool liverpool_gc_gart_translate(gart_state_t *s, int vmid,
+    uint64_t addr, hwaddr *paddr)
+{
+    GARTMemoryRegion *gart;
+    uint64_t pte;
+
+    assert(vmid < GART_VMID_COUNT);
+    gart = s->mr[vmid];
+    if (!gart || !gart->pde_base) {
+        liverpool_gc_perf_inc(LVP_PERF_GART_MISSES);
+        return false;
+    }
+    pte = gart_walk(gart->pde_base, addr);
+    *paddr = (pte & ~0xFFF) | (addr & 0xFFF);
+    return true;
+}
+
+bool liverpool_gc_gart_lookup(gart_state_t *s, int vmid,
+    uint64_t addr, hwaddr *paddr)
+{
+    GARTMemoryRegion *gart;
+    uint64_t pte;
+
+    assert(vmid < GART_VMID_COUNT);
+    gart = atomic_read(&s->mr[vmid]);
+    if (!gart || !gart->pde_base) {
+        return false;
+    }
+    if (!gart_read_pte(gart->pde_base, addr, true, &pte) ||
+        !(pte & GART_PTE_VALID)) {
+        return false;
+    }
+    *paddr = (pte & ~0xFFF) | (addr & 0xFFF);
+    return true;
 }
 
 static IOMMUTLBEntry gart_translate(
     IOMMUMemoryRegion *iommu, hwaddr addr, IOMMUAccessFlags flag)
 {
     GARTMemoryRegion *gart = (GARTMemoryRegion *)iommu;
-    uint64_t pde_base, pde_index, pde;
-    uint64_t pte_base, pte_index, pte;
+    uint64_t pte;
     IOMMUTLBEntry ret = {
         .target_as = &address_space_memory,
         .iova = addr,
@@ -78,14 +204,10 @@ static IOMMUTLBEntry gart_translate(
     };
 
     if (!gart->pde_base) {
+        liverpool_gc_perf_inc(LVP_PERF_GART_MISSES);
         return ret;
     }
-    pde_base = gart->pde_base;
-    pde_index = (addr >> 23) & 0xFFFFF; /* TODO: What's the mask? */
-    pte_index = (addr >> 12) & 0x7FF;
-    pde = ldq_le_phys(&address_space_memory, pde_base + pde_index * 8);
-    pte_base = (pde & ~0xFF);
-    pte = ldq_le_phys(&address_space_memory, pte_base + pte_index * 8);
+    pte = gart_walk(gart->pde_base, addr);
 
     ret.translated_addr = (pte & ~0xFFF) | (addr & 0xFFF);
     ret.addr_mask = 0xFFF; /* TODO: How to decode this? (set for now to 4 KB pages) */
@@ -93,13 +215,95 @@ static IOMMUTLBEntry gart_translate(
     return ret;
 }
 
+/* Calls @fn on every valid page intersecting [start, end] and the range
+ * of the context. Nothing is known to be mapped until the range is set. */
+static void gart_walk_range(GARTMemoryRegion *gart, hwaddr start, hwaddr end,
+    gart_map_fn fn, void *opaque)
+{
+    IOMMUTLBEntry entry = {
+        .target_as = &address_space_memory,
+        .addr_mask = 0xFFF,
+        .perm = IOMMU_RW,
+    };
+    uint64_t *ptes, pde, pte;
+    hwaddr addr, va;
+    int i;
+
+    start = MAX(start, gart->start << 12);
+    end = MIN(end, MIN((gart->end << 12) | 0xFFF, GART_VA_MASK));
+    if (!gart->pde_base || !gart->end || start > end) {
+        return;
+    }
+    ptes = g_new(uint64_t, GART_PTE_COUNT);
+    for (addr = start & ~(GART_PDE_SPAN - 1); addr <= end;
+         addr += GART_PDE_SPAN) {
+        pde = ldq_le_phys(&address_space_memory,
+            gart->pde_base + (addr >> 23) * 8);
+        if (!(pde & ~0xFF) || address_space_read(&address_space_memory,
+            pde & ~0xFF, MEMTXATTRS_UNSPECIFIED, (uint8_t *)ptes,
+            GART_PTE_COUNT * 8) != MEMTX_OK) {
+            continue;
+        }
+        for (i = 0; i < GART_PTE_COUNT; i++) {
+            va = addr + ((hwaddr)i << 12);
+            pte = le64_to_cpu(ptes[i]);
+            if (va < (start & ~0xFFF) || va > end || !(pte & GART_PTE_VALID)) {
+                continue;
+            }
+            entry.iova = va;
+            entry.translated_addr = pte & ~0xFFF;
+            fn(gart, &entry, opaque);
+        }
+    }
+    g_free(ptes);
+}
+
+static void gart_notify_map(GARTMemoryRegion *gart,
+    IOMMUTLBEntry *entry, void *opaque)
+{
+    memory_region_notify_iommu(&gart->iommu_mr, *entry);
+}
+
+/* Tells the notifiers that the whole context changed: an UNMAP of its
+ * address space, followed by MAPs of the pages it now translates */
+static void gart_notify(GARTMemoryRegion *gart)
+{
+    IOMMUTLBEntry entry = {
+        .target_as = &address_space_memory,
+        .iova = 0,
+        .translated_addr = 0,
+        .addr_mask = GART_VA_MASK,
+        .perm = IOMMU_NONE
+    };
+
+    if (gart->notify_flags == IOMMU_NOTIFIER_NONE) {
+        return;
+    }
+    memory_region_notify_iommu(&gart->iommu_mr, entry);
+    if (gart->notify_flags & IOMMU_NOTIFIER_MAP) {
+        gart_walk_range(gart, 0, GART_VA_MASK, gart_notify_map, NULL);
+    }
+}
+
+static void gart_replay_map(GARTMemoryRegion *gart,
+    IOMMUTLBEntry *entry, void *opaque)
+{
+    memory_region_notify_one(opaque, entry);
+}
+
+static void gart_replay(IOMMUMemoryRegion *iommu, IOMMUNotifier *n)
+{
+    GARTMemoryRegion *gart = (GARTMemoryRegion *)iommu;
+
+    gart_walk_range(gart, n->start, n->end, gart_replay_map, n);
+}
+
 static void gart_notify_flag_changed(
     IOMMUMemoryRegion *iommu, IOMMUNotifierFlag old, IOMMUNotifierFlag new)
 {
     GARTMemoryRegion *gart = (GARTMemoryRegion *)iommu;
-    UNUSED_ARGUMENT(gart);
-    UNUSED_ARGUMENT(old);
-    UNUSED_ARGUMENT(new);
+
+    gart->notify_flags = new;
 }
 
 static void liverpool_gart_memory_region_class_init(
@@ -109,6 +313,7 @@ static void liverpool_gart_memory_region_class_init(
 
     imrc->translate = gart_translate;
     imrc->notify_flag_changed = gart_notify_flag_changed;
+    imrc->replay = gart_replay;
 }
 
 static const TypeInfo liverpool_gart_info = {
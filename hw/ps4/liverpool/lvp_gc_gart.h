@@ -22,6 +22,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/typedefs.h"
+#include "exec/hwaddr.h"
 
 #define GART_VMID_COUNT 16
 
@@ -37,5 +38,19 @@ typedef struct gart_state_t {
 } gart_state_t;
 
 void liverpool_gc_gart_set_pde(gart_state_t *s, int vmid, uint64_t pde_base);
+void liverpool_gc_gart_set_range(gart_state_t *s, int vmid,
+    uint64_t start, uint64_t end);
+
+/* Notifies the IOMMU notifiers of each context in @vmid_mask that its
+ * translations may have changed */
+void liverpool_gc_gart_invalidate(gart_state_t *s, uint32_t vmid_mask);
+bool liverpool_gc_gart_translate(gart_state_t *s, int vmid,
+    uint64_t addr, hwaddr *paddr);
+
+/* Translates without updating the performance counters, for debuggers.
+ * Unlike liverpool_gc_gart_translate, fails on invalid entries, and only
+ * reads page tables in RAM, so it is safe without the BQL. */
+bool liverpool_gc_gart_lookup(gart_state_t *s, int vmid,
+    uint64_t addr, hwaddr *paddr);
 
 #endif /* HW_PS4_LIVERPOOL_GC_GART_H */
@@ -19,40 +19,280 @@
 
 #include "lvp_gc_gfx.h"
 #include "lvp_gc_gart.h"
+#include "lvp_gc_gfx_capture.h"
+#include "lvp_gc_perf.h"
+#include "lvp_gc_shader.h"
 #include "hw/ps4/liverpool/pm4.h"
+#include "hw/ps4/liverpool_gc_mmio.h"
 #include "hw/ps4/macros.h"
+#include "hw/ps4/ps4_timebase.h"
 
 #include "exec/address-spaces.h"
+#include "qemu/atomic.h"
+#include "qemu/host-utils.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
 
 #define FIELD(from, to, name) \
     struct { uint32_t:(32-to-1); uint32_t name:(to-from+1); uint32_t:from; }
 
+/* Number of render backends reporting occlusion results */
+#define GFX_RB_COUNT 8
+
+/* Delays between polls of a stalled condition */
+#define CP_BACKOFF_MIN_US    8
+#define CP_BACKOFF_MAX_US    16000
+
+typedef enum cp_ring_status_t {
+    CP_RING_IDLE,       /* nothing to do until wptr moves */
+    CP_RING_PROGRESS,   /* consumed at least one packet */
+    CP_RING_STALLED,    /* waiting on memory, registers or a partial packet */
+} cp_ring_status_t;
+
 /* forward declarations */
 static uint32_t cp_handle_pm4(gfx_state_t *s, const uint32_t *rb);
 
+static void gfx_ring_desc_free(gfx_ring_desc_t *desc)
+{
+    address_space_unmap(desc->as, desc->mapped_base,
+        desc->mapped_size, true, desc->mapped_size);
+    g_free(desc);
+}
+
+void liverpool_gc_gfx_init(gfx_state_t *s)
+{
+    event_notifier_init(&s->cp_event, false);
+    s->cp_pred_exec = true;
+    s->shaders = liverpool_gc_shader_cache_new();
+}
+
+/* Stops and joins the CP thread. Called with the iothread lock held, after
+ * the doorbell ioeventfds have been removed. The lock is dropped while
+ * joining, since MMIO accesses from the CP thread may need it. The caller
+ * cleans up cp_event once the thread is gone. */
+void liverpool_gc_gfx_cp_stop(gfx_state_t *s)
+{
+    atomic_set(&s->cp_stopping, true);
+    event_notifier_set(&s->cp_event);
+    qemu_mutex_unlock_iothread();
+    qemu_thread_join(&s->cp_thread);
+    qemu_mutex_lock_iothread();
+}
+
 void liverpool_gc_gfx_cp_set_ring_location(gfx_state_t *s,
     int index, uint64_t base, uint64_t size)
 {
     gart_state_t *gart = s->gart;
-    uint32_t *mapped_base;
-    hwaddr mapped_size;
+    gfx_ring_desc_t *desc, *old_desc;
     assert(index <= 1);     // Only two ringbuffers are implemented
-    assert(size != 0);      // Size must be positive
-    assert(size % 8 == 0);  // Size must be a multiple of 8 bytes
 
-    if (s->cp_rb[index].mapped_base) {
-        address_space_unmap(gart->as[0],
-            s->cp_rb[index].mapped_base, s->cp_rb[index].base,
-            s->cp_rb[index].mapped_size, true);
+    /* The size comes from CP_RB*_CNTL, the previous location is kept */
+    if (size < 8 || !is_power_of_2(size)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "lvp-gfx: ring %d size 0x%" PRIx64
+                      " is not a power of 2\n", index, size);
+        return;
+    }
+
+    desc = g_new0(gfx_ring_desc_t, 1);
+    desc->as = gart->as[0];
+    desc->base = base;
+    desc->size = size;
+    desc->mapped_size = size;
+    desc->mapped_base = address_space_map(desc->as,
+        base, &desc->mapped_size, true);
+    if (!desc->mapped_base || desc->mapped_size < size) {
+        qemu_log_mask(LOG_GUEST_ERROR, "lvp-gfx: ring %d at 0x%" PRIx64
+                      " (size 0x%" PRIx64 ") is not in RAM\n",
+                      index, base, size);
+        if (desc->mapped_base) {
+            address_space_unmap(desc->as, desc->mapped_base,
+                desc->mapped_size, false, 0);
+        }
+        g_free(desc);
+        return;
+    }
+
+    if (s->capture) {
+        pm4_capture_ring(s->capture, index, base, size);
+    }
+
+    /* The CP thread may still be reading packets from the previous
+     * location, so it is only unmapped once every reader is done. */
+    old_desc = s->cp_rb[index].desc;
+    atomic_inc(&s->cp_rb[index].gen);
+    atomic_rcu_set(&s->cp_rb[index].desc, desc);
+    if (old_desc) {
+        call_rcu(old_desc, gfx_ring_desc_free, rcu);
+    }
+    liverpool_gc_gfx_cp_kick(s);
+}
+
+uint32_t liverpool_gc_gfx_cp_get_rptr(gfx_state_t *s, int index)
+{
+    return atomic_load_acquire(&s->cp_rb[index].rptr);
+}
+
+uint32_t liverpool_gc_gfx_cp_get_wptr(gfx_state_t *s, int index)
+{
+    return atomic_load_acquire(&s->cp_rb[index].wptr);
+}
+
+void liverpool_gc_gfx_cp_set_rptr(gfx_state_t *s, int index, uint32_t rptr)
+{
+    atomic_store_release(&s->cp_rb[index].rptr, rptr);
+}
+
+void liverpool_gc_gfx_cp_set_wptr(gfx_state_t *s, int index, uint32_t wptr)
+{
+    atomic_store_release(&s->cp_rb[index].wptr, wptr);
+    liverpool_gc_gfx_cp_kick(s);
+}
+
+bool liverpool_gc_gfx_cp_busy(gfx_state_t *s)
+{
+    gfx_ring_desc_t *desc;
+    uint32_t mask;
+    bool busy = false;
+    int i;
+
+    rcu_read_lock();
+    for (i = 0; i < ARRAY_SIZE(s->cp_rb); i++) {
+        desc = atomic_rcu_read(&s->cp_rb[i].desc);
+        if (!desc) {
+            continue;
+        }
+        mask = (desc->size >> 2) - 1;
+        busy |= ((atomic_read(&s->cp_rb[i].rptr) ^
+                  atomic_read(&s->cp_rb[i].wptr)) & mask) != 0;
+    }
+    rcu_read_unlock();
+    return busy;
+}
+
+/* Wakes up the CP if it is parked. Must be called after updating any state
+ * the CP could be waiting on: ring pointers, registers or doorbells. */
+void liverpool_gc_gfx_cp_kick(gfx_state_t *s)
+{
+    smp_mb();
+    if (atomic_read(&s->cp_parked) && atomic_xchg(&s->cp_parked, false)) {
+        event_notifier_set(&s->cp_event);
+    }
+}
+
+/* Parks the CP until kicked, or until timeout_ms elapses if non-negative.
+ * Idle parks check the rings again after publishing cp_parked, so a kick
+ * racing with the decision to park is never lost. Doorbell ioeventfds set
+ * cp_event straight from the kernel, whether the CP is parked or not. */
+static void cp_park(gfx_state_t *s, int timeout_ms)
+{
+    GPollFD pfd = {
+        .fd = event_notifier_get_fd(&s->cp_event),
+        .events = G_IO_IN,
+    };
+
+    atomic_set(&s->cp_parked, true);
+    smp_mb();
+    if (timeout_ms >= 0) {
+        qemu_poll_ns(&pfd, 1, timeout_ms * SCALE_MS);
+    } else if (!liverpool_gc_gfx_cp_busy(s)) {
+        qemu_poll_ns(&pfd, 1, -1);
+    }
+    event_notifier_test_and_clear(&s->cp_event);
+    atomic_set(&s->cp_parked, false);
+}
+
+/* Delays the next poll of a stalled condition with exponential backoff.
+ * Short delays just sleep, longer ones park so that kicks cut them short. */
+static void cp_backoff(gfx_state_t *s, uint32_t *delay_us)
+{
+    uint32_t delay = *delay_us;
+
+    delay = delay ? MIN(delay * 2, CP_BACKOFF_MAX_US) : CP_BACKOFF_MIN_US;
+    *delay_us = delay;
+    if (delay < 1000) {
+        g_usleep(delay);
+    } else {
+        cp_park(s, delay / 1000);
+    }
+}
+
+/* memory access */
+static uint32_t cp_read_dword(gfx_state_t *s, uint32_t vmid, uint64_t addr)
+{
+    uint32_t value = 0;
+
+    address_space_rw(s->gart->as[vmid], addr, MEMTXATTRS_UNSPECIFIED,
+        (uint8_t *)&value, sizeof(value), false);
+    return le32_to_cpu(value);
+}
+
+static uint64_t cp_read_qword(gfx_state_t *s, uint32_t vmid, uint64_t addr)
+{
+    uint64_t value = 0;
+
+    address_space_rw(s->gart->as[vmid], addr, MEMTXATTRS_UNSPECIFIED,
+        (uint8_t *)&value, sizeof(value), false);
+    return le64_to_cpu(value);
+}
+
+static void cp_write_dword(gfx_state_t *s, uint32_t vmid, uint64_t addr,
+    uint32_t value)
+{
+    value = cpu_to_le32(value);
+    address_space_rw(s->gart->as[vmid], addr, MEMTXATTRS_UNSPECIFIED,
+        (uint8_t *)&value, sizeof(value), true);
+}
+
+/* Records the pages a packet is about to access. Memory records are always
+ * emitted before the packet record, so this runs before any write. */
+static void cp_capture_memory(gfx_state_t *s, uint32_t vmid,
+    uint64_t addr, uint64_t size)
+{
+    if (s->capture && size) {
+        pm4_capture_memory(s->capture, s->gart, vmid, addr, size);
+    }
+}
+
+static uint32_t cp_read_reg(gfx_state_t *s, uint32_t reg)
+{
+    return atomic_read(&s->mmio[reg & 0xFFFF]);
+}
+
+static void cp_write_reg(gfx_state_t *s, uint32_t reg, uint32_t value)
+{
+    atomic_set(&s->mmio[reg & 0xFFFF], value);
+}
+
+/* synchronization */
+static bool cp_wait_done(gfx_state_t *s, const gfx_wait_t *wait)
+{
+    uint32_t value;
+
+    if (wait->mem_space) {
+        value = cp_read_dword(s, wait->vmid, wait->addr);
+    } else {
+        value = cp_read_reg(s, wait->addr);
+    }
+    value &= wait->mask;
+
+    switch (wait->function) {
+    case PM4_WAIT_REG_MEM_FUNC_LESS:
+        return value < wait->reference;
+    case PM4_WAIT_REG_MEM_FUNC_LESS_EQUAL:
+        return value <= wait->reference;
+    case PM4_WAIT_REG_MEM_FUNC_EQUAL:
+        return value == wait->reference;
+    case PM4_WAIT_REG_MEM_FUNC_NOT_EQUAL:
+        return value != wait->reference;
+    case PM4_WAIT_REG_MEM_FUNC_GREATER_EQUAL:
+        return value >= wait->reference;
+    case PM4_WAIT_REG_MEM_FUNC_GREATER:
+        return value > wait->reference;
+    case PM4_WAIT_REG_MEM_FUNC_ALWAYS:
+    default:
+        return true;
     }
-    s->cp_rb[index].base = base;
-    s->cp_rb[index].size = size;
-    mapped_size = size;
-    mapped_base = address_space_map(gart->as[0], base, &mapped_size, true);
-    s->cp_rb[index].mapped_base = mapped_base;
-    s->cp_rb[index].mapped_size = mapped_size;
-    assert(s->cp_rb[index].mapped_base);
-    assert(s->cp_rb[index].mapped_size >= size);
 }
 
 /* cp packet operations */
@@ -61,7 +301,7 @@ static void cp_handle_pm4_it_indirect_buffer(
 {
     gart_state_t *gart = s->gart;
     uint64_t ib_base, ib_base_lo, ib_base_hi;
-    uint32_t ib_size, vmid, i; 
+    uint32_t ib_size, vmid, vmid_prev, skip, i;
     uint32_t *mapped_ib;
     hwaddr mapped_size;
 
@@ -71,15 +311,28 @@ static void cp_handle_pm4_it_indirect_buffer(
     ib_size = packet[3] & 0xFFFFF;
     vmid = (packet[3] >> 24) & 0xF;
 
+    cp_capture_memory(s, vmid, ib_base, ib_size * 4);
+    liverpool_gc_perf_add(LVP_PERF_IB_BYTES, ib_size * 4);
+
     i = 0;
-    mapped_size = ib_size;
-    mapped_ib = address_space_map(gart->as[vmid], ib_base, &mapped_size, true);
+    mapped_size = ib_size * 4;
+    mapped_ib = address_space_map(gart->as[vmid], ib_base, &mapped_size, false);
     assert(mapped_ib);
-    assert(mapped_size >= ib_size);
-    while (i < ib_size) {
+    assert(mapped_size >= ib_size * 4);
+    vmid_prev = s->cp_vmid;
+    s->cp_vmid = vmid;
+    s->cp_ib_depth++;
+    while (i < ib_size && !s->cp_ib_abort) {
         i += cp_handle_pm4(s, &mapped_ib[i]);
+        skip = s->cp_skip_dwords;
+        s->cp_skip_dwords = 0;
+        if (skip && i < ib_size) {
+            i += MIN(skip, ib_size - i);
+        }
     }
-    address_space_unmap(gart->as[vmid], mapped_ib, ib_base, mapped_size, true);
+    s->cp_ib_depth--;
+    s->cp_vmid = vmid_prev;
+    address_space_unmap(gart->as[vmid], mapped_ib, mapped_size, false, mapped_size);
 }
 
 static void cp_handle_pm4_it_event_write_eop(
@@ -127,11 +380,11 @@ static void cp_handle_pm4_it_event_write_eop(
         break;
     case 3: // 011
         size = 8;
-        data = 0; // TODO: Send 64-bit value of GPU clock counter.
+        data = ps4_timebase_ticks(PS4_CLOCK_GPU);
         break;
     case 4: // 100
         size = 8;
-        data = 0; // TODO: Send 64-bit value of CP_PERFCOUNTER_HI/LO.
+        data = liverpool_gc_perf_counter(s->mmio, mmCPG_PERFCOUNTER0_SELECT);
         break;
     default:
         size = 0;
@@ -139,10 +392,11 @@ static void cp_handle_pm4_it_event_write_eop(
     if (size) {
         vmid = 0; // TODO: How is VMID selected?
         addr = ((uint64_t)data_cntl.addr_hi << 32) | addr_lo;
+        cp_capture_memory(s, vmid, addr, size);
         mapped_size = size;
         mapped_addr = address_space_map(gart->as[vmid], addr, &mapped_size, true);
         memcpy(mapped_addr, &data, size);
-        address_space_unmap(gart->as[vmid], mapped_addr, addr, mapped_size, true);
+        address_space_unmap(gart->as[vmid], mapped_addr, mapped_size, true, mapped_size);
     }
 
     // Interrupt action for the end-of-pipe event
@@ -160,6 +414,215 @@ static void cp_handle_pm4_it_event_write_eop(
     s->vgt_event_initiator = event_cntl.event_type;
 }
 
+static void cp_handle_pm4_it_set_predication(
+    gfx_state_t *s, const uint32_t *packet)
+{
+    uint64_t addr, begin, end;
+    uint32_t pred_op, rb;
+    bool visible;
+
+    pred_op = EXTRACT(packet[2], PM4_SET_PREDICATION_DW2_PRED_OP);
+    addr = EXTRACT(packet[2], PM4_SET_PREDICATION_DW2_START_ADDR_HI);
+    addr = (addr << 32) | (packet[1] & ~0xF);
+
+    switch (pred_op) {
+    case PM4_PRED_OP_CLEAR:
+        s->cp_pred_exec = true;
+        return;
+    case PM4_PRED_OP_ZPASS:
+        // Each RB writes a pair of begin/end ZPASS counts, with bit 63 set
+        // once valid. Results are final by the time the CP gets here, so
+        // the wait/draw hint makes no difference. Missing results count as
+        // visible, so that objects are never dropped.
+        cp_capture_memory(s, s->cp_vmid, addr, GFX_RB_COUNT * 16);
+        visible = false;
+        for (rb = 0; rb < GFX_RB_COUNT; rb++) {
+            begin = cp_read_qword(s, s->cp_vmid, addr + rb * 16 + 0);
+            end   = cp_read_qword(s, s->cp_vmid, addr + rb * 16 + 8);
+            if (!(begin >> 63) || !(end >> 63) || end != begin) {
+                visible = true;
+                break;
+            }
+        }
+        break;
+    default:
+        // TODO: PRIMCOUNT needs streamout statistics
+        visible = true;
+        break;
+    }
+    if (EXTRACT(packet[2], PM4_SET_PREDICATION_DW2_CONTINUE)) {
+        visible |= s->cp_pred_visible;
+    }
+    s->cp_pred_visible = visible;
+    if (EXTRACT(packet[2], PM4_SET_PREDICATION_DW2_PRED_BOOL)) {
+        s->cp_pred_exec = visible;
+    } else {
+        s->cp_pred_exec = !visible;
+    }
+}
+
+static void cp_handle_pm4_it_cond_exec(
+    gfx_state_t *s, const uint32_t *packet, uint32_t count)
+{
+    uint64_t addr;
+    uint32_t exec_count;
+
+    addr = ((uint64_t)(packet[2] & 0xFFFF) << 32) | (packet[1] & ~0x3);
+    // CIK added a control dword before the count
+    exec_count = EXTRACT(packet[count >= 4 ? 4 : 3], PM4_COND_EXEC_EXEC_COUNT);
+    cp_capture_memory(s, s->cp_vmid, addr, 4);
+    if (cp_read_dword(s, s->cp_vmid, addr) == 0) {
+        s->cp_skip_dwords = exec_count;
+    }
+}
+
+static void cp_handle_pm4_it_write_data(
+    gfx_state_t *s, const uint32_t *packet, uint32_t count)
+{
+    uint64_t addr;
+    uint32_t dst_sel, wr_one_addr, i, n;
+
+    dst_sel = EXTRACT(packet[1], PM4_WRITE_DATA_DW1_DST_SEL);
+    wr_one_addr = EXTRACT(packet[1], PM4_WRITE_DATA_DW1_WR_ONE_ADDR);
+    addr = ((uint64_t)packet[3] << 32) | packet[2];
+    n = count - 3;
+
+    switch (dst_sel) {
+    case PM4_WRITE_DATA_DST_SEL_REG:
+        for (i = 0; i < n; i++) {
+            cp_write_reg(s, addr + (wr_one_addr ? 0 : i), packet[4 + i]);
+        }
+        break;
+    case PM4_WRITE_DATA_DST_SEL_MEM_SYNC:
+    case PM4_WRITE_DATA_DST_SEL_TC_L2:
+    case PM4_WRITE_DATA_DST_SEL_MEM_ASYNC:
+        addr &= ~0x3ULL;
+        cp_capture_memory(s, s->cp_vmid, addr, wr_one_addr ? 4 : n * 4);
+        for (i = 0; i < n; i++) {
+            cp_write_dword(s, s->cp_vmid,
+                addr + (wr_one_addr ? 0 : i * 4), packet[4 + i]);
+        }
+        break;
+    default:
+        // TODO: GDS is not emulated
+        break;
+    }
+}
+
+static void cp_handle_pm4_it_wait_reg_mem(
+    gfx_state_t *s, const uint32_t *packet)
+{
+    gfx_ring_t *rb = s->cp_ring;
+    gfx_wait_t wait;
+    uint32_t delay_us = 0, gen;
+
+    wait.function = EXTRACT(packet[1], PM4_WAIT_REG_MEM_DW1_FUNCTION);
+    wait.mem_space = EXTRACT(packet[1], PM4_WAIT_REG_MEM_DW1_MEM_SPACE);
+    wait.vmid = s->cp_vmid;
+    if (wait.mem_space) {
+        wait.addr = ((uint64_t)(packet[3] & 0xFFFF) << 32) | (packet[2] & ~0x3);
+    } else {
+        wait.addr = packet[2] & 0xFFFF;
+    }
+    wait.reference = packet[4];
+    wait.mask = packet[5];
+    if (wait.mem_space) {
+        cp_capture_memory(s, wait.vmid, wait.addr, 4);
+    }
+
+    if (s->cp_skip_waits || cp_wait_done(s, &wait)) {
+        return;
+    }
+    if (s->cp_ib_depth == 0) {
+        // The ring handler retries the condition, serving other rings
+        s->cp_wait = wait;
+        s->cp_stalled = true;
+        return;
+    }
+
+    // IBs cannot be resumed midway, so park right here. Nothing down this
+    // call chain touches the ring mapping anymore, so the RCU read lock
+    // taken by the ring handler is released while parked. If the ring is
+    // moved meanwhile, the ring handler's packet and pointers are stale:
+    // the rest of the IB is abandoned and the ring handler drops them.
+    gen = rb ? atomic_read(&rb->gen) : 0;
+    rcu_read_unlock();
+    do {
+        cp_backoff(s, &delay_us);
+    } while (!cp_wait_done(s, &wait) && !atomic_read(&s->cp_stopping));
+    rcu_read_lock();
+    if (atomic_read(&s->cp_stopping) || (rb && atomic_read(&rb->gen) != gen)) {
+        s->cp_ib_abort = true;
+    }
+}
+
+static void cp_handle_pm4_it_dma_data(
+    gfx_state_t *s, const uint32_t *packet)
+{
+    AddressSpace *as = s->gart->as[s->cp_vmid];
+    uint8_t buffer[0x1000];
+    uint64_t src, dst;
+    uint32_t src_sel, dst_sel, command, byte_count, chunk, value, i;
+    bool sas, das, saic, daic;
+
+    src_sel = EXTRACT(packet[1], PM4_DMA_DATA_DW1_SRC_SEL);
+    dst_sel = EXTRACT(packet[1], PM4_DMA_DATA_DW1_DST_SEL);
+    src = ((uint64_t)packet[3] << 32) | packet[2];
+    dst = ((uint64_t)packet[5] << 32) | packet[4];
+    command = packet[6];
+    byte_count = EXTRACT(command, PM4_DMA_DATA_DW6_BYTE_COUNT);
+    sas = EXTRACT(command, PM4_DMA_DATA_DW6_SAS);
+    das = EXTRACT(command, PM4_DMA_DATA_DW6_DAS);
+    saic = EXTRACT(command, PM4_DMA_DATA_DW6_SAIC);
+    daic = EXTRACT(command, PM4_DMA_DATA_DW6_DAIC);
+
+    if (src_sel == PM4_DMA_DATA_SRC_SEL_GDS ||
+        dst_sel == PM4_DMA_DATA_DST_SEL_GDS) {
+        // TODO: GDS is not emulated
+        return;
+    }
+    if (src_sel != PM4_DMA_DATA_SRC_SEL_DATA && !sas) {
+        cp_capture_memory(s, s->cp_vmid, src, saic ? 4 : byte_count);
+    }
+    if (!das) {
+        cp_capture_memory(s, s->cp_vmid, dst, daic ? 4 : byte_count);
+    }
+
+    // Linear memory copies are done in bulk
+    if (src_sel == PM4_DMA_DATA_SRC_SEL_SRC_ADDR &&
+        !sas && !das && !saic && !daic) {
+        while (byte_count) {
+            chunk = MIN(byte_count, sizeof(buffer));
+            address_space_rw(as, src, MEMTXATTRS_UNSPECIFIED,
+                buffer, chunk, false);
+            address_space_rw(as, dst, MEMTXATTRS_UNSPECIFIED,
+                buffer, chunk, true);
+            src += chunk;
+            dst += chunk;
+            byte_count -= chunk;
+        }
+        return;
+    }
+
+    // Registers, fixed addresses and fills move one dword at a time
+    for (i = 0; i < byte_count / 4; i++) {
+        if (src_sel == PM4_DMA_DATA_SRC_SEL_DATA) {
+            value = packet[2];
+        } else if (sas) {
+            value = cp_read_reg(s, src >> 2);
+        } else {
+            value = cp_read_dword(s, s->cp_vmid, src);
+        }
+        if (das) {
+            cp_write_reg(s, dst >> 2, value);
+        } else {
+            cp_write_dword(s, s->cp_vmid, dst, value);
+        }
+        src += saic ? 0 : 4;
+        dst += daic ? 0 : 4;
+    }
+}
+
 static void cp_handle_pm4_it_set_config_reg(
     gfx_state_t *s, const uint32_t *packet, uint32_t count)
 {
@@ -188,12 +651,62 @@ static void cp_handle_pm4_it_set_context_reg(
     }
 }
 
+/* Program registers, in the order of lvp_shader_stage_t */
+static const uint32_t cp_shader_pgm_lo[LVP_SHADER_STAGE_COUNT] = {
+    [LVP_SHADER_LS] = mmSPI_SHADER_PGM_LO_LS,
+    [LVP_SHADER_HS] = mmSPI_SHADER_PGM_LO_HS,
+    [LVP_SHADER_ES] = mmSPI_SHADER_PGM_LO_ES,
+    [LVP_SHADER_GS] = mmSPI_SHADER_PGM_LO_GS,
+    [LVP_SHADER_VS] = mmSPI_SHADER_PGM_LO_VS,
+    [LVP_SHADER_PS] = mmSPI_SHADER_PGM_LO_PS,
+    [LVP_SHADER_CS] = mmCOMPUTE_PGM_LO,
+};
+
+/* Binds the programs whose PGM_LO/PGM_HI registers were just written */
+static void cp_bind_shaders(gfx_state_t *s, uint32_t reg, uint32_t count)
+{
+    lvp_shader_stage_t stage;
+    uint32_t pgm_lo;
+    uint64_t addr;
+
+    for (stage = 0; stage < LVP_SHADER_STAGE_COUNT; stage++) {
+        pgm_lo = cp_shader_pgm_lo[stage];
+        if (pgm_lo + 1 < reg || pgm_lo >= reg + count) {
+            continue;
+        }
+        // Programs are 256-byte aligned, PGM_HI holds address bits 47:40
+        addr = ((uint64_t)s->mmio[pgm_lo] << 8) |
+               ((uint64_t)(s->mmio[pgm_lo + 1] & 0xFF) << 40);
+        if (!addr || !s->gart->as[s->cp_vmid]) {
+            continue;
+        }
+        liverpool_gc_shader_bind(s->shaders, s->gart->as[s->cp_vmid],
+            s->cp_vmid, addr, stage);
+    }
+}
+
+static void cp_handle_pm4_it_set_sh_reg(
+    gfx_state_t *s, const uint32_t *packet, uint32_t count)
+{
+    uint32_t i;
+    uint32_t reg_offset, reg_count;
+
+    reg_offset = packet[1] & 0xFFFF;
+    reg_count = count - 1;
+    assert(reg_offset + reg_count <= 0x400);
+    for (i = 0; i < reg_count; i++) {
+        s->mmio[0x2C00 + reg_offset + i] = packet[2 + i];
+    }
+    cp_bind_shaders(s, 0x2C00 + reg_offset, reg_count);
+}
+
 /* cp packet types */
 static uint32_t cp_handle_pm4_type0(gfx_state_t *s, const uint32_t *packet)
 {
     uint32_t reg, count;
     reg   = EXTRACT(packet[0], PM4_TYPE0_HEADER_REG);
     count = EXTRACT(packet[0], PM4_TYPE0_HEADER_COUNT) + 1;
+    liverpool_gc_perf_inc(LVP_PERF_PM4_TYPE0);
     return count + 1;
 }
 
@@ -206,6 +719,7 @@ static uint32_t cp_handle_pm4_type1(gfx_state_t *s, const uint32_t *packet)
 
 static uint32_t cp_handle_pm4_type2(gfx_state_t *s, const uint32_t *packet)
 {
+    liverpool_gc_perf_inc(LVP_PERF_PM4_TYPE2);
     return 1;
 }
 
@@ -216,8 +730,25 @@ static uint32_t cp_handle_pm4_type3(gfx_state_t *s, const uint32_t *packet)
     shtype = EXTRACT(packet[0], PM4_TYPE3_HEADER_SHTYPE);
     itop   = EXTRACT(packet[0], PM4_TYPE3_HEADER_ITOP);
     count  = EXTRACT(packet[0], PM4_TYPE3_HEADER_COUNT) + 1;
+    liverpool_gc_perf_inc(LVP_PERF_PM4_TYPE3);
+    liverpool_gc_perf_inc(LVP_PERF_PM4_IT + (itop & 0xFF));
+    if (pred && !s->cp_pred_exec) {
+        return count + 1;
+    }
 
     switch (itop) {
+    case PM4_IT_SET_PREDICATION:
+        cp_handle_pm4_it_set_predication(s, packet);
+        break;
+    case PM4_IT_COND_EXEC:
+        cp_handle_pm4_it_cond_exec(s, packet, count);
+        break;
+    case PM4_IT_WRITE_DATA:
+        cp_handle_pm4_it_write_data(s, packet, count);
+        break;
+    case PM4_IT_WAIT_REG_MEM:
+        cp_handle_pm4_it_wait_reg_mem(s, packet);
+        break;
     case PM4_IT_INDIRECT_BUFFER:
         cp_handle_pm4_it_indirect_buffer(s, packet);
         break;
@@ -230,53 +761,238 @@ static uint32_t cp_handle_pm4_type3(gfx_state_t *s, const uint32_t *packet)
     case PM4_IT_SET_CONTEXT_REG:
         cp_handle_pm4_it_set_context_reg(s, packet, count);
         break;
+    case PM4_IT_SET_SH_REG:
+        cp_handle_pm4_it_set_sh_reg(s, packet, count);
+        break;
+    case PM4_IT_DMA_DATA:
+        cp_handle_pm4_it_dma_data(s, packet);
+        break;
     }
     return count + 1;
 }
 
+static uint32_t cp_pm4_packet_size(uint32_t header)
+{
+    switch (EXTRACT(header, PM4_PACKET_TYPE)) {
+    case PM4_PACKET_TYPE0:
+        return EXTRACT(header, PM4_TYPE0_HEADER_COUNT) + 2;
+    case PM4_PACKET_TYPE3:
+        return EXTRACT(header, PM4_TYPE3_HEADER_COUNT) + 2;
+    default:
+        return 1;
+    }
+}
+
+/* Records the packet in the orbital CP trace, the opcode being the packet
+ * type and IT opcode, followed by the first dwords of the packet. */
+static void cp_trace_pm4(const uint32_t *packet, int64_t start)
+{
+    orbital_trace_record_t rec;
+    uint32_t type, count, i;
+
+    type = EXTRACT(packet[0], PM4_PACKET_TYPE);
+    count = cp_pm4_packet_size(packet[0]) - 1;
+    rec.timestamp = start;
+    rec.duration = MIN(get_clock() - start, UINT32_MAX);
+    rec.opcode = type << 8;
+    if (type == PM4_PACKET_TYPE3) {
+        rec.opcode |= EXTRACT(packet[0], PM4_TYPE3_HEADER_ITOP);
+    }
+    rec.data[0] = packet[0];
+    for (i = 1; i < ARRAY_SIZE(rec.data); i++) {
+        rec.data[i] = (i <= count) ? packet[i] : 0;
+    }
+    orbital_trace_record(ORBITAL_TRACE_CP, &rec);
+}
+
 static uint32_t cp_handle_pm4(gfx_state_t *s, const uint32_t *packet)
 {
-    uint32_t type;
+    uint32_t type, size;
+    int64_t start = 0;
+    bool traced;
 
     trace_pm4_packet(packet);
+    traced = orbital_trace_enabled(ORBITAL_TRACE_CP);
+    if (traced) {
+        start = get_clock();
+    }
     type = EXTRACT(packet[0], PM4_PACKET_TYPE);
     switch (type) {
     case PM4_PACKET_TYPE0:
-        return cp_handle_pm4_type0(s, packet);
+        size = cp_handle_pm4_type0(s, packet);
+        break;
     case PM4_PACKET_TYPE1:
-        return cp_handle_pm4_type1(s, packet);
+        size = cp_handle_pm4_type1(s, packet);
+        break;
     case PM4_PACKET_TYPE2:
-        return cp_handle_pm4_type2(s, packet);
+        size = cp_handle_pm4_type2(s, packet);
+        break;
     case PM4_PACKET_TYPE3:
-        return cp_handle_pm4_type3(s, packet);
+        size = cp_handle_pm4_type3(s, packet);
+        break;
+    default:
+        size = 1;
     }
-    return 1;
+    if (traced && !s->cp_ib_abort) {
+        cp_trace_pm4(packet, start);
+    }
+    return size;
 }
 
-static uint32_t cp_handle_ringbuffer(gfx_state_t *s, gfx_ring_t *rb)
+uint32_t liverpool_gc_gfx_cp_packet(gfx_state_t *s,
+    const uint32_t *packet, uint32_t count)
 {
-    uint32_t index;
-    uint32_t *packet;
+    uint32_t size;
+
+    if (count == 0 || cp_pm4_packet_size(packet[0]) > count) {
+        return 0;
+    }
+    // Captures only contain the packets that were executed, so discards
+    // requested by COND_EXEC are already accounted for.
+    size = cp_handle_pm4(s, packet);
+    s->cp_skip_dwords = 0;
+    s->cp_stalled = false;
+    s->cp_ib_abort = false;
+    return size;
+}
+
+/* Processes a single packet from the ring, or completes the one that was
+ * waiting on a condition. */
+static cp_ring_status_t cp_handle_ringbuffer(gfx_state_t *s, gfx_ring_t *rb)
+{
+    gfx_ring_desc_t *desc;
+    const uint32_t *packet;
+    uint32_t rptr, wptr, mask, index, size, avail, i;
+    cp_ring_status_t status = CP_RING_IDLE;
+
+    rcu_read_lock();
+    desc = atomic_rcu_read(&rb->desc);
+    if (!desc) {
+        goto out;
+    }
+    mask = (desc->size >> 2) - 1;
+    rptr = atomic_read(&rb->rptr) & mask;
+    wptr = atomic_load_acquire(&rb->wptr) & mask;
+    if (rb->stalled) {
+        if (!cp_wait_done(s, &rb->wait)) {
+            status = CP_RING_STALLED;
+            goto out;
+        }
+        rb->stalled = false;
+        atomic_store_release(&rb->rptr, (rptr + rb->wait_size) & mask);
+        status = CP_RING_PROGRESS;
+        goto out;
+    }
+    if (rptr == wptr) {
+        goto out;
+    }
+
+    avail = (wptr - rptr) & mask;
+    if (rb->skip_dwords) {
+        size = MIN(rb->skip_dwords, avail);
+        rb->skip_dwords -= size;
+        atomic_store_release(&rb->rptr, (rptr + size) & mask);
+        status = CP_RING_PROGRESS;
+        goto out;
+    }
+
+    index = rptr;
+    size = cp_pm4_packet_size(desc->mapped_base[index]);
+    if (size > avail) {
+        status = CP_RING_STALLED;
+        goto out;
+    }
+    if (index + size > mask + 1) {
+        /* Packet wraps around the end of the ring, make it contiguous */
+        for (i = 0; i < size; i++) {
+            s->cp_wrap_packet[i] = desc->mapped_base[(index + i) & mask];
+        }
+        packet = s->cp_wrap_packet;
+    } else {
+        packet = &desc->mapped_base[index];
+    }
+    s->cp_ring = rb;
+    cp_handle_pm4(s, packet);
+    s->cp_ring = NULL;
+    if (s->cp_ib_abort) {
+        /* The ring was moved while an IB was parked: packet, rptr and mask
+         * belong to the old location, so none of them is used anymore.
+         * A partially executed packet cannot be replayed, nor recorded. */
+        s->cp_ib_abort = false;
+        s->cp_stalled = false;
+        s->cp_skip_dwords = 0;
+        status = CP_RING_PROGRESS;
+        goto out;
+    }
+    /* The handlers recorded the memory the packet reads or writes before
+     * touching it, so replay finds it in place when the packet comes */
+    if (s->capture) {
+        pm4_capture_packet(s->capture, rb - s->cp_rb, packet, size);
+    }
+    liverpool_gc_perf_add(LVP_PERF_RING_BYTES, size * 4);
+    if (s->cp_stalled) {
+        s->cp_stalled = false;
+        rb->stalled = true;
+        rb->wait = s->cp_wait;
+        rb->wait_size = size;
+        status = CP_RING_STALLED;
+        goto out;
+    }
+    rb->skip_dwords = s->cp_skip_dwords;
+    s->cp_skip_dwords = 0;
+    atomic_store_release(&rb->rptr, (rptr + size) & mask);
+    status = CP_RING_PROGRESS;
 
-    index = rb->rptr >> 2;
-    packet = &rb->mapped_base[index];
-    return cp_handle_pm4(s, packet);
+out:
+    rcu_read_unlock();
+    return status;
 }
 
 void *liverpool_gc_gfx_cp_thread(void *arg)
 {
     gfx_state_t *s = arg;
-    gfx_ring_t* rb0 = &s->cp_rb[0];
-    gfx_ring_t* rb1 = &s->cp_rb[1];
+    uint32_t delay_us = 0;
+    int64_t start;
+    bool busy, idle, stalled;
+    int i;
 
-    while (true) {
-        if (rb0->rptr < rb0->wptr) {
-            rb0->rptr += cp_handle_ringbuffer(s, rb0);
+    rcu_register_thread();
+    while (!atomic_read(&s->cp_stopping)) {
+        start = get_clock();
+        idle = true;
+        do {
+            busy = false;
+            stalled = false;
+            for (i = 0; i < ARRAY_SIZE(s->cp_rb); i++) {
+                switch (cp_handle_ringbuffer(s, &s->cp_rb[i])) {
+                case CP_RING_PROGRESS:
+                    busy = true;
+                    break;
+                case CP_RING_STALLED:
+                    stalled = true;
+                    break;
+                default:
+                    break;
+                }
+            }
+            idle &= !busy;
+        } while (busy && !atomic_read(&s->cp_stopping));
+        if (!idle) {
+            liverpool_gc_perf_add(LVP_PERF_CP_BUSY_NS, get_clock() - start);
+            delay_us = 0;
+            /* Ring boundary: whatever was consumed is on disk before the
+             * CP goes to sleep */
+            if (s->capture) {
+                pm4_capture_flush(s->capture);
+            }
         }
-        if (rb1->rptr < rb1->wptr) {
-            rb1->rptr += cp_handle_ringbuffer(s, rb1);
+        if (stalled) {
+            cp_backoff(s, &delay_us);
+        } else {
+            delay_us = 0;
+            cp_park(s, -1);
         }
-        usleep(1000);
     }
+    rcu_unregister_thread();
     return NULL;
 }
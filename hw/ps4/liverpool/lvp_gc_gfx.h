@@ -21,32 +21,80 @@
 #define HW_PS4_LIVERPOOL_GC_GFX_H
 
 #include "qemu/osdep.h"
+#include "qemu/event_notifier.h"
+#include "qemu/rcu.h"
 #include "qemu/thread.h"
 #include "exec/hwaddr.h"
+#include "ui/orbital-trace.h"
 
 #include "gca/gfx_7_2_enum.h"
 
 /* forward declarations */
 typedef struct gart_state_t gart_state_t;
+typedef struct pm4_capture_t pm4_capture_t;
+typedef struct lvp_shader_cache_t lvp_shader_cache_t;
 
-typedef struct gfx_ring_t {
+/* Ring location, replaced as a whole and reclaimed after a grace period */
+typedef struct gfx_ring_desc_t {
+    struct rcu_head rcu;
+    AddressSpace *as;
     uint64_t base;
     uint64_t size;
-    uint32_t rptr;
-    uint32_t wptr;
     /* qemu */
     uint32_t *mapped_base;
     hwaddr mapped_size;
+} gfx_ring_desc_t;
+
+/* Condition polled by WAIT_REG_MEM */
+typedef struct gfx_wait_t {
+    bool mem_space;         /* addr is a GPU virtual address, else a register */
+    uint32_t vmid;
+    uint64_t addr;
+    uint32_t function;
+    uint32_t reference;
+    uint32_t mask;
+} gfx_wait_t;
+
+/* Ring pointers are dword offsets, wrapping at the ring size */
+typedef struct gfx_ring_t {
+    gfx_ring_desc_t *desc;  /* RCU-protected, published under the BQL */
+    uint32_t gen;           /* bumped before every new desc is published */
+    uint32_t rptr;          /* advanced by the CP thread (store-release) */
+    uint32_t wptr;          /* advanced by the vCPU (store-release) */
+    /* cp thread */
+    bool stalled;           /* packet at rptr is waiting on a condition */
+    gfx_wait_t wait;
+    uint32_t wait_size;
+    uint32_t skip_dwords;   /* dwords discarded by COND_EXEC */
 } gfx_ring_t;
 
+/* Largest PM4 packet: type-3 header followed by 0x4000 dwords */
+#define PM4_PACKET_MAX_DWORDS 0x4001
+
 /* GFX State */
 typedef struct gfx_state_t {
     QemuThread cp_thread;
     gart_state_t *gart;
     uint32_t *mmio;
+    pm4_capture_t *capture;
+    lvp_shader_cache_t *shaders;
 
     /* cp */
     gfx_ring_t cp_rb[2];
+    uint32_t cp_wrap_packet[PM4_PACKET_MAX_DWORDS];
+    uint32_t cp_ib_depth;       /* IB nesting level of the current packet */
+    uint32_t cp_vmid;           /* VMID of the current packet */
+    uint32_t cp_skip_dwords;    /* dwords discarded by COND_EXEC */
+    gfx_ring_t *cp_ring;        /* ring of the current packet, if any */
+    bool cp_ib_abort;           /* ring moved while an IB was parked */
+    bool cp_stalled;            /* top-level packet is waiting on cp_wait */
+    gfx_wait_t cp_wait;
+    bool cp_skip_waits;         /* waits are assumed satisfied (replay) */
+    bool cp_pred_exec;          /* packets with PRED=1 are executed */
+    bool cp_pred_visible;       /* last SET_PREDICATION visibility result */
+    EventNotifier cp_event;     /* set by cp_kick or a doorbell ioeventfd */
+    bool cp_parked;
+    bool cp_stopping;           /* set once, the CP thread exits on wakeup */
 
     /* vgt */
     VGT_EVENT_TYPE vgt_event_initiator;
@@ -62,10 +110,27 @@ typedef struct gfx_state_t {
 
 /* debugging */
 void trace_pm4_packet(const uint32_t *packet);
+const char* liverpool_gc_gfx_trace_opname(uint32_t opcode);
+void liverpool_gc_gfx_trace_format(const orbital_trace_record_t *rec,
+    char *buf, size_t size);
+
+void liverpool_gc_gfx_init(gfx_state_t *s);
+void liverpool_gc_gfx_cp_stop(gfx_state_t *s);
 
 /* cp */
+void liverpool_gc_gfx_cp_kick(gfx_state_t *s);
 void liverpool_gc_gfx_cp_set_ring_location(gfx_state_t *s,
     int index, uint64_t base, uint64_t size);
+uint32_t liverpool_gc_gfx_cp_get_rptr(gfx_state_t *s, int index);
+uint32_t liverpool_gc_gfx_cp_get_wptr(gfx_state_t *s, int index);
+void liverpool_gc_gfx_cp_set_rptr(gfx_state_t *s, int index, uint32_t rptr);
+void liverpool_gc_gfx_cp_set_wptr(gfx_state_t *s, int index, uint32_t wptr);
+bool liverpool_gc_gfx_cp_busy(gfx_state_t *s);
+
+/* Executes a single top-level packet of count dwords, for replay. Returns
+ * its size, or 0 if the header claims more dwords than count. */
+uint32_t liverpool_gc_gfx_cp_packet(gfx_state_t *s,
+    const uint32_t *packet, uint32_t count);
 
 void *liverpool_gc_gfx_cp_thread(void *arg);
 
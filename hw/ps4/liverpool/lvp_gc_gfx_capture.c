@@ -0,0 +1,244 @@
+/*
+ * QEMU model of Liverpool's GFX device.
+ * PM4 command stream capture.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvp_gc_gfx_capture.h"
+#include "lvp_gc_gart.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "exec/address-spaces.h"
+
+#include <zlib.h>
+
+#define PAGE_MASK (~(uint64_t)(PM4_CAPTURE_PAGE_SIZE - 1))
+
+/* GART translations are keyed by vmid and virtual page */
+#define MAP_KEY(vmid, va) \
+    (((uint64_t)(vmid) << 60) | ((va) >> 12))
+
+struct pm4_capture_t {
+    QemuMutex lock;
+    FILE *file;
+    char *filename;
+    bool failed;            /* a write came up short, capture is disabled */
+    /* last translation recorded for each (vmid, va) */
+    GHashTable *maps;
+    /* checksum of the last contents recorded for each pa */
+    GHashTable *pages;
+};
+
+/* Writes are dropped once one of them fails: a capture with a hole in it
+ * cannot be replayed anyway, and the error is only reported once. */
+static void capture_write(pm4_capture_t *c, const void *data, size_t size)
+{
+    if (c->failed || size == 0) {
+        return;
+    }
+    if (fwrite(data, size, 1, c->file) != 1) {
+        error_report("PM4 capture: write to '%s' failed, capture disabled",
+            c->filename);
+        c->failed = true;
+    }
+}
+
+static void capture_flush(pm4_capture_t *c)
+{
+    if (c->failed) {
+        return;
+    }
+    if (fflush(c->file) != 0) {
+        error_report("PM4 capture: flush of '%s' failed, capture disabled",
+            c->filename);
+        c->failed = true;
+    }
+}
+
+static void capture_write_record(pm4_capture_t *c,
+    uint32_t type, const void *payload, uint32_t size)
+{
+    pm4_capture_record_t record;
+
+    record.type = cpu_to_le32(type);
+    record.size = cpu_to_le32(size);
+    capture_write(c, &record, sizeof(record));
+    capture_write(c, payload, size);
+}
+
+static void capture_insert(GHashTable *table, uint64_t key, uint64_t value)
+{
+    uint64_t *entry = g_new(uint64_t, 2);
+
+    entry[0] = key;
+    entry[1] = value;
+    g_hash_table_replace(table, &entry[0], entry);
+}
+
+static bool capture_lookup(GHashTable *table, uint64_t key, uint64_t *value)
+{
+    uint64_t *entry = g_hash_table_lookup(table, &key);
+
+    if (!entry) {
+        return false;
+    }
+    *value = entry[1];
+    return true;
+}
+
+pm4_capture_t *pm4_capture_open(const char *filename, Error **errp)
+{
+    pm4_capture_header_t header;
+    pm4_capture_t *c;
+    FILE *file;
+
+    file = fopen(filename, "wb");
+    if (!file) {
+        error_setg_errno(errp, errno,
+            "Could not open PM4 capture file '%s'", filename);
+        return NULL;
+    }
+    header.magic = cpu_to_le32(PM4_CAPTURE_MAGIC);
+    header.version = cpu_to_le32(PM4_CAPTURE_VERSION);
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+        error_setg_errno(errp, errno,
+            "Could not write PM4 capture file '%s'", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    c = g_new0(pm4_capture_t, 1);
+    c->file = file;
+    c->filename = g_strdup(filename);
+    c->maps = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        NULL, g_free);
+    c->pages = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        NULL, g_free);
+    qemu_mutex_init(&c->lock);
+    return c;
+}
+
+void pm4_capture_close(pm4_capture_t *c)
+{
+    if (fclose(c->file) != 0 && !c->failed) {
+        error_report("PM4 capture: closing '%s' failed, the capture may be "
+            "truncated", c->filename);
+    }
+    g_free(c->filename);
+    g_hash_table_destroy(c->maps);
+    g_hash_table_destroy(c->pages);
+    qemu_mutex_destroy(&c->lock);
+    g_free(c);
+}
+
+void pm4_capture_ring(pm4_capture_t *c,
+    int index, uint64_t base, uint64_t size)
+{
+    pm4_capture_ring_t ring;
+
+    ring.index = cpu_to_le32(index);
+    ring.reserved = 0;
+    ring.base = cpu_to_le64(base);
+    ring.size = cpu_to_le64(size);
+
+    qemu_mutex_lock(&c->lock);
+    capture_write_record(c, PM4_CAPTURE_RECORD_RING, &ring, sizeof(ring));
+    capture_flush(c);
+    qemu_mutex_unlock(&c->lock);
+}
+
+static void capture_page(pm4_capture_t *c, gart_state_t *gart,
+    int vmid, uint64_t va)
+{
+    pm4_capture_map_t map;
+    pm4_capture_page_t *page;
+    hwaddr pa, len;
+    uint64_t prev;
+    uint32_t csum;
+    void *data;
+
+    if (!liverpool_gc_gart_translate(gart, vmid, va, &pa)) {
+        return;
+    }
+    pa &= PAGE_MASK;
+    if (!capture_lookup(c->maps, MAP_KEY(vmid, va), &prev) || prev != pa) {
+        map.vmid = cpu_to_le32(vmid);
+        map.reserved = 0;
+        map.va = cpu_to_le64(va);
+        map.pa = cpu_to_le64(pa);
+        capture_write_record(c, PM4_CAPTURE_RECORD_MAP, &map, sizeof(map));
+        capture_insert(c->maps, MAP_KEY(vmid, va), pa);
+    }
+
+    len = PM4_CAPTURE_PAGE_SIZE;
+    data = address_space_map(&address_space_memory, pa, &len, false);
+    if (!data) {
+        return;
+    }
+    csum = crc32(0, data, len);
+    if (!capture_lookup(c->pages, pa, &prev) || prev != csum) {
+        page = g_malloc0(sizeof(pm4_capture_page_t));
+        page->pa = cpu_to_le64(pa);
+        memcpy(page->data, data, len);
+        capture_write_record(c, PM4_CAPTURE_RECORD_PAGE, page, sizeof(*page));
+        capture_insert(c->pages, pa, csum);
+        g_free(page);
+    }
+    address_space_unmap(&address_space_memory, data, len, false, len);
+}
+
+void pm4_capture_memory(pm4_capture_t *c, gart_state_t *gart,
+    int vmid, uint64_t addr, uint64_t size)
+{
+    uint64_t va, end;
+
+    end = addr + size;
+    qemu_mutex_lock(&c->lock);
+    if (!c->failed) {
+        for (va = addr & PAGE_MASK; va < end; va += PM4_CAPTURE_PAGE_SIZE) {
+            capture_page(c, gart, vmid, va);
+        }
+    }
+    qemu_mutex_unlock(&c->lock);
+}
+
+void pm4_capture_packet(pm4_capture_t *c,
+    int index, const uint32_t *packet, uint32_t count)
+{
+    pm4_capture_packet_t header;
+    pm4_capture_record_t record;
+
+    header.index = cpu_to_le32(index);
+    header.count = cpu_to_le32(count);
+    record.type = cpu_to_le32(PM4_CAPTURE_RECORD_PACKET);
+    record.size = cpu_to_le32(sizeof(header) + count * sizeof(uint32_t));
+
+    qemu_mutex_lock(&c->lock);
+    capture_write(c, &record, sizeof(record));
+    capture_write(c, &header, sizeof(header));
+    capture_write(c, packet, count * sizeof(uint32_t));
+    qemu_mutex_unlock(&c->lock);
+}
+
+void pm4_capture_flush(pm4_capture_t *c)
+{
+    qemu_mutex_lock(&c->lock);
+    capture_flush(c);
+    qemu_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,100 @@
+/*
+ * QEMU model of Liverpool's GFX device.
+ * PM4 command stream capture.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_PS4_LIVERPOOL_GC_GFX_CAPTURE_H
+#define HW_PS4_LIVERPOOL_GC_GFX_CAPTURE_H
+
+#include "qemu/osdep.h"
+
+/*
+ * Capture files are a little-endian stream of records, each one starting
+ * with a pm4_capture_record_t header. They can be consumed while they are
+ * still being written, and records are only emitted for state the CP
+ * actually touched:
+ *  - RING:   ring location, whenever a ring is (re-)based.
+ *  - MAP:    GART translation of a page, whenever it changes.
+ *  - PAGE:   contents of a physical page, whenever they change.
+ *  - PACKET: top-level packet consumed from a ring.
+ * The MAP and PAGE records for the memory a packet accesses, including its
+ * IBs, precede the PACKET record, so replay sees memory as the CP did.
+ */
+#define PM4_CAPTURE_MAGIC    0x43344D50 /* "PM4C" */
+#define PM4_CAPTURE_VERSION  1
+
+#define PM4_CAPTURE_PAGE_SIZE  0x1000
+
+#define PM4_CAPTURE_RECORD_RING    1
+#define PM4_CAPTURE_RECORD_MAP     2
+#define PM4_CAPTURE_RECORD_PAGE    3
+#define PM4_CAPTURE_RECORD_PACKET  4
+
+/* forward declarations */
+typedef struct gart_state_t gart_state_t;
+
+typedef struct pm4_capture_header_t {
+    uint32_t magic;
+    uint32_t version;
+} QEMU_PACKED pm4_capture_header_t;
+
+typedef struct pm4_capture_record_t {
+    uint32_t type;
+    uint32_t size; /* payload size in bytes */
+} QEMU_PACKED pm4_capture_record_t;
+
+typedef struct pm4_capture_ring_t {
+    uint32_t index;
+    uint32_t reserved;
+    uint64_t base;
+    uint64_t size;
+} QEMU_PACKED pm4_capture_ring_t;
+
+typedef struct pm4_capture_map_t {
+    uint32_t vmid;
+    uint32_t reserved;
+    uint64_t va;
+    uint64_t pa;
+} QEMU_PACKED pm4_capture_map_t;
+
+typedef struct pm4_capture_page_t {
+    uint64_t pa;
+    uint8_t data[PM4_CAPTURE_PAGE_SIZE];
+} QEMU_PACKED pm4_capture_page_t;
+
+typedef struct pm4_capture_packet_t {
+    uint32_t index;
+    uint32_t count;
+    uint32_t data[0];
+} QEMU_PACKED pm4_capture_packet_t;
+
+/* capture state */
+typedef struct pm4_capture_t pm4_capture_t;
+
+pm4_capture_t *pm4_capture_open(const char *filename, Error **errp);
+void pm4_capture_close(pm4_capture_t *c);
+
+void pm4_capture_ring(pm4_capture_t *c,
+    int index, uint64_t base, uint64_t size);
+void pm4_capture_memory(pm4_capture_t *c, gart_state_t *gart,
+    int vmid, uint64_t addr, uint64_t size);
+void pm4_capture_packet(pm4_capture_t *c,
+    int index, const uint32_t *packet, uint32_t count);
+void pm4_capture_flush(pm4_capture_t *c);
+
+#endif /* HW_PS4_LIVERPOOL_GC_GFX_CAPTURE_H */
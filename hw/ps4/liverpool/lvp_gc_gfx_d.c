@@ -263,3 +263,42 @@ void trace_pm4_packet(const uint32_t *packet)
         break;
     }
 }
+
+/* orbital trace decoders */
+const char* liverpool_gc_gfx_trace_opname(uint32_t opcode)
+{
+    switch (opcode >> 8) {
+    case PM4_PACKET_TYPE0:
+        return "TYPE0";
+    case PM4_PACKET_TYPE1:
+        return "TYPE1";
+    case PM4_PACKET_TYPE2:
+        return "TYPE2";
+    default:
+        return trace_pm4_it_opcode(opcode & 0xFF);
+    }
+}
+
+void liverpool_gc_gfx_trace_format(const orbital_trace_record_t *rec,
+    char *buf, size_t size)
+{
+    uint32_t header = rec->data[0];
+
+    switch (EXTRACT(header, PM4_PACKET_TYPE)) {
+    case PM4_PACKET_TYPE0:
+        snprintf(buf, size, "reg: 0x%04X, count: %d, data: %08X %08X %08X",
+            EXTRACT(header, PM4_TYPE0_HEADER_REG),
+            EXTRACT(header, PM4_TYPE0_HEADER_COUNT) + 1,
+            rec->data[1], rec->data[2], rec->data[3]);
+        break;
+    case PM4_PACKET_TYPE3:
+        snprintf(buf, size, "%s, count: %d, data: %08X %08X %08X",
+            trace_pm4_it_opcode(EXTRACT(header, PM4_TYPE3_HEADER_ITOP)),
+            EXTRACT(header, PM4_TYPE3_HEADER_COUNT) + 1,
+            rec->data[1], rec->data[2], rec->data[3]);
+        break;
+    default:
+        snprintf(buf, size, "header: %08X", header);
+        break;
+    }
+}
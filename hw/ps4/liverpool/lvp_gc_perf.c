@@ -0,0 +1,285 @@
+/*
+ * QEMU model of Liverpool's performance counters.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvp_gc_perf.h"
+#include "gca/gfx_7_2_enum.h"
+#include "hw/ps4/liverpool_gc_mmio.h"
+
+#include "qemu/atomic.h"
+#include "qemu/notify.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+/* Engine clock used to convert emulated busy time into GPU cycles */
+#define LVP_PERF_SCLK_MHZ  800
+
+/* Pseudo-counter holding the host clock, only used for perfmon windows */
+#define LVP_PERF_CLOCK_NS  LVP_PERF_COUNT
+
+#define PERF_SEL_MASK  0x3F
+
+typedef struct lvp_perf_block_t {
+    uint64_t counter[LVP_PERF_COUNT];
+    Notifier exit;
+    QLIST_ENTRY(lvp_perf_block_t) next;
+} lvp_perf_block_t;
+
+/* Blocks of live threads (protected by perf_lock). When a thread exits, its
+ * counts are folded into perf_retired and its block is released. */
+static QLIST_HEAD(, lvp_perf_block_t) perf_blocks =
+    QLIST_HEAD_INITIALIZER(perf_blocks);
+static uint64_t perf_retired[LVP_PERF_COUNT];
+static QemuMutex perf_lock;
+static __thread lvp_perf_block_t *perf_block;
+
+/* Perfmon window, updated through CP_PERFMON_CNTL (protected by perf_lock) */
+static uint32_t perfmon_state = CP_PERFMON_STATE_DISABLE_AND_RESET;
+static uint64_t perfmon_start[LVP_PERF_COUNT + 1];
+static uint64_t perfmon_stop[LVP_PERF_COUNT + 1];
+
+static void __attribute__((constructor)) liverpool_gc_perf_init(void)
+{
+    qemu_mutex_init(&perf_lock);
+}
+
+static void perf_block_retire(Notifier *n, void *data)
+{
+    lvp_perf_block_t *block = container_of(n, lvp_perf_block_t, exit);
+    int i;
+
+    qemu_mutex_lock(&perf_lock);
+    for (i = 0; i < LVP_PERF_COUNT; i++) {
+        perf_retired[i] += block->counter[i];
+    }
+    QLIST_REMOVE(block, next);
+    qemu_mutex_unlock(&perf_lock);
+    perf_block = NULL;
+    g_free(block);
+}
+
+static lvp_perf_block_t *perf_block_register(void)
+{
+    lvp_perf_block_t *block;
+
+    block = g_new0(lvp_perf_block_t, 1);
+    block->exit.notify = perf_block_retire;
+    qemu_thread_atexit_add(&block->exit);
+    qemu_mutex_lock(&perf_lock);
+    QLIST_INSERT_HEAD(&perf_blocks, block, next);
+    qemu_mutex_unlock(&perf_lock);
+    perf_block = block;
+    return block;
+}
+
+void liverpool_gc_perf_add(lvp_perf_counter_t counter, uint64_t value)
+{
+    lvp_perf_block_t *block = perf_block;
+
+    if (unlikely(!block)) {
+        block = perf_block_register();
+    }
+    /* Single writer: a plain add, published with a relaxed store */
+    atomic_set__nocheck(&block->counter[counter],
+        block->counter[counter] + value);
+}
+
+static uint64_t perf_read_locked(int counter)
+{
+    lvp_perf_block_t *block;
+    uint64_t value;
+
+    if (counter == LVP_PERF_CLOCK_NS) {
+        return get_clock();
+    }
+    value = perf_retired[counter];
+    QLIST_FOREACH(block, &perf_blocks, next) {
+        value += atomic_read__nocheck(&block->counter[counter]);
+    }
+    return value;
+}
+
+uint64_t liverpool_gc_perf_read(lvp_perf_counter_t counter)
+{
+    uint64_t value;
+
+    qemu_mutex_lock(&perf_lock);
+    value = perf_read_locked(counter);
+    qemu_mutex_unlock(&perf_lock);
+    return value;
+}
+
+void liverpool_gc_perf_read_all(uint64_t values[LVP_PERF_COUNT])
+{
+    lvp_perf_block_t *block;
+    int i;
+
+    qemu_mutex_lock(&perf_lock);
+    memcpy(values, perf_retired, sizeof(perf_retired));
+    QLIST_FOREACH(block, &perf_blocks, next) {
+        for (i = 0; i < LVP_PERF_COUNT; i++) {
+            values[i] += atomic_read__nocheck(&block->counter[i]);
+        }
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+
+/* perfmon */
+void liverpool_gc_perf_set_state(uint32_t state)
+{
+    int i;
+
+    qemu_mutex_lock(&perf_lock);
+    switch (state) {
+    case CP_PERFMON_STATE_DISABLE_AND_RESET:
+    case CP_PERFMON_STATE_DISABLE_AND_RESET_PHANTOM:
+        memset(perfmon_start, 0, sizeof(perfmon_start));
+        memset(perfmon_stop, 0, sizeof(perfmon_stop));
+        break;
+    case CP_PERFMON_STATE_START_COUNTING:
+        if (perfmon_state == CP_PERFMON_STATE_STOP_COUNTING) {
+            /* Resume: skip the events that happened while stopped */
+            for (i = 0; i <= LVP_PERF_COUNT; i++) {
+                perfmon_start[i] += perf_read_locked(i) - perfmon_stop[i];
+            }
+        } else if (perfmon_state != CP_PERFMON_STATE_START_COUNTING) {
+            for (i = 0; i <= LVP_PERF_COUNT; i++) {
+                perfmon_start[i] = perf_read_locked(i);
+            }
+        }
+        break;
+    case CP_PERFMON_STATE_STOP_COUNTING:
+        if (perfmon_state == CP_PERFMON_STATE_START_COUNTING) {
+            for (i = 0; i <= LVP_PERF_COUNT; i++) {
+                perfmon_stop[i] = perf_read_locked(i);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    perfmon_state = state;
+    qemu_mutex_unlock(&perf_lock);
+}
+
+static uint64_t perfmon_read_locked(int counter)
+{
+    switch (perfmon_state) {
+    case CP_PERFMON_STATE_START_COUNTING:
+        return perf_read_locked(counter) - perfmon_start[counter];
+    case CP_PERFMON_STATE_STOP_COUNTING:
+        return perfmon_stop[counter] - perfmon_start[counter];
+    default:
+        return 0;
+    }
+}
+
+static uint64_t perfmon_cycles_locked(int counter)
+{
+    return perfmon_read_locked(counter) * LVP_PERF_SCLK_MHZ / 1000;
+}
+
+static uint64_t perfmon_fetched_dwords_locked(void)
+{
+    return (perfmon_read_locked(LVP_PERF_RING_BYTES) +
+            perfmon_read_locked(LVP_PERF_IB_BYTES)) / 4;
+}
+
+static uint64_t perf_cpg_event_locked(uint32_t event)
+{
+    switch (event) {
+    case CPG_PERF_SEL_ALWAYS_COUNT:
+        return perfmon_cycles_locked(LVP_PERF_CLOCK_NS);
+    case CPG_PERF_SEL_ME_PARSER_BUSY:
+        return perfmon_cycles_locked(LVP_PERF_CP_BUSY_NS);
+    case CPG_PERF_SEL_COUNT_TYPE0_PACKETS:
+        return perfmon_read_locked(LVP_PERF_PM4_TYPE0);
+    case CPG_PERF_SEL_COUNT_TYPE3_PACKETS:
+        return perfmon_read_locked(LVP_PERF_PM4_TYPE3);
+    case CPG_PERF_SEL_CSF_FETCHING_CMD_BUFFERS:
+        return perfmon_fetched_dwords_locked();
+    default:
+        return 0;
+    }
+}
+
+static uint64_t perf_cpc_event_locked(uint32_t event)
+{
+    switch (event) {
+    case CPC_PERF_SEL_ALWAYS_COUNT:
+        return perfmon_cycles_locked(LVP_PERF_CLOCK_NS);
+    default:
+        return 0;
+    }
+}
+
+static uint64_t perf_cpf_event_locked(uint32_t event)
+{
+    switch (event) {
+    case CPF_PERF_SEL_ALWAYS_COUNT:
+        return perfmon_cycles_locked(LVP_PERF_CLOCK_NS);
+    case CPF_PERF_SEL_CSF_FETCHING_CMD_BUFFERS:
+        return perfmon_fetched_dwords_locked();
+    default:
+        return 0;
+    }
+}
+
+static uint64_t perf_grbm_event_locked(uint32_t event)
+{
+    switch (event) {
+    case GRBM_PERF_SEL_COUNT:
+        return perfmon_cycles_locked(LVP_PERF_CLOCK_NS);
+    case GRBM_PERF_SEL_GUI_ACTIVE:
+    case GRBM_PERF_SEL_CP_BUSY:
+        return perfmon_cycles_locked(LVP_PERF_CP_BUSY_NS);
+    default:
+        return 0;
+    }
+}
+
+uint64_t liverpool_gc_perf_counter(const uint32_t *mmio, uint32_t select_reg)
+{
+    uint32_t event = mmio[select_reg] & PERF_SEL_MASK;
+    uint64_t value;
+
+    qemu_mutex_lock(&perf_lock);
+    switch (select_reg) {
+    case mmCPG_PERFCOUNTER0_SELECT:
+    case mmCPG_PERFCOUNTER1_SELECT:
+        value = perf_cpg_event_locked(event);
+        break;
+    case mmCPC_PERFCOUNTER0_SELECT:
+    case mmCPC_PERFCOUNTER1_SELECT:
+        value = perf_cpc_event_locked(event);
+        break;
+    case mmCPF_PERFCOUNTER0_SELECT:
+    case mmCPF_PERFCOUNTER1_SELECT:
+        value = perf_cpf_event_locked(event);
+        break;
+    case mmGRBM_PERFCOUNTER0_SELECT:
+    case mmGRBM_PERFCOUNTER1_SELECT:
+        value = perf_grbm_event_locked(event);
+        break;
+    default:
+        value = 0;
+    }
+    qemu_mutex_unlock(&perf_lock);
+    return value;
+}
@@ -0,0 +1,73 @@
+/*
+ * QEMU model of Liverpool's performance counters.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_PS4_LIVERPOOL_GC_PERF_H
+#define HW_PS4_LIVERPOOL_GC_PERF_H
+
+#include "qemu/osdep.h"
+
+/* Register file blocks, each one decoded by its own MMIO windows */
+typedef enum lvp_mmio_block_t {
+    LVP_MMIO_BIF,
+    LVP_MMIO_GMC,
+    LVP_MMIO_OSS,
+    LVP_MMIO_DCE,
+    LVP_MMIO_GFX,
+    LVP_MMIO_ACP,
+    LVP_MMIO_SAMU,
+    LVP_MMIO_BLOCK_COUNT,
+} lvp_mmio_block_t;
+
+/* Events counted by the emulated blocks */
+typedef enum lvp_perf_counter_t {
+    LVP_PERF_PM4_TYPE0,
+    LVP_PERF_PM4_TYPE2,
+    LVP_PERF_PM4_TYPE3,
+    LVP_PERF_PM4_IT,                /* one counter per type-3 opcode */
+    LVP_PERF_RING_BYTES = LVP_PERF_PM4_IT + 0x100,
+    LVP_PERF_IB_BYTES,
+    LVP_PERF_GART_WALKS,
+    LVP_PERF_GART_MISSES,
+    LVP_PERF_IH_VECTORS,
+    LVP_PERF_SAMU_COMMANDS,
+    LVP_PERF_CP_BUSY_NS,
+    LVP_PERF_MMIO_READS,            /* one counter per lvp_mmio_block_t */
+    LVP_PERF_MMIO_WRITES = LVP_PERF_MMIO_READS + LVP_MMIO_BLOCK_COUNT,
+    LVP_PERF_COUNT = LVP_PERF_MMIO_WRITES + LVP_MMIO_BLOCK_COUNT,
+} lvp_perf_counter_t;
+
+/*
+ * Every thread increments a private block of counters, so the hot paths
+ * never share cachelines or take locks. Reads aggregate all blocks, plus
+ * the counts of the threads that have exited.
+ */
+void liverpool_gc_perf_add(lvp_perf_counter_t counter, uint64_t value);
+uint64_t liverpool_gc_perf_read(lvp_perf_counter_t counter);
+void liverpool_gc_perf_read_all(uint64_t values[LVP_PERF_COUNT]);
+
+static inline void liverpool_gc_perf_inc(lvp_perf_counter_t counter)
+{
+    liverpool_gc_perf_add(counter, 1);
+}
+
+/* Perfmon registers (CPG/CPC/CPF/GRBM_PERFCOUNTER*) */
+void liverpool_gc_perf_set_state(uint32_t state);
+uint64_t liverpool_gc_perf_counter(const uint32_t *mmio, uint32_t select_reg);
+
+#endif /* HW_PS4_LIVERPOOL_GC_PERF_H */
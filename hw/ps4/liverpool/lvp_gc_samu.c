@@ -24,6 +24,7 @@
 #include "hw/ps4/macros.h"
 #include "hw/pci/pci.h"
 #include "hw/hw.h"
+#include "qemu/timer.h"
 
 #include <zlib.h>
 #include <zip.h>
@@ -434,9 +435,38 @@ static void samu_packet_rand(samu_state_t *s,
     qcrypto_random_bytes(reply_rand->data, 0x10, &error_fatal);
 }
 
+/* Records the packet in the orbital SAMU trace. CCP operations are traced
+ * separately, since their cost depends on the operation. */
+static void samu_trace_packet(const samu_packet_t *query,
+    const samu_packet_t *reply, int64_t start)
+{
+    orbital_trace_record_t rec;
+
+    rec.timestamp = start;
+    rec.duration = MIN(get_clock() - start, UINT32_MAX);
+    rec.opcode = query->command << 8;
+    rec.data[0] = query->message_id;
+    rec.data[1] = 0;
+    rec.data[2] = 0;
+    rec.data[3] = reply->status;
+    switch (query->command) {
+    case SAMU_CMD_SERVICE_CCP:
+        rec.opcode |= query->data.service_ccp.opcode >> 24;
+        rec.data[1] = query->data.service_ccp.opcode;
+        break;
+    case SAMU_CMD_SERVICE_MAILBOX:
+        rec.data[1] = query->data.service_mailbox.function_id;
+        rec.data[2] = query->data.service_mailbox.module_id;
+        break;
+    }
+    orbital_trace_record(ORBITAL_TRACE_SAMU, &rec);
+}
+
 void liverpool_gc_samu_packet(samu_state_t *s,
     uint64_t query_addr, uint64_t reply_addr)
 {
+    int64_t start = 0;
+    bool traced;
     uint64_t packet_length = 0x1000;
     samu_packet_t *query, *reply;
     hwaddr query_len = packet_length;
@@ -448,6 +478,10 @@ void liverpool_gc_samu_packet(samu_state_t *s,
     reply = (samu_packet_t*)address_space_map(
         &address_space_memory, reply_addr, &reply_len, true);
     trace_samu_packet(query);
+    traced = orbital_trace_enabled(ORBITAL_TRACE_SAMU);
+    if (traced) {
+        start = get_clock();
+    }
 
     memset(reply, 0, packet_length);
     reply->command = query->command;
@@ -471,6 +505,9 @@ void liverpool_gc_samu_packet(samu_state_t *s,
     default:
         printf("Unknown SAMU command %d\n", query->command);
     }
+    if (traced) {
+        samu_trace_packet(query, reply, start);
+    }
     address_space_unmap(&address_space_memory, query, query_addr, query_len, true);
     address_space_unmap(&address_space_memory, reply, reply_addr, reply_len, true);
 }
@@ -22,6 +22,7 @@
 
 #include "qemu/osdep.h"
 #include "lvp_gc_samu_.h"
+#include "ui/orbital-trace.h"
 
 #define SAMU_SLOT_SIZE   0x10
 #define SAMU_SLOT_COUNT  0x200 /* TODO */
@@ -78,6 +79,9 @@ typedef struct samu_packet_t {
 
 /* debugging */
 void trace_samu_packet(const samu_packet_t* packet);
+const char* liverpool_gc_samu_trace_opname(uint32_t opcode);
+void liverpool_gc_samu_trace_format(const orbital_trace_record_t *rec,
+    char *buf, size_t size);
 
 /* crypto */
 void liverpool_gc_samu_fakedecrypt(uint8_t *out_buffer,
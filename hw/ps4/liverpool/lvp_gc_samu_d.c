@@ -436,3 +436,32 @@ void trace_samu_packet(const samu_packet_t* packet)
         break;
     }
 }
+
+/* orbital trace decoders */
+const char* liverpool_gc_samu_trace_opname(uint32_t opcode)
+{
+    if ((opcode >> 8) == SAMU_CMD_SERVICE_CCP) {
+        return trace_samu_packet_command_ccp_op(opcode & 0xFF);
+    }
+    return trace_samu_packet_command(opcode >> 8);
+}
+
+void liverpool_gc_samu_trace_format(const orbital_trace_record_t *rec,
+    char *buf, size_t size)
+{
+    switch (rec->opcode >> 8) {
+    case SAMU_CMD_SERVICE_CCP:
+        snprintf(buf, size, "id: %u, CCP %s, flags: %06X, status: %X",
+            rec->data[0], trace_samu_packet_command_ccp_op(rec->data[1] >> 24),
+            rec->data[1] & 0xFFFFFF, rec->data[3]);
+        break;
+    case SAMU_CMD_SERVICE_MAILBOX:
+        snprintf(buf, size, "id: %u, module: 0x%X, function: 0x%X, status: %X",
+            rec->data[0], rec->data[2], rec->data[1], rec->data[3]);
+        break;
+    default:
+        snprintf(buf, size, "id: %u, %s, status: %X", rec->data[0],
+            trace_samu_packet_command(rec->opcode >> 8), rec->data[3]);
+        break;
+    }
+}
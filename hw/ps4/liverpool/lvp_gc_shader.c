@@ -0,0 +1,256 @@
+/*
+ * QEMU model of Liverpool's shader cache.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvp_gc_shader.h"
+
+#include "exec/memory.h"
+#include "qemu/thread.h"
+
+/* Distinct programs kept before the cache is flushed */
+#define LVP_SHADER_CACHE_MAX     4096
+
+/* Fetches never cross a page, so programs ending right before an
+ * unmapped page are still found */
+#define LVP_SHADER_FETCH_SIZE    0x1000
+
+/* FNV-1a, applied to dwords */
+#define LVP_SHADER_HASH_BASIS    0xCBF29CE484222325ULL
+#define LVP_SHADER_HASH_PRIME    0x00000100000001B3ULL
+
+/* Last program bound to each stage (only accessed by the CP thread) */
+typedef struct lvp_shader_binding_t {
+    AddressSpace *as;
+    uint64_t addr;
+    lvp_shader_t *shader;
+} lvp_shader_binding_t;
+
+struct lvp_shader_cache_t {
+    QemuMutex lock;
+    GHashTable *shaders;    /* hash -> lvp_shader_t */
+    lvp_shader_binding_t bound[LVP_SHADER_STAGE_COUNT];
+    uint32_t fetch[LVP_SHADER_MAX_SIZE / 4];
+};
+
+static void shader_free(gpointer data)
+{
+    lvp_shader_t *shader = data;
+
+    g_free(shader->code);
+    g_free(shader->insns);
+    g_free(shader);
+}
+
+lvp_shader_cache_t *liverpool_gc_shader_cache_new(void)
+{
+    lvp_shader_cache_t *cache;
+
+    cache = g_new0(lvp_shader_cache_t, 1);
+    qemu_mutex_init(&cache->lock);
+    cache->shaders = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        NULL, shader_free);
+    return cache;
+}
+
+void liverpool_gc_shader_cache_free(lvp_shader_cache_t *cache)
+{
+    g_hash_table_destroy(cache->shaders);
+    qemu_mutex_destroy(&cache->lock);
+    g_free(cache);
+}
+
+static uint64_t shader_hash(const uint32_t *code, uint32_t dwords)
+{
+    uint64_t hash = LVP_SHADER_HASH_BASIS;
+    uint32_t i;
+
+    for (i = 0; i < dwords; i++) {
+        hash ^= code[i];
+        hash *= LVP_SHADER_HASH_PRIME;
+    }
+    return hash;
+}
+
+static bool shader_fetch(AddressSpace *as, uint64_t addr,
+    uint32_t *buf, uint32_t dwords)
+{
+    return address_space_rw(as, addr, MEMTXATTRS_UNSPECIFIED,
+        (uint8_t *)buf, dwords * 4, false) == MEMTX_OK;
+}
+
+/* Fetches the program into cache->fetch, decoding it up to s_endpgm.
+ * Returns its size in dwords, or 0 if the memory could not be read. */
+static uint32_t shader_scan(lvp_shader_cache_t *cache, AddressSpace *as,
+    uint64_t addr, GArray *insns, bool *truncated)
+{
+    const uint32_t max_dwords = LVP_SHADER_MAX_SIZE / 4;
+    uint32_t *code = cache->fetch;
+    uint32_t fetched = 0, pos = 0, chunk, len;
+    GCNInstruction insn;
+
+    while (true) {
+        len = gcn_decode(&insn, &code[pos], fetched - pos);
+        if (!len) {
+            if (fetched == max_dwords) {
+                *truncated = true;
+                return pos;
+            }
+            chunk = LVP_SHADER_FETCH_SIZE -
+                ((addr + fetched * 4) & (LVP_SHADER_FETCH_SIZE - 1));
+            chunk = MIN(chunk / 4, max_dwords - fetched);
+            if (!shader_fetch(as, addr + fetched * 4, &code[fetched], chunk)) {
+                return 0;
+            }
+            fetched += chunk;
+            continue;
+        }
+        g_array_append_val(insns, insn);
+        pos += len;
+        if (gcn_is_endpgm(&insn)) {
+            *truncated = false;
+            return pos;
+        }
+    }
+}
+
+static void shader_cache_flush_locked(lvp_shader_cache_t *cache)
+{
+    g_hash_table_remove_all(cache->shaders);
+    memset(cache->bound, 0, sizeof(cache->bound));
+}
+
+/* Drops an entry whose hash collides with a different program */
+static void shader_cache_evict_locked(lvp_shader_cache_t *cache,
+    lvp_shader_t *shader)
+{
+    int i;
+
+    for (i = 0; i < LVP_SHADER_STAGE_COUNT; i++) {
+        if (cache->bound[i].shader == shader) {
+            memset(&cache->bound[i], 0, sizeof(cache->bound[i]));
+        }
+    }
+    g_hash_table_remove(cache->shaders, &shader->hash);
+}
+
+void liverpool_gc_shader_bind(lvp_shader_cache_t *cache, AddressSpace *as,
+    uint32_t vmid, uint64_t addr, lvp_shader_stage_t stage)
+{
+    lvp_shader_binding_t *binding = &cache->bound[stage];
+    lvp_shader_t *shader = binding->shader;
+    GArray *insns;
+    uint32_t dwords;
+    uint64_t hash;
+    bool truncated;
+
+    // Shaders are usually rebound at the same address for every draw,
+    // so a compare against the cached code avoids decoding it again.
+    // Entries are only freed by this thread, so no lock is needed yet.
+    if (shader && binding->as == as && binding->addr == addr &&
+        shader_fetch(as, addr, cache->fetch, shader->size / 4) &&
+        !memcmp(cache->fetch, shader->code, shader->size)) {
+        qemu_mutex_lock(&cache->lock);
+        shader->binds++;
+        qemu_mutex_unlock(&cache->lock);
+        return;
+    }
+
+    insns = g_array_new(false, false, sizeof(GCNInstruction));
+    dwords = shader_scan(cache, as, addr, insns, &truncated);
+    if (!dwords) {
+        g_array_free(insns, true);
+        return;
+    }
+    hash = shader_hash(cache->fetch, dwords);
+
+    qemu_mutex_lock(&cache->lock);
+    shader = g_hash_table_lookup(cache->shaders, &hash);
+    if (shader && (shader->size != dwords * 4 ||
+                   memcmp(shader->code, cache->fetch, shader->size))) {
+        shader_cache_evict_locked(cache, shader);
+        shader = NULL;
+    }
+    if (shader) {
+        g_array_free(insns, true);
+    } else {
+        if (g_hash_table_size(cache->shaders) >= LVP_SHADER_CACHE_MAX) {
+            shader_cache_flush_locked(cache);
+        }
+        shader = g_new0(lvp_shader_t, 1);
+        shader->hash = hash;
+        shader->addr = addr;
+        shader->vmid = vmid;
+        shader->stage = stage;
+        shader->size = dwords * 4;
+        shader->truncated = truncated;
+        shader->code = g_memdup(cache->fetch, dwords * 4);
+        shader->insn_count = insns->len;
+        shader->insns = (GCNInstruction *)g_array_free(insns, false);
+        g_hash_table_insert(cache->shaders, &shader->hash, shader);
+    }
+    shader->binds++;
+    qemu_mutex_unlock(&cache->lock);
+
+    binding = &cache->bound[stage];
+    binding->as = as;
+    binding->addr = addr;
+    binding->shader = shader;
+}
+
+void liverpool_gc_shader_foreach(lvp_shader_cache_t *cache,
+    void (*fn)(const lvp_shader_t *shader, void *opaque), void *opaque)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    qemu_mutex_lock(&cache->lock);
+    g_hash_table_iter_init(&iter, cache->shaders);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        fn(value, opaque);
+    }
+    qemu_mutex_unlock(&cache->lock);
+}
+
+char *liverpool_gc_shader_disassemble(const lvp_shader_t *shader)
+{
+    const GCNInstruction *insn;
+    GString *text;
+    char line[128], words[20];
+    uint64_t pc = shader->addr;
+    uint32_t i;
+
+    text = g_string_new(NULL);
+    for (i = 0; i < shader->insn_count; i++) {
+        insn = &shader->insns[i];
+        gcn_format(insn, pc, line, sizeof(line));
+        if (insn->length > 1) {
+            snprintf(words, sizeof(words), "%08x %08x", insn->word[0],
+                insn->has_literal ? insn->literal : insn->word[1]);
+        } else {
+            snprintf(words, sizeof(words), "%08x", insn->word[0]);
+        }
+        g_string_append_printf(text, "%010" PRIx64 ":  %-17s  %s\n",
+            pc, words, line);
+        pc += insn->length * 4;
+    }
+    if (shader->truncated) {
+        g_string_append_printf(text, "; no s_endpgm within %u bytes\n",
+            shader->size);
+    }
+    return g_string_free(text, false);
+}
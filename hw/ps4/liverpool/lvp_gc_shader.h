@@ -0,0 +1,73 @@
+/*
+ * QEMU model of Liverpool's shader cache.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_PS4_LIVERPOOL_GC_SHADER_H
+#define HW_PS4_LIVERPOOL_GC_SHADER_H
+
+#include "qemu/osdep.h"
+#include "disas/gcn.h"
+
+/* Hardware stages, named after their SPI_SHADER_PGM_*_<stage> registers */
+typedef enum lvp_shader_stage_t {
+    LVP_SHADER_LS,
+    LVP_SHADER_HS,
+    LVP_SHADER_ES,
+    LVP_SHADER_GS,
+    LVP_SHADER_VS,
+    LVP_SHADER_PS,
+    LVP_SHADER_CS,
+    LVP_SHADER_STAGE_COUNT,
+} lvp_shader_stage_t;
+
+/* Largest program fetched when looking for s_endpgm */
+#define LVP_SHADER_MAX_SIZE  0x10000
+
+typedef struct lvp_shader_t {
+    uint64_t hash;          /* of the code, which identifies the shader */
+    uint64_t addr;          /* first address the shader was bound at */
+    uint32_t vmid;
+    lvp_shader_stage_t stage;
+    uint32_t size;          /* in bytes, up to and including s_endpgm */
+    bool truncated;         /* no s_endpgm within LVP_SHADER_MAX_SIZE */
+    uint32_t *code;
+    GCNInstruction *insns;
+    uint32_t insn_count;
+    uint64_t binds;
+} lvp_shader_t;
+
+typedef struct lvp_shader_cache_t lvp_shader_cache_t;
+
+lvp_shader_cache_t *liverpool_gc_shader_cache_new(void);
+void liverpool_gc_shader_cache_free(lvp_shader_cache_t *cache);
+
+/*
+ * Fingerprints the program at @addr, decoding it only the first time its
+ * contents are seen. Rebinding an unchanged program costs a compare.
+ */
+void liverpool_gc_shader_bind(lvp_shader_cache_t *cache, AddressSpace *as,
+    uint32_t vmid, uint64_t addr, lvp_shader_stage_t stage);
+
+/* Iterates the cache under its lock, @fn must not bind shaders */
+void liverpool_gc_shader_foreach(lvp_shader_cache_t *cache,
+    void (*fn)(const lvp_shader_t *shader, void *opaque), void *opaque);
+
+/* Returns the disassembly of @shader, to be freed with g_free */
+char *liverpool_gc_shader_disassemble(const lvp_shader_t *shader);
+
+#endif /* HW_PS4_LIVERPOOL_GC_SHADER_H */
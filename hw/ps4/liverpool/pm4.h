@@ -34,6 +34,52 @@
 #define PM4_TYPE3_HEADER_ITOP(M)                M(15, 8)
 #define PM4_TYPE3_HEADER_COUNT(M)               M(29,16)
 
+/* pm4 packet fields */
+#define PM4_SET_PREDICATION_DW2_START_ADDR_HI(M) M( 7, 0)
+#define PM4_SET_PREDICATION_DW2_PRED_BOOL(M)    M( 8, 8)
+#define PM4_SET_PREDICATION_DW2_HINT(M)         M(12,12)
+#define PM4_SET_PREDICATION_DW2_PRED_OP(M)      M(18,16)
+#define PM4_SET_PREDICATION_DW2_CONTINUE(M)     M(31,31)
+#define PM4_COND_EXEC_EXEC_COUNT(M)             M(13, 0)
+#define PM4_WRITE_DATA_DW1_DST_SEL(M)           M(11, 8)
+#define PM4_WRITE_DATA_DW1_WR_ONE_ADDR(M)       M(16,16)
+#define PM4_WRITE_DATA_DW1_WR_CONFIRM(M)        M(20,20)
+#define PM4_WAIT_REG_MEM_DW1_FUNCTION(M)        M( 2, 0)
+#define PM4_WAIT_REG_MEM_DW1_MEM_SPACE(M)       M( 4, 4)
+#define PM4_WAIT_REG_MEM_DW1_ENGINE(M)          M( 8, 8)
+#define PM4_DMA_DATA_DW1_DST_SEL(M)             M(21,20)
+#define PM4_DMA_DATA_DW1_SRC_SEL(M)             M(30,29)
+#define PM4_DMA_DATA_DW6_BYTE_COUNT(M)          M(20, 0)
+#define PM4_DMA_DATA_DW6_SAS(M)                 M(26,26)
+#define PM4_DMA_DATA_DW6_DAS(M)                 M(27,27)
+#define PM4_DMA_DATA_DW6_SAIC(M)                M(28,28)
+#define PM4_DMA_DATA_DW6_DAIC(M)                M(29,29)
+
+/* pm4 field values */
+#define PM4_PRED_OP_CLEAR                          0x00
+#define PM4_PRED_OP_ZPASS                          0x01
+#define PM4_PRED_OP_PRIMCOUNT                      0x02
+
+#define PM4_WRITE_DATA_DST_SEL_REG                 0x00
+#define PM4_WRITE_DATA_DST_SEL_MEM_SYNC            0x01
+#define PM4_WRITE_DATA_DST_SEL_TC_L2               0x02
+#define PM4_WRITE_DATA_DST_SEL_GDS                 0x03
+#define PM4_WRITE_DATA_DST_SEL_MEM_ASYNC           0x05
+
+#define PM4_WAIT_REG_MEM_FUNC_ALWAYS               0x00
+#define PM4_WAIT_REG_MEM_FUNC_LESS                 0x01
+#define PM4_WAIT_REG_MEM_FUNC_LESS_EQUAL           0x02
+#define PM4_WAIT_REG_MEM_FUNC_EQUAL                0x03
+#define PM4_WAIT_REG_MEM_FUNC_NOT_EQUAL            0x04
+#define PM4_WAIT_REG_MEM_FUNC_GREATER_EQUAL        0x05
+#define PM4_WAIT_REG_MEM_FUNC_GREATER              0x06
+
+#define PM4_DMA_DATA_DST_SEL_DST_ADDR              0x00
+#define PM4_DMA_DATA_DST_SEL_GDS                   0x01
+#define PM4_DMA_DATA_SRC_SEL_SRC_ADDR              0x00
+#define PM4_DMA_DATA_SRC_SEL_GDS                   0x01
+#define PM4_DMA_DATA_SRC_SEL_DATA                  0x02
+
 /* pm4 operations */
 #define PM4_IT_NOP                                 0x10
 #define PM4_IT_SET_BASE                            0x11
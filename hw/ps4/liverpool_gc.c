@@ -27,9 +27,18 @@
 #include "liverpool/lvp_gc_dce.h"
 #include "liverpool/lvp_gc_gart.h"
 #include "liverpool/lvp_gc_gfx.h"
+#include "liverpool/lvp_gc_gfx_capture.h"
+#include "liverpool/lvp_gc_perf.h"
 #include "liverpool/lvp_gc_samu.h"
+#include "liverpool/lvp_gc_shader.h"
+#include "ps4_timebase.h"
 
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+#include "qemu/atomic.h"
+#include "sysemu/kvm.h"
 #include "ui/console.h"
+#include "ui/orbital-memory.h"
 #include "hw/display/vga.h"
 #include "hw/display/vga_int.h"
 
@@ -83,20 +92,56 @@ do { \
 #define GBASE_IH_UNK3_E9              0xE9
 #define GBASE_IH_UNK4_EF              0xEF
 
+// Apertures
+#define LIVERPOOL_GC_FB_SIZE        0x4000000
+#define LIVERPOOL_GC_DOORBELL_SIZE   0x800000
+/* Scanout of the frame buffer aperture until the guest enables GRPH */
+#define LIVERPOOL_GC_FB_WIDTH            1920
+#define LIVERPOOL_GC_FB_HEIGHT           1080
+/* Doorbell slots that kick the CP, writes to the rest of BAR2 are ignored.
+ * Doorbell values are not latched, so reads of BAR2 return zero. */
+#define LIVERPOOL_GC_DOORBELL_COUNT      1024
+/* Doorbell slots that kick the CP through ioeventfds, the ones used by the
+ * gfx and compute rings, when the accelerator supports them */
+#define LIVERPOOL_GC_DOORBELL_KICKS        64
+
+// Register file
+#define LIVERPOOL_GC_MMIO_SIZE        0x40000
+#define LIVERPOOL_GC_MMIO_REGS  (LIVERPOOL_GC_MMIO_SIZE / 4)
+#define LIVERPOOL_GC_WINDOW_SIZE       0x1000
+#define LIVERPOOL_GC_WINDOW_REGS (LIVERPOOL_GC_WINDOW_SIZE / 4)
+#define LIVERPOOL_GC_WINDOW_COUNT          12
+
+/* Register targeted by MM_DATA */
+#define LIVERPOOL_GC_MM_TARGET(mmio) \
+    (((mmio)[mmMM_INDEX] >> 2) & (LIVERPOOL_GC_MMIO_REGS - 1))
+
 #define LIVERPOOL_GC(obj) \
     OBJECT_CHECK(LiverpoolGCState, (obj), TYPE_LIVERPOOL_GC)
 
+typedef struct LiverpoolGCWindow {
+    MemoryRegion iomem;
+    struct LiverpoolGCState *gc;
+    lvp_mmio_block_t block;
+    uint32_t base;
+} LiverpoolGCWindow;
+
 typedef struct LiverpoolGCState {
     /*< private >*/
     PCIDevice parent_obj;
     /*< public >*/
     MemoryRegion iomem[3];
+    LiverpoolGCWindow window[LIVERPOOL_GC_WINDOW_COUNT];
     VGACommonState vga;
-    uint32_t mmio[0x10000];
+    QemuConsole *con;
+    bool fb_invalidate;
+    uint32_t *mmio;
     gart_state_t gart;
 
     /* gfx */
     gfx_state_t gfx;
+    char *pm4_capture;
+    bool ioeventfd;
 
     /* oss */
     uint8_t sdma0_ucode[0x8000];
@@ -108,24 +153,125 @@ typedef struct LiverpoolGCState {
     samu_state_t samu;
 } LiverpoolGCState;
 
-/* Liverpool GC ??? */
-static uint64_t liverpool_gc_read(void *opaque, hwaddr addr,
-                              unsigned size)
+/* Liverpool GC doorbells */
+static uint64_t liverpool_gc_doorbell_read(void *opaque, hwaddr addr,
+                                           unsigned size)
 {
-    printf("liverpool_gc_read:  { addr: %llX, size: %X }\n", addr, size);
     return 0;
 }
 
-static void liverpool_gc_write(void *opaque, hwaddr addr,
-                           uint64_t value, unsigned size)
+/* Doorbells bypass the register file: the queue thread is woken up right
+ * away. The CP is the only queue engine modelled so far and it picks up
+ * the write pointers of its rings itself, so the value is not latched and
+ * every doorbell just kicks it. */
+static void liverpool_gc_doorbell_write(void *opaque, hwaddr addr,
+                                        uint64_t value, unsigned size)
 {
-    printf("liverpool_gc_write: { addr: %llX, size: %X, value: %llX }\n", addr, size, value);
+    LiverpoolGCState *s = opaque;
+    uint32_t index = addr >> 2;
+
+    if (index >= LIVERPOOL_GC_DOORBELL_COUNT) {
+        DPRINTF("Unexpected doorbell { addr: %" HWADDR_PRIX
+                ", value: %" PRIX64 " }", addr, value);
+        return;
+    }
+    liverpool_gc_gfx_cp_kick(&s->gfx);
 }
 
-static const MemoryRegionOps liverpool_gc_ops = {
-    .read = liverpool_gc_read,
-    .write = liverpool_gc_write,
+static const MemoryRegionOps liverpool_gc_doorbell_ops = {
+    .read = liverpool_gc_doorbell_read,
+    .write = liverpool_gc_doorbell_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+/* With ioeventfds, doorbell writes set the CP event from the kernel without
+ * leaving the guest, which is equivalent since the CP rescans its rings on
+ * every wakeup. Reads are not matched and still return zero through
+ * liverpool_gc_doorbell_read. */
+static void liverpool_gc_doorbell_set_ioeventfds(LiverpoolGCState *s,
+                                                 bool assign)
+{
+    EventNotifier *e = &s->gfx.cp_event;
+    int i;
+
+    memory_region_transaction_begin();
+    for (i = 0; i < LIVERPOOL_GC_DOORBELL_KICKS; i++) {
+        if (assign) {
+            memory_region_add_eventfd(&s->iomem[1], i * 4, 4, false, 0, e);
+        } else {
+            memory_region_del_eventfd(&s->iomem[1], i * 4, 4, false, 0, e);
+        }
+    }
+    memory_region_transaction_commit();
+}
+
+/* Liverpool GC display */
+static void liverpool_gc_fb_update(void *opaque)
+{
+    LiverpoolGCState *s = opaque;
+    DisplaySurface *surface = qemu_console_surface(s->con);
+    DirtyBitmapSnapshot *snap;
+    uint8_t *fb = memory_region_get_ram_ptr(&s->iomem[0]);
+    uint32_t width, height, pitch;
+    int y, y_start;
+
+    width = LIVERPOOL_GC_FB_WIDTH;
+    height = LIVERPOOL_GC_FB_HEIGHT;
+    pitch = width * 4;
+    if (s->mmio[mmGRPH_ENABLE] & GRPH_ENABLE__GRPH_ENABLE_MASK) {
+        width = s->mmio[mmGRPH_X_END] - s->mmio[mmGRPH_X_START];
+        height = s->mmio[mmGRPH_Y_END] - s->mmio[mmGRPH_Y_START];
+        pitch = s->mmio[mmGRPH_PITCH] * 4;
+    }
+    if (!width || !height || width > 0x4000 || height > 0x4000 ||
+        pitch < width * 4 || (uint64_t)pitch * height > LIVERPOOL_GC_FB_SIZE) {
+        return;
+    }
+
+    /* The surface aliases the aperture, so updates only need to be flagged */
+    if (surface_data(surface) != fb || surface_width(surface) != width ||
+        surface_height(surface) != height || surface_stride(surface) != pitch) {
+        surface = qemu_create_displaysurface_from(width, height,
+            PIXMAN_x8r8g8b8, pitch, fb);
+        dpy_gfx_replace_surface(s->con, surface);
+        s->fb_invalidate = true;
+    }
+
+    snap = memory_region_snapshot_and_clear_dirty(&s->iomem[0], 0,
+        (hwaddr)pitch * height, DIRTY_MEMORY_VGA);
+    y_start = -1;
+    for (y = 0; y < height; y++) {
+        if (s->fb_invalidate || memory_region_snapshot_get_dirty(&s->iomem[0],
+                snap, (hwaddr)y * pitch, width * 4)) {
+            if (y_start < 0) {
+                y_start = y;
+            }
+        } else if (y_start >= 0) {
+            dpy_gfx_update(s->con, 0, y_start, width, y - y_start);
+            y_start = -1;
+        }
+    }
+    if (y_start >= 0) {
+        dpy_gfx_update(s->con, 0, y_start, width, y - y_start);
+    }
+    s->fb_invalidate = false;
+    g_free(snap);
+}
+
+static void liverpool_gc_fb_invalidate(void *opaque)
+{
+    LiverpoolGCState *s = opaque;
+
+    s->fb_invalidate = true;
+}
+
+static const GraphicHwOps liverpool_gc_fb_ops = {
+    .invalidate  = liverpool_gc_fb_invalidate,
+    .gfx_update  = liverpool_gc_fb_update,
 };
 
 /* Liverpool GC MMIO */
@@ -195,6 +341,22 @@ static void liverpool_gc_gart_update_pde(
     liverpool_gc_gart_set_pde(&s->gart, vmid, pde_base);
 }
 
+/* Context 0 has its own range, contexts 1-15 share the one of context 1 */
+static void liverpool_gc_gart_update_range(LiverpoolGCState *s)
+{
+    uint32_t *mmio = s->mmio;
+    int vmid;
+
+    liverpool_gc_gart_set_range(&s->gart, 0,
+        mmio[mmVM_CONTEXT0_PAGE_TABLE_START_ADDR],
+        mmio[mmVM_CONTEXT0_PAGE_TABLE_END_ADDR]);
+    for (vmid = 1; vmid < GART_VMID_COUNT; vmid++) {
+        liverpool_gc_gart_set_range(&s->gart, vmid,
+            mmio[mmVM_CONTEXT1_PAGE_TABLE_START_ADDR],
+            mmio[mmVM_CONTEXT1_PAGE_TABLE_END_ADDR]);
+    }
+}
+
 static void liverpool_gc_cp_update_ring(
     LiverpoolGCState *s, uint32_t mm_index, uint32_t mm_value)
 {
@@ -221,61 +383,164 @@ static void liverpool_gc_cp_update_ring(
         size = s->mmio[mmCP_RB1_CNTL] & 0x3F;
     }
     if (base && size) {
-        size = (1 << size) * 8;
+        /* Sizes past 2^63 wrap to 0, which the CP rejects */
+        size = 8ULL << size;
         base = (base << 8);
         liverpool_gc_gfx_cp_set_ring_location(&s->gfx, rb_index, base, size);
     }
 }
 
+/* Reading LO samples the whole 64-bit counter and latches the HI half */
+static uint32_t liverpool_gc_perfcounter_read(LiverpoolGCState *s,
+    uint32_t select_reg, uint32_t hi_reg)
+{
+    uint64_t value;
+
+    value = liverpool_gc_perf_counter(s->mmio, select_reg);
+    s->mmio[hi_reg] = (uint32_t)(value >> 32);
+    return (uint32_t)value;
+}
+
+static uint32_t liverpool_gc_grbm_status(LiverpoolGCState *s)
+{
+    uint32_t value = 0;
+
+    value = REG_SET_FIELD(value, GRBM_STATUS, ME0PIPE0_CMDFIFO_AVAIL, 0xF);
+    value = REG_SET_FIELD(value, GRBM_STATUS, DB_CLEAN, 1);
+    value = REG_SET_FIELD(value, GRBM_STATUS, CB_CLEAN, 1);
+    if (liverpool_gc_gfx_cp_busy(&s->gfx)) {
+        value = REG_SET_FIELD(value, GRBM_STATUS, CP_BUSY, 1);
+        value = REG_SET_FIELD(value, GRBM_STATUS, GUI_ACTIVE, 1);
+    }
+    return value;
+}
+
 static uint64_t CRTC_BLANK_CONTROL_value = 0;
 
-static uint64_t liverpool_gc_mmio_read(
-    void *opaque, hwaddr addr, unsigned size)
+/*
+ * The register file is a RAM region backed by s->mmio, so registers without
+ * side effects are accessed with no callback at all. Pages holding registers
+ * with side effects are covered by MMIO windows, each decoded by the block
+ * owning it. Indirect accesses are routed through the same blocks.
+ */
+static uint32_t liverpool_gc_reg_read(LiverpoolGCState *s, uint32_t index);
+static void liverpool_gc_reg_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value);
+
+static uint32_t liverpool_gc_bif_read(LiverpoolGCState *s, uint32_t index)
 {
-    LiverpoolGCState *s = opaque;
-    uint32_t* mmio = s->mmio;
-    uint32_t index = addr >> 2;
-    uint32_t index_ix;
-    uint32_t value;
+    uint32_t *mmio = s->mmio;
+
+    /* Indirect accesses do not chain */
+    if (index == mmMM_DATA && LIVERPOOL_GC_MM_TARGET(mmio) != mmMM_DATA) {
+        return liverpool_gc_reg_read(s, LIVERPOOL_GC_MM_TARGET(mmio));
+    }
+    return mmio[index];
+}
+
+static uint32_t liverpool_gc_gmc_read(LiverpoolGCState *s, uint32_t index)
+{
+    uint32_t *mmio = s->mmio;
 
     switch (index) {
     case mmVM_INVALIDATE_RESPONSE:
         return mmio[mmVM_INVALIDATE_REQUEST];
-    case mmCP_HQD_ACTIVE:
-        return 0;
-    case mmRLC_SERDES_CU_MASTER_BUSY:
-        return 0;
-    case mmACP_STATUS:
-        return 1;
-    case mmACP_UNK512F_:
-        return 0xFFFFFFFF;
-    /* oss */
+    }
+    return mmio[index];
+}
+
+static uint32_t liverpool_gc_oss_read(LiverpoolGCState *s, uint32_t index)
+{
+    uint32_t value;
+
+    switch (index) {
     case mmIH_STATUS:
         value = 0;
         value = REG_SET_FIELD(value, IH_STATUS, IDLE, 1);
         value = REG_SET_FIELD(value, IH_STATUS, INPUT_IDLE, 1);
         value = REG_SET_FIELD(value, IH_STATUS, RB_IDLE, 1);
         return value; // TODO
-    /* dce */
+    }
+    return s->mmio[index];
+}
+
+static uint32_t liverpool_gc_dce_read(LiverpoolGCState *s, uint32_t index)
+{
+    uint32_t value;
+
+    switch (index) {
     case mmCRTC_BLANK_CONTROL:
         return CRTC_BLANK_CONTROL_value; // TODO
     case mmCRTC_STATUS:
         value = 1;
         return value; // TODO
-    /* gfx */
+    }
+    return s->mmio[index];
+}
+
+static uint32_t liverpool_gc_gfx_read(LiverpoolGCState *s, uint32_t index)
+{
+    switch (index) {
+    case mmCP_HQD_ACTIVE:
+        return 0;
+    case mmRLC_SERDES_CU_MASTER_BUSY:
+        return 0;
     case mmGRBM_STATUS:
-        return 0; // TODO
+        return liverpool_gc_grbm_status(s);
+    case mmGRBM_PERFCOUNTER0_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmGRBM_PERFCOUNTER0_SELECT, mmGRBM_PERFCOUNTER0_HI);
+    case mmGRBM_PERFCOUNTER1_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmGRBM_PERFCOUNTER1_SELECT, mmGRBM_PERFCOUNTER1_HI);
+    case mmCPG_PERFCOUNTER0_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmCPG_PERFCOUNTER0_SELECT, mmCPG_PERFCOUNTER0_HI);
+    case mmCPG_PERFCOUNTER1_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmCPG_PERFCOUNTER1_SELECT, mmCPG_PERFCOUNTER1_HI);
+    case mmCPC_PERFCOUNTER0_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmCPC_PERFCOUNTER0_SELECT, mmCPC_PERFCOUNTER0_HI);
+    case mmCPC_PERFCOUNTER1_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmCPC_PERFCOUNTER1_SELECT, mmCPC_PERFCOUNTER1_HI);
+    case mmCPF_PERFCOUNTER0_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmCPF_PERFCOUNTER0_SELECT, mmCPF_PERFCOUNTER0_HI);
+    case mmCPF_PERFCOUNTER1_LO:
+        return liverpool_gc_perfcounter_read(s,
+            mmCPF_PERFCOUNTER1_SELECT, mmCPF_PERFCOUNTER1_HI);
     case mmCP_RB0_RPTR:
-        return s->gfx.cp_rb[0].rptr;
+        return liverpool_gc_gfx_cp_get_rptr(&s->gfx, 0);
     case mmCP_RB1_RPTR:
-        return s->gfx.cp_rb[1].rptr;
+        return liverpool_gc_gfx_cp_get_rptr(&s->gfx, 1);
     case mmCP_RB0_WPTR:
-        return s->gfx.cp_rb[0].wptr;
+        return liverpool_gc_gfx_cp_get_wptr(&s->gfx, 0);
     case mmCP_RB1_WPTR:
-        return s->gfx.cp_rb[1].wptr;
+        return liverpool_gc_gfx_cp_get_wptr(&s->gfx, 1);
     case mmVGT_EVENT_INITIATOR:
         return s->gfx.vgt_event_initiator;
-    /* samu */
+    }
+    return s->mmio[index];
+}
+
+static uint32_t liverpool_gc_acp_read(LiverpoolGCState *s, uint32_t index)
+{
+    switch (index) {
+    case mmACP_STATUS:
+        return 1;
+    case mmACP_UNK512F_:
+        return 0xFFFFFFFF;
+    }
+    return s->mmio[index];
+}
+
+static uint32_t liverpool_gc_samu_read(LiverpoolGCState *s, uint32_t index)
+{
+    uint32_t index_ix;
+
+    switch (index) {
     case mmSAM_IX_DATA:
         index_ix = s->mmio[mmSAM_IX_INDEX];
         DPRINTF("mmSAM_IX_DATA_read { index: %X }", index_ix);
@@ -285,8 +550,6 @@ static uint64_t liverpool_gc_mmio_read(
         DPRINTF("mmSAM_SAB_IX_DATA_read { index: %X }", index_ix);
         return s->samu_sab_ix[index_ix];
     }
-
-    DPRINTF("liverpool_gc_mmio_read:  { addr: %llX, size: %X }", addr, size);
     return s->mmio[index];
 }
 
@@ -318,7 +581,8 @@ static void liverpool_gc_ih_push_iv(LiverpoolGCState *s,
     liverpool_gc_ih_rb_push(s, id);
     liverpool_gc_ih_rb_push(s, data);
     liverpool_gc_ih_rb_push(s, ((pasid << 16) | (vmid << 8) | ringid));
-    liverpool_gc_ih_rb_push(s, 0 /* TODO: timestamp & 0xFFFFFFF */);
+    liverpool_gc_ih_rb_push(s, ps4_timebase_ticks(PS4_CLOCK_IH) & 0xFFFFFFF);
+    liverpool_gc_perf_inc(LVP_PERF_IH_VECTORS);
 
     /* Trigger MSI */
     dev = PCI_DEVICE(s);
@@ -345,6 +609,7 @@ static void liverpool_gc_samu_doorbell(LiverpoolGCState *s, uint32_t value)
         query_addr >> 48, query_addr, reply_addr);
 
     uint32_t command = ldl_le_phys(&address_space_memory, query_addr);
+    liverpool_gc_perf_inc(LVP_PERF_SAMU_COMMANDS);
     if (command == 0) {
         liverpool_gc_samu_init(&s->samu, query_addr);
     } else {
@@ -359,56 +624,71 @@ static void liverpool_gc_samu_doorbell(LiverpoolGCState *s, uint32_t value)
     liverpool_gc_ih_push_iv(s, GBASE_IH_SAM, 0 /* TODO */);
 }
 
-static void liverpool_gc_mmio_write(
-    void *opaque, hwaddr addr, uint64_t value, unsigned size)
+static void liverpool_gc_bif_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
 {
-    LiverpoolGCState *s = opaque;
-    uint32_t* mmio = s->mmio;
-    uint32_t index = addr >> 2;
-    uint32_t index_ix;
+    uint32_t *mmio = s->mmio;
 
-    // Indirect registers
-    switch (index) {
-    case mmSAM_IX_DATA:
-        switch (s->mmio[mmSAM_IX_INDEX]) {
-        case ixSAM_IH_CPU_AM32_INT:
-            liverpool_gc_samu_doorbell(s, value);
-            break;
-        default:
-            index_ix = s->mmio[mmSAM_IX_INDEX];
-            DPRINTF("mmSAM_IX_DATA_write { index: %X, value: %llX }", index_ix, value);
-            s->samu_ix[index_ix] = value;
-        }
-        return;
-
-    case mmSAM_SAB_IX_DATA:
-        switch (s->mmio[mmSAM_SAB_IX_INDEX]) {
-        default:
-            index_ix = s->mmio[mmSAM_SAB_IX_INDEX];
-            DPRINTF("mmSAM_SAB_IX_DATA_write { index: %X, value: %llX }", index_ix, value);
-            s->samu_sab_ix[index_ix] = value;
-        }
-        return;
-
-    case mmMM_DATA:
-        liverpool_gc_mmio_write(s, mmio[mmMM_INDEX], value, size);
+    if (index == mmMM_DATA && LIVERPOOL_GC_MM_TARGET(mmio) != mmMM_DATA) {
+        liverpool_gc_reg_write(s, LIVERPOOL_GC_MM_TARGET(mmio), value);
         return;
     }
+    mmio[index] = value;
+    switch (index) {
+    /* srbm */
+    case mmSRBM_GFX_CNTL: {
+        uint32_t me = REG_GET_FIELD(value, SRBM_GFX_CNTL, MEID);
+        uint32_t pipe = REG_GET_FIELD(value, SRBM_GFX_CNTL, PIPEID);
+        uint32_t queue = REG_GET_FIELD(value, SRBM_GFX_CNTL, QUEUEID);
+        uint32_t vmid = REG_GET_FIELD(value, SRBM_GFX_CNTL, VMID);
+        DPRINTF("mmSRBM_GFX_CNTL { me: %d, pipe: %d, queue: %d, vmid: %d }", me, pipe, queue, vmid);
+        break;
+    }
+    }
+}
 
-    // Direct registers
+static void liverpool_gc_gmc_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
+{
     s->mmio[index] = value;
     switch (index) {
-    case mmACP_SOFT_RESET:
-        mmio[mmACP_SOFT_RESET] = (value << 16);
-        break;
-    /* gmc */
     case mmVM_CONTEXT0_PAGE_TABLE_BASE_ADDR ...
          mmVM_CONTEXT7_PAGE_TABLE_BASE_ADDR:
     case mmVM_CONTEXT8_PAGE_TABLE_BASE_ADDR ...
          mmVM_CONTEXT15_PAGE_TABLE_BASE_ADDR:
         liverpool_gc_gart_update_pde(s, index, value);
         break;
-    /* dce */
+    case mmVM_CONTEXT0_PAGE_TABLE_START_ADDR:
+    case mmVM_CONTEXT1_PAGE_TABLE_START_ADDR:
+    case mmVM_CONTEXT0_PAGE_TABLE_END_ADDR:
+    case mmVM_CONTEXT1_PAGE_TABLE_END_ADDR:
+        liverpool_gc_gart_update_range(s);
+        break;
+    case mmVM_INVALIDATE_REQUEST:
+        liverpool_gc_gart_invalidate(&s->gart, value & 0xFFFF);
+        break;
+    }
+}
+
+static void liverpool_gc_oss_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
+{
+    s->mmio[index] = value;
+    switch (index) {
+    case mmSDMA0_UCODE_DATA:
+        liverpool_gc_ucode_load(s, mmSDMA0_UCODE_ADDR, value);
+        break;
+    case mmSDMA1_UCODE_DATA:
+        liverpool_gc_ucode_load(s, mmSDMA1_UCODE_ADDR, value);
+        break;
+    }
+}
+
+static void liverpool_gc_dce_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
+{
+    s->mmio[index] = value;
+    switch (index) {
     case mmCRTC_V_SYNC_A: // TODO
         liverpool_gc_ih_push_iv(s, GBASE_IH_DCE_EVENT_UPDATE, 0xFF /* TODO */);
         liverpool_gc_ih_push_iv(s, GBASE_IH_DCE_EVENT_UPDATE, 0xFF /* TODO */);
@@ -421,7 +701,16 @@ static void liverpool_gc_mmio_write(
         CRTC_BLANK_CONTROL_value = REG_SET_FIELD(curvalue, CRTC_BLANK_CONTROL, CRTC_CURRENT_BLANK_STATE, new_blank_state == 0 ? 1 : 0);
         break;
     }
-    /* gfx */
+    }
+}
+
+static void liverpool_gc_gfx_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
+{
+    uint32_t *mmio = s->mmio;
+
+    mmio[index] = value;
+    switch (index) {
     case mmCP_PFP_UCODE_DATA:
         liverpool_gc_ucode_load(s, mmCP_PFP_UCODE_ADDR, value);
         break;
@@ -444,6 +733,13 @@ static void liverpool_gc_mmio_write(
     case mmRLC_GPM_UCODE_DATA:
         liverpool_gc_ucode_load(s, mmRLC_GPM_UCODE_ADDR, value);
         break;
+    case mmRLC_CAPTURE_GPU_CLOCK_COUNT:
+        if (value & RLC_CAPTURE_GPU_CLOCK_COUNT__CAPTURE_MASK) {
+            uint64_t clock = ps4_timebase_ticks(PS4_CLOCK_GPU);
+            mmio[mmRLC_GPU_CLOCK_COUNT_LSB] = (uint32_t)clock;
+            mmio[mmRLC_GPU_CLOCK_COUNT_MSB] = (uint32_t)(clock >> 32);
+        }
+        break;
     case mmCP_RB0_BASE:
     case mmCP_RB1_BASE:
     case mmCP_RB0_CNTL:
@@ -451,40 +747,162 @@ static void liverpool_gc_mmio_write(
         liverpool_gc_cp_update_ring(s, index, value);
         break;
     case mmCP_RB0_RPTR:
-        s->gfx.cp_rb[0].rptr = value;
+        liverpool_gc_gfx_cp_set_rptr(&s->gfx, 0, value);
         break;
     case mmCP_RB1_RPTR:
-        s->gfx.cp_rb[1].rptr = value;
+        liverpool_gc_gfx_cp_set_rptr(&s->gfx, 1, value);
         break;
     case mmCP_RB0_WPTR:
-        s->gfx.cp_rb[0].wptr = value;
+        liverpool_gc_gfx_cp_set_wptr(&s->gfx, 0, value);
         break;
     case mmCP_RB1_WPTR:
-        s->gfx.cp_rb[1].wptr = value;
+        liverpool_gc_gfx_cp_set_wptr(&s->gfx, 1, value);
         break;
-    /* oss */
-    case mmSRBM_GFX_CNTL: {
-        uint32_t me = REG_GET_FIELD(value, SRBM_GFX_CNTL, MEID);
-        uint32_t pipe = REG_GET_FIELD(value, SRBM_GFX_CNTL, PIPEID);
-        uint32_t queue = REG_GET_FIELD(value, SRBM_GFX_CNTL, QUEUEID);
-        uint32_t vmid = REG_GET_FIELD(value, SRBM_GFX_CNTL, VMID);
-        DPRINTF("liverpool_gc_mmio_write: mmSRBM_GFX_CNTL { me: %d, pipe: %d, queue: %d, vmid: %d }", me, pipe, queue, vmid);
+    case mmCP_PERFMON_CNTL:
+        liverpool_gc_perf_set_state(
+            REG_GET_FIELD(value, CP_PERFMON_CNTL, PERFMON_STATE));
         break;
     }
-    case mmSDMA0_UCODE_DATA:
-        liverpool_gc_ucode_load(s, mmSDMA0_UCODE_ADDR, value);
-        break;
-    case mmSDMA1_UCODE_DATA:
-        liverpool_gc_ucode_load(s, mmSDMA1_UCODE_ADDR, value);
+}
+
+static void liverpool_gc_acp_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
+{
+    s->mmio[index] = value;
+    switch (index) {
+    case mmACP_SOFT_RESET:
+        s->mmio[mmACP_SOFT_RESET] = (value << 16);
         break;
-    default:
-        DPRINTF("liverpool_gc_mmio_write: { addr: %llX, size: %X, value: %llX }", addr, size, value);
     }
 }
 
-static const MemoryRegionOps liverpool_gc_mmio_ops = {
-    .read = liverpool_gc_mmio_read,
-    .write = liverpool_gc_mmio_write,
+static void liverpool_gc_samu_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
+{
+    uint32_t index_ix;
+
+    switch (index) {
+    case mmSAM_IX_DATA:
+        switch (s->mmio[mmSAM_IX_INDEX]) {
+        case ixSAM_IH_CPU_AM32_INT:
+            liverpool_gc_samu_doorbell(s, value);
+            break;
+        default:
+            index_ix = s->mmio[mmSAM_IX_INDEX];
+            DPRINTF("mmSAM_IX_DATA_write { index: %X, value: %X }", index_ix, value);
+            s->samu_ix[index_ix] = value;
+        }
+        return;
+    case mmSAM_SAB_IX_DATA:
+        switch (s->mmio[mmSAM_SAB_IX_INDEX]) {
+        default:
+            index_ix = s->mmio[mmSAM_SAB_IX_INDEX];
+            DPRINTF("mmSAM_SAB_IX_DATA_write { index: %X, value: %X }", index_ix, value);
+            s->samu_sab_ix[index_ix] = value;
+        }
+        return;
+    }
+    s->mmio[index] = value;
+}
+
+/* Register file blocks */
+typedef struct LiverpoolGCBlock {
+    const char *name;
+    uint32_t (*read)(LiverpoolGCState *s, uint32_t index);
+    void (*write)(LiverpoolGCState *s, uint32_t index, uint32_t value);
+} LiverpoolGCBlock;
+
+static const LiverpoolGCBlock liverpool_gc_blocks[LVP_MMIO_BLOCK_COUNT] = {
+    [LVP_MMIO_BIF]  = { "bif",  liverpool_gc_bif_read,  liverpool_gc_bif_write  },
+    [LVP_MMIO_GMC]  = { "gmc",  liverpool_gc_gmc_read,  liverpool_gc_gmc_write  },
+    [LVP_MMIO_OSS]  = { "oss",  liverpool_gc_oss_read,  liverpool_gc_oss_write  },
+    [LVP_MMIO_DCE]  = { "dce",  liverpool_gc_dce_read,  liverpool_gc_dce_write  },
+    [LVP_MMIO_GFX]  = { "gfx",  liverpool_gc_gfx_read,  liverpool_gc_gfx_write  },
+    [LVP_MMIO_ACP]  = { "acp",  liverpool_gc_acp_read,  liverpool_gc_acp_write  },
+    [LVP_MMIO_SAMU] = { "samu", liverpool_gc_samu_read, liverpool_gc_samu_write },
+};
+
+/* Pages of the register file holding registers with side effects */
+static const struct {
+    lvp_mmio_block_t block;
+    uint32_t base;
+} liverpool_gc_windows[LIVERPOOL_GC_WINDOW_COUNT] = {
+    { LVP_MMIO_BIF,  0x0000 },  /* MM_INDEX/MM_DATA, SRBM */
+    { LVP_MMIO_GMC,  0x0400 },  /* VM contexts, invalidation */
+    { LVP_MMIO_OSS,  0x0C00 },  /* IH */
+    { LVP_MMIO_DCE,  0x1800 },  /* CRTC */
+    { LVP_MMIO_GFX,  0x2000 },  /* GRBM, CP ring pointers */
+    { LVP_MMIO_GFX,  0x3000 },  /* CP rings, ucode, HQD, RLC */
+    { LVP_MMIO_OSS,  0x3400 },  /* SDMA ucode */
+    { LVP_MMIO_ACP,  0x5000 },
+    { LVP_MMIO_SAMU, 0x8800 },
+    { LVP_MMIO_GFX,  0xA000 },  /* VGT events */
+    { LVP_MMIO_GFX,  0xD000 },  /* perfcounters */
+    { LVP_MMIO_GFX,  0xD800 },  /* perfmon control */
+};
+
+static int liverpool_gc_window_find(uint32_t index)
+{
+    int i;
+
+    for (i = 0; i < LIVERPOOL_GC_WINDOW_COUNT; i++) {
+        if (index - liverpool_gc_windows[i].base < LIVERPOOL_GC_WINDOW_REGS) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint32_t liverpool_gc_reg_read(LiverpoolGCState *s, uint32_t index)
+{
+    int i;
+
+    i = liverpool_gc_window_find(index);
+    if (i < 0) {
+        return s->mmio[index];
+    }
+    return liverpool_gc_blocks[liverpool_gc_windows[i].block].read(s, index);
+}
+
+static void liverpool_gc_reg_write(LiverpoolGCState *s,
+    uint32_t index, uint32_t value)
+{
+    int i;
+
+    i = liverpool_gc_window_find(index);
+    if (i < 0) {
+        s->mmio[index] = value;
+        return;
+    }
+    liverpool_gc_blocks[liverpool_gc_windows[i].block].write(s, index, value);
+}
+
+static uint64_t liverpool_gc_window_read(
+    void *opaque, hwaddr addr, unsigned size)
+{
+    LiverpoolGCWindow *w = opaque;
+    uint32_t index = w->base + (addr >> 2);
+
+    liverpool_gc_perf_inc(LVP_PERF_MMIO_READS + w->block);
+    return liverpool_gc_blocks[w->block].read(w->gc, index);
+}
+
+static void liverpool_gc_window_write(
+    void *opaque, hwaddr addr, uint64_t value, unsigned size)
+{
+    LiverpoolGCWindow *w = opaque;
+    uint32_t index = w->base + (addr >> 2);
+
+    liverpool_gc_perf_inc(LVP_PERF_MMIO_WRITES + w->block);
+    liverpool_gc_blocks[w->block].write(w->gc, index, value);
+
+    // The CP might be waiting on this register
+    liverpool_gc_gfx_cp_kick(&w->gc->gfx);
+}
+
+static const MemoryRegionOps liverpool_gc_window_ops = {
+    .read = liverpool_gc_window_read,
+    .write = liverpool_gc_window_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .impl = {
         .min_access_size = 4,
@@ -492,10 +910,140 @@ static const MemoryRegionOps liverpool_gc_mmio_ops = {
     },
 };
 
+/* QMP */
+LiverpoolStats *qmp_query_liverpool_stats(Error **errp)
+{
+    LiverpoolStats *stats;
+    LiverpoolPM4OpcodeStatsList *entry;
+    LiverpoolMMIOBlockStatsList *mmio_entry;
+    uint64_t values[LVP_PERF_COUNT];
+    int opcode, block;
+
+    liverpool_gc_perf_read_all(values);
+    stats = g_new0(LiverpoolStats, 1);
+    stats->pm4_type0_packets = values[LVP_PERF_PM4_TYPE0];
+    stats->pm4_type2_packets = values[LVP_PERF_PM4_TYPE2];
+    stats->pm4_type3_packets = values[LVP_PERF_PM4_TYPE3];
+    stats->ring_bytes = values[LVP_PERF_RING_BYTES];
+    stats->ib_bytes = values[LVP_PERF_IB_BYTES];
+    stats->gart_walks = values[LVP_PERF_GART_WALKS];
+    stats->gart_misses = values[LVP_PERF_GART_MISSES];
+    stats->ih_vectors = values[LVP_PERF_IH_VECTORS];
+    stats->samu_commands = values[LVP_PERF_SAMU_COMMANDS];
+    stats->cp_busy_ns = values[LVP_PERF_CP_BUSY_NS];
+
+    for (block = LVP_MMIO_BLOCK_COUNT - 1; block >= 0; block--) {
+        if (!values[LVP_PERF_MMIO_READS + block] &&
+            !values[LVP_PERF_MMIO_WRITES + block]) {
+            continue;
+        }
+        mmio_entry = g_new0(LiverpoolMMIOBlockStatsList, 1);
+        mmio_entry->value = g_new0(LiverpoolMMIOBlockStats, 1);
+        mmio_entry->value->block = g_strdup(liverpool_gc_blocks[block].name);
+        mmio_entry->value->reads = values[LVP_PERF_MMIO_READS + block];
+        mmio_entry->value->writes = values[LVP_PERF_MMIO_WRITES + block];
+        mmio_entry->next = stats->mmio_blocks;
+        stats->mmio_blocks = mmio_entry;
+    }
+
+    for (opcode = 0xFF; opcode >= 0; opcode--) {
+        if (!values[LVP_PERF_PM4_IT + opcode]) {
+            continue;
+        }
+        entry = g_new0(LiverpoolPM4OpcodeStatsList, 1);
+        entry->value = g_new0(LiverpoolPM4OpcodeStats, 1);
+        entry->value->opcode = opcode;
+        entry->value->count = values[LVP_PERF_PM4_IT + opcode];
+        entry->next = stats->pm4_opcodes;
+        stats->pm4_opcodes = entry;
+    }
+    return stats;
+}
+
+static const LiverpoolShaderStage liverpool_gc_shader_stages[] = {
+    [LVP_SHADER_LS] = LIVERPOOL_SHADER_STAGE_LS,
+    [LVP_SHADER_HS] = LIVERPOOL_SHADER_STAGE_HS,
+    [LVP_SHADER_ES] = LIVERPOOL_SHADER_STAGE_ES,
+    [LVP_SHADER_GS] = LIVERPOOL_SHADER_STAGE_GS,
+    [LVP_SHADER_VS] = LIVERPOOL_SHADER_STAGE_VS,
+    [LVP_SHADER_PS] = LIVERPOOL_SHADER_STAGE_PS,
+    [LVP_SHADER_CS] = LIVERPOOL_SHADER_STAGE_CS,
+};
+
+typedef struct LiverpoolShaderQuery {
+    LiverpoolShaderInfoList *list;
+    bool disassemble;
+} LiverpoolShaderQuery;
+
+static void liverpool_gc_query_shader(const lvp_shader_t *shader, void *opaque)
+{
+    LiverpoolShaderQuery *query = opaque;
+    LiverpoolShaderInfoList *entry;
+    LiverpoolShaderInfo *info;
+
+    info = g_new0(LiverpoolShaderInfo, 1);
+    info->hash = shader->hash;
+    info->stage = liverpool_gc_shader_stages[shader->stage];
+    info->vmid = shader->vmid;
+    info->address = shader->addr;
+    info->size = shader->size;
+    info->truncated = shader->truncated;
+    info->instructions = shader->insn_count;
+    info->binds = shader->binds;
+    if (query->disassemble) {
+        info->has_disassembly = true;
+        info->disassembly = liverpool_gc_shader_disassemble(shader);
+    }
+
+    entry = g_new0(LiverpoolShaderInfoList, 1);
+    entry->value = info;
+    entry->next = query->list;
+    query->list = entry;
+}
+
+LiverpoolShaderInfoList *qmp_query_liverpool_shaders(bool has_disassemble,
+                                                     bool disassemble,
+                                                     Error **errp)
+{
+    LiverpoolShaderQuery query = {
+        .list = NULL,
+        .disassemble = has_disassemble && disassemble,
+    };
+    LiverpoolGCState *s;
+    Object *obj;
+
+    obj = object_resolve_path_type("", TYPE_LIVERPOOL_GC, NULL);
+    if (!obj) {
+        error_setg(errp, "No Liverpool GC device found");
+        return NULL;
+    }
+    s = LIVERPOOL_GC(obj);
+    liverpool_gc_shader_foreach(s->gfx.shaders,
+        liverpool_gc_query_shader, &query);
+    return query.list;
+}
+
+/* Memory inspector */
+static bool liverpool_gc_inspect_gart(void *opaque, int vmid,
+    uint64_t addr, void *buf, size_t len)
+{
+    LiverpoolGCState *s = opaque;
+    hwaddr paddr;
+
+    if (vmid < 0 || vmid >= GART_VMID_COUNT ||
+        !liverpool_gc_gart_lookup(&s->gart, vmid, addr, &paddr)) {
+        return false;
+    }
+    return orbital_memory_read_ram(&address_space_memory, paddr, buf, len);
+}
+
 /* Device functions */
 static void liverpool_gc_realize(PCIDevice *dev, Error **errp)
 {
     LiverpoolGCState *s = LIVERPOOL_GC(dev);
+    Error *err = NULL;
+    char name[32];
+    int i;
 
     // PCI Configuration Space
     dev->config[PCI_INTERRUPT_LINE] = 0xFF;
@@ -503,12 +1051,36 @@ static void liverpool_gc_realize(PCIDevice *dev, Error **errp)
     msi_init(dev, 0, 1, true, false, errp);
 
     // Memory
-    memory_region_init_io(&s->iomem[0], OBJECT(dev),
-        &liverpool_gc_ops, s, "liverpool-gc-0", 0x4000000);
+    /* Frame buffer aperture: guest accesses go straight to host memory,
+     * and the console picks up updates through the VGA dirty log */
+    memory_region_init_ram(&s->iomem[0], OBJECT(dev),
+        "liverpool-gc-0", LIVERPOOL_GC_FB_SIZE, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    memory_region_set_log(&s->iomem[0], true, DIRTY_MEMORY_VGA);
     memory_region_init_io(&s->iomem[1], OBJECT(dev),
-        &liverpool_gc_ops, s, "liverpool-gc-1", 0x800000);
-    memory_region_init_io(&s->iomem[2], OBJECT(dev),
-        &liverpool_gc_mmio_ops, s, "liverpool-gc-mmio", 0x40000);
+        &liverpool_gc_doorbell_ops, s, "liverpool-gc-1",
+        LIVERPOOL_GC_DOORBELL_SIZE);
+    s->mmio = qemu_memalign(qemu_real_host_page_size, LIVERPOOL_GC_MMIO_SIZE);
+    memset(s->mmio, 0, LIVERPOOL_GC_MMIO_SIZE);
+    memory_region_init_ram_ptr(&s->iomem[2], OBJECT(dev),
+        "liverpool-gc-mmio", LIVERPOOL_GC_MMIO_SIZE, s->mmio);
+    vmstate_register_ram(&s->iomem[2], DEVICE(dev));
+    for (i = 0; i < LIVERPOOL_GC_WINDOW_COUNT; i++) {
+        LiverpoolGCWindow *w = &s->window[i];
+
+        w->gc = s;
+        w->block = liverpool_gc_windows[i].block;
+        w->base = liverpool_gc_windows[i].base;
+        snprintf(name, sizeof(name), "liverpool-gc-%s-%04x",
+            liverpool_gc_blocks[w->block].name, w->base);
+        memory_region_init_io(&w->iomem, OBJECT(dev), &liverpool_gc_window_ops,
+            w, name, LIVERPOOL_GC_WINDOW_SIZE);
+        memory_region_add_subregion_overlap(&s->iomem[2],
+            w->base * 4, &w->iomem, 1);
+    }
 
     pci_register_bar(dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[0]);
     pci_register_bar(dev, 2, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem[1]);
@@ -518,17 +1090,62 @@ static void liverpool_gc_realize(PCIDevice *dev, Error **errp)
     s->gfx.gart = &s->gart;
     s->gfx.mmio = &s->mmio[0];
 
+    // PM4 capture
+    if (s->pm4_capture) {
+        s->gfx.capture = pm4_capture_open(s->pm4_capture, errp);
+        if (!s->gfx.capture) {
+            return;
+        }
+    }
+
+    // Debugging
+    orbital_trace_register(ORBITAL_TRACE_CP,
+        liverpool_gc_gfx_trace_opname, liverpool_gc_gfx_trace_format);
+    orbital_trace_register(ORBITAL_TRACE_SAMU,
+        liverpool_gc_samu_trace_opname, liverpool_gc_samu_trace_format);
+    orbital_memory_register(ORBITAL_MEMORY_GART,
+        liverpool_gc_inspect_gart, s);
+
+    // Display
+    s->con = graphic_console_init(DEVICE(dev), 0, &liverpool_gc_fb_ops, s);
+
     // Command Processor
+    liverpool_gc_gfx_init(&s->gfx);
     qemu_thread_create(&s->gfx.cp_thread, "lvp-gfx-cp",
         liverpool_gc_gfx_cp_thread, &s->gfx, QEMU_THREAD_JOINABLE);
+    if (s->ioeventfd && kvm_eventfds_enabled()) {
+        liverpool_gc_doorbell_set_ioeventfds(s, true);
+    }
 }
 
 static void liverpool_gc_exit(PCIDevice *dev)
 {
+    LiverpoolGCState *s = LIVERPOOL_GC(dev);
+
+    if (s->ioeventfd && kvm_eventfds_enabled()) {
+        liverpool_gc_doorbell_set_ioeventfds(s, false);
+    }
+    graphic_console_close(s->con);
+    liverpool_gc_gfx_cp_stop(&s->gfx);
+    event_notifier_cleanup(&s->gfx.cp_event);
+    if (s->gfx.capture) {
+        pm4_capture_close(s->gfx.capture);
+        s->gfx.capture = NULL;
+    }
+    vmstate_unregister_ram(&s->iomem[2], DEVICE(dev));
+    qemu_vfree(s->mmio);
+    s->mmio = NULL;
 }
 
+static Property liverpool_gc_properties[] = {
+    DEFINE_PROP_STRING("pm4-capture", LiverpoolGCState, pm4_capture),
+    DEFINE_PROP_BOOL("ioeventfd", LiverpoolGCState, ioeventfd, true),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void liverpool_gc_class_init(ObjectClass *klass, void *data)
 {
+    DeviceClass *dc = DEVICE_CLASS(klass);
     PCIDeviceClass *pc = PCI_DEVICE_CLASS(klass);
 
     pc->vendor_id = LIVERPOOL_GC_VENDOR_ID;
@@ -540,6 +1157,7 @@ static void liverpool_gc_class_init(ObjectClass *klass, void *data)
     pc->class_id = PCI_CLASS_DISPLAY_VGA;
     pc->realize = liverpool_gc_realize;
     pc->exit = liverpool_gc_exit;
+    dc->props = liverpool_gc_properties;
 }
 
 static const TypeInfo liverpool_gc_info = {
@@ -17,82 +17,48 @@
  * License along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * The HDAC is a standard HD Audio controller for the HDMI/S/PDIF codecs
+ * behind Liverpool, so it is backed by the generic intel-hda controller.
+ * Codecs attach to its bus and stream through QEMU's audio backends.
+ *
+ * The registers Orbis pokes to mute audio at boot are the Immediate
+ * Command interface: 0x60 (ICW), 0x64 (IRR) and 0x68 (ICS), e.g.
+ * ICW = 0x377703, 0x377823, ... for ATI multichannel verbs on nid 3/5/7.
+ */
+
 #include "liverpool.h"
 #include "qemu/osdep.h"
+#include "qapi/error.h"
 #include "hw/pci/pci.h"
-#include "macros.h"
-
-// MMIO
-/* The following three registers are involved in muting audio  */
-#define HDAC_UNK60 0x60  // Command?
-#define HDAC_UNK64 0x64  // Size?
-#define HDAC_UNK68 0x68  // Flags?
-
-// During the muting audio phase, following values are passed to HDAC_UNK60
-// 377703h 377823h 377943h 377A63h
-// 577703h 577823h 577943h 577A63h
-// 777703h 777823h 777943h 777A63h
-
-// Helpers
-#define MMIO_R(...) MMIO_READ(s->mmio, __VA_ARGS__)
-#define MMIO_W(...) MMIO_WRITE(s->mmio, __VA_ARGS__)
-
-#define LIVERPOOL_HDAC(obj) \
-    OBJECT_CHECK(LiverpoolHDACState, (obj), TYPE_LIVERPOOL_HDAC)
-
-typedef struct LiverpoolHDACState {
-    /*< private >*/
-    PCIDevice parent_obj;
-    /*< public >*/
-    MemoryRegion iomem;
-    uint32_t mmio[0x1000];
-} LiverpoolHDACState;
-
-static uint64_t liverpool_hdac_read
-    (void *opaque, hwaddr addr, unsigned size)
-{
-    LiverpoolHDACState *s = opaque;
-
-    switch (addr) {
-    case HDAC_UNK68: 
-        return 0;
-    }
-    printf("liverpool_hdac_read:  { addr: %lX, size: %X }\n", addr, size);
-    return MMIO_R(addr);
-}
-
-static void liverpool_hdac_write
-    (void *opaque, hwaddr addr, uint64_t value, unsigned size)
-{
-    LiverpoolHDACState *s = opaque;
-
-    MMIO_W(addr, value);
-    printf("liverpool_hdac_write: { addr: %lX, size: %X, value: %lX }\n", addr, size, value);
-}
-
-static const MemoryRegionOps liverpool_hdac_ops = {
-    .read = liverpool_hdac_read,
-    .write = liverpool_hdac_write,
-    .endianness = DEVICE_LITTLE_ENDIAN,
-};
+#include "hw/audio/intel-hda.h"
 
 static void liverpool_hdac_realize(PCIDevice *dev, Error **errp)
 {
-    LiverpoolHDACState *s = LIVERPOOL_HDAC(dev);
+    PCIDeviceClass *pc;
+    Error *err = NULL;
+
+    pc = PCI_DEVICE_CLASS(object_class_by_name(TYPE_INTEL_HDA_GENERIC));
+    pc->realize(dev, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
 
     // PCI Configuration Space
     dev->config[PCI_INTERRUPT_LINE] = 0xFF;
     dev->config[PCI_INTERRUPT_PIN] = 0x02;
-    pci_add_capability(dev, PCI_CAP_ID_MSI, 0, PCI_CAP_SIZEOF, errp);
+}
 
-    // Memory
-    memory_region_init_io(&s->iomem, OBJECT(dev),
-        &liverpool_hdac_ops, s, "liverpool-hdac-0", 0x4000);
-    pci_register_bar(dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->iomem);
+static void liverpool_hdac_init(Object *obj)
+{
+    /* Both a conventional and an express function, see intel-hda */
+    PCI_DEVICE(obj)->cap_present |= QEMU_PCI_CAP_EXPRESS;
 }
 
 static void liverpool_hdac_class_init(ObjectClass *klass, void *data)
 {
+    DeviceClass *dc = DEVICE_CLASS(klass);
     PCIDeviceClass *pc = PCI_DEVICE_CLASS(klass);
 
     pc->vendor_id = 0x1002;
@@ -100,12 +66,13 @@ static void liverpool_hdac_class_init(ObjectClass *klass, void *data)
     pc->revision = 0;
     pc->class_id = PCI_CLASS_MULTIMEDIA_AUDIO;
     pc->realize = liverpool_hdac_realize;
+    set_bit(DEVICE_CATEGORY_SOUND, dc->categories);
 }
 
 static const TypeInfo liverpool_hdac_info = {
     .name          = TYPE_LIVERPOOL_HDAC,
-    .parent        = TYPE_PCI_DEVICE,
-    .instance_size = sizeof(LiverpoolHDACState),
+    .parent        = TYPE_INTEL_HDA_GENERIC,
+    .instance_init = liverpool_hdac_init,
     .class_init    = liverpool_hdac_class_init,
     .interfaces    = (InterfaceInfo[]) {
         { INTERFACE_PCIE_DEVICE },
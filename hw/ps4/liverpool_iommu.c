@@ -29,6 +29,10 @@
 #include "hw/i386/amd_iommu.h"
 #include "hw/i386/pc.h"
 #include "hw/pci/msi.h"
+#include "qemu/atomic.h"
+#include "qemu/bitmap.h"
+#include "qemu/main-loop.h"
+#include "ui/orbital-memory.h"
 
 #define LIVERPOOL_IOMMU(obj) \
     OBJECT_CHECK(LiverpoolIOMMUState, (obj), TYPE_LIVERPOOL_IOMMU)
@@ -72,6 +76,9 @@ typedef struct LiverpoolIOMMUState {
     uint32_t cmdbuf_head;        /* current IOMMU read position  */
     uint32_t cmdbuf_tail;        /* next Software write position */
     bool completion_wait_intr;
+    QEMUBH *cmdbuf_bh;           /* drains the command buffer    */
+    uint8_t *cmdbuf_map;         /* host mapping of the buffer   */
+    hwaddr cmdbuf_map_len;
 
     hwaddr evtlog;               /* base address event log       */
     bool evtlog_intr;
@@ -101,6 +108,14 @@ typedef struct LiverpoolIOMMUState {
 
     /* IOTLB */
     GHashTable *iotlb;
+
+    /* Domains and devices invalidated since the last IOTLB sweep */
+    unsigned long *inval_domids;
+    unsigned long *inval_devids;
+    bool inval_pending;
+
+    /* Address spaces with IOMMU notifiers */
+    QLIST_HEAD(, AMDVIAddressSpace) notifiers;
 } LiverpoolIOMMUState;
 
 typedef struct LiverpoolIOMMUPCIState {
@@ -140,8 +155,19 @@ struct AMDVIAddressSpace {
     IOMMUMemoryRegion iommu;    /* Device's address translation region  */
     MemoryRegion iommu_ir;      /* Device's interrupt remapping region  */
     AddressSpace as;            /* device's corresponding address space */
+    IOMMUNotifierFlag notify_flags;       /* notifiers registered on iommu */
+    QLIST_ENTRY(AMDVIAddressSpace) next;  /* in notifiers, if any         */
 };
 
+/* Range covered by notifications about a whole address space */
+#define AMDVI_NOTIFY_VA_MASK ((1ULL << 48) - 1)
+
+/* forward declarations */
+static void liverpool_iommu_notify_as(AMDVIAddressSpace *as,
+                                      hwaddr iova, hwaddr mask);
+static void liverpool_iommu_notify_pending(LiverpoolIOMMUState *s);
+static void liverpool_iommu_notify_all(LiverpoolIOMMUState *s);
+
 /* AMDVI cache entry */
 typedef struct AMDVIIOTLBEntry {
     uint16_t domid;             /* assigned domain id  */
@@ -399,12 +425,28 @@ static void liverpool_iommu_iotlb_reset(LiverpoolIOMMUState *s)
     g_hash_table_remove_all(s->iotlb);
 }
 
-static gboolean liverpool_iommu_iotlb_remove_by_devid(gpointer key, gpointer value,
-                                            gpointer user_data)
+static gboolean liverpool_iommu_iotlb_remove_pending(gpointer key,
+                                                     gpointer value,
+                                                     gpointer user_data)
 {
     AMDVIIOTLBEntry *entry = (AMDVIIOTLBEntry *)value;
-    uint16_t devid = *(uint16_t *)user_data;
-    return entry->devid == devid;
+    LiverpoolIOMMUState *s = user_data;
+    return test_bit(entry->domid, s->inval_domids) ||
+           test_bit(entry->devid, s->inval_devids);
+}
+
+/* Removes every entry of the invalidated domains and devices in one sweep */
+static void liverpool_iommu_iotlb_flush_pending(LiverpoolIOMMUState *s)
+{
+    if (!s->inval_pending) {
+        return;
+    }
+    g_hash_table_foreach_remove(s->iotlb, liverpool_iommu_iotlb_remove_pending,
+                                s);
+    liverpool_iommu_notify_pending(s);
+    bitmap_zero(s->inval_domids, 1 << 16);
+    bitmap_zero(s->inval_devids, 1 << 16);
+    s->inval_pending = false;
 }
 
 static void liverpool_iommu_iotlb_remove_page(LiverpoolIOMMUState *s, hwaddr addr,
@@ -433,6 +475,7 @@ static void liverpool_iommu_update_iotlb(LiverpoolIOMMUState *s, uint16_t devid,
         }
 
         entry->domid = domid;
+        entry->devid = devid;
         entry->perms = to_cache.perm;
         entry->translated_addr = to_cache.translated_addr;
         entry->page_mask = to_cache.addr_mask;
@@ -471,11 +514,13 @@ static void liverpool_iommu_inval_devtab_entry(LiverpoolIOMMUState *s, uint64_t
 {
     uint16_t devid = cpu_to_le16((uint16_t)extract64(cmd[0], 0, 16));
 
-    /* This command should invalidate internal caches of which there isn't */
+    /* The entry may now map the device elsewhere, so drop its translations */
     if (extract64(cmd[0], 15, 16) || cmd[1]) {
         liverpool_iommu_log_illegalcom_error(s, extract64(cmd[0], 60, 4),
                                    s->cmdbuf + s->cmdbuf_head);
     }
+    set_bit(devid, s->inval_devids);
+    s->inval_pending = true;
     /*trace_liverpool_iommu_devtab_inval(PCI_BUS_NUM(devid), PCI_SLOT(devid),
                              PCI_FUNC(devid));*/
 }
@@ -499,17 +544,13 @@ static void liverpool_iommu_inval_all(LiverpoolIOMMUState *s, uint64_t *cmd)
     }
 
     liverpool_iommu_iotlb_reset(s);
+    bitmap_zero(s->inval_domids, 1 << 16);
+    bitmap_zero(s->inval_devids, 1 << 16);
+    s->inval_pending = false;
+    liverpool_iommu_notify_all(s);
     //trace_liverpool_iommu_all_inval();
 }
 
-static gboolean liverpool_iommu_iotlb_remove_by_domid(gpointer key, gpointer value,
-                                            gpointer user_data)
-{
-    AMDVIIOTLBEntry *entry = (AMDVIIOTLBEntry *)value;
-    uint16_t domid = *(uint16_t *)user_data;
-    return entry->domid == domid;
-}
-
 /* we don't have devid - we can't remove pages by address */
 static void liverpool_iommu_inval_pages(LiverpoolIOMMUState *s, uint64_t *cmd)
 {
@@ -521,8 +562,8 @@ static void liverpool_iommu_inval_pages(LiverpoolIOMMUState *s, uint64_t *cmd)
                                    s->cmdbuf + s->cmdbuf_head);
     }
 
-    g_hash_table_foreach_remove(s->iotlb, liverpool_iommu_iotlb_remove_by_domid,
-                                &domid);
+    set_bit(domid, s->inval_domids);
+    s->inval_pending = true;
     //trace_liverpool_iommu_pages_inval(domid);
 }
 
@@ -552,8 +593,18 @@ static void liverpool_iommu_inval_inttable(LiverpoolIOMMUState *s, uint64_t *cmd
 /* FIXME: Try to work with the specified size instead of all the pages
  * when the S bit is on
  */
+static AMDVIAddressSpace *liverpool_iommu_find_as(LiverpoolIOMMUState *s,
+                                                  uint16_t devid)
+{
+    AMDVIAddressSpace **iommu_as = s->address_spaces[PCI_BUS_NUM(devid)];
+
+    return iommu_as ? iommu_as[devid & 0xFF] : NULL;
+}
+
 static void iommu_inval_iotlb(LiverpoolIOMMUState *s, uint64_t *cmd)
 {
+    AMDVIAddressSpace *as;
+    hwaddr addr;
 
     uint16_t devid = extract64(cmd[0], 0, 16);
     if (extract64(cmd[1], 1, 1) || extract64(cmd[1], 3, 9)) {
@@ -563,22 +614,74 @@ static void iommu_inval_iotlb(LiverpoolIOMMUState *s, uint64_t *cmd)
     }
 
     if (extract64(cmd[1], 0, 1)) {
-        g_hash_table_foreach_remove(s->iotlb, liverpool_iommu_iotlb_remove_by_devid,
-                                    &devid);
+        set_bit(devid, s->inval_devids);
+        s->inval_pending = true;
     } else {
-        liverpool_iommu_iotlb_remove_page(s, cpu_to_le64(extract64(cmd[1], 12, 52)) << 12,
-                                cpu_to_le16(extract64(cmd[1], 0, 16)));
+        addr = extract64(cmd[1], 12, 52) << 12;
+        liverpool_iommu_iotlb_remove_page(s, addr, devid);
+        as = liverpool_iommu_find_as(s, devid);
+        if (as && as->notify_flags) {
+            liverpool_iommu_notify_as(as, addr, ~AMDVI_PAGE_MASK_4K);
+        }
     }
     //trace_liverpool_iommu_iotlb_inval();
 }
 
+static void liverpool_iommu_cmdbuf_unmap(LiverpoolIOMMUState *s)
+{
+    if (s->cmdbuf_map) {
+        address_space_unmap(&address_space_memory, s->cmdbuf_map,
+                            s->cmdbuf_map_len, false, 0);
+        s->cmdbuf_map = NULL;
+    }
+}
+
+/* The buffer is mapped once; if it is not contiguous RAM, commands are
+ * read one at a time instead */
+static void liverpool_iommu_cmdbuf_map(LiverpoolIOMMUState *s)
+{
+    hwaddr len = s->cmdbuf_len * AMDVI_COMMAND_SIZE;
+
+    if (s->cmdbuf_map || !len) {
+        return;
+    }
+    s->cmdbuf_map_len = len;
+    s->cmdbuf_map = address_space_map(&address_space_memory, s->cmdbuf,
+                                      &s->cmdbuf_map_len, false);
+    if (s->cmdbuf_map && s->cmdbuf_map_len < len) {
+        liverpool_iommu_cmdbuf_unmap(s);
+    }
+}
+
+static bool liverpool_iommu_cmdbuf_fetch(LiverpoolIOMMUState *s, uint64_t *cmd)
+{
+    if (s->cmdbuf_map) {
+        cmd[0] = ldq_le_p(s->cmdbuf_map + s->cmdbuf_head);
+        cmd[1] = ldq_le_p(s->cmdbuf_map + s->cmdbuf_head + 8);
+        return true;
+    }
+    if (dma_memory_read(&address_space_memory, s->cmdbuf + s->cmdbuf_head,
+        cmd, AMDVI_COMMAND_SIZE)) {
+        return false;
+    }
+    cmd[0] = le64_to_cpu(cmd[0]);
+    cmd[1] = le64_to_cpu(cmd[1]);
+    return true;
+}
+
+/* Completes the commands executed so far, so they are visible to software */
+static void liverpool_iommu_cmdbuf_sync(LiverpoolIOMMUState *s)
+{
+    liverpool_iommu_iotlb_flush_pending(s);
+    liverpool_iommu_writeq_raw(s, AMDVI_MMIO_COMMAND_HEAD, s->cmdbuf_head);
+}
+
 /* not honouring reserved bits is regarded as an illegal command */
 static void liverpool_iommu_cmdbuf_exec(LiverpoolIOMMUState *s)
 {
     uint64_t cmd[2];
 
-    if (dma_memory_read(&address_space_memory, s->cmdbuf + s->cmdbuf_head,
-        cmd, AMDVI_COMMAND_SIZE)) {
+    if (!liverpool_iommu_cmdbuf_fetch(s, cmd)) {
         DPRINTF("error: fail to access memory at 0x%"PRIx64" + 0x%"PRIx32"\n", s->cmdbuf, s->cmdbuf_head);
         liverpool_iommu_log_command_error(s, s->cmdbuf + s->cmdbuf_head);
         return;
@@ -586,6 +689,7 @@ static void liverpool_iommu_cmdbuf_exec(LiverpoolIOMMUState *s)
 
     switch (extract64(cmd[0], 60, 4)) {
     case AMDVI_CMD_COMPLETION_WAIT:
+        liverpool_iommu_cmdbuf_sync(s);
         liverpool_iommu_completion_wait(s, cmd);
         break;
     case AMDVI_CMD_INVAL_DEVTAB_ENTRY:
@@ -617,25 +721,35 @@ static void liverpool_iommu_cmdbuf_exec(LiverpoolIOMMUState *s)
     }
 }
 
-static void liverpool_iommu_cmdbuf_run(LiverpoolIOMMUState *s)
+/* Drains the command buffer from a bottom half, so that software queueing
+ * many commands pays for a single run. Invalidations are only recorded,
+ * and applied in one IOTLB sweep before the next COMPLETION_WAIT or at
+ * the end of the run. */
+static void liverpool_iommu_cmdbuf_run(void *opaque)
 {
+    LiverpoolIOMMUState *s = opaque;
+
     if (!s->cmdbuf_enabled) {
         //trace_liverpool_iommu_command_error(liverpool_iommu_readq(s, AMDVI_MMIO_CONTROL));
         return;
     }
 
     /* check if there is work to do. */
+    if (s->cmdbuf_head == s->cmdbuf_tail) {
+        return;
+    }
+    liverpool_iommu_cmdbuf_map(s);
     while (s->cmdbuf_head != s->cmdbuf_tail) {
         //trace_liverpool_iommu_command_exec(s->cmdbuf_head, s->cmdbuf_tail, s->cmdbuf);
         liverpool_iommu_cmdbuf_exec(s);
         s->cmdbuf_head += AMDVI_COMMAND_SIZE;
-        liverpool_iommu_writeq_raw(s, AMDVI_MMIO_COMMAND_HEAD, s->cmdbuf_head);
 
         /* wrap head pointer */
         if (s->cmdbuf_head >= s->cmdbuf_len * AMDVI_COMMAND_SIZE) {
             s->cmdbuf_head = 0;
         }
     }
+    liverpool_iommu_cmdbuf_sync(s);
 }
 
 static void liverpool_iommu_mmio_trace(hwaddr addr, unsigned size)
@@ -677,7 +791,12 @@ static uint64_t liverpool_iommu_mmio_read(void *opaque, hwaddr addr, unsigned si
 static void liverpool_iommu_handle_control_write(LiverpoolIOMMUState *s)
 {
     unsigned long control = liverpool_iommu_readq(s, AMDVI_MMIO_CONTROL);
+    bool enabled = s->enabled;
+
     s->enabled = !!(control & AMDVI_MMIO_CONTROL_AMDVIEN);
+    if (s->enabled != enabled) {
+        liverpool_iommu_notify_all(s);
+    }
 
     s->ats_enabled = !!(control & AMDVI_MMIO_CONTROL_HTTUNEN);
     s->evtlog_enabled = s->enabled && !!(control &
@@ -701,7 +820,7 @@ static void liverpool_iommu_handle_control_write(LiverpoolIOMMUState *s)
     }
 
     //trace_liverpool_iommu_control_status(control);
-    liverpool_iommu_cmdbuf_run(s);
+    qemu_bh_schedule(s->cmdbuf_bh);
 }
 
 static inline void liverpool_iommu_handle_devtab_write(LiverpoolIOMMUState *s)
@@ -720,11 +839,12 @@ static inline void liverpool_iommu_handle_cmdhead_write(LiverpoolIOMMUState *s)
 {
     s->cmdbuf_head = liverpool_iommu_readq(s, AMDVI_MMIO_COMMAND_HEAD)
                      & AMDVI_MMIO_CMDBUF_HEAD_MASK;
-    liverpool_iommu_cmdbuf_run(s);
+    qemu_bh_schedule(s->cmdbuf_bh);
 }
 
 static inline void liverpool_iommu_handle_cmdbase_write(LiverpoolIOMMUState *s)
 {
+    liverpool_iommu_cmdbuf_unmap(s);
     s->cmdbuf = liverpool_iommu_readq(s, AMDVI_MMIO_COMMAND_BASE)
                 & AMDVI_MMIO_CMDBUF_BASE_MASK;
     s->cmdbuf_len = 1UL << (liverpool_iommu_readq(s, AMDVI_MMIO_CMDBUF_SIZE_BYTE)
@@ -736,7 +856,7 @@ static inline void liverpool_iommu_handle_cmdtail_write(LiverpoolIOMMUState *s)
 {
     s->cmdbuf_tail = liverpool_iommu_readq(s, AMDVI_MMIO_COMMAND_TAIL)
                      & AMDVI_MMIO_CMDBUF_TAIL_MASK;
-    liverpool_iommu_cmdbuf_run(s);
+    qemu_bh_schedule(s->cmdbuf_bh);
 }
 
 static inline void liverpool_iommu_handle_excllim_write(LiverpoolIOMMUState *s)
@@ -952,83 +1072,124 @@ static inline uint64_t pte_get_page_mask(uint64_t oldlevel)
     return ~((1UL << ((oldlevel * 9) + 3)) - 1);
 }
 
-static inline uint64_t liverpool_iommu_get_pte_entry(LiverpoolIOMMUState *s, uint64_t pte_addr,
-                                          uint16_t devid)
+/* Outcome of a page table lookup */
+typedef enum LiverpoolIOMMUWalk {
+    LVP_IOMMU_WALK_OK,
+    LVP_IOMMU_WALK_INVALID,     /* invalid translation mode */
+    LVP_IOMMU_WALK_FAULT,       /* not present, or permission denied */
+    LVP_IOMMU_WALK_TABLE_ERROR, /* a table entry could not be read */
+    LVP_IOMMU_WALK_EMPTY,       /* a table entry is zero */
+} LiverpoolIOMMUWalk;
+
+/* The memory inspector runs on the UI thread without the BQL, so its reads
+ * must never dispatch MMIO: they go through the RAM-only accessor. */
+static bool liverpool_iommu_read_pte(hwaddr pte_addr, uint64_t *pte,
+                                     bool inspect)
+{
+    if (inspect) {
+        if (!orbital_memory_read_ram(&address_space_memory, pte_addr,
+                                     pte, sizeof(*pte))) {
+            return false;
+        }
+    } else if (dma_memory_read(&address_space_memory, pte_addr,
+                               pte, sizeof(*pte))) {
+        return false;
+    }
+    *pte = le64_to_cpu(*pte);
+    return true;
+}
+
+/* Looks up @addr in the tables of a DTE whose first quadword is @dte, and
+ * fills @ret on success. @perms are required at every level above the leaf.
+ * On table errors, *pte_addr is the entry that could not be read. */
+static LiverpoolIOMMUWalk liverpool_iommu_lookup(uint64_t dte, hwaddr addr,
+                                                 unsigned perms, bool inspect,
+                                                 IOMMUTLBEntry *ret,
+                                                 hwaddr *pte_addr)
 {
-    uint64_t pte;
+    unsigned level, present, pte_perms, oldlevel = 0;
+    uint64_t pte = dte, page_mask;
 
-    if (dma_memory_read(&address_space_memory, pte_addr, &pte, sizeof(pte))) {
-        //trace_liverpool_iommu_get_pte_hwerror(pte_addr);
-        liverpool_iommu_log_pagetab_error(s, devid, pte_addr, 0);
-        pte = 0;
-        return pte;
+    level = get_pte_translation_mode(pte);
+    if (level >= 7) {
+        return LVP_IOMMU_WALK_INVALID;
+    }
+    if (level == 0) {
+        ret->iova = addr & AMDVI_PAGE_MASK_4K;
+        ret->translated_addr = addr & AMDVI_PAGE_MASK_4K;
+        ret->addr_mask = ~AMDVI_PAGE_MASK_4K;
+        ret->perm = liverpool_iommu_get_perms(pte);
+        return LVP_IOMMU_WALK_OK;
+    }
+
+    /* we are at the leaf page table or page table encodes a huge page */
+    while (level > 0) {
+        pte_perms = liverpool_iommu_get_perms(pte);
+        present = pte & 1;
+        if (!present || perms != (perms & pte_perms)) {
+            return LVP_IOMMU_WALK_FAULT;
+        }
+
+        /* go to the next lower level */
+        *pte_addr = pte & AMDVI_DEV_PT_ROOT_MASK;
+        /* add offset and load pte */
+        *pte_addr += ((addr >> (3 + 9 * level)) & 0x1FF) << 3;
+        if (!liverpool_iommu_read_pte(*pte_addr, &pte, inspect)) {
+            return LVP_IOMMU_WALK_TABLE_ERROR;
+        }
+        if (!pte) {
+            return LVP_IOMMU_WALK_EMPTY;
+        }
+        oldlevel = level;
+        level = get_pte_translation_mode(pte);
+        if (level == 0x7) {
+            break;
+        }
     }
 
-    pte = le64_to_cpu(pte);
-    return pte;
+    if (level == 0x7) {
+        page_mask = pte_override_page_mask(pte);
+    } else {
+        page_mask = pte_get_page_mask(oldlevel);
+    }
+
+    /* get access permissions from pte */
+    ret->iova = addr & page_mask;
+    ret->translated_addr = (pte & AMDVI_DEV_PT_ROOT_MASK) & page_mask;
+    ret->addr_mask = ~page_mask;
+    ret->perm = liverpool_iommu_get_perms(pte);
+    return LVP_IOMMU_WALK_OK;
 }
 
 static void liverpool_iommu_page_walk(AMDVIAddressSpace *as, uint64_t *dte,
                             IOMMUTLBEntry *ret, unsigned perms,
                             hwaddr addr)
 {
-    unsigned level, present, pte_perms, oldlevel;
-    uint64_t pte = dte[0], pte_addr, page_mask;
+    hwaddr pte_addr;
 
     /* make sure the DTE has TV = 1 */
-    if (pte & AMDVI_DEV_TRANSLATION_VALID) {
-        level = get_pte_translation_mode(pte);
-        if (level >= 7) {
-            //trace_liverpool_iommu_mode_invalid(level, addr);
-            return;
-        }
-        if (level == 0) {
-            goto no_remap;
-        }
-
-        /* we are at the leaf page table or page table encodes a huge page */
-        while (level > 0) {
-            pte_perms = liverpool_iommu_get_perms(pte);
-            present = pte & 1;
-            if (!present || perms != (perms & pte_perms)) {
-                liverpool_iommu_page_fault(as->iommu_state, as->devfn, addr, perms);
-                //trace_liverpool_iommu_page_fault(addr);
-                return;
-            }
-
-            /* go to the next lower level */
-            pte_addr = pte & AMDVI_DEV_PT_ROOT_MASK;
-            /* add offset and load pte */
-            pte_addr += ((addr >> (3 + 9 * level)) & 0x1FF) << 3;
-            pte = liverpool_iommu_get_pte_entry(as->iommu_state, pte_addr, as->devfn);
-            if (!pte) {
-                return;
-            }
-            oldlevel = level;
-            level = get_pte_translation_mode(pte);
-            if (level == 0x7) {
-                break;
-            }
-        }
-
-        if (level == 0x7) {
-            page_mask = pte_override_page_mask(pte);
-        } else {
-            page_mask = pte_get_page_mask(oldlevel);
-        }
-
-        /* get access permissions from pte */
-        ret->iova = addr & page_mask;
-        ret->translated_addr = (pte & AMDVI_DEV_PT_ROOT_MASK) & page_mask;
-        ret->addr_mask = ~page_mask;
-        ret->perm = liverpool_iommu_get_perms(pte);
+    if (!(dte[0] & AMDVI_DEV_TRANSLATION_VALID)) {
+        ret->iova = addr & AMDVI_PAGE_MASK_4K;
+        ret->translated_addr = addr & AMDVI_PAGE_MASK_4K;
+        ret->addr_mask = ~AMDVI_PAGE_MASK_4K;
+        ret->perm = liverpool_iommu_get_perms(dte[0]);
         return;
     }
-no_remap:
-    ret->iova = addr & AMDVI_PAGE_MASK_4K;
-    ret->translated_addr = addr & AMDVI_PAGE_MASK_4K;
-    ret->addr_mask = ~AMDVI_PAGE_MASK_4K;
-    ret->perm = liverpool_iommu_get_perms(pte);
+
+    switch (liverpool_iommu_lookup(dte[0], addr, perms, false,
+                                   ret, &pte_addr)) {
+    case LVP_IOMMU_WALK_FAULT:
+        liverpool_iommu_page_fault(as->iommu_state, as->devfn, addr, perms);
+        //trace_liverpool_iommu_page_fault(addr);
+        break;
+    case LVP_IOMMU_WALK_TABLE_ERROR:
+        //trace_liverpool_iommu_get_pte_hwerror(pte_addr);
+        liverpool_iommu_log_pagetab_error(as->iommu_state, as->devfn,
+                                          pte_addr, 0);
+        break;
+    default:
+        break;
+    }
 }
 
 static void liverpool_iommu_do_translate(AMDVIAddressSpace *as, hwaddr addr,
@@ -1069,6 +1230,169 @@ out:
     ret->perm = IOMMU_RW;
 }
 
+/* IOMMU notifiers */
+typedef void (*liverpool_iommu_map_fn)(AMDVIAddressSpace *as,
+                                       IOMMUTLBEntry *entry, void *opaque);
+
+/* get a device table entry without logging errors */
+static bool liverpool_iommu_peek_dte(LiverpoolIOMMUState *s, uint16_t devid,
+                                     uint64_t *entry)
+{
+    if (dma_memory_read(&address_space_memory,
+        s->devtab + devid * AMDVI_DEVTAB_ENTRY_SIZE,
+        entry, AMDVI_DEVTAB_ENTRY_SIZE)) {
+        return false;
+    }
+    entry[0] = le64_to_cpu(entry[0]);
+    entry[1] = le64_to_cpu(entry[1]);
+    return entry[0] & AMDVI_DEV_VALID;
+}
+
+/* Calls @fn on every leaf of the table pointed by @pte, mapping @base
+ * onwards, that intersects [start, end] */
+static void liverpool_iommu_walk_table(AMDVIAddressSpace *as, uint64_t pte,
+                                       hwaddr base, unsigned perms,
+                                       hwaddr start, hwaddr end,
+                                       liverpool_iommu_map_fn fn, void *opaque)
+{
+    unsigned level = get_pte_translation_mode(pte), next;
+    IOMMUTLBEntry entry = { .target_as = &address_space_memory };
+    uint64_t table[512], page_mask;
+    hwaddr span, iova;
+    int i;
+
+    if (dma_memory_read(&address_space_memory, pte & AMDVI_DEV_PT_ROOT_MASK,
+        table, sizeof(table))) {
+        return;
+    }
+    span = 1ULL << (3 + 9 * level);
+    for (i = 0; i < 512; i++) {
+        iova = base + i * span;
+        if (iova > end || iova + span - 1 < start) {
+            continue;
+        }
+        pte = le64_to_cpu(table[i]);
+        if (!(pte & 1)) {
+            continue;
+        }
+        next = get_pte_translation_mode(pte);
+        entry.perm = perms & liverpool_iommu_get_perms(pte);
+        if (next > 0 && next < level) {
+            liverpool_iommu_walk_table(as, pte, iova, entry.perm,
+                                       start, end, fn, opaque);
+            continue;
+        }
+        if (next == 0x7) {
+            /* larger pages are replicated over several entries */
+            page_mask = pte_override_page_mask(pte);
+            if (iova & ~page_mask) {
+                continue;
+            }
+        } else if (next == 0) {
+            page_mask = ~(span - 1);
+        } else {
+            continue;
+        }
+        if (entry.perm == IOMMU_NONE) {
+            continue;
+        }
+        entry.iova = iova;
+        entry.translated_addr = (pte & AMDVI_DEV_PT_ROOT_MASK) & page_mask;
+        entry.addr_mask = ~page_mask;
+        fn(as, &entry, opaque);
+    }
+}
+
+/* Calls @fn on every translation of @as intersecting [start, end] */
+static void liverpool_iommu_walk(AMDVIAddressSpace *as, hwaddr start,
+                                 hwaddr end, liverpool_iommu_map_fn fn,
+                                 void *opaque)
+{
+    LiverpoolIOMMUState *s = as->iommu_state;
+    uint16_t devid = PCI_BUILD_BDF(as->bus_num, as->devfn);
+    uint64_t dte[4];
+    unsigned level;
+
+    /* identity mappings are left for translate to resolve */
+    if (!s->enabled || !liverpool_iommu_peek_dte(s, devid, dte) ||
+        !(dte[0] & AMDVI_DEV_TRANSLATION_VALID)) {
+        return;
+    }
+    level = get_pte_translation_mode(dte[0]);
+    if (level == 0 || level >= 7) {
+        return;
+    }
+    liverpool_iommu_walk_table(as, dte[0], 0, liverpool_iommu_get_perms(dte[0]),
+                               start, end, fn, opaque);
+}
+
+static void liverpool_iommu_notify_map(AMDVIAddressSpace *as,
+                                       IOMMUTLBEntry *entry, void *opaque)
+{
+    memory_region_notify_iommu(&as->iommu, *entry);
+}
+
+/* Notifies that [iova, iova + mask] of @as changed: an UNMAP of the range,
+ * followed by MAPs of what it now translates to */
+static void liverpool_iommu_notify_as(AMDVIAddressSpace *as,
+                                      hwaddr iova, hwaddr mask)
+{
+    IOMMUTLBEntry entry = {
+        .target_as = &address_space_memory,
+        .iova = iova,
+        .translated_addr = 0,
+        .addr_mask = mask,
+        .perm = IOMMU_NONE
+    };
+
+    memory_region_notify_iommu(&as->iommu, entry);
+    if (as->notify_flags & IOMMU_NOTIFIER_MAP) {
+        liverpool_iommu_walk(as, iova, iova + mask,
+                             liverpool_iommu_notify_map, NULL);
+    }
+}
+
+/* Notifies the address spaces of the devices and domains invalidated since
+ * the last IOTLB sweep */
+static void liverpool_iommu_notify_pending(LiverpoolIOMMUState *s)
+{
+    AMDVIAddressSpace *as;
+    uint64_t dte[4];
+    uint16_t devid;
+
+    QLIST_FOREACH(as, &s->notifiers, next) {
+        devid = PCI_BUILD_BDF(as->bus_num, as->devfn);
+        if (test_bit(devid, s->inval_devids) ||
+            (liverpool_iommu_peek_dte(s, devid, dte) &&
+             test_bit(dte[1] & AMDVI_DEV_DOMID_ID_MASK, s->inval_domids))) {
+            liverpool_iommu_notify_as(as, 0, AMDVI_NOTIFY_VA_MASK);
+        }
+    }
+}
+
+static void liverpool_iommu_notify_all(LiverpoolIOMMUState *s)
+{
+    AMDVIAddressSpace *as;
+
+    QLIST_FOREACH(as, &s->notifiers, next) {
+        liverpool_iommu_notify_as(as, 0, AMDVI_NOTIFY_VA_MASK);
+    }
+}
+
+static void liverpool_iommu_replay_map(AMDVIAddressSpace *as,
+                                       IOMMUTLBEntry *entry, void *opaque)
+{
+    memory_region_notify_one(opaque, entry);
+}
+
+static void liverpool_iommu_replay(IOMMUMemoryRegion *iommu,
+                                   IOMMUNotifier *n)
+{
+    AMDVIAddressSpace *as = container_of(iommu, AMDVIAddressSpace, iommu);
+
+    liverpool_iommu_walk(as, n->start, n->end, liverpool_iommu_replay_map, n);
+}
+
 static inline bool liverpool_iommu_is_interrupt_addr(hwaddr addr)
 {
     return addr >= AMDVI_INT_ADDR_FIRST && addr <= AMDVI_INT_ADDR_LAST;
@@ -1110,6 +1434,44 @@ static IOMMUTLBEntry liverpool_iommu_translate(IOMMUMemoryRegion *iommu, hwaddr
     return ret;
 }
 
+/* Translates @addr for the memory inspector. Unlike liverpool_iommu_translate,
+ * this neither fills the IOTLB nor logs faults, since it runs on the UI
+ * thread and must not be visible to the guest. */
+static bool liverpool_iommu_inspect(void *opaque, int devid,
+    uint64_t addr, void *buf, size_t len)
+{
+    LiverpoolIOMMUState *s = opaque;
+    IOMMUTLBEntry entry;
+    uint64_t dte[4];
+    hwaddr paddr = addr, pte_addr;
+
+    if (devid < 0 || devid > UINT16_MAX) {
+        return false;
+    }
+    if (!atomic_read(&s->enabled)) {
+        goto read;
+    }
+    if (!orbital_memory_read_ram(&address_space_memory,
+        s->devtab + devid * AMDVI_DEVTAB_ENTRY_SIZE,
+        dte, sizeof(dte))) {
+        return false;
+    }
+    dte[0] = le64_to_cpu(dte[0]);
+    if (!(dte[0] & AMDVI_DEV_VALID) ||
+        !(dte[0] & AMDVI_DEV_TRANSLATION_VALID)) {
+        goto read;
+    }
+    if (liverpool_iommu_lookup(dte[0], addr, 0, true,
+                               &entry, &pte_addr) != LVP_IOMMU_WALK_OK ||
+        entry.perm == IOMMU_NONE) {
+        return false;
+    }
+    paddr = entry.translated_addr | (addr & entry.addr_mask);
+
+read:
+    return orbital_memory_read_ram(&address_space_memory, paddr, buf, len);
+}
+
 AddressSpace *liverpool_iommu_host_dma_iommu(PCIBus *bus, void *opaque, int devfn)
 {
     LiverpoolIOMMUState *s = opaque;
@@ -1163,18 +1525,26 @@ static void liverpool_iommu_notify_flag_changed(IOMMUMemoryRegion *iommu,
                                             IOMMUNotifierFlag new)
 {
     AMDVIAddressSpace *as = container_of(iommu, AMDVIAddressSpace, iommu);
+    LiverpoolIOMMUState *s = as->iommu_state;
 
-    if (new & IOMMU_NOTIFIER_MAP) {
-        error_report("device %02x.%02x.%x requires iommu notifier which is not "
-                     "currently supported", as->bus_num, PCI_SLOT(as->devfn),
-                     PCI_FUNC(as->devfn));
-        exit(1);
+    as->notify_flags = new;
+    if (old == IOMMU_NOTIFIER_NONE) {
+        QLIST_INSERT_HEAD(&s->notifiers, as, next);
+    } else if (new == IOMMU_NOTIFIER_NONE) {
+        QLIST_REMOVE(as, next);
     }
 }
 
 static void liverpool_iommu_init(LiverpoolIOMMUState *s)
 {
+    /* Neither the command buffer mapping nor invalidations queued before
+     * the reset may outlive it */
+    qemu_bh_cancel(s->cmdbuf_bh);
+    liverpool_iommu_cmdbuf_unmap(s);
     liverpool_iommu_iotlb_reset(s);
+    bitmap_zero(s->inval_domids, 1 << 16);
+    bitmap_zero(s->inval_devids, 1 << 16);
+    s->inval_pending = false;
 
     s->devtab_len = 0;
     s->cmdbuf_len = 0;
@@ -1209,6 +1579,14 @@ static void liverpool_iommu_init(LiverpoolIOMMUState *s)
 }
 
 /* SysBus device functions */
+static void liverpool_iommu_reset(DeviceState *dev)
+{
+    LiverpoolIOMMUState *s = LIVERPOOL_IOMMU(dev);
+
+    msi_reset(s->pci);
+    liverpool_iommu_init(s);
+}
+
 static void liverpool_iommu_realize(DeviceState *dev, Error **err)
 {
     int ret = 0;
@@ -1227,6 +1605,10 @@ static void liverpool_iommu_realize(DeviceState *dev, Error **err)
     bus = pcms->bus;
     s->iotlb = g_hash_table_new_full(liverpool_iommu_uint64_hash,
                                      liverpool_iommu_uint64_equal, g_free, g_free);
+    s->inval_domids = bitmap_new(1 << 16);
+    s->inval_devids = bitmap_new(1 << 16);
+    s->cmdbuf_bh = qemu_bh_new(liverpool_iommu_cmdbuf_run, s);
+    QLIST_INIT(&s->notifiers);
     /* This device should take care of IOMMU PCI properties */
     x86_iommu->type = TYPE_AMD_LIVERPOOL;
     ret = pci_add_capability(s->pci, AMDVI_CAPAB_ID_SEC, 0,
@@ -1255,6 +1637,7 @@ static void liverpool_iommu_realize(DeviceState *dev, Error **err)
     pci_setup_iommu(bus, liverpool_iommu_host_dma_iommu, s);
     msi_init(s->pci, 0, 1, true, false, err);
     liverpool_iommu_init(s);
+    orbital_memory_register(ORBITAL_MEMORY_IOMMU, liverpool_iommu_inspect, s);
 }
 
 static void liverpool_iommu_class_init(ObjectClass *oc, void *data)
@@ -1262,6 +1645,7 @@ static void liverpool_iommu_class_init(ObjectClass *oc, void *data)
     DeviceClass *dc = DEVICE_CLASS(oc);
     X86IOMMUClass *ic = X86_IOMMU_CLASS(oc);
 
+    dc->reset = liverpool_iommu_reset;
     dc->hotpluggable = false;
     ic->realize = liverpool_iommu_realize;
 }
@@ -1314,6 +1698,7 @@ static void liverpool_iommu_memory_region_class_init(ObjectClass *oc, void *data
 
     imrc->translate = liverpool_iommu_translate;
     imrc->notify_flag_changed = liverpool_iommu_notify_flag_changed;
+    imrc->replay = liverpool_iommu_replay;
 }
 
 static const TypeInfo liverpool_iommu_memory_region_info = {
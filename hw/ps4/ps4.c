@@ -47,8 +47,11 @@
 #include "hw/loader.h"
 #include "hw/timer/hpet.h"
 #include "hw/timer/mc146818rtc.h"
+#include "net/net.h"
+#include "sysemu/blockdev.h"
 #include "sysemu/cpus.h"
 #include "sysemu/numa.h"
+#include "sysemu/reset.h"
 
 #include "kvm_i386.h"
 #include "sysemu/kvm.h"
@@ -93,37 +96,54 @@ typedef struct PS4MachineState {
     PCIDevice *aeolia_dmac;
     PCIDevice *aeolia_mem;
     PCIDevice *aeolia_xhci;
+
+    /* the mapped kernel, see load_bootloader() */
+    int kernel_fd;
+    struct stat kernel_stat;
 } PS4MachineState;
 
 static void ps4_aeolia_init(PS4MachineState* s)
 {
     PCIBus *bus;
+    DriveInfo *dinfo;
 
     bus = s->pci_bus;
     s->aeolia_acpi = pci_create_simple_multifunction(
         bus, PCI_DEVFN(0x14, 0x00), true, TYPE_AEOLIA_ACPI);
-    s->aeolia_gbe = pci_create_simple_multifunction(
+    s->aeolia_gbe = pci_create_multifunction(
         bus, PCI_DEVFN(0x14, 0x01), true, TYPE_AEOLIA_GBE);
+    if (nd_table[0].used) {
+        qemu_check_nic_model(&nd_table[0], TYPE_AEOLIA_GBE);
+        qdev_set_nic_properties(DEVICE(s->aeolia_gbe), &nd_table[0]);
+    }
+    qdev_init_nofail(DEVICE(s->aeolia_gbe));
     s->aeolia_ahci = pci_create_simple_multifunction(
         bus, PCI_DEVFN(0x14, 0x02), true, TYPE_AEOLIA_AHCI);
     s->aeolia_sdhci = pci_create_simple_multifunction(
         bus, PCI_DEVFN(0x14, 0x03), true, TYPE_AEOLIA_SDHCI);
-    s->aeolia_pcie = pci_create_simple_multifunction(
+    s->aeolia_pcie = pci_create_multifunction(
         bus, PCI_DEVFN(0x14, 0x04), true, TYPE_AEOLIA_PCIE);
+    dinfo = drive_get(IF_MTD, 0, 0);
+    if (dinfo) {
+        qdev_prop_set_drive(DEVICE(s->aeolia_pcie), "nvram",
+            blk_by_legacy_dinfo(dinfo), &error_fatal);
+    }
+    qdev_init_nofail(DEVICE(s->aeolia_pcie));
     s->aeolia_dmac = pci_create_simple_multifunction(
         bus, PCI_DEVFN(0x14, 0x05), true, TYPE_AEOLIA_DMAC);
     s->aeolia_mem = pci_create_simple_multifunction(
         bus, PCI_DEVFN(0x14, 0x06), true, TYPE_AEOLIA_MEM);
-    /*s->aeolia_xhci = pci_create_simple_multifunction(
-        bus, PCI_DEVFN(0x14, 0x07), true, TYPE_AEOLIA_XHCI);*/
+    s->aeolia_xhci = pci_create_simple_multifunction(
+        bus, PCI_DEVFN(0x14, 0x07), true, TYPE_AEOLIA_XHCI);
 
-    char* icc_data = aeolia_mem_get_icc_data(s->aeolia_mem);
-    aeolia_pcie_set_icc_data(s->aeolia_pcie, icc_data);
+    aeolia_pcie_set_icc_region(s->aeolia_pcie,
+        aeolia_mem_get_icc_region(s->aeolia_mem));
 }
 
 static void ps4_liverpool_init(PS4MachineState* s)
 {
     PCIBus *bus;
+    BusState *hdabus;
 
     bus = s->pci_bus;
     /*
@@ -137,6 +157,8 @@ static void ps4_liverpool_init(PS4MachineState* s)
         bus, PCI_DEVFN(0x01, 0x00), true, TYPE_LIVERPOOL_GC);
     s->liverpool_hdac = pci_create_simple_multifunction(
         bus, PCI_DEVFN(0x01, 0x01), true, TYPE_LIVERPOOL_HDAC);
+    hdabus = QLIST_FIRST(&DEVICE(s->liverpool_hdac)->child_bus);
+    qdev_init_nofail(qdev_create(hdabus, "hda-output"));
     s->liverpool_rootp = pci_create_simple_multifunction(
         bus, PCI_DEVFN(0x02, 0x00), true, TYPE_LIVERPOOL_ROOTP);
 
@@ -286,44 +308,61 @@ static FWCfgState *bochs_bios_init(AddressSpace *as, PCMachineState *pcms)
     return fw_cfg;
 }
 
-static long get_file_size(FILE *f)
+/* Runs before the roms are written back on reset */
+static void ps4_kernel_check(void *opaque)
 {
-    long where, size;
-
-    /* XXX: on Unix systems, using fstat() probably makes more sense */
-
-    where = ftell(f);
-    fseek(f, 0, SEEK_END);
-    size = ftell(f);
-    fseek(f, where, SEEK_SET);
-
-    return size;
+    PS4MachineState *s = opaque;
+    struct stat st;
+
+    if (fstat(s->kernel_fd, &st) < 0 ||
+        st.st_size != s->kernel_stat.st_size ||
+        st.st_mtime != s->kernel_stat.st_mtime) {
+        error_report("kernel '%s' was modified while in use, cannot reset",
+                     MACHINE(s)->kernel_filename);
+        exit(1);
+    }
 }
 
 static void load_bootloader(
     PS4MachineState *s, FWCfgState *fw_cfg)
 {
-    int kernel_size, ret;
-    uint8_t header[8192];
-    FILE *f;
     MachineState *machine = MACHINE(s);
     const char *kernel_filename = machine->kernel_filename;
-    const char *initrd_filename = machine->initrd_filename;
-    const char *kernel_cmdline = machine->kernel_cmdline;
-
-    /* load the kernel header */
-    f = fopen(kernel_filename, "rb");
-    if (!f || !(kernel_size = get_file_size(f)) ||
-        fread(header, 1, MIN(ARRAY_SIZE(header), kernel_size), f) !=
-        MIN(ARRAY_SIZE(header), kernel_size)) {
-        fprintf(stderr, "qemu: could not load kernel '%s': %s\n",
-                kernel_filename, strerror(errno));
+    GMappedFile *kernel;
+    GError *gerr = NULL;
+    int ret;
+
+    /* The kernel is mapped rather than read: its segments reference the
+     * mapping and are copied into guest RAM on every reset.  The mapping
+     * is private but never written, so it keeps following the file: the
+     * kernel must not be rewritten or truncated in place while the machine
+     * exists, while replacing it with a new file is fine.  A truncated
+     * file would fault with SIGBUS, so keep the file open and check its
+     * size and mtime on reset instead.
+     */
+    s->kernel_fd = qemu_open(kernel_filename, O_RDONLY);
+    if (s->kernel_fd < 0 || fstat(s->kernel_fd, &s->kernel_stat) < 0) {
+        error_report("could not load kernel '%s': %s",
+                     kernel_filename, strerror(errno));
         exit(1);
     }
+    qemu_register_reset(ps4_kernel_check, s);
 
-    ret = load_multiboot(fw_cfg, f, kernel_filename, initrd_filename,
-        kernel_cmdline, kernel_size, header);
-    assert(ret);
+    kernel = g_mapped_file_new(kernel_filename, FALSE, &gerr);
+    if (!kernel) {
+        error_report("could not load kernel '%s': %s",
+                     kernel_filename, gerr->message);
+        g_error_free(gerr);
+        exit(1);
+    }
+
+    ret = load_multiboot_mapped(fw_cfg, kernel, kernel_filename,
+        machine->initrd_filename, machine->kernel_cmdline);
+    g_mapped_file_unref(kernel);
+    if (!ret) {
+        error_report("kernel '%s' is not a multiboot image", kernel_filename);
+        exit(1);
+    }
 }
 
 static void ps4_memory_init(PS4MachineState *s,
@@ -596,6 +635,12 @@ static void ps4_init(MachineState *machine)
     }
     g_free(i8259);
 
+    /* The kernel irqchip always comes with an IOAPIC, wire it up so that
+     * its state is migrated and PCI INTx lines beyond the PIC are routed */
+    if (kvm_ioapic_in_kernel()) {
+        ioapic_init_gsi(gsi_state, "q35");
+    }
+
     pc_register_ferr_irq(pcms->gsi[13]);
 
     assert(pcms->vmport != ON_OFF_AUTO__MAX);
@@ -611,6 +656,7 @@ static void ps4_init(MachineState *machine)
 
     DeviceState *dev;
     dev = qdev_create(NULL, TYPE_AEOLIA_UART);
+    qdev_prop_set_chr(dev, "chardev", serial_hds[0]);
     qdev_init_nofail(dev);
     sysbus_mmio_map_overlap(SYS_BUS_DEVICE(dev), 0, BASE_AEOLIA_UART_0, -1000);
 
@@ -0,0 +1,71 @@
+/*
+ * PlayStation 4 timebase.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ps4_timebase.h"
+
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
+
+/* Every clock runs slower than 1 GHz, so ticks = (ns * mult) >> 63 keeps
+ * the whole ratio in a 64-bit multiplier. It is rounded up, so that whole
+ * periods convert back to exact tick counts. */
+#define TIMEBASE_SHIFT  63
+
+typedef struct ps4_clock_info_t {
+    uint32_t freq;
+    uint64_t mult;
+} ps4_clock_info_t;
+
+static ps4_clock_info_t clocks[PS4_CLOCK_COUNT] = {
+    [PS4_CLOCK_HPET] = { .freq = 10000000 },
+    [PS4_CLOCK_EMC]  = { .freq = 32768 },
+    [PS4_CLOCK_GPU]  = { .freq = 100000000 },
+    [PS4_CLOCK_IH]   = { .freq = 100000000 },
+};
+
+static void __attribute__((constructor)) ps4_timebase_init(void)
+{
+    int i;
+
+    for (i = 0; i < PS4_CLOCK_COUNT; i++) {
+        clocks[i].mult = muldiv64(1ULL << TIMEBASE_SHIFT,
+            clocks[i].freq, NANOSECONDS_PER_SECOND) + 1;
+    }
+}
+
+int64_t ps4_timebase_ns(void)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+}
+
+uint64_t ps4_timebase_ns_to_ticks(ps4_clock_t clock, int64_t ns)
+{
+    uint64_t lo, hi;
+
+    if (ns <= 0) {
+        return 0;
+    }
+    mulu64(&lo, &hi, ns, clocks[clock].mult);
+    return (hi << (64 - TIMEBASE_SHIFT)) | (lo >> TIMEBASE_SHIFT);
+}
+
+int64_t ps4_timebase_ticks_to_ns(ps4_clock_t clock, uint64_t ticks)
+{
+    return muldiv64(ticks, NANOSECONDS_PER_SECOND, clocks[clock].freq);
+}
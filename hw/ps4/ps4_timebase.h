@@ -0,0 +1,47 @@
+/*
+ * PlayStation 4 timebase.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_PS4_TIMEBASE_H
+#define HW_PS4_TIMEBASE_H
+
+#include "qemu/osdep.h"
+
+/* Guest-visible counters, all derived from QEMU_CLOCK_VIRTUAL */
+typedef enum ps4_clock_t {
+    PS4_CLOCK_HPET,     /* Aeolia HPET, 10 MHz */
+    PS4_CLOCK_EMC,      /* Aeolia EMC timers, 32.768 kHz */
+    PS4_CLOCK_GPU,      /* Liverpool RLC GPU clock counter, 100 MHz */
+    PS4_CLOCK_IH,       /* Liverpool IH timestamps, same as the GPU clock */
+    PS4_CLOCK_COUNT,
+} ps4_clock_t;
+
+/*
+ * Conversions from nanoseconds use a multiplier calibrated once per clock,
+ * so sampling a counter costs a clock read and a 64x64 multiplication.
+ */
+int64_t ps4_timebase_ns(void);
+uint64_t ps4_timebase_ns_to_ticks(ps4_clock_t clock, int64_t ns);
+int64_t ps4_timebase_ticks_to_ns(ps4_clock_t clock, uint64_t ticks);
+
+static inline uint64_t ps4_timebase_ticks(ps4_clock_t clock)
+{
+    return ps4_timebase_ns_to_ticks(clock, ps4_timebase_ns());
+}
+
+#endif /* HW_PS4_TIMEBASE_H */
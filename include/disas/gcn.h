@@ -0,0 +1,84 @@
+/*
+ * AMD GCN (Sea Islands) instruction decoder.
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DISAS_GCN_H
+#define DISAS_GCN_H
+
+typedef enum GCNEncoding {
+    GCN_ENC_UNKNOWN,
+    GCN_ENC_SOP2,
+    GCN_ENC_SOPK,
+    GCN_ENC_SOP1,
+    GCN_ENC_SOPC,
+    GCN_ENC_SOPP,
+    GCN_ENC_SMRD,
+    GCN_ENC_VOP2,
+    GCN_ENC_VOP1,
+    GCN_ENC_VOPC,
+    GCN_ENC_VOP3,
+    GCN_ENC_VINTRP,
+    GCN_ENC_DS,
+    GCN_ENC_MUBUF,
+    GCN_ENC_MTBUF,
+    GCN_ENC_MIMG,
+    GCN_ENC_EXP,
+    GCN_ENC_FLAT,
+} GCNEncoding;
+
+/* Decoded instruction. Operands are kept in the raw words and only
+ * extracted when formatting, so decoding a shader is cheap. */
+typedef struct GCNInstruction {
+    GCNEncoding encoding;
+    uint16_t opcode;
+    uint8_t length;         /* in dwords, including the literal */
+    bool has_literal;
+    uint32_t word[2];
+    uint32_t literal;
+} GCNInstruction;
+
+/* Longest instruction: 64-bit encoding, or 32-bit encoding plus literal */
+#define GCN_INSN_MAX_DWORDS  2
+
+/**
+ * gcn_decode:
+ * @insn: decoded instruction
+ * @words: instruction stream
+ * @avail: number of dwords available in @words
+ *
+ * Returns the length of the instruction in dwords, or 0 if @avail
+ * does not cover the whole instruction.
+ */
+unsigned gcn_decode(GCNInstruction *insn, const uint32_t *words,
+                    unsigned avail);
+
+/**
+ * gcn_format:
+ * @insn: instruction previously decoded with gcn_decode
+ * @pc: byte address of the instruction, used for branch targets
+ * @buf: output buffer
+ * @size: size of @buf
+ *
+ * Formats @insn in the syntax used by the AMD ISA manuals.
+ */
+void gcn_format(const GCNInstruction *insn, uint64_t pc,
+                char *buf, size_t size);
+
+bool gcn_is_endpgm(const GCNInstruction *insn);
+
+#endif /* DISAS_GCN_H */
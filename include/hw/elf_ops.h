@@ -471,8 +471,8 @@ static int glue(load_elf, SZ)(const char *name, int fd,
                     snprintf(label, sizeof(label), "phdr #%d: %s", i, name);
 
                     /* rom_add_elf_program() seize the ownership of 'data' */
-                    rom_add_elf_program(label, data, file_size, mem_size,
-                                        addr, as);
+                    rom_add_elf_program(label, NULL, data, file_size,
+                                        mem_size, addr, as);
                 } else {
                     cpu_physical_memory_write(addr, data, file_size);
                     g_free(data);
@@ -49,6 +49,7 @@ typedef struct SDHCIState {
     QEMUTimer *insert_timer;       /* timer for 'changing' sd card. */
     QEMUTimer *transfer_timer;
     qemu_irq irq;
+    uint32_t adma_descs_per_delay; /* ADMA descriptors walked per timer tick */
 
     /* Registers cleared on reset */
     uint32_t sdmasysad;    /* SDMA System Address register */
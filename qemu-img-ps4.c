@@ -25,8 +25,19 @@
 #include "qemu/osdep.h"
 #include "qemu-img-ps4.h"
 
+#include "qemu/bswap.h"
 #include "qemu/crc32c.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
 #include "block/block.h"
+#include "block/thread-pool.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qjson.h"
+#include "qapi/qmp/qlist.h"
+#include "qapi/qmp/qnum.h"
+#include "qapi/qmp/qstring.h"
 #include "sysemu/block-backend.h"
 
 /* crc32 */
@@ -34,6 +45,8 @@
 
 // Configuration
 #define LBA_SIZE 512
+#define GPT_PARTS_MAX 32
+#define COPY_CHUNK_SIZE (2 * 1024 * 1024)
 
 // Constants
 #define GPT_TYPE_GUID_SCE_PREINST      "\x17\x0F\x80\x17\xE1\xB9\x5D\x42\xB9\x37\x01\x19\xA0\x81\x31\x72"
@@ -65,6 +78,221 @@
 #define countof(x) \
     (sizeof(x) / sizeof((x)[0]))
 
+/* Layout */
+typedef struct hdd_part_desc_t {
+    int slot;               /* index in the GPT partition array */
+    const char *type_guid;
+    uint64_t size;
+    uint64_t flags;
+    const char *image;      /* file in the data directory copied into it */
+    bool relative;          /* partition takes the disk size minus @size */
+} hdd_part_desc_t;
+
+struct PS4HDDLayout {
+    QObject *json;          /* owns the image names, if parsed */
+    int count;
+    hdd_part_desc_t parts[GPT_PARTS_MAX];
+};
+
+static const struct {
+    const char *name;
+    const char *type_guid;
+} hdd_part_types[] = {
+    { "preinst",     GPT_TYPE_GUID_SCE_PREINST },
+    { "preinst2",    GPT_TYPE_GUID_SCE_PREINST2 },
+    { "da0x2",       GPT_TYPE_GUID_SCE_DA0X2 },
+    { "eap-vsh",     GPT_TYPE_GUID_SCE_EAP_VSH },
+    { "system",      GPT_TYPE_GUID_SCE_SYSTEM },
+    { "system-ex",   GPT_TYPE_GUID_SCE_SYSTEM_EX },
+    { "swap",        GPT_TYPE_GUID_SCE_SWAP },
+    { "app-tmp",     GPT_TYPE_GUID_SCE_APP_TMP },
+    { "system-data", GPT_TYPE_GUID_SCE_SYSTEM_DATA },
+    { "update",      GPT_TYPE_GUID_SCE_UPDATE },
+    { "user",        GPT_TYPE_GUID_SCE_USER },
+    { "eap-user",    GPT_TYPE_GUID_SCE_EAP_USER },
+    { "da0x15",      GPT_TYPE_GUID_SCE_DA0X15 },
+};
+
+/* Retail layout, partitions are allocated in this order */
+static const hdd_part_desc_t hdd_layout_default[] = {
+    { 0x9, GPT_TYPE_GUID_SCE_APP_TMP,     1 GB },
+    { 0xE, GPT_TYPE_GUID_SCE_DA0X15,      6 GB },
+    { 0xC, GPT_TYPE_GUID_SCE_USER,       36 GB, .relative = true },
+    { 0x8, GPT_TYPE_GUID_SCE_SWAP,        8 GB },
+    { 0x4, GPT_TYPE_GUID_SCE_SYSTEM,      1 GB, 0x80000000000000, "system.img" },
+    { 0x5, GPT_TYPE_GUID_SCE_SYSTEM,      1 GB, 0, "system.img" },
+    { 0x6, GPT_TYPE_GUID_SCE_SYSTEM_EX,   1 GB, 0x80000000000000, "system_ex.img" },
+    { 0x7, GPT_TYPE_GUID_SCE_SYSTEM_EX,   1 GB, 0, "system_ex.img" },
+    { 0xA, GPT_TYPE_GUID_SCE_SYSTEM_DATA, 8 GB },
+    { 0x0, GPT_TYPE_GUID_SCE_PREINST,   512 MB },
+    { 0x1, GPT_TYPE_GUID_SCE_PREINST2,    1 GB },
+    { 0x2, GPT_TYPE_GUID_SCE_DA0X2,      16 MB },
+    { 0x3, GPT_TYPE_GUID_SCE_EAP_VSH,   128 MB },
+    { 0xD, GPT_TYPE_GUID_SCE_EAP_USER,    1 GB },
+    { 0xB, GPT_TYPE_GUID_SCE_UPDATE,      6 GB },
+};
+
+static bool hdd_layout_parse_size(hdd_part_desc_t *desc, QObject *obj,
+    Error **errp)
+{
+    QNum *qnum = qobject_to(QNum, obj);
+    QString *qstr = qobject_to(QString, obj);
+    const char *str;
+    int64_t value;
+
+    if (qnum) {
+        if (!qnum_get_try_int(qnum, &value) || value <= 0) {
+            error_setg(errp, "Invalid partition size");
+            return false;
+        }
+        desc->size = value;
+    } else if (qstr) {
+        /* A leading '-' makes the size relative to the disk size */
+        str = qstring_get_str(qstr);
+        desc->relative = (*str == '-');
+        if (qemu_strtosz(str + desc->relative, NULL, &desc->size) < 0 ||
+            !desc->size) {
+            error_setg(errp, "Invalid partition size '%s'", str);
+            return false;
+        }
+    } else {
+        error_setg(errp, "Partition size must be a number or a string");
+        return false;
+    }
+    if (desc->size % LBA_SIZE) {
+        error_setg(errp, "Partition size must be a multiple of %d bytes",
+            LBA_SIZE);
+        return false;
+    }
+    return true;
+}
+
+static bool hdd_layout_parse_part(hdd_part_desc_t *desc, QDict *dict,
+    Error **errp)
+{
+    const char *type;
+    int64_t value;
+    int i;
+
+    value = qdict_get_try_int(dict, "slot", -1);
+    if (value < 0 || value >= GPT_PARTS_MAX) {
+        error_setg(errp, "Partition slot must be between 0 and %d",
+            GPT_PARTS_MAX - 1);
+        return false;
+    }
+    desc->slot = value;
+
+    type = qdict_get_try_str(dict, "type");
+    for (i = 0; type && i < countof(hdd_part_types); i++) {
+        if (!strcmp(type, hdd_part_types[i].name)) {
+            desc->type_guid = hdd_part_types[i].type_guid;
+            break;
+        }
+    }
+    if (!desc->type_guid) {
+        error_setg(errp, "Unknown partition type '%s'", type ? type : "");
+        return false;
+    }
+    if (!qdict_haskey(dict, "size")) {
+        error_setg(errp, "Partition %d has no size", desc->slot);
+        return false;
+    }
+    if (!hdd_layout_parse_size(desc, qdict_get(dict, "size"), errp)) {
+        return false;
+    }
+    desc->flags = qdict_get_try_int(dict, "flags", 0);
+    desc->image = qdict_get_try_str(dict, "image");
+    return true;
+}
+
+PS4HDDLayout *ps4_hdd_layout_load(const char *path, Error **errp)
+{
+    PS4HDDLayout *layout;
+    const QListEntry *entry;
+    QDict *dict, *part;
+    QList *parts;
+    uint32_t used = 0;
+    gchar *contents;
+    GError *gerr = NULL;
+    int i;
+
+    layout = g_new0(PS4HDDLayout, 1);
+    if (!path) {
+        layout->count = countof(hdd_layout_default);
+        memcpy(layout->parts, hdd_layout_default, sizeof(hdd_layout_default));
+        return layout;
+    }
+
+    if (!g_file_get_contents(path, &contents, NULL, &gerr)) {
+        error_setg(errp, "Could not read layout '%s': %s", path,
+            gerr->message);
+        g_error_free(gerr);
+        goto fail;
+    }
+    layout->json = qobject_from_json(contents, errp);
+    g_free(contents);
+    if (!layout->json) {
+        goto fail;
+    }
+    dict = qobject_to(QDict, layout->json);
+    parts = dict ? qobject_to(QList, qdict_get(dict, "partitions")) : NULL;
+    if (!parts) {
+        error_setg(errp, "Layout '%s' has no 'partitions' array", path);
+        goto fail;
+    }
+    for (entry = qlist_first(parts); entry; entry = qlist_next(entry)) {
+        part = qobject_to(QDict, qlist_entry_obj(entry));
+        if (!part || layout->count == GPT_PARTS_MAX) {
+            error_setg(errp, "Layout '%s' has an invalid partition", path);
+            goto fail;
+        }
+        if (!hdd_layout_parse_part(&layout->parts[layout->count], part,
+                                   errp)) {
+            error_prepend(errp, "Layout '%s': ", path);
+            goto fail;
+        }
+        layout->count++;
+    }
+    for (i = 0; i < layout->count; i++) {
+        if (used & (1U << layout->parts[i].slot)) {
+            error_setg(errp, "Layout '%s' uses slot %d twice", path,
+                layout->parts[i].slot);
+            goto fail;
+        }
+        used |= 1U << layout->parts[i].slot;
+    }
+    return layout;
+
+fail:
+    ps4_hdd_layout_free(layout);
+    return NULL;
+}
+
+void ps4_hdd_layout_free(PS4HDDLayout *layout)
+{
+    if (layout) {
+        qobject_decref(layout->json);
+        g_free(layout);
+    }
+}
+
+static int generate_hdd_write(BlockBackend *blk, int64_t offset,
+    const void *buf, int count, bool backing)
+{
+    uint8_t old[LBA_SIZE];
+    int ret;
+
+    /* Overlays only get the sectors that differ from their base */
+    if (backing && count <= sizeof(old)) {
+        ret = blk_pread(blk, offset, old, count);
+        if (ret >= 0 && !memcmp(old, buf, count)) {
+            return 0;
+        }
+    }
+    ret = blk_pwrite(blk, offset, buf, count, 0);
+    return ret < 0 ? ret : 0;
+}
+
 /* MBR */
 typedef struct mbr_chs_t {
 	uint8_t head;
@@ -81,7 +309,7 @@ typedef struct mbr_partition_t {
 	uint32_t sec_count;
 } QEMU_PACKED mbr_partition_t;
 
-static void generate_hdd_mbr(BlockBackend* blk, uint64_t size)
+static int generate_hdd_mbr(BlockBackend* blk, uint64_t size, bool backing)
 {
     mbr_partition_t part;
     uint32_t last_lba;
@@ -99,10 +327,11 @@ static void generate_hdd_mbr(BlockBackend* blk, uint64_t size)
     part.sec_first = 1;
     part.sec_count = last_lba;
 
-    ret = blk_pwrite(blk, 0x1BE, &part, sizeof(part), 0);
-    assert(ret >= 0);
-    ret = blk_pwrite(blk, 0x1FE, "\x55\xAA", 2, 0);
-    assert(ret >= 0);
+    ret = generate_hdd_write(blk, 0x1BE, &part, sizeof(part), backing);
+    if (ret < 0) {
+        return ret;
+    }
+    return generate_hdd_write(blk, 0x1FE, "\x55\xAA", 2, backing);
 }
 
 /* GPT */
@@ -148,7 +377,6 @@ static void generate_hdd_gpt_partition(gpt_header_t *gpt,
     }
     last_lba = first_lba + ((size / LBA_SIZE) - 1);
     gpt->last_lba = last_lba;
-    gpt->parts_count += 1;
 
     /* write partition data */
     memset(part, 0, sizeof(gpt_partition_t));
@@ -162,44 +390,78 @@ static void generate_hdd_gpt_partition(gpt_header_t *gpt,
     }
 }
 
-static void generate_hdd_gpt_partitions(
-    gpt_header_t *gpt, gpt_partition_t *parts, uint64_t size)
+static int generate_hdd_gpt_partitions(gpt_header_t *gpt,
+    gpt_partition_t *parts, const PS4HDDLayout *layout, uint64_t size,
+    uint32_t last_usable_lba)
 {
-    generate_hdd_gpt_partition(gpt, &parts[0x9], GPT_TYPE_GUID_SCE_APP_TMP,
-        GPT_PART_GUID_SCE("\x01\x00\x00\x00"), 1 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0xE], GPT_TYPE_GUID_SCE_DA0X15,
-        GPT_PART_GUID_SCE("\x02\x00\x00\x00"), 6 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0xC], GPT_TYPE_GUID_SCE_USER,
-        GPT_PART_GUID_SCE("\x03\x00\x00\x00"), size - 36 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x8], GPT_TYPE_GUID_SCE_SWAP,
-        GPT_PART_GUID_SCE("\x04\x00\x00\x00"), 8 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x4], GPT_TYPE_GUID_SCE_SYSTEM,
-        GPT_PART_GUID_SCE("\x05\x00\x00\x00"), 1 GB, 0x80000000000000, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x5], GPT_TYPE_GUID_SCE_SYSTEM,
-        GPT_PART_GUID_SCE("\x06\x00\x00\x00"), 1 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x6], GPT_TYPE_GUID_SCE_SYSTEM_EX,
-        GPT_PART_GUID_SCE("\x07\x00\x00\x00"), 1 GB, 0x80000000000000, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x7], GPT_TYPE_GUID_SCE_SYSTEM_EX,
-        GPT_PART_GUID_SCE("\x08\x00\x00\x00"), 1 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0xA], GPT_TYPE_GUID_SCE_SYSTEM_DATA,
-        GPT_PART_GUID_SCE("\x09\x00\x00\x00"), 8 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x0], GPT_TYPE_GUID_SCE_PREINST,
-        GPT_PART_GUID_SCE("\x0A\x00\x00\x00"), 512 MB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x1], GPT_TYPE_GUID_SCE_PREINST2,
-        GPT_PART_GUID_SCE("\x0B\x00\x00\x00"), 1 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x2], GPT_TYPE_GUID_SCE_DA0X2,
-        GPT_PART_GUID_SCE("\x0C\x00\x00\x00"), 16 MB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0x3], GPT_TYPE_GUID_SCE_EAP_VSH,
-        GPT_PART_GUID_SCE("\x0D\x00\x00\x00"), 128 MB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0xD], GPT_TYPE_GUID_SCE_EAP_USER,
-        GPT_PART_GUID_SCE("\x0E\x00\x00\x00"), 1 GB, 0, NULL);
-    generate_hdd_gpt_partition(gpt, &parts[0xB], GPT_TYPE_GUID_SCE_UPDATE,
-        GPT_PART_GUID_SCE("\x0F\x00\x00\x00"), 6 GB, 0, NULL);
+    const hdd_part_desc_t *desc;
+    char part_guid[16];
+    uint64_t part_size;
+    int i;
+
+    for (i = 0; i < layout->count; i++) {
+        desc = &layout->parts[i];
+        part_size = desc->size;
+        if (desc->relative) {
+            if (size <= desc->size) {
+                error_report("Partition %d needs a disk larger than %"
+                    PRIu64 " bytes", desc->slot, desc->size);
+                return -ENOSPC;
+            }
+            part_size = size - desc->size;
+        }
+        memcpy(part_guid, GPT_PART_GUID_SCE("\x00\x00\x00\x00"), 16);
+        stl_le_p(part_guid, i + 1);
+        generate_hdd_gpt_partition(gpt, &parts[desc->slot], desc->type_guid,
+            part_guid, part_size, desc->flags, NULL);
+        if (gpt->last_lba > last_usable_lba) {
+            error_report("Partition %d does not fit in the disk", desc->slot);
+            return -ENOSPC;
+        }
+        gpt->parts_count = MAX(gpt->parts_count, desc->slot + 1);
+    }
+    return 0;
+}
+
+/*
+ * Partitions with contents are inherited from the backing image, which must
+ * place them exactly where this layout does.
+ */
+static int generate_hdd_gpt_check_backing(BlockBackend *blk,
+    gpt_partition_t *parts, const PS4HDDLayout *layout)
+{
+    const hdd_part_desc_t *desc;
+    gpt_partition_t *part;
+    gpt_partition_t base;
+    int i, ret;
+
+    for (i = 0; i < layout->count; i++) {
+        desc = &layout->parts[i];
+        if (!desc->image &&
+            memcmp(desc->type_guid, GPT_TYPE_GUID_SCE_SWAP, 16)) {
+            continue;
+        }
+        part = &parts[desc->slot];
+        ret = blk_pread(blk, lba_offset(2 + desc->slot), &base, sizeof(base));
+        if (ret < 0) {
+            error_report("Could not read the backing GPT: %s", strerror(-ret));
+            return ret;
+        }
+        if (memcmp(base.type_guid, part->type_guid, 16) ||
+            base.first_lba != part->first_lba ||
+            base.last_lba != part->last_lba) {
+            error_report("Partition %d does not match the backing image",
+                desc->slot);
+            return -EINVAL;
+        }
+    }
+    return 0;
 }
 
-static void generate_hdd_gpt(BlockBackend* blk, uint64_t size,
-    gpt_partition_t* gpt_partitions)
+static int generate_hdd_gpt(BlockBackend* blk, uint64_t size,
+    gpt_partition_t* gpt_partitions, const PS4HDDLayout *layout, bool backing)
 {
+    int ret;
     uint32_t i, crc;
     uint32_t last_lba, backup_lba;
     uint32_t parts_padding, parts_length;
@@ -226,7 +488,17 @@ static void generate_hdd_gpt(BlockBackend* blk, uint64_t size,
     gpt_primary.parts_count = 0;
     gpt_primary.parts_size = sizeof(gpt_partition_t);
     gpt_primary.parts_crc = 0;
-    generate_hdd_gpt_partitions(&gpt_primary, gpt_partitions, size);
+    ret = generate_hdd_gpt_partitions(&gpt_primary, gpt_partitions, layout,
+        size, last_lba);
+    if (ret < 0) {
+        return ret;
+    }
+    if (backing) {
+        ret = generate_hdd_gpt_check_backing(blk, gpt_partitions, layout);
+        if (ret < 0) {
+            return ret;
+        }
+    }
 
     crc = 0;
     parts_length = gpt_primary.parts_count;
@@ -251,75 +523,297 @@ static void generate_hdd_gpt(BlockBackend* blk, uint64_t size,
     gpt_secondary.crc = crc32(0, (uint8_t*)&gpt_secondary, sizeof(gpt_header_t));
 
     /* write to disk */
-    blk_pwrite(blk, lba_offset(gpt_primary.current_lba),
-        &gpt_primary, gpt_primary.size, 0);
-    blk_pwrite(blk, lba_offset(gpt_secondary.current_lba),
-        &gpt_secondary, gpt_secondary.size, 0);
+    ret = generate_hdd_write(blk, lba_offset(gpt_primary.current_lba),
+        &gpt_primary, gpt_primary.size, backing);
+    if (ret < 0) {
+        goto write_fail;
+    }
+    ret = generate_hdd_write(blk, lba_offset(gpt_secondary.current_lba),
+        &gpt_secondary, gpt_secondary.size, backing);
+    if (ret < 0) {
+        goto write_fail;
+    }
     for (i = 0; i < parts_length; i++) {
-        blk_pwrite(blk, lba_offset(gpt_primary.parts_lba + i),
-            &(gpt_partitions[i]), gpt_primary.parts_size, 0);
-        blk_pwrite(blk, lba_offset(gpt_secondary.parts_lba + i),
-            &(gpt_partitions[i]), gpt_secondary.parts_size, 0);
+        ret = generate_hdd_write(blk, lba_offset(gpt_primary.parts_lba + i),
+            &(gpt_partitions[i]), gpt_primary.parts_size, backing);
+        if (ret < 0) {
+            goto write_fail;
+        }
+        ret = generate_hdd_write(blk, lba_offset(gpt_secondary.parts_lba + i),
+            &(gpt_partitions[i]), gpt_secondary.parts_size, backing);
+        if (ret < 0) {
+            goto write_fail;
+        }
     }
+    return 0;
+
+write_fail:
+    error_report("Could not write the GPT: %s", strerror(-ret));
+    return ret;
 }
 
 /* SCE */
-static void generate_hdd_sce_da0x6(BlockBackend* blk, uint64_t size,
+typedef struct hdd_copy_state_t {
+    BlockBackend *blk;
+    ThreadPool *pool;
+    bool zero_init;
+    uint64_t bytes_total;
+    uint64_t bytes_done;
+    int running;
+    int ret;
+} hdd_copy_state_t;
+
+/* Partition image copied by its own coroutine */
+typedef struct hdd_copy_t {
+    hdd_copy_state_t *s;
+    char *path;
+    int fd;
+    uint64_t offset;    /* of the partition in the disk image */
+    uint64_t size;      /* of the partition image */
+} hdd_copy_t;
+
+typedef struct hdd_read_t {
+    int fd;
+    void *buf;
+    size_t len;
+    off_t offset;
+} hdd_read_t;
+
+static int generate_hdd_sce_da0x6(BlockBackend* blk, uint64_t size,
     gpt_partition_t* part)
 {
     const char magic[] = "SONY COMPUTER ENTERTAINMENT INC.";
-    blk_pwrite(blk, lba_offset(part->first_lba), magic, strlen(magic), 0);
+    int ret;
+
+    ret = blk_pwrite(blk, lba_offset(part->first_lba), magic, strlen(magic), 0);
+    if (ret < 0) {
+        error_report("Could not write the swap partition: %s", strerror(-ret));
+        return ret;
+    }
+    return 0;
 }
 
-static void generate_hdd_sce_partition_img(BlockBackend* blk, uint64_t size,
-    gpt_partition_t* part, const char* data_dir, const char* data_name)
+static int hdd_read_worker(void *opaque)
 {
-    char path[256];
-    char buffer[4096];
-    size_t offset;
-    size_t count;
-    FILE* file;
-
-    snprintf(path, sizeof(path), "%s/%s", data_dir, data_name);
-    file = fopen(path, "rb");
-    if (!file) {
-        printf("Couldn't open file: %s\n", path);
-        exit(1);
-    }
-    offset = lba_offset(part->first_lba);
-    while (count = fread(buffer, 1, sizeof(buffer), file)) {
-        blk_pwrite(blk, offset, buffer, count, 0);
-        offset += count;
+    hdd_read_t *req = opaque;
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < req->len) {
+        ret = pread(req->fd, req->buf + done, req->len - done,
+            req->offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            return -errno;
+        }
+        if (ret == 0) {
+            return -EIO;
+        }
+        done += ret;
     }
+    return 0;
 }
 
-static void generate_hdd_sce(BlockBackend* blk, uint64_t size,
-    gpt_partition_t* gpt_partitions, const char* data_dir)
+/*
+ * Returns the end of the extent starting at @offset, capped at @end, and
+ * whether it holds data. Files without hole information are all data.
+ */
+static off_t hdd_file_extent(int fd, off_t offset, off_t end, bool *data)
 {
-    int i;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    off_t next;
+
+    next = lseek(fd, offset, SEEK_DATA);
+    if (next < 0) {
+        /* ENXIO: only a hole is left, anything else: no support */
+        *data = (errno != ENXIO);
+        return end;
+    }
+    if (next > offset) {
+        *data = false;
+        return MIN(next, end);
+    }
+    next = lseek(fd, offset, SEEK_HOLE);
+    *data = true;
+    return next > offset ? MIN(next, end) : end;
+#else
+    *data = true;
+    return end;
+#endif
+}
+
+static int coroutine_fn hdd_co_zero(hdd_copy_state_t *s,
+    uint64_t offset, uint64_t len)
+{
+    /* Freshly created images usually read back as zeroes already */
+    if (s->zero_init) {
+        return 0;
+    }
+    return blk_co_pwrite_zeroes(s->blk, offset, len, BDRV_REQ_MAY_UNMAP);
+}
+
+static void coroutine_fn hdd_copy_co(void *opaque)
+{
+    hdd_copy_t *copy = opaque;
+    hdd_copy_state_t *s = copy->s;
+    QEMUIOVector qiov;
+    struct iovec iov;
+    hdd_read_t req;
+    uint64_t offset, end, len;
+    bool data;
+    int ret = 0;
 
-    for (i = 0; i < 32; i++) {
-        if (!memcmp(gpt_partitions[i].type_guid, GPT_TYPE_GUID_SCE_SWAP, 16)) {
-            generate_hdd_sce_da0x6(blk, size, &gpt_partitions[i]);
+    req.fd = copy->fd;
+    req.buf = blk_blockalign(s->blk, COPY_CHUNK_SIZE);
+    for (offset = 0; offset < copy->size && !s->ret; offset += len) {
+        end = hdd_file_extent(copy->fd, offset, copy->size, &data);
+        len = MIN(end - offset, COPY_CHUNK_SIZE);
+        if (data) {
+            req.len = len;
+            req.offset = offset;
+            ret = thread_pool_submit_co(s->pool, hdd_read_worker, &req);
+            if (ret < 0) {
+                error_report("Could not read '%s': %s",
+                    copy->path, strerror(-ret));
+                break;
+            }
+            data = !buffer_is_zero(req.buf, len);
         }
-        if (!memcmp(gpt_partitions[i].type_guid, GPT_TYPE_GUID_SCE_SYSTEM, 16)) {
-            generate_hdd_sce_partition_img(blk, size,
-                &gpt_partitions[i], data_dir, "system.img");
+        if (data) {
+            iov.iov_base = req.buf;
+            iov.iov_len = len;
+            qemu_iovec_init_external(&qiov, &iov, 1);
+            ret = blk_co_pwritev(s->blk, copy->offset + offset, len, &qiov, 0);
+        } else {
+            ret = hdd_co_zero(s, copy->offset + offset, len);
         }
-        if (!memcmp(gpt_partitions[i].type_guid, GPT_TYPE_GUID_SCE_SYSTEM_EX, 16)) {
-            generate_hdd_sce_partition_img(blk, size,
-                &gpt_partitions[i], data_dir, "system_ex.img");
+        if (ret < 0) {
+            error_report("Could not write '%s' to the image: %s",
+                copy->path, strerror(-ret));
+            break;
         }
+        s->bytes_done += len;
+        qemu_progress_print(100.f * s->bytes_done / s->bytes_total, 0);
     }
+    qemu_vfree(req.buf);
+
+    if (ret < 0 && !s->ret) {
+        s->ret = ret;
+    }
+    s->running--;
 }
 
-int generate_hdd_ps4(BlockBackend* blk, const char* data_dir, uint64_t size)
+static int generate_hdd_sce_partition_img(hdd_copy_state_t *s,
+    hdd_copy_t *copy, gpt_partition_t* part,
+    const char* data_dir, const char* data_name)
 {
-    gpt_partition_t gpt_partitions[32];
-    memset(&gpt_partitions, 0, sizeof(gpt_partitions));
-
-    generate_hdd_mbr(blk, size);
-    generate_hdd_gpt(blk, size, gpt_partitions);
-    generate_hdd_sce(blk, size, gpt_partitions, data_dir);
+    uint64_t part_size;
+    struct stat st;
+
+    copy->s = s;
+    copy->path = g_strdup_printf("%s/%s", data_dir, data_name);
+    copy->fd = qemu_open(copy->path, O_RDONLY | O_BINARY);
+    if (copy->fd < 0) {
+        error_report("Could not open '%s': %s", copy->path, strerror(errno));
+        return -errno;
+    }
+    if (fstat(copy->fd, &st) < 0) {
+        error_report("Could not stat '%s': %s", copy->path, strerror(errno));
+        return -errno;
+    }
+    part_size = lba_offset(part->last_lba - part->first_lba + 1);
+    if (st.st_size > part_size) {
+        error_report("'%s' does not fit in its partition (%" PRIu64 " bytes)",
+            copy->path, part_size);
+        return -EFBIG;
+    }
+    copy->offset = lba_offset(part->first_lba);
+    copy->size = st.st_size;
+    s->bytes_total += copy->size;
     return 0;
 }
+
+static int generate_hdd_sce(BlockBackend* blk, uint64_t size,
+    gpt_partition_t* gpt_partitions, const PS4HDDLayout *layout,
+    const char* data_dir)
+{
+    const hdd_part_desc_t *desc;
+    gpt_partition_t *part;
+    hdd_copy_state_t s = {};
+    hdd_copy_t copies[GPT_PARTS_MAX];
+    int count = 0;
+    int i, ret = 0;
+
+    s.blk = blk;
+    s.pool = aio_get_thread_pool(qemu_get_aio_context());
+    s.zero_init = bdrv_has_zero_init(blk_bs(blk));
+    for (i = 0; i < layout->count && !ret; i++) {
+        desc = &layout->parts[i];
+        part = &gpt_partitions[desc->slot];
+        if (!memcmp(desc->type_guid, GPT_TYPE_GUID_SCE_SWAP, 16)) {
+            ret = generate_hdd_sce_da0x6(blk, size, part);
+        }
+        if (desc->image && !ret) {
+            if (!data_dir) {
+                error_report("Please specify a folder with the PS4 HDD data "
+                    "(--data)");
+                ret = -EINVAL;
+                break;
+            }
+            ret = generate_hdd_sce_partition_img(&s, &copies[count++],
+                part, data_dir, desc->image);
+        }
+    }
+
+    /* Partition images are copied concurrently, one coroutine each */
+    if (!ret && s.bytes_total) {
+        s.running = count;
+        for (i = 0; i < count; i++) {
+            qemu_coroutine_enter(qemu_coroutine_create(hdd_copy_co, &copies[i]));
+        }
+        while (s.running) {
+            main_loop_wait(false);
+        }
+        ret = s.ret;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (copies[i].fd >= 0) {
+            qemu_close(copies[i].fd);
+        }
+        g_free(copies[i].path);
+    }
+    return ret;
+}
+
+int generate_hdd_ps4(BlockBackend* blk, const PS4HDDLayout *layout,
+    const char* data_dir, uint64_t size, bool backing)
+{
+    gpt_partition_t gpt_partitions[GPT_PARTS_MAX];
+    int ret;
+
+    memset(&gpt_partitions, 0, sizeof(gpt_partitions));
+    ret = generate_hdd_gpt(blk, size, gpt_partitions, layout, backing);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = generate_hdd_mbr(blk, size, backing);
+    if (ret < 0) {
+        error_report("Could not write the MBR: %s", strerror(-ret));
+        return ret;
+    }
+    /* Overlays inherit the partition contents from their backing image */
+    if (!backing) {
+        ret = generate_hdd_sce(blk, size, gpt_partitions, layout, data_dir);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    ret = blk_flush(blk);
+    if (ret < 0) {
+        error_report("Could not flush the image: %s", strerror(-ret));
+    }
+    return ret;
+}
@@ -27,6 +27,28 @@
 
 #include "qemu/typedefs.h"
 
-int generate_hdd_ps4(BlockBackend* blk, const char* data_path, uint64_t size);
+typedef struct PS4HDDLayout PS4HDDLayout;
+
+/*
+ * Loads a partition layout from the JSON file at @path, or the retail
+ * layout if @path is NULL. Example:
+ *   { "partitions": [
+ *       { "slot": 12, "type": "user", "size": "-36G" },
+ *       { "slot": 4, "type": "system", "size": "1G",
+ *         "flags": 36028797018963968, "image": "system.img" } ] }
+ * Partitions are allocated in order. A size prefixed with '-' is subtracted
+ * from the disk size, and "image" is copied from the data directory.
+ */
+PS4HDDLayout *ps4_hdd_layout_load(const char *path, Error **errp);
+void ps4_hdd_layout_free(PS4HDDLayout *layout);
+
+/*
+ * Writes the MBR, GPT and partition contents. With @backing set, @blk is
+ * an overlay whose base was created with a compatible layout: only the
+ * differing metadata sectors are written and the partition contents are
+ * inherited.
+ */
+int generate_hdd_ps4(BlockBackend* blk, const PS4HDDLayout *layout,
+    const char* data_path, uint64_t size, bool backing);
 
 #endif /* QEMU_IMG_PS4_H */
\ No newline at end of file
@@ -69,6 +69,7 @@ enum {
     OPTION_PREALLOCATION = 265,
     OPTION_SHRINK = 266,
     OPTION_DATA = 267,
+    OPTION_LAYOUT = 268,
 };
 
 typedef enum OutputFormat {
@@ -558,12 +559,18 @@ static int img_create_ps4(int argc, char **argv)
 
     int c, ret;
     uint64_t size = -1;
+    int64_t length;
     const char *fmt = "raw";
     const char *cache = "writeback";
     const char *filename;
     const char *data_path = NULL;
+    const char *layout_path = NULL;
+    const char *base_filename = NULL;
+    const char *base_fmt = NULL;
+    PS4HDDLayout *layout = NULL;
     char *options = NULL;
     bool quiet = false;
+    bool progress = false;
     bool force_share = false;
     bool writethrough;
     BlockBackend* blk;
@@ -574,10 +581,11 @@ static int img_create_ps4(int argc, char **argv)
         static const struct option long_options[] = {
             {"help", no_argument, 0, 'h'},
             {"data", required_argument, 0, OPTION_DATA},
+            {"layout", required_argument, 0, OPTION_LAYOUT},
             {"object", required_argument, 0, OPTION_OBJECT},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, ":F:b:f:ho:qu", long_options, NULL);
+        c = getopt_long(argc, argv, ":F:b:f:ho:pqu", long_options, NULL);
         if (c == -1) {
             break;
         }
@@ -591,6 +599,12 @@ static int img_create_ps4(int argc, char **argv)
         case 'h':
             help();
             break;
+        case 'b':
+            base_filename = optarg;
+            break;
+        case 'F':
+            base_fmt = optarg;
+            break;
         case 'f':
             fmt = optarg;
             break;
@@ -607,18 +621,34 @@ static int img_create_ps4(int argc, char **argv)
                 g_free(old_options);
             }
             break;
+        case 'p':
+            progress = true;
+            break;
         case 'q':
             quiet = true;
             break;
         case OPTION_DATA:
             data_path = optarg;
+            break;
+        case OPTION_LAYOUT:
+            layout_path = optarg;
+            break;
         }
     }
 
-    if (!data_path) {
-        error_report("Please specify a folder with the PS4 HDD data (--data)");
+    if (quiet) {
+        progress = false;
+    }
+    layout = ps4_hdd_layout_load(layout_path, &local_err);
+    if (!layout) {
+        error_report_err(local_err);
         goto fail;
     }
+    /* Overlays are opened with their base, so that partial writes to
+     * metadata clusters copy the base contents */
+    if (base_filename) {
+        flags &= ~BDRV_O_NO_BACKING;
+    }
 
     ret = bdrv_parse_cache_mode(cache, &flags, &writethrough);
     if (ret < 0) {
@@ -654,7 +684,7 @@ static int img_create_ps4(int argc, char **argv)
     }
 
     /* Create image */
-    bdrv_img_create(filename, fmt, NULL, NULL,
+    bdrv_img_create(filename, fmt, base_filename, base_fmt,
         options, size, flags, quiet, &local_err);
     if (local_err) {
         error_reportf_err(local_err, "%s: ", filename);
@@ -666,13 +696,26 @@ static int img_create_ps4(int argc, char **argv)
         goto fail;
     }
     /* Write partitions */
-    if (generate_hdd_ps4(blk, data_path, size)) {
-        goto fail;
+    qemu_progress_init(progress, 1.f);
+    qemu_progress_print(0.f, 100);
+    length = blk_getlength(blk);
+    if (length >= 0) {
+        ret = generate_hdd_ps4(blk, layout, data_path, length,
+            base_filename != NULL);
+    } else {
+        error_report("Could not get the image size: %s", strerror(-length));
+        ret = length;
     }
+    qemu_progress_end();
     blk_unref(blk);
+    if (ret < 0) {
+        goto fail;
+    }
+    ps4_hdd_layout_free(layout);
     return 0;
 
 fail:
+    ps4_hdd_layout_free(layout);
     return 1;
 }
 
@@ -0,0 +1,18 @@
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+#include "qapi/qmp/qerror.h"
+
+LiverpoolStats *qmp_query_liverpool_stats(Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+    return NULL;
+}
+
+LiverpoolShaderInfoList *qmp_query_liverpool_shaders(bool has_disassemble,
+                                                     bool disassemble,
+                                                     Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+    return NULL;
+}
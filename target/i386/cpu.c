@@ -236,11 +236,22 @@ static void x86_cpu_vendor_words2str(char *dst, uint32_t vendor1,
           CPUID_MTRR, CPUID_MCA, CPUID_CLFLUSH (needed for Win64) */
           /* missing:
           CPUID_VME, CPUID_DTS, CPUID_SS, CPUID_HT, CPUID_TM, CPUID_PBE */
+/* Only the VEX.128 encodings are translated, which is all the Jaguar
+ * needs.  Other guests would use VEX.256 too, so there AVX and F16C are
+ * only enabled when asked for by name, e.g. "-cpu max,+avx,+f16c".
+ */
+#define TCG_EXT_FEATURES_OPT_IN (CPUID_EXT_AVX | CPUID_EXT_F16C)
+#ifdef TARGET_PS4
+#define TCG_EXT_FEATURES_VEX TCG_EXT_FEATURES_OPT_IN
+#else
+#define TCG_EXT_FEATURES_VEX 0
+#endif
 #define TCG_EXT_FEATURES (CPUID_EXT_SSE3 | CPUID_EXT_PCLMULQDQ | \
           CPUID_EXT_MONITOR | CPUID_EXT_SSSE3 | CPUID_EXT_CX16 | \
           CPUID_EXT_SSE41 | CPUID_EXT_SSE42 | CPUID_EXT_POPCNT | \
           CPUID_EXT_XSAVE | /* CPUID_EXT_OSXSAVE is dynamic */   \
-          CPUID_EXT_MOVBE | CPUID_EXT_AES | CPUID_EXT_HYPERVISOR)
+          CPUID_EXT_MOVBE | CPUID_EXT_AES | CPUID_EXT_HYPERVISOR | \
+          TCG_EXT_FEATURES_VEX)
           /* missing:
           CPUID_EXT_DTES64, CPUID_EXT_DSCPL, CPUID_EXT_VMX, CPUID_EXT_SMX,
           CPUID_EXT_EST, CPUID_EXT_TM2, CPUID_EXT_CID, CPUID_EXT_FMA,
@@ -2111,6 +2122,26 @@ static PropValue kvm_default_props[] = {
     { NULL, NULL },
 };
 
+#ifdef TARGET_PS4
+/* Jaguar features that no KVM version reports in KVM_GET_SUPPORTED_CPUID:
+ * turned off under KVM so the model passes CPUID filtering on an AMD host.
+ * HTT is still set by cpu_x86_cpuid when the topology has several threads.
+ */
+static PropValue jaguar_kvm_props[] = {
+    { "ht", "off" },
+    { "extapic", "off" },
+    { "ibs", "off" },
+    { "skinit", "off" },
+    { "wdt", "off" },
+    { "nodeid-msr", "off" },
+    { "perfctr-nb", "off" },
+    { NULL, NULL },
+};
+
+/* Same, for the 80000001H:ECX bits that have no property name */
+#define JAGUAR_KVM_EXT3_UNNAMED ((1U << 26) | (1U << 28))
+#endif
+
 /* TCG-specific defaults that override all CPU models when using TCG
  */
 static PropValue tcg_default_props[] = {
@@ -2990,6 +3021,17 @@ static void x86_cpu_load_def(X86CPU *cpu, X86CPUDefinition *def, Error **errp)
         }
 
         x86_cpu_apply_props(cpu, kvm_default_props);
+#ifdef TARGET_PS4
+        if (!strcmp(def->name, "jaguar")) {
+            x86_cpu_apply_props(cpu, jaguar_kvm_props);
+            env->features[FEAT_8000_0001_ECX] &= ~JAGUAR_KVM_EXT3_UNNAMED;
+            /* Only reported by recent host kernels */
+            if (!(kvm_arch_get_supported_cpuid(kvm_state, 0x80000001, 0,
+                                               R_ECX) & CPUID_EXT3_TOPOEXT)) {
+                env->features[FEAT_8000_0001_ECX] &= ~CPUID_EXT3_TOPOEXT;
+            }
+        }
+#endif
     } else if (tcg_enabled()) {
         x86_cpu_apply_props(cpu, tcg_default_props);
     }
@@ -4183,6 +4225,9 @@ static int x86_cpu_filter_features(X86CPU *cpu)
         uint32_t host_feat =
             x86_cpu_get_supported_feature_word(w, false);
         uint32_t requested_features = env->features[w];
+        if (tcg_enabled() && w == FEAT_1_ECX) {
+            host_feat |= env->user_features[w] & TCG_EXT_FEATURES_OPT_IN;
+        }
         env->features[w] &= host_feat;
         cpu->filtered_features[w] = requested_features & ~env->features[w];
         if (cpu->filtered_features[w]) {
@@ -1224,6 +1224,9 @@ static uint64_t get_xinuse(CPUX86State *env)
     if ((env->hflags & HF_MPX_IU_MASK) == 0) {
        inuse &= ~XSTATE_BNDREGS_MASK;
     }
+    /* Only VEX.128 is implemented, and it clears bits 255:128, so the
+       upper halves of the YMM registers never leave their init state.  */
+    inuse &= ~XSTATE_YMM_MASK;
     return inuse;
 }
 
@@ -1606,6 +1609,74 @@ void helper_movq(CPUX86State *env, void *d, void *s)
     *(uint64_t *)d = *(uint64_t *)s;
 }
 
+#ifdef CONFIG_AESNI_OPT
+/* AES-NI and PCLMULQDQ are executed natively when the host implements
+ * them; the table-driven versions in ops_sse.h are the fallback.
+ */
+#include "qemu/cpuid.h"
+#pragma GCC push_options
+#pragma GCC target("aes,pclmul")
+#include <wmmintrin.h>
+
+static bool host_aesni;
+static bool host_pclmul;
+
+static void host_aes_round(ZMMReg *d, ZMMReg *s, bool dec, bool last)
+{
+    __m128i st = _mm_loadu_si128((__m128i *)d);
+    __m128i rk = _mm_loadu_si128((__m128i *)s);
+
+    if (dec) {
+        st = last ? _mm_aesdeclast_si128(st, rk) : _mm_aesdec_si128(st, rk);
+    } else {
+        st = last ? _mm_aesenclast_si128(st, rk) : _mm_aesenc_si128(st, rk);
+    }
+    _mm_storeu_si128((__m128i *)d, st);
+}
+
+static void host_aesimc(ZMMReg *d, ZMMReg *s)
+{
+    __m128i x = _mm_loadu_si128((__m128i *)s);
+
+    _mm_storeu_si128((__m128i *)d, _mm_aesimc_si128(x));
+}
+
+static void host_pclmulqdq(ZMMReg *d, ZMMReg *s, uint32_t ctrl)
+{
+    __m128i a = _mm_loadu_si128((__m128i *)d);
+    __m128i b = _mm_loadu_si128((__m128i *)s);
+
+    /* The selector has to be an immediate */
+    switch (ctrl & 0x11) {
+    case 0x00:
+        a = _mm_clmulepi64_si128(a, b, 0x00);
+        break;
+    case 0x01:
+        a = _mm_clmulepi64_si128(a, b, 0x01);
+        break;
+    case 0x10:
+        a = _mm_clmulepi64_si128(a, b, 0x10);
+        break;
+    default:
+        a = _mm_clmulepi64_si128(a, b, 0x11);
+        break;
+    }
+    _mm_storeu_si128((__m128i *)d, a);
+}
+#pragma GCC pop_options
+
+static void __attribute__((constructor)) init_host_aesni(void)
+{
+    int a, b, c, d;
+
+    if (__get_cpuid_max(0, NULL) >= 1) {
+        __cpuid(1, a, b, c, d);
+        host_aesni = (c & bit_AES) != 0;
+        host_pclmul = (c & bit_PCLMUL) != 0;
+    }
+}
+#endif /* CONFIG_AESNI_OPT */
+
 #define SHIFT 0
 #include "ops_sse.h"
 
@@ -2169,6 +2169,12 @@ void glue(helper_pclmulqdq, SUFFIX)(CPUX86State *env, Reg *d, Reg *s,
 {
     uint64_t ah, al, b, resh, resl;
 
+#ifdef CONFIG_AESNI_OPT
+    if (host_pclmul) {
+        host_pclmulqdq(d, s, ctrl);
+        return;
+    }
+#endif
     ah = 0;
     al = d->Q((ctrl & 1) != 0);
     b = s->Q((ctrl & 16) != 0);
@@ -2191,8 +2197,16 @@ void glue(helper_pclmulqdq, SUFFIX)(CPUX86State *env, Reg *d, Reg *s,
 void glue(helper_aesdec, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 {
     int i;
-    Reg st = *d;
-    Reg rk = *s;
+    Reg st, rk;
+
+#ifdef CONFIG_AESNI_OPT
+    if (host_aesni) {
+        host_aes_round(d, s, true, false);
+        return;
+    }
+#endif
+    st = *d;
+    rk = *s;
 
     for (i = 0 ; i < 4 ; i++) {
         d->L(i) = rk.L(i) ^ bswap32(AES_Td0[st.B(AES_ishifts[4*i+0])] ^
@@ -2205,8 +2219,16 @@ void glue(helper_aesdec, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 void glue(helper_aesdeclast, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 {
     int i;
-    Reg st = *d;
-    Reg rk = *s;
+    Reg st, rk;
+
+#ifdef CONFIG_AESNI_OPT
+    if (host_aesni) {
+        host_aes_round(d, s, true, true);
+        return;
+    }
+#endif
+    st = *d;
+    rk = *s;
 
     for (i = 0; i < 16; i++) {
         d->B(i) = rk.B(i) ^ (AES_isbox[st.B(AES_ishifts[i])]);
@@ -2216,8 +2238,16 @@ void glue(helper_aesdeclast, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 void glue(helper_aesenc, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 {
     int i;
-    Reg st = *d;
-    Reg rk = *s;
+    Reg st, rk;
+
+#ifdef CONFIG_AESNI_OPT
+    if (host_aesni) {
+        host_aes_round(d, s, false, false);
+        return;
+    }
+#endif
+    st = *d;
+    rk = *s;
 
     for (i = 0 ; i < 4 ; i++) {
         d->L(i) = rk.L(i) ^ bswap32(AES_Te0[st.B(AES_shifts[4*i+0])] ^
@@ -2230,8 +2260,16 @@ void glue(helper_aesenc, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 void glue(helper_aesenclast, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 {
     int i;
-    Reg st = *d;
-    Reg rk = *s;
+    Reg st, rk;
+
+#ifdef CONFIG_AESNI_OPT
+    if (host_aesni) {
+        host_aes_round(d, s, false, true);
+        return;
+    }
+#endif
+    st = *d;
+    rk = *s;
 
     for (i = 0; i < 16; i++) {
         d->B(i) = rk.B(i) ^ (AES_sbox[st.B(AES_shifts[i])]);
@@ -2242,7 +2280,15 @@ void glue(helper_aesenclast, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 void glue(helper_aesimc, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 {
     int i;
-    Reg tmp = *s;
+    Reg tmp;
+
+#ifdef CONFIG_AESNI_OPT
+    if (host_aesni) {
+        host_aesimc(d, s);
+        return;
+    }
+#endif
+    tmp = *s;
 
     for (i = 0 ; i < 4 ; i++) {
         d->L(i) = bswap32(AES_imc[tmp.B(4*i+0)][0] ^
@@ -2267,6 +2313,191 @@ void glue(helper_aeskeygenassist, SUFFIX)(CPUX86State *env, Reg *d, Reg *s,
 }
 #endif
 
+/* F16C op helpers */
+#if SHIFT == 1
+void glue(helper_cvtph2ps, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
+{
+    uint64_t h = s->Q(0);
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        d->ZMM_S(i) = float32_maybe_silence_nan(
+            float16_to_float32(make_float16(h >> (i * 16)), true,
+                               &env->sse_status), &env->sse_status);
+    }
+}
+
+void glue(helper_cvtps2ph, SUFFIX)(CPUX86State *env, Reg *d, Reg *s,
+                                   uint32_t mode)
+{
+    signed char prev_rounding_mode;
+    uint64_t h = 0;
+    int i;
+
+    prev_rounding_mode = env->sse_status.float_rounding_mode;
+    if (!(mode & (1 << 2))) {
+        switch (mode & 3) {
+        case 0:
+            set_float_rounding_mode(float_round_nearest_even, &env->sse_status);
+            break;
+        case 1:
+            set_float_rounding_mode(float_round_down, &env->sse_status);
+            break;
+        case 2:
+            set_float_rounding_mode(float_round_up, &env->sse_status);
+            break;
+        case 3:
+            set_float_rounding_mode(float_round_to_zero, &env->sse_status);
+            break;
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        h |= (uint64_t)float16_val(float16_maybe_silence_nan(
+            float32_to_float16(s->ZMM_S(i), true, &env->sse_status),
+            &env->sse_status)) << (i * 16);
+    }
+    env->sse_status.float_rounding_mode = prev_rounding_mode;
+
+    d->Q(0) = h;
+    d->Q(1) = 0;
+}
+#endif
+
+/* AVX op helpers */
+#if SHIFT == 1
+void glue(helper_vpermilps, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
+{
+    Reg r = *d, c = *s;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        d->L(i) = r.L(c.L(i) & 3);
+    }
+}
+
+void glue(helper_vpermilpd, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
+{
+    Reg r = *d, c = *s;
+
+    d->Q(0) = r.Q((c.Q(0) >> 1) & 1);
+    d->Q(1) = r.Q((c.Q(1) >> 1) & 1);
+}
+
+void glue(helper_vpermilps_imm, SUFFIX)(CPUX86State *env, Reg *d, Reg *s,
+                                        uint32_t imm)
+{
+    Reg r = *s;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        d->L(i) = r.L((imm >> (i * 2)) & 3);
+    }
+}
+
+void glue(helper_vpermilpd_imm, SUFFIX)(CPUX86State *env, Reg *d, Reg *s,
+                                        uint32_t imm)
+{
+    Reg r = *s;
+
+    d->Q(0) = r.Q(imm & 1);
+    d->Q(1) = r.Q((imm >> 1) & 1);
+}
+
+void glue(helper_vtestps, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
+{
+    uint32_t zf = 0, cf = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        zf |= s->L(i) &  d->L(i);
+        cf |= s->L(i) & ~d->L(i);
+    }
+    CC_SRC = (zf & 0x80000000 ? 0 : CC_Z) | (cf & 0x80000000 ? 0 : CC_C);
+}
+
+void glue(helper_vtestpd, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
+{
+    uint64_t zf = (s->Q(0) &  d->Q(0)) | (s->Q(1) &  d->Q(1));
+    uint64_t cf = (s->Q(0) & ~d->Q(0)) | (s->Q(1) & ~d->Q(1));
+
+    CC_SRC = (zf >> 63 ? 0 : CC_Z) | (cf >> 63 ? 0 : CC_C);
+}
+
+/* Masked-out elements are neither read nor written, so they cannot
+   fault.  Loads go through a temporary, so that a fault leaves the
+   destination (which may be the mask) untouched.  */
+void glue(helper_vmaskmovps_ld, SUFFIX)(CPUX86State *env, Reg *d, Reg *m,
+                                        target_ulong a0)
+{
+    Reg r;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        r.L(i) = m->L(i) & 0x80000000
+            ? cpu_ldl_data_ra(env, a0 + i * 4, GETPC()) : 0;
+    }
+    *d = r;
+}
+
+void glue(helper_vmaskmovpd_ld, SUFFIX)(CPUX86State *env, Reg *d, Reg *m,
+                                        target_ulong a0)
+{
+    Reg r;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        r.Q(i) = m->Q(i) >> 63
+            ? cpu_ldq_data_ra(env, a0 + i * 8, GETPC()) : 0;
+    }
+    *d = r;
+}
+
+void glue(helper_vmaskmovps_st, SUFFIX)(CPUX86State *env, Reg *d, Reg *m,
+                                        target_ulong a0)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (m->L(i) & 0x80000000) {
+            cpu_stl_data_ra(env, a0 + i * 4, d->L(i), GETPC());
+        }
+    }
+}
+
+void glue(helper_vmaskmovpd_st, SUFFIX)(CPUX86State *env, Reg *d, Reg *m,
+                                        target_ulong a0)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (m->Q(i) >> 63) {
+            cpu_stq_data_ra(env, a0 + i * 8, d->Q(i), GETPC());
+        }
+    }
+}
+
+/* The four-operand blends take the first source and the selector from
+   the registers in regs[3:0] and regs[7:4]; every element is computed
+   from the same element of each operand, so any of them may alias d.  */
+#define SSE_HELPER_VEX_V(name, elem, num, F)                            \
+    void glue(name, SUFFIX)(CPUX86State *env, Reg *d, Reg *s,           \
+                            uint32_t regs)                              \
+    {                                                                   \
+        Reg *v = &env->xmm_regs[regs & 15];                             \
+        Reg *m = &env->xmm_regs[regs >> 4];                             \
+        int i;                                                          \
+                                                                        \
+        for (i = 0; i < num; i++) {                                     \
+            d->elem(i) = F(v->elem(i), s->elem(i), m->elem(i));         \
+        }                                                               \
+    }
+
+SSE_HELPER_VEX_V(helper_vpblendvb, B, 16, FBLENDVB)
+SSE_HELPER_VEX_V(helper_vblendvps, L, 4, FBLENDVPS)
+SSE_HELPER_VEX_V(helper_vblendvpd, Q, 2, FBLENDVPD)
+#endif
+
 #undef SHIFT
 #undef XMM_ONLY
 #undef Reg
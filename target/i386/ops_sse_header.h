@@ -346,6 +346,29 @@ DEF_HELPER_4(glue(aeskeygenassist, SUFFIX), void, env, Reg, Reg, i32)
 DEF_HELPER_4(glue(pclmulqdq, SUFFIX), void, env, Reg, Reg, i32)
 #endif
 
+/* F16C op helpers */
+#if SHIFT == 1
+DEF_HELPER_3(glue(cvtph2ps, SUFFIX), void, env, Reg, Reg)
+DEF_HELPER_4(glue(cvtps2ph, SUFFIX), void, env, Reg, Reg, i32)
+#endif
+
+/* AVX op helpers */
+#if SHIFT == 1
+DEF_HELPER_3(glue(vpermilps, SUFFIX), void, env, Reg, Reg)
+DEF_HELPER_3(glue(vpermilpd, SUFFIX), void, env, Reg, Reg)
+DEF_HELPER_4(glue(vpermilps_imm, SUFFIX), void, env, Reg, Reg, i32)
+DEF_HELPER_4(glue(vpermilpd_imm, SUFFIX), void, env, Reg, Reg, i32)
+DEF_HELPER_3(glue(vtestps, SUFFIX), void, env, Reg, Reg)
+DEF_HELPER_3(glue(vtestpd, SUFFIX), void, env, Reg, Reg)
+DEF_HELPER_4(glue(vmaskmovps_ld, SUFFIX), void, env, Reg, Reg, tl)
+DEF_HELPER_4(glue(vmaskmovpd_ld, SUFFIX), void, env, Reg, Reg, tl)
+DEF_HELPER_4(glue(vmaskmovps_st, SUFFIX), void, env, Reg, Reg, tl)
+DEF_HELPER_4(glue(vmaskmovpd_st, SUFFIX), void, env, Reg, Reg, tl)
+DEF_HELPER_4(glue(vpblendvb, SUFFIX), void, env, Reg, Reg, i32)
+DEF_HELPER_4(glue(vblendvps, SUFFIX), void, env, Reg, Reg, i32)
+DEF_HELPER_4(glue(vblendvpd, SUFFIX), void, env, Reg, Reg, i32)
+#endif
+
 #undef SHIFT
 #undef Reg
 #undef SUFFIX
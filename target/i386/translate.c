@@ -23,6 +23,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg-op.h"
+#include "tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translator.h"
 
@@ -2933,6 +2934,13 @@ struct SSEOpHelper_eppi {
 #define PCLMULQDQ_OP(x) { { NULL, gen_helper_ ## x ## _xmm }, \
         CPUID_EXT_PCLMULQDQ }
 #define AESNI_OP(x) { { NULL, gen_helper_ ## x ## _xmm }, CPUID_EXT_AES }
+#define F16C_OP(x) { { NULL, gen_helper_ ## x ## _xmm }, CPUID_EXT_F16C }
+#define F16C_SPECIAL { { NULL, SSE_SPECIAL }, CPUID_EXT_F16C }
+#define AVX_OP(x) { { NULL, gen_helper_ ## x ## _xmm }, CPUID_EXT_AVX }
+#define AVX_SPECIAL { { NULL, SSE_SPECIAL }, CPUID_EXT_AVX }
+
+/* Entries that only exist in the VEX encoding */
+#define VEX_ONLY (CPUID_EXT_AVX | CPUID_EXT_F16C)
 
 static const struct SSEOpHelper_epp sse_op_table6[256] = {
     [0x00] = SSSE3_OP(pshufb),
@@ -2947,10 +2955,16 @@ static const struct SSEOpHelper_epp sse_op_table6[256] = {
     [0x09] = SSSE3_OP(psignw),
     [0x0a] = SSSE3_OP(psignd),
     [0x0b] = SSSE3_OP(pmulhrsw),
+    [0x0c] = AVX_OP(vpermilps),
+    [0x0d] = AVX_OP(vpermilpd),
+    [0x0e] = AVX_OP(vtestps),
+    [0x0f] = AVX_OP(vtestpd),
     [0x10] = SSE41_OP(pblendvb),
+    [0x13] = F16C_OP(cvtph2ps),
     [0x14] = SSE41_OP(blendvps),
     [0x15] = SSE41_OP(blendvpd),
     [0x17] = SSE41_OP(ptest),
+    [0x18] = AVX_SPECIAL, /* vbroadcastss */
     [0x1c] = SSSE3_OP(pabsb),
     [0x1d] = SSSE3_OP(pabsw),
     [0x1e] = SSSE3_OP(pabsd),
@@ -2964,6 +2978,10 @@ static const struct SSEOpHelper_epp sse_op_table6[256] = {
     [0x29] = SSE41_OP(pcmpeqq),
     [0x2a] = SSE41_SPECIAL, /* movntqda */
     [0x2b] = SSE41_OP(packusdw),
+    [0x2c] = AVX_SPECIAL, /* vmaskmovps */
+    [0x2d] = AVX_SPECIAL, /* vmaskmovpd */
+    [0x2e] = AVX_SPECIAL, /* vmaskmovps */
+    [0x2f] = AVX_SPECIAL, /* vmaskmovpd */
     [0x30] = SSE41_OP(pmovzxbw),
     [0x31] = SSE41_OP(pmovzxbd),
     [0x32] = SSE41_OP(pmovzxbq),
@@ -2989,6 +3007,8 @@ static const struct SSEOpHelper_epp sse_op_table6[256] = {
 };
 
 static const struct SSEOpHelper_eppi sse_op_table7[256] = {
+    [0x04] = AVX_OP(vpermilps_imm),
+    [0x05] = AVX_OP(vpermilpd_imm),
     [0x08] = SSE41_OP(roundps),
     [0x09] = SSE41_OP(roundpd),
     [0x0a] = SSE41_OP(roundss),
@@ -3001,6 +3021,7 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0x15] = SSE41_SPECIAL, /* pextrw */
     [0x16] = SSE41_SPECIAL, /* pextrd/pextrq */
     [0x17] = SSE41_SPECIAL, /* extractps */
+    [0x1d] = F16C_SPECIAL, /* vcvtps2ph */
     [0x20] = SSE41_SPECIAL, /* pinsrb */
     [0x21] = SSE41_SPECIAL, /* insertps */
     [0x22] = SSE41_SPECIAL, /* pinsrd/pinsrq */
@@ -3008,6 +3029,9 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0x41] = SSE41_OP(dppd),
     [0x42] = SSE41_OP(mpsadbw),
     [0x44] = PCLMULQDQ_OP(pclmulqdq),
+    [0x4a] = AVX_OP(vblendvps),
+    [0x4b] = AVX_OP(vblendvpd),
+    [0x4c] = AVX_OP(vpblendvb),
     [0x60] = SSE42_OP(pcmpestrm),
     [0x61] = SSE42_OP(pcmpestri),
     [0x62] = SSE42_OP(pcmpistrm),
@@ -3015,6 +3039,96 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0xdf] = AESNI_OP(aeskeygenassist),
 };
 
+/* The vvvv register; its top bit is ignored outside of 64-bit mode */
+static inline int vex_reg(DisasContext *s)
+{
+    return CODE64(s) ? s->vex_v : s->vex_v & 7;
+}
+
+/* Scalar instructions ignore VEX.L; everything else only has a VEX.128
+   form here.  */
+static bool sse_vex_lig(int b, int b1)
+{
+    switch (b) {
+    case 0x2e: /* ucomiss, ucomisd */
+    case 0x2f: /* comiss, comisd */
+        return true;
+    case 0x10: case 0x11: /* movss, movsd */
+    case 0x2a: /* cvtsi2ss, cvtsi2sd */
+    case 0x2c: case 0x2d: /* cvttss2si, cvtss2si, ... */
+    case 0x51 ... 0x5a: /* sqrtss ... cvtss2sd, cvtsd2ss */
+    case 0x5c ... 0x5f: /* subss ... maxss */
+    case 0xc2: /* cmpss, cmpsd */
+        return b1 >= 2;
+    default:
+        return false;
+    }
+}
+
+/* VEX.128 forms take their first source from vvvv: copy it into the
+   destination first, so that the two-operand helpers can be used as is.
+   Only the low 128 bits of the registers are implemented, so there is
+   nothing to clear above them.  */
+static void gen_vex_src1(DisasContext *s, int reg, int *op2_offset)
+{
+    int d_offset = offsetof(CPUX86State, xmm_regs[reg]);
+    int v = vex_reg(s);
+
+    if (!(s->prefix & PREFIX_VEX) || v == reg) {
+        return;
+    }
+    if (op2_offset && *op2_offset == d_offset) {
+        tcg_gen_gvec_mov(MO_64, offsetof(CPUX86State, xmm_t0), d_offset,
+                         16, 16);
+        *op2_offset = offsetof(CPUX86State, xmm_t0);
+    }
+    tcg_gen_gvec_mov(MO_64, d_offset, offsetof(CPUX86State, xmm_regs[v]),
+                     16, 16);
+}
+
+/* Bitwise and integer add/sub on XMM registers are expanded inline
+   instead of calling out to the helpers.  */
+static bool gen_sse_gvec(int b, int op1_offset, int op2_offset)
+{
+    switch (b) {
+    case 0x54: /* andps, andpd */
+    case 0xdb: /* pand */
+        tcg_gen_gvec_and(MO_64, op1_offset, op1_offset, op2_offset, 16, 16);
+        break;
+    case 0x55: /* andnps, andnpd */
+    case 0xdf: /* pandn */
+        tcg_gen_gvec_andc(MO_64, op1_offset, op2_offset, op1_offset, 16, 16);
+        break;
+    case 0x56: /* orps, orpd */
+    case 0xeb: /* por */
+        tcg_gen_gvec_or(MO_64, op1_offset, op1_offset, op2_offset, 16, 16);
+        break;
+    case 0x57: /* xorps, xorpd */
+    case 0xef: /* pxor */
+        tcg_gen_gvec_xor(MO_64, op1_offset, op1_offset, op2_offset, 16, 16);
+        break;
+    case 0xfc: /* paddb */
+    case 0xfd: /* paddw */
+    case 0xfe: /* paddd */
+        tcg_gen_gvec_add(b - 0xfc, op1_offset, op1_offset, op2_offset,
+                         16, 16);
+        break;
+    case 0xd4: /* paddq */
+        tcg_gen_gvec_add(MO_64, op1_offset, op1_offset, op2_offset, 16, 16);
+        break;
+    case 0xf8: /* psubb */
+    case 0xf9: /* psubw */
+    case 0xfa: /* psubd */
+    case 0xfb: /* psubq */
+        tcg_gen_gvec_sub(b - 0xf8, op1_offset, op1_offset, op2_offset,
+                         16, 16);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start, int rex_r)
 {
@@ -3050,7 +3164,8 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
         }
     }
 
-    modrm = x86_ldub_code(env, s);
+    /* femms, emms and vzeroupper/vzeroall have no modrm byte */
+    modrm = (b == 0x0e || b == 0x77) ? 0 : x86_ldub_code(env, s);
     reg = ((modrm >> 3) & 7);
     if (is_xmm)
         reg |= rex_r;
@@ -3082,10 +3197,33 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
         return;
     }
     if (b == 0x77) {
+        if (s->prefix & PREFIX_VEX) {
+            int i, n = CODE64(s) ? CPU_NB_REGS : 8;
+
+            if (!(s->cpuid_ext_features & CPUID_EXT_AVX)) {
+                goto illegal_op;
+            }
+            /* vzeroupper is a no-op, as the upper halves of the YMM
+               registers always read as zero; vzeroall also clears XMM */
+            if (s->vex_l) {
+                for (i = 0; i < n; i++) {
+                    tcg_gen_gvec_dup64i(offsetof(CPUX86State, xmm_regs[i]),
+                                        16, 16, 0);
+                }
+            }
+            return;
+        }
         /* emms */
         gen_helper_emms(cpu_env);
         return;
     }
+    if ((s->prefix & PREFIX_VEX) && b != 0x38 && b != 0x3a) {
+        /* Only the VEX.128 encodings of the SSE instructions exist */
+        if (!is_xmm || (s->vex_l && !sse_vex_lig(b, b1))
+            || !(s->cpuid_ext_features & CPUID_EXT_AVX)) {
+            goto illegal_op;
+        }
+    }
     /* prepare MMX state (XXX: optimize by storing fptt and fptags in
        the static cpu state) */
     if (!is_xmm) {
@@ -3094,6 +3232,17 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
 
     if (sse_fn_epp == SSE_SPECIAL) {
         b |= (b1 << 8);
+        if (s->prefix & PREFIX_VEX) {
+            switch (b) {
+            case 0x02a: case 0x12a: /* cvtpi2ps, cvtpi2pd */
+            case 0x02c: case 0x12c: /* cvttps2pi, cvttpd2pi */
+            case 0x02d: case 0x12d: /* cvtps2pi, cvtpd2pi */
+            case 0x22b: case 0x32b: /* movntss, movntsd */
+            case 0x178: case 0x378: /* extrq_i, insertq_i */
+            case 0x2d6: case 0x3d6: /* movq2dq, movdq2q */
+                goto illegal_op;
+            }
+        }
         switch(b) {
         case 0x0e7: /* movntq */
             if (mod == 3) {
@@ -3200,8 +3349,11 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                 tcg_gen_st32_tl(cpu_T0, cpu_env, offsetof(CPUX86State,xmm_regs[reg].ZMM_L(3)));
             } else {
                 rm = (modrm & 7) | REX_B(s);
-                gen_op_movl(offsetof(CPUX86State,xmm_regs[reg].ZMM_L(0)),
-                            offsetof(CPUX86State,xmm_regs[rm].ZMM_L(0)));
+                tcg_gen_ld_i32(cpu_tmp2_i32, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[rm].ZMM_L(0)));
+                gen_vex_src1(s, reg, NULL);
+                tcg_gen_st_i32(cpu_tmp2_i32, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[reg].ZMM_L(0)));
             }
             break;
         case 0x310: /* movsd xmm, ea */
@@ -3214,21 +3366,28 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                 tcg_gen_st32_tl(cpu_T0, cpu_env, offsetof(CPUX86State,xmm_regs[reg].ZMM_L(3)));
             } else {
                 rm = (modrm & 7) | REX_B(s);
-                gen_op_movq(offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(0)),
-                            offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(0)));
+                tcg_gen_ld_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(0)));
+                gen_vex_src1(s, reg, NULL);
+                tcg_gen_st_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(0)));
             }
             break;
         case 0x012: /* movlps */
         case 0x112: /* movlpd */
             if (mod != 3) {
                 gen_lea_modrm(env, s, modrm);
+                gen_vex_src1(s, reg, NULL);
                 gen_ldq_env_A0(s, offsetof(CPUX86State,
                                            xmm_regs[reg].ZMM_Q(0)));
             } else {
                 /* movhlps */
                 rm = (modrm & 7) | REX_B(s);
-                gen_op_movq(offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(0)),
-                            offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(1)));
+                tcg_gen_ld_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(1)));
+                gen_vex_src1(s, reg, NULL);
+                tcg_gen_st_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(0)));
             }
             break;
         case 0x212: /* movsldup */
@@ -3264,13 +3423,17 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
         case 0x116: /* movhpd */
             if (mod != 3) {
                 gen_lea_modrm(env, s, modrm);
+                gen_vex_src1(s, reg, NULL);
                 gen_ldq_env_A0(s, offsetof(CPUX86State,
                                            xmm_regs[reg].ZMM_Q(1)));
             } else {
                 /* movlhps */
                 rm = (modrm & 7) | REX_B(s);
-                gen_op_movq(offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(1)),
-                            offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(0)));
+                tcg_gen_ld_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(0)));
+                gen_vex_src1(s, reg, NULL);
+                tcg_gen_st_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(1)));
             }
             break;
         case 0x216: /* movshdup */
@@ -3382,8 +3545,11 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                 gen_op_st_v(s, MO_32, cpu_T0, cpu_A0);
             } else {
                 rm = (modrm & 7) | REX_B(s);
-                gen_op_movl(offsetof(CPUX86State,xmm_regs[rm].ZMM_L(0)),
-                            offsetof(CPUX86State,xmm_regs[reg].ZMM_L(0)));
+                tcg_gen_ld_i32(cpu_tmp2_i32, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[reg].ZMM_L(0)));
+                gen_vex_src1(s, rm, NULL);
+                tcg_gen_st_i32(cpu_tmp2_i32, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[rm].ZMM_L(0)));
             }
             break;
         case 0x311: /* movsd ea, xmm */
@@ -3393,8 +3559,11 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                                            xmm_regs[reg].ZMM_Q(0)));
             } else {
                 rm = (modrm & 7) | REX_B(s);
-                gen_op_movq(offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(0)),
-                            offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(0)));
+                tcg_gen_ld_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[reg].ZMM_Q(0)));
+                gen_vex_src1(s, rm, NULL);
+                tcg_gen_st_i64(cpu_tmp1_i64, cpu_env,
+                               offsetof(CPUX86State,xmm_regs[rm].ZMM_Q(0)));
             }
             break;
         case 0x013: /* movlps */
@@ -3447,6 +3616,13 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             }
             if (is_xmm) {
                 rm = (modrm & 7) | REX_B(s);
+                if (s->prefix & PREFIX_VEX) {
+                    /* The VEX forms shift rm into vvvv */
+                    tcg_gen_gvec_mov(MO_64,
+                                     offsetof(CPUX86State,xmm_regs[vex_reg(s)]),
+                                     offsetof(CPUX86State,xmm_regs[rm]), 16, 16);
+                    rm = vex_reg(s);
+                }
                 op2_offset = offsetof(CPUX86State,xmm_regs[rm]);
             } else {
                 rm = (modrm & 7);
@@ -3498,6 +3674,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
         case 0x32a: /* cvtsi2sd */
             ot = mo_64_32(s->dflag);
             gen_ldst_modrm(env, s, modrm, ot, OR_TMP0, 0);
+            gen_vex_src1(s, reg, NULL);
             op1_offset = offsetof(CPUX86State,xmm_regs[reg]);
             tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
             if (ot == MO_32) {
@@ -3586,6 +3763,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             val = x86_ldub_code(env, s);
             if (b1) {
                 val &= 7;
+                gen_vex_src1(s, reg, NULL);
                 tcg_gen_st16_tl(cpu_T0, cpu_env,
                                 offsetof(CPUX86State,xmm_regs[reg].ZMM_W(val)));
             } else {
@@ -3676,6 +3854,57 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             }
             if (!(s->cpuid_ext_features & sse_op_table6[b].ext_mask))
                 goto illegal_op;
+            if (s->prefix & PREFIX_VEX) {
+                /* The VEX blendv forms live in the 0f 3a map */
+                if (!b1 || s->vex_l
+                    || !(s->cpuid_ext_features & CPUID_EXT_AVX)
+                    || b == 0x10 || b == 0x14 || b == 0x15) {
+                    goto illegal_op;
+                }
+            } else if (sse_op_table6[b].ext_mask & VEX_ONLY) {
+                goto illegal_op;
+            }
+
+            if (sse_fn_epp == SSE_SPECIAL && (s->prefix & PREFIX_VEX)
+                && b != 0x2a) {
+                /* vbroadcastss and vmaskmov only take a memory operand
+                   (the register forms are AVX2) */
+                if (mod == 3) {
+                    goto illegal_op;
+                }
+                gen_lea_modrm(env, s, modrm);
+                op1_offset = offsetof(CPUX86State,xmm_regs[reg]);
+                tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
+                tcg_gen_addi_ptr(cpu_ptr1, cpu_env,
+                                 offsetof(CPUX86State,xmm_regs[vex_reg(s)]));
+                switch (b) {
+                case 0x18: /* vbroadcastss */
+                    tcg_gen_qemu_ld_i32(cpu_tmp2_i32, cpu_A0,
+                                        s->mem_index, MO_LEUL);
+                    tcg_gen_gvec_dup_i32(MO_32, op1_offset, 16, 16,
+                                         cpu_tmp2_i32);
+                    break;
+                case 0x2c: /* vmaskmovps xmm, xmm, m128 */
+                    gen_helper_vmaskmovps_ld_xmm(cpu_env, cpu_ptr0, cpu_ptr1,
+                                                 cpu_A0);
+                    break;
+                case 0x2d: /* vmaskmovpd xmm, xmm, m128 */
+                    gen_helper_vmaskmovpd_ld_xmm(cpu_env, cpu_ptr0, cpu_ptr1,
+                                                 cpu_A0);
+                    break;
+                case 0x2e: /* vmaskmovps m128, xmm, xmm */
+                    gen_helper_vmaskmovps_st_xmm(cpu_env, cpu_ptr0, cpu_ptr1,
+                                                 cpu_A0);
+                    break;
+                case 0x2f: /* vmaskmovpd m128, xmm, xmm */
+                    gen_helper_vmaskmovpd_st_xmm(cpu_env, cpu_ptr0, cpu_ptr1,
+                                                 cpu_A0);
+                    break;
+                default:
+                    goto unknown_op;
+                }
+                break;
+            }
 
             if (b1) {
                 op1_offset = offsetof(CPUX86State,xmm_regs[reg]);
@@ -3688,6 +3917,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     case 0x20: case 0x30: /* pmovsxbw, pmovzxbw */
                     case 0x23: case 0x33: /* pmovsxwd, pmovzxwd */
                     case 0x25: case 0x35: /* pmovsxdq, pmovzxdq */
+                    case 0x13:            /* vcvtph2ps */
                         gen_ldq_env_A0(s, op2_offset +
                                         offsetof(ZMMReg, ZMM_Q(0)));
                         break;
@@ -3724,12 +3954,16 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             if (sse_fn_epp == SSE_SPECIAL) {
                 goto unknown_op;
             }
+            /* ptest and vtestps/pd have no vvvv operand */
+            if (b != 0x17 && b != 0x0e && b != 0x0f) {
+                gen_vex_src1(s, reg, &op2_offset);
+            }
 
             tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(cpu_ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, cpu_ptr0, cpu_ptr1);
 
-            if (b == 0x17) {
+            if (b == 0x17 || b == 0x0e || b == 0x0f) {
                 set_cc_op(s, CC_OP_EFLAGS);
             }
             break;
@@ -4114,6 +4348,15 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             }
             if (!(s->cpuid_ext_features & sse_op_table7[b].ext_mask))
                 goto illegal_op;
+            if (s->prefix & PREFIX_VEX) {
+                /* vroundss/sd are scalar and ignore VEX.L */
+                if (!b1 || (s->vex_l && b != 0x0a && b != 0x0b)
+                    || !(s->cpuid_ext_features & CPUID_EXT_AVX)) {
+                    goto illegal_op;
+                }
+            } else if (sse_op_table7[b].ext_mask & VEX_ONLY) {
+                goto illegal_op;
+            }
 
             s->rip_offset = 1;
 
@@ -4182,6 +4425,21 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                                            s->mem_index, MO_LEUL);
                     }
                     break;
+                case 0x1d: /* vcvtps2ph */
+                    tcg_gen_addi_ptr(cpu_ptr0, cpu_env,
+                                     offsetof(CPUX86State,xmm_t0));
+                    tcg_gen_addi_ptr(cpu_ptr1, cpu_env,
+                                     offsetof(CPUX86State,xmm_regs[reg]));
+                    gen_helper_cvtps2ph_xmm(cpu_env, cpu_ptr0, cpu_ptr1,
+                                            tcg_const_i32(val));
+                    if (mod == 3) {
+                        gen_op_movo(offsetof(CPUX86State,xmm_regs[rm]),
+                                    offsetof(CPUX86State,xmm_t0));
+                    } else {
+                        gen_stq_env_A0(s, offsetof(CPUX86State,
+                                                   xmm_t0.ZMM_Q(0)));
+                    }
+                    break;
                 case 0x20: /* pinsrb */
                     if (mod == 3) {
                         gen_op_mov_v_reg(MO_32, cpu_T0, rm);
@@ -4189,6 +4447,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                         tcg_gen_qemu_ld_tl(cpu_T0, cpu_A0,
                                            s->mem_index, MO_UB);
                     }
+                    gen_vex_src1(s, reg, NULL);
                     tcg_gen_st8_tl(cpu_T0, cpu_env, offsetof(CPUX86State,
                                             xmm_regs[reg].ZMM_B(val & 15)));
                     break;
@@ -4201,6 +4460,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                         tcg_gen_qemu_ld_i32(cpu_tmp2_i32, cpu_A0,
                                             s->mem_index, MO_LEUL);
                     }
+                    gen_vex_src1(s, reg, NULL);
                     tcg_gen_st_i32(cpu_tmp2_i32, cpu_env,
                                     offsetof(CPUX86State,xmm_regs[reg]
                                             .ZMM_L((val >> 4) & 3)));
@@ -4229,6 +4489,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                             tcg_gen_qemu_ld_i32(cpu_tmp2_i32, cpu_A0,
                                                 s->mem_index, MO_LEUL);
                         }
+                        gen_vex_src1(s, reg, NULL);
                         tcg_gen_st_i32(cpu_tmp2_i32, cpu_env,
                                         offsetof(CPUX86State,
                                                 xmm_regs[reg].ZMM_L(val & 3)));
@@ -4240,6 +4501,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                             tcg_gen_qemu_ld_i64(cpu_tmp1_i64, cpu_A0,
                                                 s->mem_index, MO_LEQ);
                         }
+                        gen_vex_src1(s, reg, NULL);
                         tcg_gen_st_i64(cpu_tmp1_i64, cpu_env,
                                         offsetof(CPUX86State,
                                                 xmm_regs[reg].ZMM_Q(val & 1)));
@@ -4280,6 +4542,15 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     /* The helper must use entire 64-bit gp registers */
                     val |= 1 << 8;
                 }
+            } else if (b == 0x04 || b == 0x05) {
+                /* vpermilps/pd only have the rm source */
+            } else if (b >= 0x4a && b <= 0x4c) {
+                /* vblendvps/pd, vpblendvb: the helper reads vvvv and the
+                   selector register from imm8[7:4] itself */
+                val = (val >> 4) & (CODE64(s) ? 15 : 7);
+                val = (val << 4) | vex_reg(s);
+            } else {
+                gen_vex_src1(s, reg, &op2_offset);
             }
 
             tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
@@ -4395,6 +4666,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                 op2_offset = offsetof(CPUX86State,fpregs[rm].mmx);
             }
         }
+        if (is_xmm && b != 0x2e && b != 0x2f && b != 0xf7) {
+            gen_vex_src1(s, reg, &op2_offset);
+        }
         switch(b) {
         case 0x0f: /* 3DNow! data insns */
             val = x86_ldub_code(env, s);
@@ -4444,6 +4718,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             sse_fn_eppt(cpu_env, cpu_ptr0, cpu_ptr1, cpu_A0);
             break;
         default:
+            if (is_xmm && gen_sse_gvec(b, op1_offset, op2_offset)) {
+                break;
+            }
             tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(cpu_ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, cpu_ptr0, cpu_ptr1);
@@ -4567,7 +4844,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             rex_r = (~vex2 >> 4) & 8;
             if (b == 0xc5) {
                 vex3 = vex2;
-                b = x86_ldub_code(env, s);
+                b = x86_ldub_code(env, s) | 0x100;
             } else {
 #ifdef TARGET_X86_64
                 s->rex_x = (~vex2 >> 3) & 8;
@@ -0,0 +1,483 @@
+/*
+ * QTest testcase for the Aeolia xHCI controllers
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qemu/bswap.h"
+#include "libqos/libqos-pc.h"
+#include "libqos/pci-pc.h"
+
+#define AXHCI_DEVFN         QPCI_DEVFN(0x14, 7)
+#define AXHCI_HC_COUNT      3
+
+/* Registers */
+#define XHCI_CAPLENGTH      0x00
+#define XHCI_HCSPARAMS1     0x04
+#define XHCI_DBOFF          0x14
+#define XHCI_RTSOFF         0x18
+
+#define XHCI_USBCMD         0x00
+#define XHCI_USBCMD_RS      (1 << 0)
+#define XHCI_USBCMD_HCRST   (1 << 1)
+#define XHCI_USBSTS         0x04
+#define XHCI_USBSTS_HCH     (1 << 0)
+#define XHCI_USBSTS_CNR     (1 << 11)
+#define XHCI_CRCR           0x18
+#define XHCI_DCBAAP         0x30
+#define XHCI_CONFIG         0x38
+#define XHCI_PORTSC(n)      (0x400 + 0x10 * (n))
+#define XHCI_PORTSC_CCS     (1 << 0)
+#define XHCI_PORTSC_PED     (1 << 1)
+#define XHCI_PORTSC_PR      (1 << 4)
+#define XHCI_PORTSC_PP      (1 << 9)
+#define XHCI_PORTSC_SPEED(v) (((v) >> 10) & 0xF)
+#define XHCI_PORTSC_CHANGE  (0x7F << 17)
+
+#define XHCI_ERSTSZ         0x28
+#define XHCI_ERSTBA         0x30
+#define XHCI_ERDP           0x38
+#define XHCI_ERDP_EHB       (1 << 3)
+
+/* TRBs */
+#define TRB_C               (1 << 0)
+#define TRB_LK_TC           (1 << 1)
+#define TRB_ISP             (1 << 2)
+#define TRB_IOC             (1 << 5)
+#define TRB_IDT             (1 << 6)
+#define TRB_TYPE(t)         ((t) << 10)
+#define TRB_GET_TYPE(c)     (((c) >> 10) & 0x3F)
+#define TRB_GET_SLOT(c)     ((c) >> 24)
+#define TRB_GET_CC(s)       ((s) >> 24)
+#define TRB_SETUP_DIR_IN    (1 << 16)
+
+#define TR_NORMAL           1
+#define TR_SETUP            2
+#define TR_STATUS           4
+#define TR_LINK             6
+#define CR_ENABLE_SLOT      9
+#define CR_ADDRESS_DEVICE   11
+#define CR_CONFIGURE_EP     12
+#define ER_TRANSFER         32
+#define ER_COMMAND_COMPLETE 33
+
+#define CC_SUCCESS          1
+#define CC_SHORT_PACKET     13
+
+#define RING_SIZE           256
+#define CTX_SIZE            32
+
+/* usb-storage endpoints, as device context indexes */
+#define DCI_CONTROL         1
+#define DCI_BULK_IN         3
+#define DCI_BULK_OUT        4
+
+/* Bulk-only transport */
+#define CBW_SIGNATURE       0x43425355
+#define CSW_SIGNATURE       0x53425355
+#define CBW_SIZE            31
+#define CSW_SIZE            13
+
+#define BENCH_XFER_SIZE     (1 * 1024 * 1024)
+#define BENCH_TOTAL_SIZE    (64 * 1024 * 1024)
+#define BENCH_TRB_SIZE      (64 * 1024)
+
+typedef struct XHCITRB {
+    uint64_t parameter;
+    uint32_t status;
+    uint32_t control;
+} XHCITRB;
+
+typedef struct TestRing {
+    uint64_t base;
+    uint32_t index;
+    bool cycle;
+} TestRing;
+
+typedef struct TestXHCI {
+    QOSState *qs;
+    QPCIDevice *dev;
+    QPCIBar bar;
+    uint64_t oper;
+    uint64_t runtime;
+    uint64_t doorbell;
+    uint32_t maxports;
+    uint64_t dcbaa;
+    TestRing cmd;
+    TestRing event;
+    TestRing ep[DCI_BULK_OUT + 1];
+    uint32_t slot;
+    uint32_t port;
+    uint32_t tag;
+} TestXHCI;
+
+static uint32_t xhci_readl(TestXHCI *x, uint64_t off)
+{
+    return qpci_io_readl(x->dev, x->bar, off);
+}
+
+static void xhci_writel(TestXHCI *x, uint64_t off, uint32_t value)
+{
+    qpci_io_writel(x->dev, x->bar, off, value);
+}
+
+/* 64-bit registers are latched when the high half is written */
+static void xhci_writeq(TestXHCI *x, uint64_t off, uint64_t value)
+{
+    xhci_writel(x, off, value);
+    xhci_writel(x, off + 4, value >> 32);
+}
+
+static void ring_init(TestXHCI *x, TestRing *ring)
+{
+    ring->base = guest_alloc(x->qs->alloc, RING_SIZE * sizeof(XHCITRB));
+    qmemset(ring->base, 0, RING_SIZE * sizeof(XHCITRB));
+    ring->index = 0;
+    ring->cycle = true;
+}
+
+static void ring_write(TestRing *ring, uint32_t index, uint64_t parameter,
+                       uint32_t status, uint32_t control)
+{
+    XHCITRB trb;
+
+    trb.parameter = cpu_to_le64(parameter);
+    trb.status = cpu_to_le32(status);
+    trb.control = cpu_to_le32(control | (ring->cycle ? TRB_C : 0));
+    memwrite(ring->base + index * sizeof(trb), &trb, sizeof(trb));
+}
+
+static void ring_push(TestRing *ring, uint64_t parameter,
+                      uint32_t status, uint32_t control)
+{
+    if (ring->index == RING_SIZE - 1) {
+        ring_write(ring, ring->index, ring->base, 0,
+                   TRB_TYPE(TR_LINK) | TRB_LK_TC);
+        ring->index = 0;
+        ring->cycle = !ring->cycle;
+    }
+    ring_write(ring, ring->index++, parameter, status, control);
+}
+
+static void xhci_wait_event(TestXHCI *x, uint32_t type, XHCITRB *trb)
+{
+    TestRing *ring = &x->event;
+    uint64_t addr;
+    uint32_t control;
+    int i;
+
+    for (i = 0; i < 10000000; i++) {
+        addr = ring->base + ring->index * sizeof(*trb);
+        memread(addr, trb, sizeof(*trb));
+        control = le32_to_cpu(trb->control);
+        if ((control & TRB_C) != ring->cycle) {
+            continue;
+        }
+        if (++ring->index == RING_SIZE) {
+            ring->index = 0;
+            ring->cycle = !ring->cycle;
+        }
+        addr = ring->base + ring->index * sizeof(*trb);
+        xhci_writeq(x, x->runtime + XHCI_ERDP, addr | XHCI_ERDP_EHB);
+        if (TRB_GET_TYPE(control) == type) {
+            trb->status = le32_to_cpu(trb->status);
+            trb->control = control;
+            return;
+        }
+    }
+    g_assert_not_reached();
+}
+
+static uint32_t xhci_command(TestXHCI *x, uint64_t parameter, uint32_t control)
+{
+    XHCITRB ev;
+
+    ring_push(&x->cmd, parameter, 0, control);
+    xhci_writel(x, x->doorbell, 0);
+    xhci_wait_event(x, ER_COMMAND_COMPLETE, &ev);
+    g_assert_cmpuint(TRB_GET_CC(ev.status), ==, CC_SUCCESS);
+    return ev.control;
+}
+
+static uint32_t xhci_transfer_wait(TestXHCI *x)
+{
+    XHCITRB ev;
+    uint32_t cc;
+
+    xhci_wait_event(x, ER_TRANSFER, &ev);
+    cc = TRB_GET_CC(ev.status);
+    g_assert(cc == CC_SUCCESS || cc == CC_SHORT_PACKET);
+    return ev.status & 0xFFFFFF;
+}
+
+static void xhci_init(TestXHCI *x, QOSState *qs, int hc)
+{
+    uint64_t erst;
+    uint32_t caplength;
+
+    x->qs = qs;
+    x->dev = qpci_device_find(qs->pcibus, AXHCI_DEVFN);
+    g_assert(x->dev != NULL);
+    qpci_device_enable(x->dev);
+    x->bar = qpci_iomap(x->dev, hc * 2, NULL);
+
+    caplength = xhci_readl(x, XHCI_CAPLENGTH) & 0xFF;
+    g_assert_cmphex(xhci_readl(x, XHCI_CAPLENGTH) >> 16, ==, 0x100);
+    x->oper = caplength;
+    x->runtime = xhci_readl(x, XHCI_RTSOFF) & ~0x1F;
+    x->doorbell = xhci_readl(x, XHCI_DBOFF) & ~0x3;
+    x->maxports = xhci_readl(x, XHCI_HCSPARAMS1) >> 24;
+
+    xhci_writel(x, x->oper + XHCI_USBCMD, XHCI_USBCMD_HCRST);
+    while (xhci_readl(x, x->oper + XHCI_USBCMD) & XHCI_USBCMD_HCRST ||
+           xhci_readl(x, x->oper + XHCI_USBSTS) & XHCI_USBSTS_CNR) {
+    }
+    xhci_writel(x, x->oper + XHCI_CONFIG, 1);
+
+    x->dcbaa = guest_alloc(qs->alloc, 0x800);
+    qmemset(x->dcbaa, 0, 0x800);
+    xhci_writeq(x, x->oper + XHCI_DCBAAP, x->dcbaa);
+
+    ring_init(x, &x->cmd);
+    xhci_writeq(x, x->oper + XHCI_CRCR, x->cmd.base | TRB_C);
+
+    ring_init(x, &x->event);
+    erst = guest_alloc(qs->alloc, 16);
+    writeq(erst, x->event.base);
+    writel(erst + 8, RING_SIZE);
+    xhci_writel(x, x->runtime + XHCI_ERSTSZ, 1);
+    xhci_writeq(x, x->runtime + XHCI_ERDP, x->event.base);
+    xhci_writeq(x, x->runtime + XHCI_ERSTBA, erst);
+
+    xhci_writel(x, x->oper + XHCI_USBCMD, XHCI_USBCMD_RS);
+    g_assert(!(xhci_readl(x, x->oper + XHCI_USBSTS) & XHCI_USBSTS_HCH));
+}
+
+/* Resets the first port with a device attached, returning its speed */
+static uint32_t xhci_port_reset(TestXHCI *x)
+{
+    uint32_t portsc;
+    uint32_t i;
+
+    for (i = 0; i < x->maxports; i++) {
+        portsc = xhci_readl(x, x->oper + XHCI_PORTSC(i));
+        if (portsc & XHCI_PORTSC_CCS) {
+            break;
+        }
+    }
+    g_assert_cmpuint(i, <, x->maxports);
+    x->port = i + 1;
+
+    xhci_writel(x, x->oper + XHCI_PORTSC(i),
+                XHCI_PORTSC_PP | XHCI_PORTSC_PR | XHCI_PORTSC_CHANGE);
+    do {
+        portsc = xhci_readl(x, x->oper + XHCI_PORTSC(i));
+    } while (portsc & XHCI_PORTSC_PR);
+    g_assert(portsc & XHCI_PORTSC_PED);
+    xhci_writel(x, x->oper + XHCI_PORTSC(i),
+                XHCI_PORTSC_PP | XHCI_PORTSC_CHANGE);
+    return XHCI_PORTSC_SPEED(portsc);
+}
+
+static void xhci_ep_context(TestXHCI *x, uint64_t ictx, uint32_t dci,
+                            uint32_t type, uint32_t mps)
+{
+    uint64_t ep = ictx + CTX_SIZE * (dci + 1);
+
+    ring_init(x, &x->ep[dci]);
+    writel(ep + 0x04, (mps << 16) | (type << 3) | (3 << 1));
+    writeq(ep + 0x08, x->ep[dci].base | 1);
+    writel(ep + 0x10, dci == DCI_CONTROL ? 8 : 0x1000);
+}
+
+static void xhci_control(TestXHCI *x, uint8_t type, uint8_t request,
+                         uint16_t value)
+{
+    TestRing *ring = &x->ep[DCI_CONTROL];
+
+    ring_push(ring, type | (request << 8) | ((uint32_t)value << 16), 8,
+              TRB_TYPE(TR_SETUP) | TRB_IDT);
+    ring_push(ring, 0, 0, TRB_TYPE(TR_STATUS) | TRB_SETUP_DIR_IN | TRB_IOC);
+    xhci_writel(x, x->doorbell + 4 * x->slot, DCI_CONTROL);
+    xhci_transfer_wait(x);
+}
+
+static void xhci_setup_storage(TestXHCI *x)
+{
+    uint64_t ictx, octx;
+    uint32_t speed, mps, control;
+
+    speed = xhci_port_reset(x);
+    mps = (speed >= 4) ? 1024 : 512;
+
+    control = xhci_command(x, 0, TRB_TYPE(CR_ENABLE_SLOT));
+    x->slot = TRB_GET_SLOT(control);
+    g_assert_cmpuint(x->slot, >, 0);
+
+    octx = guest_alloc(x->qs->alloc, CTX_SIZE * 32);
+    qmemset(octx, 0, CTX_SIZE * 32);
+    writeq(x->dcbaa + 8 * x->slot, octx);
+
+    ictx = guest_alloc(x->qs->alloc, CTX_SIZE * 33);
+    qmemset(ictx, 0, CTX_SIZE * 33);
+    writel(ictx + 0x04, (1 << 0) | (1 << DCI_CONTROL));
+    writel(ictx + CTX_SIZE + 0x00, (1 << 27) | (speed << 20));
+    writel(ictx + CTX_SIZE + 0x04, x->port << 16);
+    xhci_ep_context(x, ictx, DCI_CONTROL, 4, speed >= 4 ? 512 : 64);
+    xhci_command(x, ictx, TRB_TYPE(CR_ADDRESS_DEVICE) | (x->slot << 24));
+
+    /* SET_CONFIGURATION(1) */
+    xhci_control(x, 0x00, 0x09, 1);
+
+    qmemset(ictx, 0, CTX_SIZE * 33);
+    writel(ictx + 0x04, (1 << 0) | (1 << DCI_BULK_IN) | (1 << DCI_BULK_OUT));
+    writel(ictx + CTX_SIZE + 0x00, (DCI_BULK_OUT << 27) | (speed << 20));
+    writel(ictx + CTX_SIZE + 0x04, x->port << 16);
+    xhci_ep_context(x, ictx, DCI_BULK_IN, 6, mps);
+    xhci_ep_context(x, ictx, DCI_BULK_OUT, 2, mps);
+    xhci_command(x, ictx, TRB_TYPE(CR_CONFIGURE_EP) | (x->slot << 24));
+}
+
+/* Runs a SCSI command through bulk-only transport, returning its status */
+static uint8_t xhci_storage_command(TestXHCI *x, const uint8_t *cdb,
+                                    uint8_t cdb_len, uint64_t data,
+                                    uint32_t data_len)
+{
+    uint8_t cbw[CBW_SIZE], csw[CSW_SIZE];
+    uint64_t cbw_addr, csw_addr;
+    uint32_t chunk, offset;
+
+    memset(cbw, 0, sizeof(cbw));
+    stl_le_p(&cbw[0], CBW_SIGNATURE);
+    stl_le_p(&cbw[4], ++x->tag);
+    stl_le_p(&cbw[8], data_len);
+    cbw[12] = 0x80;
+    cbw[14] = cdb_len;
+    memcpy(&cbw[15], cdb, cdb_len);
+
+    cbw_addr = guest_alloc(x->qs->alloc, CBW_SIZE + CSW_SIZE);
+    csw_addr = cbw_addr + CBW_SIZE;
+    memwrite(cbw_addr, cbw, sizeof(cbw));
+    ring_push(&x->ep[DCI_BULK_OUT], cbw_addr, CBW_SIZE,
+              TRB_TYPE(TR_NORMAL) | TRB_IOC);
+    xhci_writel(x, x->doorbell + 4 * x->slot, DCI_BULK_OUT);
+    xhci_transfer_wait(x);
+
+    for (offset = 0; offset < data_len; offset += chunk) {
+        chunk = MIN(BENCH_TRB_SIZE, data_len - offset);
+        ring_push(&x->ep[DCI_BULK_IN], data + offset, chunk,
+                  TRB_TYPE(TR_NORMAL) | TRB_ISP |
+                  (offset + chunk == data_len ? TRB_IOC : 0));
+    }
+    ring_push(&x->ep[DCI_BULK_IN], csw_addr, CSW_SIZE,
+              TRB_TYPE(TR_NORMAL) | TRB_IOC);
+    xhci_writel(x, x->doorbell + 4 * x->slot, DCI_BULK_IN);
+    if (data_len) {
+        xhci_transfer_wait(x);
+    }
+    xhci_transfer_wait(x);
+
+    memread(csw_addr, csw, sizeof(csw));
+    guest_free(x->qs->alloc, cbw_addr);
+    g_assert_cmphex(ldl_le_p(&csw[0]), ==, CSW_SIGNATURE);
+    g_assert_cmpuint(ldl_le_p(&csw[4]), ==, x->tag);
+    return csw[12];
+}
+
+/* The ps4 machine always has 8 GB of RAM. It is backed by a sparse file,
+ * so that the test does not depend on the host overcommit policy. The disk
+ * goes on the bus of the first controller, usb-bus.0. */
+static QOSState *axhci_boot(void)
+{
+    QOSState *qs;
+
+    qs = qtest_pc_boot("-machine ps4 "
+                       "-object memory-backend-file,id=ram,size=8G,"
+                       "mem-path=%s,share=on "
+                       "-numa node,memdev=ram "
+                       "-drive if=none,id=usbdisk,format=raw,"
+                       "file=null-co://,file.size=128M "
+                       "-device usb-storage,bus=usb-bus.0,drive=usbdisk",
+                       g_get_tmp_dir());
+    global_qtest = qs->qts;
+    return qs;
+}
+
+static void test_axhci_controllers(void)
+{
+    QOSState *qs = axhci_boot();
+    TestXHCI x;
+    int hc;
+
+    for (hc = 0; hc < AXHCI_HC_COUNT; hc++) {
+        memset(&x, 0, sizeof(x));
+        xhci_init(&x, qs, hc);
+        g_free(x.dev);
+    }
+    qtest_shutdown(qs);
+}
+
+static void test_axhci_storage_bulk(void)
+{
+    QOSState *qs = axhci_boot();
+    const uint8_t tur[6] = { 0x00 };
+    uint8_t read10[10] = { 0x28 };
+    uint32_t lba, blocks;
+    uint64_t data, done;
+    gint64 start, elapsed;
+    TestXHCI x;
+
+    memset(&x, 0, sizeof(x));
+    xhci_init(&x, qs, 0);
+    xhci_setup_storage(&x);
+
+    /* The first command reports the power-on unit attention */
+    if (xhci_storage_command(&x, tur, sizeof(tur), 0, 0)) {
+        g_assert_cmpuint(xhci_storage_command(&x, tur, sizeof(tur), 0, 0),
+                         ==, 0);
+    }
+
+    data = guest_alloc(qs->alloc, BENCH_XFER_SIZE);
+    blocks = BENCH_XFER_SIZE / 512;
+    start = g_get_monotonic_time();
+    for (done = 0, lba = 0; done < BENCH_TOTAL_SIZE; done += BENCH_XFER_SIZE) {
+        stl_be_p(&read10[2], lba);
+        stw_be_p(&read10[7], blocks);
+        g_assert_cmpuint(xhci_storage_command(&x, read10, sizeof(read10),
+                                              data, BENCH_XFER_SIZE), ==, 0);
+        lba += blocks;
+    }
+    elapsed = MAX(g_get_monotonic_time() - start, 1);
+    g_test_message("usb-storage bulk read: %" PRIu64 " MiB in %" PRId64
+                   " us, %.1f MiB/s", done >> 20, elapsed,
+                   (double)done / (1 << 20) / (elapsed / 1e6));
+
+    guest_free(qs->alloc, data);
+    g_free(x.dev);
+    qtest_shutdown(qs);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/aeolia-xhci/controllers", test_axhci_controllers);
+    qtest_add_func("/aeolia-xhci/usb-storage/bulk", test_axhci_storage_bulk);
+
+    return g_test_run();
+}
@@ -0,0 +1,228 @@
+/*
+ * Guest AES-XTS and memcpy throughput, for the AES-NI and SSE paths of
+ * the x86 translator. The XTS code is checked against a known answer
+ * first, and the round trip is checked for consistency.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <cpuid.h>
+#include <wmmintrin.h>
+
+#define BUF_SIZE    (4 << 20)
+#define SECTOR_SIZE 512
+#define LOOPS       16
+
+static __m128i key_enc[11], key_dec[11], key_tweak[11];
+
+#define EXPAND(k, i, rcon) \
+    k[i] = aes_expand(k[i - 1], _mm_aeskeygenassist_si128(k[i - 1], rcon))
+
+static __m128i aes_expand(__m128i k, __m128i t)
+{
+    t = _mm_shuffle_epi32(t, 0xff);
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    return _mm_xor_si128(k, t);
+}
+
+static void aes_key_setup(__m128i *k, const uint8_t *key)
+{
+    k[0] = _mm_loadu_si128((const __m128i *)key);
+    EXPAND(k, 1, 0x01);
+    EXPAND(k, 2, 0x02);
+    EXPAND(k, 3, 0x04);
+    EXPAND(k, 4, 0x08);
+    EXPAND(k, 5, 0x10);
+    EXPAND(k, 6, 0x20);
+    EXPAND(k, 7, 0x40);
+    EXPAND(k, 8, 0x80);
+    EXPAND(k, 9, 0x1b);
+    EXPAND(k, 10, 0x36);
+}
+
+static __m128i aes_enc(const __m128i *k, __m128i x)
+{
+    int i;
+
+    x = _mm_xor_si128(x, k[0]);
+    for (i = 1; i < 10; i++) {
+        x = _mm_aesenc_si128(x, k[i]);
+    }
+    return _mm_aesenclast_si128(x, k[10]);
+}
+
+static __m128i aes_dec(const __m128i *k, __m128i x)
+{
+    int i;
+
+    x = _mm_xor_si128(x, k[10]);
+    for (i = 9; i > 0; i--) {
+        x = _mm_aesdec_si128(x, k[i]);
+    }
+    return _mm_aesdeclast_si128(x, k[0]);
+}
+
+/* Multiply the tweak by x in GF(2^128) */
+static __m128i xts_next(__m128i t)
+{
+    __m128i carry = _mm_shuffle_epi32(_mm_srai_epi32(t, 31), 0x93);
+
+    carry = _mm_and_si128(carry, _mm_set_epi32(1, 1, 1, 0x87));
+    return _mm_xor_si128(_mm_slli_epi32(t, 1), carry);
+}
+
+static void xts_crypt(uint8_t *dst, const uint8_t *src, size_t len, int enc)
+{
+    __m128i t, x;
+    size_t sector, i;
+
+    for (sector = 0; sector < len / SECTOR_SIZE; sector++) {
+        t = aes_enc(key_tweak, _mm_set_epi64x(0, sector));
+        for (i = 0; i < SECTOR_SIZE; i += 16) {
+            x = _mm_loadu_si128((const __m128i *)(src + i));
+            x = _mm_xor_si128(x, t);
+            x = enc ? aes_enc(key_enc, x) : aes_dec(key_dec, x);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(x, t));
+            t = xts_next(t);
+        }
+        src += SECTOR_SIZE;
+        dst += SECTOR_SIZE;
+    }
+}
+
+static void xts_setkey(const uint8_t *key)
+{
+    int i;
+
+    aes_key_setup(key_enc, key);
+    aes_key_setup(key_tweak, key + 16);
+    key_dec[0] = key_enc[0];
+    key_dec[10] = key_enc[10];
+    for (i = 1; i < 10; i++) {
+        key_dec[i] = _mm_aesimc_si128(key_enc[i]);
+    }
+}
+
+/* IEEE 1619-2007 XTS-AES-128 test vector 4: one 512-byte data unit */
+static const uint8_t kat_key[32] = {
+    0x27, 0x18, 0x28, 0x18, 0x28, 0x45, 0x90, 0x45,
+    0x23, 0x53, 0x60, 0x28, 0x74, 0x71, 0x35, 0x26,
+    0x31, 0x41, 0x59, 0x26, 0x53, 0x58, 0x97, 0x93,
+    0x23, 0x84, 0x62, 0x64, 0x33, 0x83, 0x27, 0x95,
+};
+
+static const char kat_ctx[] =
+    "27a7479befa1d476489f308cd4cfa6e2a96e4bbe3208ff25287dd3819616e89c"
+    "c78cf7f5e543445f8333d8fa7f56000005279fa5d8b5e4ad40e736ddb4d35412"
+    "328063fd2aab53e5ea1e0a9f332500a5df9487d07a5c92cc512c8866c7e860ce"
+    "93fdf166a24912b422976146ae20ce846bb7dc9ba94a767aaef20c0d61ad0265"
+    "5ea92dc4c4e41a8952c651d33174be51a10c421110e6d81588ede82103a252d8"
+    "a750e8768defffed9122810aaeb99f9172af82b604dc4b8e51bcb08235a6f434"
+    "1332e4ca60482a4ba1a03b3e65008fc5da76b70bf1690db4eae29c5f1badd03c"
+    "5ccf2a55d705ddcd86d449511ceb7ec30bf12b1fa35b913f9f747a8afd1b130e"
+    "94bff94effd01a91735ca1726acd0b197c4e5b03393697e126826fb6bbde8ecc"
+    "1e08298516e2c9ed03ff3c1b7860f6de76d4cecd94c8119855ef5297ca67e9f3"
+    "e7ff72b1e99785ca0a7e7720c5b36dc6d72cac9574c8cbbc2f801e23e56fd344"
+    "b07f22154beba0f08ce8891e643ed995c94d9a69c9f1b5f499027a78572aeebd"
+    "74d20cc39881c213ee770b1010e4bea718846977ae119f7a023ab58cca0ad752"
+    "afe656bb3c17256a9f6e9bf19fdd5a38fc82bbe872c5539edb609ef4f79c203e"
+    "bb140f2e583cb2ad15b4aa5b655016a8449277dbd477ef2c8d6c017db738b18d"
+    "eb4a427d1923ce3ff262735779a418f20a282df920147beabe421ee5319d0568";
+
+static int xts_kat(void)
+{
+    uint8_t ptx[SECTOR_SIZE], ctx[SECTOR_SIZE], buf[SECTOR_SIZE];
+    unsigned int v;
+    int i;
+
+    for (i = 0; i < SECTOR_SIZE; i++) {
+        ptx[i] = i;
+        sscanf(&kat_ctx[i * 2], "%2x", &v);
+        ctx[i] = v;
+    }
+
+    xts_setkey(kat_key);
+    xts_crypt(buf, ptx, SECTOR_SIZE, 1);
+    if (memcmp(buf, ctx, SECTOR_SIZE)) {
+        printf("aes-xts encrypt known answer mismatch\n");
+        return 1;
+    }
+    xts_crypt(buf, ctx, SECTOR_SIZE, 0);
+    if (memcmp(buf, ptx, SECTOR_SIZE)) {
+        printf("aes-xts decrypt known answer mismatch\n");
+        return 1;
+    }
+    return 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double t)
+{
+    printf("%-16s %8.1f MB/s\n", name,
+           (double)BUF_SIZE * LOOPS / t / (1 << 20));
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint8_t key[32] = "0123456789abcdefFEDCBA9876543210";
+    unsigned int a, b, c, d;
+    uint8_t *src, *dst, *chk;
+    double t;
+    int i;
+
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_AES)) {
+        printf("AES-NI not available, skipped\n");
+        return 0;
+    }
+
+    if (xts_kat()) {
+        return 1;
+    }
+
+    src = malloc(BUF_SIZE);
+    dst = malloc(BUF_SIZE);
+    chk = malloc(BUF_SIZE);
+    for (i = 0; i < BUF_SIZE; i++) {
+        src[i] = i * 7 + (i >> 9);
+    }
+
+    xts_setkey(key);
+
+    t = now();
+    for (i = 0; i < LOOPS; i++) {
+        memcpy(dst, src, BUF_SIZE);
+    }
+    report("memcpy", now() - t);
+
+    t = now();
+    for (i = 0; i < LOOPS; i++) {
+        xts_crypt(dst, src, BUF_SIZE, 1);
+    }
+    report("aes-xts encrypt", now() - t);
+
+    t = now();
+    for (i = 0; i < LOOPS; i++) {
+        xts_crypt(chk, dst, BUF_SIZE, 0);
+    }
+    report("aes-xts decrypt", now() - t);
+
+    if (memcmp(src, chk, BUF_SIZE)) {
+        printf("aes-xts round trip mismatch\n");
+        return 1;
+    }
+    return 0;
+}
@@ -35,6 +35,7 @@
 #endif
 //#define LINUX_VM86_IOPL_FIX
 //#define TEST_P4_FLAGS
+/* TEST_AVX needs a host and a CPU model with AVX and F16C */
 #ifdef __SSE__
 #define TEST_SSE
 #define TEST_CMOV  1
@@ -2665,6 +2666,315 @@ void test_sse(void)
     asm volatile ("emms");
 }
 
+#ifdef TEST_AVX
+
+/* VEX.128 forms: all three operand aliasings and a memory source */
+#define VEX_OP(op)\
+{\
+    XMMReg r1, r2, r3;\
+    asm volatile ("v" #op " %2, %1, %0" : "=x" (r.dq) : "x" (a.dq), "x" (b.dq));\
+    r1 = b;\
+    asm volatile ("v" #op " %0, %1, %0" : "+x" (r1.dq) : "x" (a.dq));\
+    r2 = a;\
+    asm volatile ("v" #op " %1, %0, %0" : "+x" (r2.dq) : "x" (b.dq));\
+    asm volatile ("v" #op " %2, %1, %0" : "=x" (r3.dq) : "x" (a.dq), "m" (b));\
+    printf("%-9s: a=" FMT64X "" FMT64X " b=" FMT64X "" FMT64X " r=" FMT64X "" FMT64X "\n",\
+           "v" #op,\
+           a.q[1], a.q[0],\
+           b.q[1], b.q[0],\
+           r.q[1], r.q[0]);\
+    printf("%-9s: d=b " FMT64X "" FMT64X " d=a " FMT64X "" FMT64X " m " FMT64X "" FMT64X "\n",\
+           "",\
+           r1.q[1], r1.q[0],\
+           r2.q[1], r2.q[0],\
+           r3.q[1], r3.q[0]);\
+}
+
+#define VEX_OP2(op)\
+{\
+    int i;\
+    for(i=0;i<2;i++) {\
+    a.q[0] = test_values[2*i][0];\
+    a.q[1] = test_values[2*i][1];\
+    b.q[0] = test_values[2*i+1][0];\
+    b.q[1] = test_values[2*i+1][1];\
+    VEX_OP(op);\
+    }\
+}
+
+#define VEX_MOV(op, src)\
+{\
+    asm volatile (#op " %2, %1, %0" : "=x" (r.dq) : "x" (a.dq), src (b));\
+    printf("%-9s: a=" FMT64X "" FMT64X " b=" FMT64X "" FMT64X " r=" FMT64X "" FMT64X "\n",\
+           #op,\
+           a.q[1], a.q[0],\
+           b.q[1], b.q[0],\
+           r.q[1], r.q[0]);\
+}
+
+#define VEX_INSR(op, ib, val)\
+{\
+    asm volatile (#op " $" #ib ", %2, %1, %0" : "=x" (r.dq) : "x" (a.dq), "r" (val));\
+    printf("%-9s: a=" FMT64X "" FMT64X " ib=%02x r=" FMT64X "" FMT64X "\n",\
+           #op,\
+           a.q[1], a.q[0],\
+           ib,\
+           r.q[1], r.q[0]);\
+}
+
+#define VEX_SHUF(op, ib)\
+{\
+    asm volatile (#op " $" #ib ", %2, %1, %0" : "=x" (r.dq) : "x" (a.dq), "x" (b.dq));\
+    printf("%-9s: a=" FMT64X "" FMT64X " b=" FMT64X "" FMT64X " ib=%02x r=" FMT64X "" FMT64X "\n",\
+           #op,\
+           a.q[1], a.q[0],\
+           b.q[1], b.q[0],\
+           ib,\
+           r.q[1], r.q[0]);\
+}
+
+#define VEX_PERMIL(op, ib)\
+{\
+    asm volatile (#op " $" #ib ", %1, %0" : "=x" (r.dq) : "x" (a.dq));\
+    printf("%-9s: a=" FMT64X "" FMT64X " ib=%02x r=" FMT64X "" FMT64X "\n",\
+           #op,\
+           a.q[1], a.q[0],\
+           ib,\
+           r.q[1], r.q[0]);\
+}
+
+/* The selector is also the destination */
+#define VEX_BLENDV(op)\
+{\
+    XMMReg m = b;\
+    asm volatile (#op " %0, %2, %1, %0" : "+x" (m.dq) : "x" (a.dq), "x" (c.dq));\
+    asm volatile (#op " %3, %2, %1, %0" : "=x" (r.dq) : "x" (a.dq), "x" (c.dq), "x" (b.dq));\
+    printf("%-9s: a=" FMT64X "" FMT64X " b=" FMT64X "" FMT64X " r=" FMT64X "" FMT64X " " FMT64X "" FMT64X "\n",\
+           #op,\
+           a.q[1], a.q[0],\
+           c.q[1], c.q[0],\
+           r.q[1], r.q[0],\
+           m.q[1], m.q[0]);\
+}
+
+#define VEX_TEST(op)\
+{\
+    long eflags;\
+    asm volatile (#op " %2, %1\n"\
+                  "pushf\n"\
+                  "pop %0\n"\
+                  : "=r" (eflags) : "x" (a.dq), "x" (b.dq));\
+    printf("%-9s: a=" FMT64X "" FMT64X " b=" FMT64X "" FMT64X " CC=%04lx\n",\
+           #op,\
+           a.q[1], a.q[0],\
+           b.q[1], b.q[0],\
+           eflags & (CC_Z | CC_C));\
+}
+
+static const uint32_t f16c_values[12] = {
+    0x3f801000, /* 1 + 2^-11: halfway between two halves */
+    0x3f803000, /* 1 + 3 * 2^-11: halfway, odd */
+    0xbf801001, /* -(1 + 2^-11) - ulp */
+    0x477ff000, /* 65520: rounds to infinity or 65504 */
+    0x33000001, /* just above half of the smallest denormal */
+    0x38800000, /* 2^-14: smallest normal */
+    0x7fc12345, /* qNaN with payload */
+    0xff800000, /* -infinity */
+    0x7f812345, /* sNaN */
+    0x387fc000, /* exact denormal */
+    0xc77fe000, /* -65504: largest finite */
+    0x00000001, /* single denormal */
+};
+
+static const uint16_t f16c_halves[8] = {
+    0x3c00, 0x7bff, 0x0001, 0x83ff, 0xfc00, 0x7e01, 0x7c01, 0x8000,
+};
+
+#define VEX_CVTPS2PH(ib)\
+{\
+    asm volatile ("vcvtps2ph $" #ib ", %1, %0" : "=x" (r.dq) : "x" (a.dq));\
+    printf("%-9s: a=" FMT64X "" FMT64X " ib=%02x r=" FMT64X "" FMT64X "\n",\
+           "vcvtps2ph",\
+           a.q[1], a.q[0],\
+           ib,\
+           r.q[1], r.q[0]);\
+}
+
+void test_avx(void)
+{
+    XMMReg r, a, b, c;
+    uint32_t mxcsr, mxcsr_ru = 0x5f80;
+    uint64_t q = 0x0123456789abcdefULL;
+    uint8_t *page;
+    int i;
+
+    /* arithmetic, logic and shuffles with a separate first source */
+    VEX_OP2(addps);
+    VEX_OP2(subps);
+    VEX_OP2(subpd);
+    VEX_OP2(andnps);
+    VEX_OP2(unpcklps);
+    VEX_OP2(unpckhpd);
+    VEX_OP2(paddb);
+    VEX_OP2(psubw);
+    VEX_OP2(psubq);
+    VEX_OP2(pandn);
+    VEX_OP2(pxor);
+    VEX_OP2(pshufb);
+    VEX_OP2(packsswb);
+    VEX_OP2(pmaddwd);
+    VEX_OP2(psllw);
+    VEX_OP2(pcmpgtd);
+    VEX_OP2(aesenc);
+    VEX_OP2(aesdeclast);
+    VEX_OP2(permilps);
+    VEX_OP2(permilpd);
+
+    /* scalar ops merge the upper bits of the first source */
+    a.s[0] = 1.5;
+    a.s[1] = 2.5;
+    a.s[2] = -3.5;
+    a.s[3] = 4.5;
+    b.s[0] = 0.25;
+    b.s[1] = 8;
+    b.s[2] = 9;
+    b.s[3] = 10;
+    VEX_OP(addss);
+    VEX_OP(subss);
+    VEX_OP(divss);
+    VEX_OP(maxss);
+    VEX_OP(cvtss2sd);
+    VEX_OP(sqrtss);
+
+    /* VEX.L is ignored by scalar instructions */
+    asm volatile ("vmovaps %1, %%xmm1\n"
+                  "vmovaps %2, %%xmm2\n"
+                  ".byte 0xc5, 0xf6, 0x5c, 0xc2\n" /* vsubss %xmm2, %xmm1, %xmm0 */
+                  "vmovaps %%xmm0, %0\n"
+                  : "=x" (r.dq) : "x" (a.dq), "x" (b.dq)
+                  : "xmm0", "xmm1", "xmm2");
+    printf("%-9s: a=" FMT64X "" FMT64X " b=" FMT64X "" FMT64X " r=" FMT64X "" FMT64X "\n",
+           "vsubss.l1", a.q[1], a.q[0], b.q[1], b.q[0], r.q[1], r.q[0]);
+
+    a.d[0] = 1.5;
+    a.d[1] = -2.5;
+    b.d[0] = 0.75;
+    b.d[1] = 8;
+    VEX_OP(subsd);
+    VEX_OP(sqrtsd);
+    VEX_OP(cvtsd2ss);
+
+    /* moves that merge */
+    a.q[0] = test_values[0][0];
+    a.q[1] = test_values[0][1];
+    b.q[0] = test_values[1][0];
+    b.q[1] = test_values[1][1];
+    VEX_MOV(vmovss, "x");
+    VEX_MOV(vmovsd, "x");
+    VEX_MOV(vmovhlps, "x");
+    VEX_MOV(vmovlhps, "x");
+    VEX_MOV(vmovlps, "m");
+    VEX_MOV(vmovhps, "m");
+    VEX_MOV(vmovlpd, "m");
+    VEX_MOV(vmovhpd, "m");
+    asm volatile ("vmovss %1, %0" : "=x" (r.dq) : "m" (b.l[1]));
+    printf("%-9s: r=" FMT64X "" FMT64X "\n", "vmovss", r.q[1], r.q[0]);
+    asm volatile ("vmovsd %1, %0" : "=x" (r.dq) : "m" (b.q[1]));
+    printf("%-9s: r=" FMT64X "" FMT64X "\n", "vmovsd", r.q[1], r.q[0]);
+
+    /* inserts */
+    VEX_INSR(vpinsrb, 13, 0x1a5);
+    VEX_INSR(vpinsrw, 6, 0x12345);
+    VEX_INSR(vpinsrd, 2, 0x89abcdef);
+    VEX_INSR(vpinsrq, 1, q);
+    VEX_SHUF(vinsertps, 0x00);
+    VEX_SHUF(vinsertps, 0x9a);
+    VEX_SHUF(vinsertps, 0x65);
+    VEX_SHUF(vshufps, 0x1b);
+    VEX_SHUF(vpalignr, 5);
+    VEX_SHUF(vpblendw, 0xa5);
+
+    /* permutes, broadcasts, tests and blends */
+    VEX_PERMIL(vpermilps, 0x1b);
+    VEX_PERMIL(vpermilps, 0xe4);
+    VEX_PERMIL(vpermilpd, 0x01);
+    VEX_PERMIL(vpermilpd, 0x02);
+    asm volatile ("vbroadcastss %1, %0" : "=x" (r.dq) : "m" (a.l[3]));
+    printf("%-9s: r=" FMT64X "" FMT64X "\n", "vbroadcastss", r.q[1], r.q[0]);
+    for (i = 0; i < 4; i++) {
+        a.q[0] = test_values[i][0];
+        a.q[1] = test_values[i][1];
+        b.q[0] = test_values[3 - i][0];
+        b.q[1] = test_values[(i + 1) & 3][1];
+        VEX_TEST(vtestps);
+        VEX_TEST(vtestpd);
+    }
+    a.q[0] = test_values[0][0];
+    a.q[1] = test_values[0][1];
+    b.q[0] = test_values[1][0];
+    b.q[1] = test_values[1][1];
+    c.q[0] = test_values[2][0];
+    c.q[1] = test_values[2][1];
+    VEX_BLENDV(vblendvps);
+    VEX_BLENDV(vblendvpd);
+    VEX_BLENDV(vpblendvb);
+
+    /* masked loads and stores do not touch masked-out elements, even
+       on an unmapped page */
+    page = mmap(NULL, 8192, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    munmap(page + 4096, 4096);
+    memset(page, 0x5a, 4096);
+    b.l[0] = 0x80000000;
+    b.l[1] = 0xffffffff;
+    b.l[2] = 0x7fffffff;
+    b.l[3] = 0x7fffffff;
+    asm volatile ("vmaskmovps %2, %1, %0"
+                  : "=x" (r.dq) : "x" (b.dq), "m" (*(XMMReg *)(page + 4088)));
+    printf("%-9s: r=" FMT64X "" FMT64X "\n", "vmaskmovps", r.q[1], r.q[0]);
+    asm volatile ("vmaskmovpd %2, %1, %0"
+                  : "=x" (r.dq) : "x" (b.dq), "m" (*(XMMReg *)(page + 4088)));
+    printf("%-9s: r=" FMT64X "" FMT64X "\n", "vmaskmovpd", r.q[1], r.q[0]);
+    b.l[1] = 0;
+    asm volatile ("vmaskmovps %2, %1, %0"
+                  : "=m" (*(XMMReg *)(page + 4088)) : "x" (b.dq), "x" (a.dq));
+    printf("%-9s: m=" FMT64X "\n", "vmaskmovps", *(uint64_t *)(page + 4088));
+    b.l[1] = 0x80000000;
+    asm volatile ("vmaskmovpd %2, %1, %0"
+                  : "=m" (*(XMMReg *)(page + 4080)) : "x" (b.dq), "x" (c.dq));
+    printf("%-9s: m=" FMT64X "" FMT64X "\n", "vmaskmovpd",
+           *(uint64_t *)(page + 4088), *(uint64_t *)(page + 4080));
+    munmap(page, 4096);
+
+    /* half precision conversions in every rounding mode */
+    for (i = 0; i < 3; i++) {
+        memcpy(&a, &f16c_values[i * 4], 16);
+        VEX_CVTPS2PH(0);
+        VEX_CVTPS2PH(1);
+        VEX_CVTPS2PH(2);
+        VEX_CVTPS2PH(3);
+        VEX_CVTPS2PH(4);
+        asm volatile ("stmxcsr %0\n"
+                      "ldmxcsr %2\n"
+                      "vcvtps2ph $4, %1, %1\n"
+                      "ldmxcsr %0\n"
+                      : "=m" (mxcsr), "+x" (a.dq) : "m" (mxcsr_ru));
+        printf("%-9s: ib=04 mxcsr=%04x r=" FMT64X "" FMT64X "\n",
+               "vcvtps2ph", mxcsr_ru, a.q[1], a.q[0]);
+    }
+    for (i = 0; i < 2; i++) {
+        memcpy(&a.q[0], &f16c_halves[i * 4], 8);
+        asm volatile ("vcvtph2ps %1, %0" : "=x" (r.dq) : "x" (a.dq));
+        printf("%-9s: a=" FMT64X " r=" FMT64X "" FMT64X "\n",
+               "vcvtph2ps", a.q[0], r.q[1], r.q[0]);
+        asm volatile ("vcvtph2ps %1, %0" : "=x" (r.dq) : "m" (a.q[0]));
+        printf("%-9s: a=" FMT64X " r=" FMT64X "" FMT64X "\n",
+               "vcvtph2ps", a.q[0], r.q[1], r.q[0]);
+    }
+}
+
+#endif
+
 #endif
 
 #define TEST_CONV_RAX(op)\
@@ -2760,6 +3070,9 @@ int main(int argc, char **argv)
 #ifdef TEST_SSE
     test_sse();
     test_fxsave();
+#endif
+#ifdef TEST_AVX
+    test_avx();
 #endif
     return 0;
 }
@@ -0,0 +1,248 @@
+/*
+ * PM4 command stream replay tests
+ *
+ * Copyright (c) 2018 Alexandro Sanchez Bach
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "contrib/ps4-pm4-replay/replay.h"
+#include "hw/ps4/liverpool/lvp_gc_gfx_capture.h"
+#include "hw/ps4/liverpool/pm4.h"
+
+#define PM4_TYPE3(itop, dwords) \
+    (((uint32_t)PM4_PACKET_TYPE3 << 30) | (((dwords) - 2) << 16) | ((itop) << 8))
+
+/* The IB lives at IB_VA and writes TEST_VALUE at DATA_VA + DATA_OFFSET */
+#define TEST_VMID    1
+#define IB_VA        0x10000ULL
+#define IB_PA        0x200000ULL
+#define DATA_VA      0x20000ULL
+#define DATA_PA      0x300000ULL
+#define DATA_OFFSET  0x40
+#define DATA_FILL    0xAA
+#define TEST_VALUE   0xC0FFEE
+
+static gart_state_t gart;
+static gfx_state_t *gfx;
+
+static FILE *capture_new(void)
+{
+    pm4_capture_header_t header;
+    FILE *file;
+
+    file = tmpfile();
+    g_assert(file);
+    header.magic = cpu_to_le32(PM4_CAPTURE_MAGIC);
+    header.version = cpu_to_le32(PM4_CAPTURE_VERSION);
+    g_assert_cmpint(fwrite(&header, sizeof(header), 1, file), ==, 1);
+    return file;
+}
+
+static void capture_record(FILE *file,
+    uint32_t type, const void *payload, uint32_t size)
+{
+    pm4_capture_record_t record;
+
+    record.type = cpu_to_le32(type);
+    record.size = cpu_to_le32(size);
+    g_assert_cmpint(fwrite(&record, sizeof(record), 1, file), ==, 1);
+    if (size) {
+        g_assert_cmpint(fwrite(payload, size, 1, file), ==, 1);
+    }
+}
+
+static void capture_map(FILE *file, uint64_t va, uint64_t pa)
+{
+    pm4_capture_map_t map;
+
+    map.vmid = cpu_to_le32(TEST_VMID);
+    map.reserved = 0;
+    map.va = cpu_to_le64(va);
+    map.pa = cpu_to_le64(pa);
+    capture_record(file, PM4_CAPTURE_RECORD_MAP, &map, sizeof(map));
+}
+
+static void capture_page(FILE *file, uint64_t pa, const void *data, size_t size)
+{
+    pm4_capture_page_t *page = g_new0(pm4_capture_page_t, 1);
+
+    page->pa = cpu_to_le64(pa);
+    memcpy(page->data, data, size);
+    capture_record(file, PM4_CAPTURE_RECORD_PAGE, page, sizeof(*page));
+    g_free(page);
+}
+
+/* Packet records with a count independent from the payload, if forced */
+static void capture_packet(FILE *file,
+    const uint32_t *data, uint32_t dwords, uint32_t count)
+{
+    pm4_capture_packet_t *packet;
+    size_t size;
+    uint32_t i;
+
+    size = sizeof(*packet) + dwords * sizeof(uint32_t);
+    packet = g_malloc0(size);
+    packet->index = 0;
+    packet->count = cpu_to_le32(count);
+    for (i = 0; i < dwords; i++) {
+        packet->data[i] = cpu_to_le32(data[i]);
+    }
+    capture_record(file, PM4_CAPTURE_RECORD_PACKET, packet, size);
+    g_free(packet);
+}
+
+static int capture_replay(FILE *file, ReplayStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    replay_gfx_reset(gfx);
+    fflush(file);
+    return replay_pass(file, gfx, stats);
+}
+
+static uint32_t replay_read_dword(uint64_t va)
+{
+    uint32_t value;
+
+    replay_memory_read(TEST_VMID, va, &value, sizeof(value));
+    return le32_to_cpu(value);
+}
+
+/* Top-level INDIRECT_BUFFER running a WRITE_DATA to memory */
+static void test_replay_ib(void)
+{
+    const uint32_t ib[] = {
+        PM4_TYPE3(PM4_IT_WRITE_DATA, 5),
+        PM4_WRITE_DATA_DST_SEL_MEM_ASYNC << 8,
+        (uint32_t)(DATA_VA + DATA_OFFSET),
+        (uint32_t)((DATA_VA + DATA_OFFSET) >> 32),
+        TEST_VALUE,
+    };
+    const uint32_t packet[] = {
+        PM4_TYPE3(PM4_IT_INDIRECT_BUFFER, 4),
+        (uint32_t)IB_VA,
+        (uint32_t)(IB_VA >> 32),
+        ARRAY_SIZE(ib) | (TEST_VMID << 24),
+    };
+    uint8_t data[PM4_CAPTURE_PAGE_SIZE];
+    uint32_t ib_le[ARRAY_SIZE(ib)];
+    ReplayStats stats;
+    FILE *file;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ib); i++) {
+        ib_le[i] = cpu_to_le32(ib[i]);
+    }
+    memset(data, DATA_FILL, sizeof(data));
+
+    /* Memory records come first, as the CP emits them */
+    file = capture_new();
+    capture_map(file, IB_VA, IB_PA);
+    capture_page(file, IB_PA, ib_le, sizeof(ib_le));
+    capture_map(file, DATA_VA, DATA_PA);
+    capture_page(file, DATA_PA, data, sizeof(data));
+    capture_packet(file, packet, ARRAY_SIZE(packet), ARRAY_SIZE(packet));
+
+    g_assert_cmpint(capture_replay(file, &stats), ==, 0);
+    g_assert_cmpint(stats.maps, ==, 2);
+    g_assert_cmpint(stats.pages, ==, 2);
+    g_assert_cmpint(stats.packets, ==, 1);
+    g_assert_cmphex(replay_read_dword(DATA_VA + DATA_OFFSET), ==, TEST_VALUE);
+    g_assert_cmphex(replay_read_dword(DATA_VA + DATA_OFFSET - 4), ==,
+                    0xAAAAAAAA);
+    g_assert_cmphex(replay_read_dword(DATA_VA + DATA_OFFSET + 4), ==,
+                    0xAAAAAAAA);
+
+    /* Every pass starts over from the captured memory */
+    g_assert_cmpint(capture_replay(file, &stats), ==, 0);
+    g_assert_cmphex(replay_read_dword(DATA_VA + DATA_OFFSET), ==, TEST_VALUE);
+    fclose(file);
+}
+
+/* Packet count larger than the record payload */
+static void test_replay_packet_overflow(void)
+{
+    const uint32_t packet[] = { PM4_TYPE3(PM4_IT_NOP, 2), 0 };
+    ReplayStats stats;
+    FILE *file;
+
+    file = capture_new();
+    capture_packet(file, packet, ARRAY_SIZE(packet), 0x100000);
+    g_assert_cmpint(capture_replay(file, &stats), <, 0);
+    g_assert_cmpint(stats.packets, ==, 0);
+    fclose(file);
+}
+
+/* Packet header claiming more dwords than the record holds */
+static void test_replay_packet_truncated(void)
+{
+    const uint32_t packet[] = { PM4_TYPE3(PM4_IT_NOP, 0x100), 0 };
+    ReplayStats stats;
+    FILE *file;
+
+    file = capture_new();
+    capture_packet(file, packet, ARRAY_SIZE(packet), ARRAY_SIZE(packet));
+    g_assert_cmpint(capture_replay(file, &stats), <, 0);
+    g_assert_cmpint(stats.packets, ==, 0);
+    fclose(file);
+}
+
+/* Known records that are too large or too small for their type */
+static void test_replay_record_size(void)
+{
+    uint8_t payload[16] = { 0 };
+    pm4_capture_record_t record;
+    ReplayStats stats;
+    FILE *file;
+
+    file = capture_new();
+    record.type = cpu_to_le32(PM4_CAPTURE_RECORD_PAGE);
+    record.size = cpu_to_le32(UINT32_MAX);
+    g_assert_cmpint(fwrite(&record, sizeof(record), 1, file), ==, 1);
+    g_assert_cmpint(capture_replay(file, &stats), <, 0);
+    fclose(file);
+
+    file = capture_new();
+    capture_record(file, PM4_CAPTURE_RECORD_PAGE, payload, sizeof(payload));
+    g_assert_cmpint(capture_replay(file, &stats), <, 0);
+    g_assert_cmpint(stats.pages, ==, 0);
+    fclose(file);
+
+    file = capture_new();
+    capture_record(file, PM4_CAPTURE_RECORD_MAP, payload, 8);
+    g_assert_cmpint(capture_replay(file, &stats), <, 0);
+    g_assert_cmpint(stats.maps, ==, 0);
+    fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    gfx = replay_gfx_new(&gart);
+
+    g_test_add_func("/pm4-replay/ib", test_replay_ib);
+    g_test_add_func("/pm4-replay/packet-overflow",
+                    test_replay_packet_overflow);
+    g_test_add_func("/pm4-replay/packet-truncated",
+                    test_replay_packet_truncated);
+    g_test_add_func("/pm4-replay/record-size", test_replay_record_size);
+
+    ret = g_test_run();
+    replay_gfx_free(gfx);
+    return ret;
+}
@@ -23,6 +23,7 @@
  */
 
 #include "orbital-logs.h"
+#include "orbital-ring.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
@@ -34,12 +35,27 @@
 #include "imgui/imgui_impl_sdl.h"
 #include "imgui/imgui_impl_vulkan.h"
 
+// Bytes buffered between producers and the UI thread
+#define ORBITAL_LOGS_RING_SIZE  (256 * 1024)
+
 struct orbital_logs_t
 {
     ImGuiTextBuffer     Buf;
     ImGuiTextFilter     Filter;
     ImVector<int>       LineOffsets;
     bool                ScrollToBottom;
+    size_t              MaxSize;
+    orbital_ring_t      Ring;
+
+    orbital_logs_t(size_t history) : ScrollToBottom(false), MaxSize(history)
+    {
+        orbital_ring_init(&Ring, ORBITAL_LOGS_RING_SIZE);
+    }
+
+    ~orbital_logs_t()
+    {
+        orbital_ring_destroy(&Ring);
+    }
 
     void Clear()
     {
@@ -47,31 +63,71 @@ struct orbital_logs_t
         LineOffsets.clear();
     }
 
-    void Log(const char* fmt, ...) IM_FMTARGS(2)
+    // Producer side, may be called from any (single) thread
+    void Log(const char* data, size_t len)
+    {
+        orbital_ring_write(&Ring, data, len);
+    }
+
+    // Consumer side, only called from the UI thread
+    void Append(const char* data, int len)
     {
+        ImVector<char>& chars = Buf.Buf;
         int old_size = Buf.size();
-        va_list args;
-        va_start(args, fmt);
-        Buf.appendfv(fmt, args);
-        va_end(args);
-        for (int new_size = Buf.size(); old_size < new_size; old_size++)
-            if (Buf[old_size] == '\n')
-                LineOffsets.push_back(old_size);
+        chars.resize(old_size + len + 1);
+        memcpy(&chars[old_size], data, len);
+        chars[old_size + len] = 0;
+        for (int i = old_size; i < old_size + len; i++)
+            if (chars[i] == '\n')
+                LineOffsets.push_back(i);
         ScrollToBottom = true;
     }
 
-    void Log(char c)
+    void Trim()
     {
         ImVector<char>& chars = Buf.Buf;
-        if (c == '\n')
-            LineOffsets.push_back(Buf.size());
-        chars[chars.Size - 1] = c;
-        chars.push_back(0);
-        ScrollToBottom = true;
+        int excess, cut, lines;
+
+        if ((size_t)Buf.size() <= MaxSize)
+            return;
+        // Drop whole lines down to 3/4 of the history, so that a steady
+        // stream of output does not cause a memmove every frame
+        excess = Buf.size() - (int)(MaxSize - MaxSize / 4);
+        for (lines = 0; lines < LineOffsets.Size; lines++)
+            if (LineOffsets[lines] >= excess)
+                break;
+        if (lines < LineOffsets.Size)
+            cut = LineOffsets[lines++] + 1;
+        else
+            cut = excess;
+        chars.erase(chars.begin(), chars.begin() + cut);
+        if (lines > 0)
+            LineOffsets.erase(LineOffsets.begin(), LineOffsets.begin() + lines);
+        for (int i = 0; i < LineOffsets.Size; i++)
+            LineOffsets[i] -= cut;
+    }
+
+    void Flush()
+    {
+        char chunk[4096];
+        size_t len, budget;
+
+        // Bounded, so that a flood of output cannot stall the frame
+        budget = Ring.mask + 1;
+        while (budget > 0) {
+            len = orbital_ring_read(&Ring, chunk, MIN(sizeof(chunk), budget));
+            if (len == 0)
+                break;
+            Append(chunk, (int)len);
+            budget -= len;
+        }
+        Trim();
     }
 
     void Draw(const char* title, bool* p_open = NULL)
     {
+        uint64_t dropped;
+
         ImGui::SetNextWindowSize(ImVec2(500,400), ImGuiCond_FirstUseEver);
         if (!ImGui::Begin(title, p_open)) {
             ImGui::End();
@@ -82,6 +138,9 @@ struct orbital_logs_t
         bool copy = ImGui::Button("Copy");
         ImGui::SameLine();
         Filter.Draw("Filter", -100.0f);
+        dropped = orbital_ring_dropped(&Ring);
+        if (dropped)
+            ImGui::TextDisabled("%" PRIu64 " bytes dropped", dropped);
         ImGui::Separator();
         ImGui::BeginChild("scrolling", ImVec2(0,0), false, ImGuiWindowFlags_HorizontalScrollbar);
         if (copy) ImGui::LogToClipboard();
@@ -109,11 +168,11 @@ struct orbital_logs_t
 
 extern "C" {
 
-struct orbital_logs_t* orbital_logs_create(void)
+struct orbital_logs_t* orbital_logs_create(size_t history)
 {
     struct orbital_logs_t *logs;
-    
-    logs = new orbital_logs_t();
+
+    logs = new orbital_logs_t(MAX(history, 4096));
     return logs;
 }
 
@@ -127,6 +186,11 @@ void orbital_logs_clear(struct orbital_logs_t *logs)
     logs->Clear();
 }
 
+void orbital_logs_flush(struct orbital_logs_t *logs)
+{
+    logs->Flush();
+}
+
 void orbital_logs_draw(struct orbital_logs_t *logs, const char *title, bool* p_open)
 {
     logs->Draw(title, p_open);
@@ -134,17 +198,25 @@ void orbital_logs_draw(struct orbital_logs_t *logs, const char *title, bool* p_o
 
 void orbital_logs_logfmt(struct orbital_logs_t *logs, const char* fmt, ...)
 {
-    return; // TODO
+    char buf[1024];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len > 0)
+        logs->Log(buf, MIN((size_t)len, sizeof(buf) - 1));
 }
 
 void orbital_logs_logstr(struct orbital_logs_t *logs, const char* str)
 {
-    return; // TODO
+    logs->Log(str, strlen(str));
 }
 
 void orbital_logs_logchr(struct orbital_logs_t *logs, char chr)
 {
-    logs->Log(chr);
+    logs->Log(&chr, 1);
 }
 
 } // extern "C"
@@ -32,17 +32,26 @@
 extern "C" {
 #endif
 
+// Default bytes of output kept by a log window
+#define ORBITAL_LOGS_HISTORY  (1 << 20)
+
 struct orbital_logs_t;
 
-struct orbital_logs_t* orbital_logs_create(void);
+struct orbital_logs_t* orbital_logs_create(size_t history);
 
 void orbital_logs_destroy(struct orbital_logs_t *logs);
 
 void orbital_logs_clear(struct orbital_logs_t *logs);
 
+void orbital_logs_flush(struct orbital_logs_t *logs);
+
 void orbital_logs_draw(struct orbital_logs_t *logs, const char *title, bool* p_open);
 
-void orbital_logs_logfmt(struct orbital_logs_t *logs, const char* fmt, ...);
+/*
+ * Producers: these only append to a lock-free ring, which the UI thread
+ * drains once per frame. Output that does not fit is dropped and counted.
+ */
+void orbital_logs_logfmt(struct orbital_logs_t *logs, const char* fmt, ...) GCC_FMT_ATTR(2, 3);
 
 void orbital_logs_logstr(struct orbital_logs_t *logs, const char* str);
 
@@ -0,0 +1,200 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "orbital-memory-view.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_vulkan.h>
+#include <vulkan/vulkan.h>
+
+#define CIMGUI_DEFINE_ENUMS_AND_STRUCTS
+#define IMGUI_IMPL_API
+#include "imgui/imgui.h"
+#include "imgui/imgui_impl_sdl.h"
+#include "imgui/imgui_impl_vulkan.h"
+
+// Guest memory is fetched in pages, and only for the visible rows
+#define ORBITAL_MEMORY_VIEW_PAGE_SIZE   0x1000
+#define ORBITAL_MEMORY_VIEW_PAGES       16
+
+// Rows scrollable at once, moving further requires a new base address
+#define ORBITAL_MEMORY_VIEW_COLUMNS     16
+#define ORBITAL_MEMORY_VIEW_ROWS        0x10000
+
+struct orbital_memory_page_t
+{
+    uint64_t            Addr;
+    int                 Space;
+    bool                Valid;
+    uint64_t            Fetched;    // frame of the last fetch
+    uint64_t            Used;       // frame of the last use
+    uint8_t             Data[ORBITAL_MEMORY_VIEW_PAGE_SIZE];
+};
+
+struct orbital_memory_view_t
+{
+    orbital_memory_id_t Id;
+    int                 Space;
+    uint64_t            Base;
+    char                AddrInput[20];
+    bool                Live;
+    bool                ScrollToTop;
+    uint64_t            Frame;
+    ImVector<orbital_memory_page_t> Pages;
+
+    orbital_memory_view_t(orbital_memory_id_t id) : Id(id), Space(0), Base(0),
+        Live(true), ScrollToTop(false), Frame(0)
+    {
+        AddrInput[0] = '\0';
+        Pages.resize(ORBITAL_MEMORY_VIEW_PAGES);
+        memset(Pages.Data, 0, Pages.Size * sizeof(orbital_memory_page_t));
+    }
+
+    // Pages are refreshed at most once per frame, and never while paused
+    const orbital_memory_page_t& GetPage(uint64_t addr)
+    {
+        orbital_memory_page_t *page, *victim = NULL;
+
+        addr &= ~(uint64_t)(ORBITAL_MEMORY_VIEW_PAGE_SIZE - 1);
+        for (int i = 0; i < Pages.Size; i++) {
+            page = &Pages[i];
+            if (page->Used && page->Addr == addr && page->Space == Space) {
+                if (Live && page->Fetched != Frame)
+                    Fetch(page);
+                page->Used = Frame;
+                return *page;
+            }
+            if (!victim || page->Used < victim->Used)
+                victim = page;
+        }
+        victim->Addr = addr;
+        victim->Space = Space;
+        victim->Used = Frame;
+        Fetch(victim);
+        return *victim;
+    }
+
+    void Fetch(orbital_memory_page_t *page)
+    {
+        page->Valid = orbital_memory_read(Id, page->Space, page->Addr,
+            page->Data, sizeof(page->Data));
+        page->Fetched = Frame;
+    }
+
+    void Invalidate()
+    {
+        for (int i = 0; i < Pages.Size; i++)
+            Pages[i].Used = 0;
+    }
+
+    void DrawRow(uint64_t addr)
+    {
+        const orbital_memory_page_t& page = GetPage(addr);
+        const uint8_t *data;
+        char line[128];
+        int pos, i;
+
+        pos = snprintf(line, sizeof(line), "%016" PRIX64 ": ", addr);
+        data = &page.Data[addr & (ORBITAL_MEMORY_VIEW_PAGE_SIZE - 1)];
+        for (i = 0; i < ORBITAL_MEMORY_VIEW_COLUMNS; i++) {
+            if (page.Valid)
+                pos += snprintf(line + pos, sizeof(line) - pos, "%02X ", data[i]);
+            else
+                pos += snprintf(line + pos, sizeof(line) - pos, "?? ");
+        }
+        line[pos++] = ' ';
+        for (i = 0; i < ORBITAL_MEMORY_VIEW_COLUMNS; i++)
+            line[pos++] = (page.Valid && data[i] >= 0x20 && data[i] < 0x7F) ? data[i] : '.';
+        line[pos] = '\0';
+        ImGui::TextUnformatted(line);
+    }
+
+    void Draw(const char* title, bool* p_open = NULL)
+    {
+        ImGui::SetNextWindowSize(ImVec2(620,400), ImGuiCond_FirstUseEver);
+        if (!ImGui::Begin(title, p_open)) {
+            ImGui::End();
+            return;
+        }
+        Frame++;
+
+        ImGui::PushItemWidth(160);
+        if (ImGui::InputText("Address", AddrInput, sizeof(AddrInput),
+                ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_EnterReturnsTrue)) {
+            Base = strtoull(AddrInput, NULL, 16) & ~(uint64_t)(ORBITAL_MEMORY_VIEW_COLUMNS - 1);
+            ScrollToTop = true;
+        }
+        ImGui::PopItemWidth();
+        if (Id != ORBITAL_MEMORY_GPA) {
+            const char *label = (Id == ORBITAL_MEMORY_GVA) ? "vCPU" :
+                                (Id == ORBITAL_MEMORY_GART) ? "VMID" : "Device ID";
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            if (ImGui::InputInt(label, &Space))
+                Invalidate();
+            ImGui::PopItemWidth();
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Live", &Live);
+        if (!orbital_memory_available(Id)) {
+            ImGui::TextDisabled("Not available on this machine");
+            ImGui::End();
+            return;
+        }
+        ImGui::Separator();
+
+        ImGui::BeginChild("rows", ImVec2(0,0), false, ImGuiWindowFlags_HorizontalScrollbar);
+        if (ScrollToTop)
+            ImGui::SetScrollY(0.0f);
+        ScrollToTop = false;
+        ImGuiListClipper clipper(ORBITAL_MEMORY_VIEW_ROWS);
+        while (clipper.Step())
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+                DrawRow(Base + (uint64_t)i * ORBITAL_MEMORY_VIEW_COLUMNS);
+        ImGui::EndChild();
+        ImGui::End();
+    }
+};
+
+extern "C" {
+
+struct orbital_memory_view_t* orbital_memory_view_create(orbital_memory_id_t id)
+{
+    struct orbital_memory_view_t *view;
+
+    view = new orbital_memory_view_t(id);
+    return view;
+}
+
+void orbital_memory_view_destroy(struct orbital_memory_view_t *view)
+{
+    delete view;
+}
+
+void orbital_memory_view_draw(struct orbital_memory_view_t *view, const char *title, bool* p_open)
+{
+    view->Draw(title, p_open);
+}
+
+} // extern "C"
@@ -0,0 +1,127 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "orbital-memory.h"
+
+#include "exec/address-spaces.h"
+#include "exec/memory.h"
+#include "qemu/atomic.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qom/cpu.h"
+#include "sysemu/hw_accel.h"
+
+#define ORBITAL_MEMORY_PAGE_MASK  (~(uint64_t)0xFFF)
+
+typedef struct orbital_memory_t {
+    orbital_memory_read_t read;
+    void *opaque;
+} orbital_memory_t;
+
+static bool memory_read_gpa(void *opaque, int space,
+    uint64_t addr, void *buf, size_t len);
+static bool memory_read_gva(void *opaque, int space,
+    uint64_t addr, void *buf, size_t len);
+
+static orbital_memory_t memories[ORBITAL_MEMORY_COUNT] = {
+    [ORBITAL_MEMORY_GPA] = { memory_read_gpa, NULL },
+    [ORBITAL_MEMORY_GVA] = { memory_read_gva, NULL },
+};
+
+bool orbital_memory_read_ram(AddressSpace *as, hwaddr addr,
+    void *buf, size_t len)
+{
+    MemoryRegion *mr;
+    hwaddr xlat, l;
+    uint8_t *ptr = buf;
+    bool ok = true;
+
+    rcu_read_lock();
+    while (len > 0) {
+        l = len;
+        mr = address_space_translate(as, addr, &xlat, &l, false);
+        if (!memory_region_is_ram(mr) || memory_region_is_ram_device(mr)) {
+            ok = false;
+            break;
+        }
+        memcpy(ptr, (uint8_t *)memory_region_get_ram_ptr(mr) + xlat, l);
+        ptr += l;
+        addr += l;
+        len -= l;
+    }
+    rcu_read_unlock();
+    return ok;
+}
+
+static bool memory_read_gpa(void *opaque, int space,
+    uint64_t addr, void *buf, size_t len)
+{
+    return orbital_memory_read_ram(&address_space_memory, addr, buf, len);
+}
+
+static bool memory_read_gva(void *opaque, int space,
+    uint64_t addr, void *buf, size_t len)
+{
+    CPUState *cpu;
+    hwaddr phys = -1;
+
+    /* Under KVM the paging registers live in the kernel until synchronized,
+     * and the page walk itself may touch MMIO, so this is done like the
+     * monitor does it: with the BQL held */
+    qemu_mutex_lock_iothread();
+    cpu = qemu_get_cpu(space);
+    if (cpu) {
+        cpu_synchronize_state(cpu);
+        phys = cpu_get_phys_page_debug(cpu, addr & ORBITAL_MEMORY_PAGE_MASK);
+    }
+    qemu_mutex_unlock_iothread();
+    if (phys == -1) {
+        return false;
+    }
+    return orbital_memory_read_ram(cpu->as,
+        phys | (addr & ~ORBITAL_MEMORY_PAGE_MASK), buf, len);
+}
+
+void orbital_memory_register(orbital_memory_id_t id,
+    orbital_memory_read_t read, void *opaque)
+{
+    atomic_set(&memories[id].opaque, opaque);
+    atomic_store_release(&memories[id].read, read);
+}
+
+bool orbital_memory_available(orbital_memory_id_t id)
+{
+    return atomic_load_acquire(&memories[id].read) != NULL;
+}
+
+bool orbital_memory_read(orbital_memory_id_t id, int space,
+    uint64_t addr, void *buf, size_t len)
+{
+    orbital_memory_read_t read = atomic_load_acquire(&memories[id].read);
+
+    if (!read) {
+        return false;
+    }
+    return read(atomic_read(&memories[id].opaque), space, addr, buf, len);
+}
@@ -0,0 +1,70 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef UI_ORBITAL_MEMORY_H_
+#define UI_ORBITAL_MEMORY_H_
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "exec/hwaddr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum orbital_memory_id_t {
+    ORBITAL_MEMORY_GPA,     /* guest physical */
+    ORBITAL_MEMORY_GVA,     /* guest virtual, space is the vCPU index */
+    ORBITAL_MEMORY_GART,    /* GPU virtual, space is the VMID */
+    ORBITAL_MEMORY_IOMMU,   /* device virtual, space is the PCI device ID */
+    ORBITAL_MEMORY_COUNT,
+} orbital_memory_id_t;
+
+/*
+ * Reads @len bytes at @addr, within a single page. Called from the UI
+ * thread without the BQL, so readers must not have side effects on the
+ * guest: tables and data are read with orbital_memory_read_ram, and state
+ * that needs the BQL is only accessed with it taken. Returns false if the
+ * range is not backed by RAM.
+ */
+typedef bool (*orbital_memory_read_t)(void *opaque, int space,
+                                      uint64_t addr, void *buf, size_t len);
+
+void orbital_memory_register(orbital_memory_id_t id,
+    orbital_memory_read_t read, void *opaque);
+
+bool orbital_memory_available(orbital_memory_id_t id);
+
+bool orbital_memory_read(orbital_memory_id_t id, int space,
+    uint64_t addr, void *buf, size_t len);
+
+/* Copies guest RAM without dispatching MMIO, for use by readers */
+bool orbital_memory_read_ram(AddressSpace *as, hwaddr addr,
+    void *buf, size_t len);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // UI_ORBITAL_MEMORY_H_
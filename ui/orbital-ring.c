@@ -0,0 +1,102 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "orbital-ring.h"
+
+#include "qemu/atomic.h"
+#include "qemu/host-utils.h"
+
+void orbital_ring_init(struct orbital_ring_t *ring, uint32_t size)
+{
+    size = pow2ceil(size);
+    ring->buf = g_malloc(size);
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+}
+
+void orbital_ring_destroy(struct orbital_ring_t *ring)
+{
+    g_free(ring->buf);
+    ring->buf = NULL;
+}
+
+size_t orbital_ring_write(struct orbital_ring_t *ring, const void *data, size_t len)
+{
+    uint32_t head, tail, size, offset, chunk;
+
+    head = ring->head;
+    tail = atomic_load_acquire(&ring->tail);
+    size = ring->mask + 1;
+    if (len > size - (head - tail)) {
+        atomic_set__nocheck(&ring->dropped,
+            ring->dropped + len - (size - (head - tail)));
+        len = size - (head - tail);
+    }
+
+    offset = head & ring->mask;
+    chunk = MIN(len, size - offset);
+    memcpy(ring->buf + offset, data, chunk);
+    memcpy(ring->buf, (const uint8_t *)data + chunk, len - chunk);
+    atomic_store_release(&ring->head, head + len);
+    return len;
+}
+
+bool orbital_ring_push(struct orbital_ring_t *ring, const void *data, size_t len)
+{
+    uint32_t head, tail, size;
+
+    head = ring->head;
+    tail = atomic_load_acquire(&ring->tail);
+    size = ring->mask + 1;
+    if (len > size - (head - tail)) {
+        atomic_set__nocheck(&ring->dropped, ring->dropped + len);
+        return false;
+    }
+    orbital_ring_write(ring, data, len);
+    return true;
+}
+
+size_t orbital_ring_read(struct orbital_ring_t *ring, void *data, size_t len)
+{
+    uint32_t head, tail, size, offset, chunk;
+
+    tail = ring->tail;
+    head = atomic_load_acquire(&ring->head);
+    size = ring->mask + 1;
+    len = MIN(len, head - tail);
+
+    offset = tail & ring->mask;
+    chunk = MIN(len, size - offset);
+    memcpy(data, ring->buf + offset, chunk);
+    memcpy((uint8_t *)data + chunk, ring->buf, len - chunk);
+    atomic_store_release(&ring->tail, tail + len);
+    return len;
+}
+
+uint64_t orbital_ring_dropped(struct orbital_ring_t *ring)
+{
+    return atomic_read__nocheck(&ring->dropped);
+}
@@ -0,0 +1,68 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef UI_ORBITAL_RING_H_
+#define UI_ORBITAL_RING_H_
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Single-producer single-consumer byte ring used to hand data from device
+ * threads to the UI thread. The producer never blocks: whatever does not
+ * fit is dropped and accounted for. Producers that may run on several
+ * threads (e.g. vCPUs) must be serialized by the caller, e.g. by the BQL.
+ */
+struct orbital_ring_t {
+    uint8_t *buf;
+    uint32_t mask;
+    /* producer */
+    uint32_t head QEMU_ALIGNED(64);
+    uint64_t dropped;
+    /* consumer */
+    uint32_t tail QEMU_ALIGNED(64);
+};
+
+void orbital_ring_init(struct orbital_ring_t *ring, uint32_t size);
+
+void orbital_ring_destroy(struct orbital_ring_t *ring);
+
+size_t orbital_ring_write(struct orbital_ring_t *ring, const void *data, size_t len);
+
+/* Writes either all of @data or nothing, for rings of fixed-size records */
+bool orbital_ring_push(struct orbital_ring_t *ring, const void *data, size_t len);
+
+size_t orbital_ring_read(struct orbital_ring_t *ring, void *data, size_t len);
+
+uint64_t orbital_ring_dropped(struct orbital_ring_t *ring);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // UI_ORBITAL_RING_H_
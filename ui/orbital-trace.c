@@ -0,0 +1,112 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "orbital-trace.h"
+#include "orbital-ring.h"
+
+#include "qemu/atomic.h"
+
+/* Records buffered between each device and the UI thread */
+#define ORBITAL_TRACE_RING_RECORDS  4096
+
+typedef struct orbital_trace_t {
+    bool enabled;
+    bool initialized;
+    struct orbital_ring_t ring;
+    orbital_trace_opname_t opname;
+    orbital_trace_format_t format;
+} orbital_trace_t;
+
+static orbital_trace_t traces[ORBITAL_TRACE_COUNT];
+
+void orbital_trace_register(orbital_trace_id_t id,
+    orbital_trace_opname_t opname, orbital_trace_format_t format)
+{
+    atomic_set(&traces[id].opname, opname);
+    atomic_set(&traces[id].format, format);
+}
+
+bool orbital_trace_enabled(orbital_trace_id_t id)
+{
+    return atomic_load_acquire(&traces[id].enabled);
+}
+
+void orbital_trace_record(orbital_trace_id_t id,
+    const orbital_trace_record_t *rec)
+{
+    orbital_ring_push(&traces[id].ring, rec, sizeof(*rec));
+}
+
+void orbital_trace_set_enabled(orbital_trace_id_t id, bool enabled)
+{
+    orbital_trace_t *trace = &traces[id];
+
+    /* The ring is kept once created, since producers may still be
+     * writing to it right after tracing is disabled */
+    if (enabled && !trace->initialized) {
+        orbital_ring_init(&trace->ring,
+            ORBITAL_TRACE_RING_RECORDS * sizeof(orbital_trace_record_t));
+        trace->initialized = true;
+    }
+    atomic_store_release(&trace->enabled, enabled);
+}
+
+size_t orbital_trace_drain(orbital_trace_id_t id,
+    orbital_trace_record_t *recs, size_t count)
+{
+    if (!traces[id].initialized) {
+        return 0;
+    }
+    return orbital_ring_read(&traces[id].ring, recs,
+        count * sizeof(*recs)) / sizeof(*recs);
+}
+
+uint64_t orbital_trace_dropped(orbital_trace_id_t id)
+{
+    if (!traces[id].initialized) {
+        return 0;
+    }
+    return orbital_ring_dropped(&traces[id].ring) /
+        sizeof(orbital_trace_record_t);
+}
+
+const char* orbital_trace_opname(orbital_trace_id_t id, uint32_t opcode)
+{
+    orbital_trace_opname_t opname = atomic_read(&traces[id].opname);
+
+    return opname ? opname(opcode) : "?";
+}
+
+void orbital_trace_format(orbital_trace_id_t id,
+    const orbital_trace_record_t *rec, char *buf, size_t size)
+{
+    orbital_trace_format_t format = atomic_read(&traces[id].format);
+
+    if (format) {
+        format(rec, buf, size);
+    } else {
+        snprintf(buf, size, "%08X %08X %08X %08X",
+            rec->data[0], rec->data[1], rec->data[2], rec->data[3]);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef UI_ORBITAL_TRACE_H_
+#define UI_ORBITAL_TRACE_H_
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum orbital_trace_id_t {
+    ORBITAL_TRACE_CP,
+    ORBITAL_TRACE_ICC,
+    ORBITAL_TRACE_SAMU,
+    ORBITAL_TRACE_COUNT,
+} orbital_trace_id_t;
+
+/* Fixed-size record, the meaning of opcode and data is up to each device */
+typedef struct orbital_trace_record_t {
+    uint64_t timestamp;     /* host clock (ns) when the command started */
+    uint32_t duration;      /* in ns */
+    uint32_t opcode;
+    uint32_t data[4];
+} orbital_trace_record_t;
+
+/* Decoders run on the UI thread, and only for records being displayed */
+typedef const char* (*orbital_trace_opname_t)(uint32_t opcode);
+typedef void (*orbital_trace_format_t)(const orbital_trace_record_t *rec,
+                                       char *buf, size_t size);
+
+/* producers */
+void orbital_trace_register(orbital_trace_id_t id,
+    orbital_trace_opname_t opname, orbital_trace_format_t format);
+
+bool orbital_trace_enabled(orbital_trace_id_t id);
+
+void orbital_trace_record(orbital_trace_id_t id,
+    const orbital_trace_record_t *rec);
+
+/* consumer */
+void orbital_trace_set_enabled(orbital_trace_id_t id, bool enabled);
+
+size_t orbital_trace_drain(orbital_trace_id_t id,
+    orbital_trace_record_t *recs, size_t count);
+
+uint64_t orbital_trace_dropped(orbital_trace_id_t id);
+
+const char* orbital_trace_opname(orbital_trace_id_t id, uint32_t opcode);
+
+void orbital_trace_format(orbital_trace_id_t id,
+    const orbital_trace_record_t *rec, char *buf, size_t size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // UI_ORBITAL_TRACE_H_
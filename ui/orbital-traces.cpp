@@ -0,0 +1,314 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "orbital-traces.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_vulkan.h>
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+
+#define CIMGUI_DEFINE_ENUMS_AND_STRUCTS
+#define IMGUI_IMPL_API
+#include "imgui/imgui.h"
+#include "imgui/imgui_impl_sdl.h"
+#include "imgui/imgui_impl_vulkan.h"
+
+// Records kept for the list view
+#define ORBITAL_TRACES_HISTORY  65536
+
+// Latency buckets: 8 linear sub-buckets per power of two, up to 2^32 ns
+#define ORBITAL_TRACES_SUBBUCKETS  8
+#define ORBITAL_TRACES_BUCKETS     240
+
+struct orbital_trace_stats_t
+{
+    uint32_t            Opcode;
+    uint64_t            Count;
+    uint64_t            TotalNs;
+    uint32_t            MaxNs;
+    uint32_t            Buckets[ORBITAL_TRACES_BUCKETS];
+
+    static int Bucket(uint32_t ns)
+    {
+        int e;
+
+        if (ns < ORBITAL_TRACES_SUBBUCKETS)
+            return ns;
+        e = 31 - __builtin_clz(ns);
+        return (e - 2) * ORBITAL_TRACES_SUBBUCKETS + ((ns >> (e - 3)) & 7);
+    }
+
+    // Upper bound of the values falling in @bucket
+    static uint32_t BucketLimit(int bucket)
+    {
+        int e, sub;
+
+        if (bucket < ORBITAL_TRACES_SUBBUCKETS)
+            return bucket;
+        e = bucket / ORBITAL_TRACES_SUBBUCKETS + 2;
+        sub = bucket % ORBITAL_TRACES_SUBBUCKETS;
+        return ((uint64_t)(ORBITAL_TRACES_SUBBUCKETS + sub + 1) << (e - 3)) - 1;
+    }
+
+    void Add(uint32_t ns)
+    {
+        Count++;
+        TotalNs += ns;
+        MaxNs = std::max(MaxNs, ns);
+        Buckets[Bucket(ns)]++;
+    }
+
+    uint32_t Percentile(double p) const
+    {
+        uint64_t target, seen = 0;
+
+        target = std::max<uint64_t>(1, (uint64_t)(Count * p + 0.5));
+        for (int i = 0; i < ORBITAL_TRACES_BUCKETS; i++) {
+            seen += Buckets[i];
+            if (seen >= target)
+                return std::min(BucketLimit(i), MaxNs);
+        }
+        return MaxNs;
+    }
+};
+
+struct orbital_traces_t
+{
+    orbital_trace_id_t  Id;
+    bool                Enabled;
+    bool                Paused;
+    bool                ScrollToBottom;
+    // Circular buffer of the most recent records
+    ImVector<orbital_trace_record_t> History;
+    int                 HistoryStart;
+    int                 HistoryCount;
+    uint64_t            BaseTime;
+    // Sorted by opcode
+    ImVector<orbital_trace_stats_t> Stats;
+    uint64_t            TotalNs;
+
+    orbital_traces_t(orbital_trace_id_t id) : Id(id), Enabled(false),
+        Paused(false), ScrollToBottom(false)
+    {
+        History.resize(ORBITAL_TRACES_HISTORY);
+        Clear();
+    }
+
+    ~orbital_traces_t()
+    {
+        if (Enabled)
+            orbital_trace_set_enabled(Id, false);
+    }
+
+    void Clear()
+    {
+        HistoryStart = 0;
+        HistoryCount = 0;
+        BaseTime = 0;
+        Stats.clear();
+        TotalNs = 0;
+    }
+
+    orbital_trace_stats_t& GetStats(uint32_t opcode)
+    {
+        orbital_trace_stats_t *it;
+
+        it = std::lower_bound(Stats.begin(), Stats.end(), opcode,
+            [](const orbital_trace_stats_t& s, uint32_t op) { return s.Opcode < op; });
+        if (it == Stats.end() || it->Opcode != opcode) {
+            orbital_trace_stats_t stats;
+            memset(&stats, 0, sizeof(stats));
+            stats.Opcode = opcode;
+            it = Stats.insert(it, stats);
+        }
+        return *it;
+    }
+
+    void Add(const orbital_trace_record_t& rec)
+    {
+        if (HistoryCount == 0 && Stats.empty())
+            BaseTime = rec.timestamp;
+        if (HistoryCount < History.Size) {
+            History[(HistoryStart + HistoryCount) % History.Size] = rec;
+            HistoryCount++;
+        } else {
+            History[HistoryStart] = rec;
+            HistoryStart = (HistoryStart + 1) % History.Size;
+        }
+        GetStats(rec.opcode).Add(rec.duration);
+        TotalNs += rec.duration;
+        ScrollToBottom = true;
+    }
+
+    void Update(bool enabled)
+    {
+        orbital_trace_record_t recs[256];
+        size_t count, i;
+
+        if (enabled != Enabled) {
+            orbital_trace_set_enabled(Id, enabled);
+            Enabled = enabled;
+        }
+        // Drain even while paused, so the producers do not start dropping
+        do {
+            count = orbital_trace_drain(Id, recs, ARRAY_SIZE(recs));
+            if (!Paused)
+                for (i = 0; i < count; i++)
+                    Add(recs[i]);
+        } while (count == ARRAY_SIZE(recs));
+    }
+
+    void DrawStats()
+    {
+        ImVector<const orbital_trace_stats_t*> sorted;
+
+        // Most expensive opcodes first
+        for (int i = 0; i < Stats.Size; i++)
+            sorted.push_back(&Stats[i]);
+        std::sort(sorted.begin(), sorted.end(),
+            [](const orbital_trace_stats_t* a, const orbital_trace_stats_t* b) {
+                return a->TotalNs > b->TotalNs; });
+
+        ImGui::Columns(8, "stats");
+        ImGui::Text("Opcode"); ImGui::NextColumn();
+        ImGui::Text("Count"); ImGui::NextColumn();
+        ImGui::Text("Time"); ImGui::NextColumn();
+        ImGui::Text("Avg (us)"); ImGui::NextColumn();
+        ImGui::Text("p50 (us)"); ImGui::NextColumn();
+        ImGui::Text("p90 (us)"); ImGui::NextColumn();
+        ImGui::Text("p99 (us)"); ImGui::NextColumn();
+        ImGui::Text("Max (us)"); ImGui::NextColumn();
+        ImGui::Separator();
+        for (int i = 0; i < sorted.Size; i++) {
+            const orbital_trace_stats_t* s = sorted[i];
+            char overlay[32];
+            float share = TotalNs ? (float)s->TotalNs / TotalNs : 0.0f;
+
+            ImGui::Text("%s (0x%X)", orbital_trace_opname(Id, s->Opcode), s->Opcode);
+            ImGui::NextColumn();
+            ImGui::Text("%" PRIu64, s->Count);
+            ImGui::NextColumn();
+            snprintf(overlay, sizeof(overlay), "%.3f ms", s->TotalNs / 1e6);
+            ImGui::ProgressBar(share, ImVec2(-1, 0), overlay);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", s->TotalNs / 1e3 / s->Count);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", s->Percentile(0.50) / 1e3);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", s->Percentile(0.90) / 1e3);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", s->Percentile(0.99) / 1e3);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", s->MaxNs / 1e3);
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+    }
+
+    void DrawRecords()
+    {
+        char details[256];
+
+        ImGui::BeginChild("records", ImVec2(0,0), false, ImGuiWindowFlags_HorizontalScrollbar);
+        ImGui::Columns(4, "records");
+        // Only the visible rows are decoded
+        ImGuiListClipper clipper(HistoryCount);
+        while (clipper.Step()) {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                const orbital_trace_record_t& rec =
+                    History[(HistoryStart + i) % History.Size];
+                orbital_trace_format(Id, &rec, details, sizeof(details));
+                ImGui::Text("%.6f", (rec.timestamp - BaseTime) / 1e9);
+                ImGui::NextColumn();
+                ImGui::Text("%.3f us", rec.duration / 1e3);
+                ImGui::NextColumn();
+                ImGui::TextUnformatted(orbital_trace_opname(Id, rec.opcode));
+                ImGui::NextColumn();
+                ImGui::TextUnformatted(details);
+                ImGui::NextColumn();
+            }
+        }
+        ImGui::Columns(1);
+        if (ScrollToBottom)
+            ImGui::SetScrollHere(1.0f);
+        ScrollToBottom = false;
+        ImGui::EndChild();
+    }
+
+    void Draw(const char* title, bool* p_open = NULL)
+    {
+        uint64_t dropped;
+
+        ImGui::SetNextWindowSize(ImVec2(700,500), ImGuiCond_FirstUseEver);
+        if (!ImGui::Begin(title, p_open)) {
+            ImGui::End();
+            return;
+        }
+        if (ImGui::Button("Clear")) Clear();
+        ImGui::SameLine();
+        ImGui::Checkbox("Pause", &Paused);
+        ImGui::SameLine();
+        ImGui::Text("%d records, %.3f ms total", HistoryCount, TotalNs / 1e6);
+        dropped = orbital_trace_dropped(Id);
+        if (dropped) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(%" PRIu64 " dropped)", dropped);
+        }
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("Opcodes", ImGuiTreeNodeFlags_DefaultOpen))
+            DrawStats();
+        if (ImGui::CollapsingHeader("Records", ImGuiTreeNodeFlags_DefaultOpen))
+            DrawRecords();
+        ImGui::End();
+    }
+};
+
+extern "C" {
+
+struct orbital_traces_t* orbital_traces_create(orbital_trace_id_t id)
+{
+    struct orbital_traces_t *traces;
+
+    traces = new orbital_traces_t(id);
+    return traces;
+}
+
+void orbital_traces_destroy(struct orbital_traces_t *traces)
+{
+    delete traces;
+}
+
+void orbital_traces_update(struct orbital_traces_t *traces, bool enabled)
+{
+    traces->Update(enabled);
+}
+
+void orbital_traces_draw(struct orbital_traces_t *traces, const char *title, bool* p_open)
+{
+    traces->Draw(title, p_open);
+}
+
+} // extern "C"
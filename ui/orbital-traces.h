@@ -0,0 +1,54 @@
+/*
+ * QEMU-Orbital user interface
+ *
+ * Copyright (c) 2017-2018 Alexandro Sanchez Bach
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef UI_ORBITAL_TRACES_H_
+#define UI_ORBITAL_TRACES_H_
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "orbital-trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct orbital_traces_t;
+
+struct orbital_traces_t* orbital_traces_create(orbital_trace_id_t id);
+
+void orbital_traces_destroy(struct orbital_traces_t *traces);
+
+/*
+ * Enables the producers while @enabled is set, and consumes the records
+ * they wrote since the last frame.
+ */
+void orbital_traces_update(struct orbital_traces_t *traces, bool enabled);
+
+void orbital_traces_draw(struct orbital_traces_t *traces, const char *title, bool* p_open);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // UI_ORBITAL_TRACES_H_
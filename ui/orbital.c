@@ -26,6 +26,7 @@
 #include "qemu-common.h"
 #include "ui/console.h"
 #include "ui/vk-helpers.h"
+#include "qemu/atomic.h"
 #include "qemu/thread.h"
 #include "qemu/error-report.h"
 
@@ -41,6 +42,8 @@
 
 #include "orbital.h"
 #include "orbital-logs.h"
+#include "orbital-memory-view.h"
+#include "orbital-traces.h"
 
 // Configuration
 #define ORBITAL_WIDTH 1280
@@ -56,6 +59,14 @@ typedef struct OrbitalUI {
     /* imgui */
     ImGui_ImplVulkanH_WindowData imgui_WindowData;
     struct orbital_logs_t *logs_uart;
+    size_t log_history;
+    struct orbital_traces_t *traces_cp;
+    struct orbital_traces_t *traces_icc;
+    struct orbital_traces_t *traces_samu;
+    struct orbital_memory_view_t *mem_gpa;
+    struct orbital_memory_view_t *mem_gva;
+    struct orbital_memory_view_t *mem_gart;
+    struct orbital_memory_view_t *mem_iommu;
     bool show_stats;
     bool show_uart;
     bool show_trace_cp;
@@ -72,7 +83,7 @@ OrbitalUI ui;
 
 bool orbital_display_active(void)
 {
-    return ui.active;
+    return atomic_load_acquire(&ui.active);
 }
 
 void orbital_log_uart(int index, char ch)
@@ -239,14 +250,14 @@ static void orbital_display_draw(OrbitalUI *ui)
         igMenuItemBoolPtr("Statistics", "Alt+1", &ui->show_stats, true);
         igMenuItemBoolPtr("UART Output", "Alt+2", &ui->show_uart, true);
         igSeparator();
-        igMenuItemBoolPtr("CP Commands", "Alt+3", &ui->show_trace_cp, false);
-        igMenuItemBoolPtr("ICC Commands", "Alt+4", &ui->show_trace_icc, false);
-        igMenuItemBoolPtr("SAMU Commands", "Alt+5", &ui->show_trace_samu, false);
+        igMenuItemBoolPtr("CP Commands", "Alt+3", &ui->show_trace_cp, true);
+        igMenuItemBoolPtr("ICC Commands", "Alt+4", &ui->show_trace_icc, true);
+        igMenuItemBoolPtr("SAMU Commands", "Alt+5", &ui->show_trace_samu, true);
         igSeparator();
-        igMenuItemBoolPtr("Memory Editor (GPA)", "Ctrl+1", &ui->show_mem_gpa, false);
-        igMenuItemBoolPtr("Memory Editor (GVA)", "Ctrl+2", &ui->show_mem_gva, false);
-        igMenuItemBoolPtr("Memory Editor (GART)", "Ctrl+3", &ui->show_mem_gart, false);
-        igMenuItemBoolPtr("Memory Editor (IOMMU)", "Ctrl+4", &ui->show_mem_iommu, false);
+        igMenuItemBoolPtr("Memory Editor (GPA)", "Ctrl+1", &ui->show_mem_gpa, true);
+        igMenuItemBoolPtr("Memory Editor (GVA)", "Ctrl+2", &ui->show_mem_gva, true);
+        igMenuItemBoolPtr("Memory Editor (GART)", "Ctrl+3", &ui->show_mem_gart, true);
+        igMenuItemBoolPtr("Memory Editor (IOMMU)", "Ctrl+4", &ui->show_mem_iommu, true);
         igEndMenu();
     }
     if (igBeginMenu("Help", true)) {
@@ -266,6 +277,27 @@ static void orbital_display_draw(OrbitalUI *ui)
     if (ui->show_uart) {
         orbital_logs_draw(ui->logs_uart, "UART Output", &ui->show_uart);
     }
+    if (ui->show_trace_cp) {
+        orbital_traces_draw(ui->traces_cp, "CP Commands", &ui->show_trace_cp);
+    }
+    if (ui->show_trace_icc) {
+        orbital_traces_draw(ui->traces_icc, "ICC Commands", &ui->show_trace_icc);
+    }
+    if (ui->show_trace_samu) {
+        orbital_traces_draw(ui->traces_samu, "SAMU Commands", &ui->show_trace_samu);
+    }
+    if (ui->show_mem_gpa) {
+        orbital_memory_view_draw(ui->mem_gpa, "Memory Editor (GPA)", &ui->show_mem_gpa);
+    }
+    if (ui->show_mem_gva) {
+        orbital_memory_view_draw(ui->mem_gva, "Memory Editor (GVA)", &ui->show_mem_gva);
+    }
+    if (ui->show_mem_gart) {
+        orbital_memory_view_draw(ui->mem_gart, "Memory Editor (GART)", &ui->show_mem_gart);
+    }
+    if (ui->show_mem_iommu) {
+        orbital_memory_view_draw(ui->mem_iommu, "Memory Editor (IOMMU)", &ui->show_mem_iommu);
+    }
 }
 
 static void* orbital_display_main(void* arg)
@@ -376,7 +408,14 @@ static void* orbital_display_main(void* arg)
     // Initialization
     float clear_color[4] = {0.45f, 0.55f, 0.60f, 1.00f};
     memcpy(&wd->ClearValue.color.float32[0], &clear_color, 4 * sizeof(float));
-    ui.logs_uart = orbital_logs_create();
+    ui.logs_uart = orbital_logs_create(ui.log_history);
+    ui.traces_cp = orbital_traces_create(ORBITAL_TRACE_CP);
+    ui.traces_icc = orbital_traces_create(ORBITAL_TRACE_ICC);
+    ui.traces_samu = orbital_traces_create(ORBITAL_TRACE_SAMU);
+    ui.mem_gpa = orbital_memory_view_create(ORBITAL_MEMORY_GPA);
+    ui.mem_gva = orbital_memory_view_create(ORBITAL_MEMORY_GVA);
+    ui.mem_gart = orbital_memory_view_create(ORBITAL_MEMORY_GART);
+    ui.mem_iommu = orbital_memory_view_create(ORBITAL_MEMORY_IOMMU);
     ui.show_stats = false;
     ui.show_uart = false;
     ui.show_trace_cp = false;
@@ -387,7 +426,8 @@ static void* orbital_display_main(void* arg)
     ui.show_mem_gart = false;
     ui.show_mem_iommu = false;
     assert(ui.logs_uart);
-    ui.active = true;
+    /* Publish the log windows to the device threads */
+    atomic_store_release(&ui.active, true);
 
     quit = false;
     while (!quit) {
@@ -412,6 +452,11 @@ static void* orbital_display_main(void* arg)
         igNewFrame();
 
         // Window
+        orbital_logs_flush(ui.logs_uart);
+        // Devices are only traced while their window is open
+        orbital_traces_update(ui.traces_cp, ui.show_trace_cp);
+        orbital_traces_update(ui.traces_icc, ui.show_trace_icc);
+        orbital_traces_update(ui.traces_samu, ui.show_trace_samu);
         orbital_display_draw(&ui);
 
         // Rendering
@@ -438,6 +483,10 @@ static void orbital_display_early_init(DisplayOptions *o)
 
 static void orbital_display_init(DisplayState *ds, DisplayOptions *o)
 {
+    ui.log_history = ORBITAL_LOGS_HISTORY;
+    if (o->u.orbital.has_log_history) {
+        ui.log_history = o->u.orbital.log_history;
+    }
     qemu_thread_create(&ui.sdl_thread, "sdl_thread",
         orbital_display_main, NULL, QEMU_THREAD_JOINABLE);
 }
@@ -2200,6 +2200,23 @@ static void parse_display(const char *p)
         }
     } else if (strstart(p, "orbital", &opts)) {
         dpy.type = DISPLAY_TYPE_ORBITAL;
+        while (*opts) {
+            const char *nextopt;
+
+            if (strstart(opts, ",log_history=", &nextopt)) {
+                opts = nextopt;
+                dpy.u.orbital.has_log_history = true;
+                if (qemu_strtosz(opts, (char **)&nextopt,
+                                 &dpy.u.orbital.log_history) < 0) {
+                    goto invalid_orbital_args;
+                }
+            } else {
+            invalid_orbital_args:
+                error_report("invalid Orbital option string");
+                exit(1);
+            }
+            opts = nextopt;
+        }
     } else if (strstart(p, "none", &opts)) {
         dpy.type = DISPLAY_TYPE_NONE;
     } else {